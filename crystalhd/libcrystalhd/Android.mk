@@ -1,4 +1,21 @@
 LOCAL_PATH := $(call my-dir)
+
+# Copy kernels built for newer instruction sets, only reached through the
+# cpuid dispatch in libcrystalhd_copy.cpp
+include $(CLEAR_VARS)
+LOCAL_MODULE := libcrystalhd_copy_ssse3
+LOCAL_MODULE_TAGS := eng
+LOCAL_CFLAGS :=  -O2 -Wall -fPIC -fstrict-aliasing -mssse3
+LOCAL_SRC_FILES := libcrystalhd_copy_ssse3.cpp
+include $(BUILD_STATIC_LIBRARY)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := libcrystalhd_copy_avx2
+LOCAL_MODULE_TAGS := eng
+LOCAL_CFLAGS :=  -O2 -Wall -fPIC -fstrict-aliasing -mavx2
+LOCAL_SRC_FILES := libcrystalhd_copy_avx2.cpp
+include $(BUILD_STATIC_LIBRARY)
+
 include $(CLEAR_VARS)
 
 LOCAL_MODULE := libcrystalhd
@@ -16,9 +33,12 @@ LOCAL_SRC_FILES :=  libcrystalhd_if.cpp \
 	libcrystalhd_fwdiag_if.cpp \
 	libcrystalhd_fwload_if.cpp \
 	libcrystalhd_parser.cpp \
+	libcrystalhd_copy.cpp \
+	libcrystalhd_copy_frame.cpp \
 	fixes.c
 LOCAL_C_INCLUDES += $(LOCAL_PATH)/include
 LOCAL_C_INCLUDES += $(LOCAL_PATH)/include/link
 LOCAL_SHARED_LIBRARIES:= libutils liblog
+LOCAL_STATIC_LIBRARIES := libcrystalhd_copy_ssse3 libcrystalhd_copy_avx2
 
 include $(BUILD_SHARED_LIBRARY)
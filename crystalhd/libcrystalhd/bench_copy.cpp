@@ -0,0 +1,638 @@
+/********************************************************************
+ * Copyright(c) 2006-2009 Broadcom Corporation.
+ *
+ *  Name: bench_copy.cpp
+ *
+ *  Description: Benchmark for the picture copy and conversion paths.
+ *               Runs every conversion on synthetic frames, checks the
+ *               output against plain C references and reports GB/s and
+ *               cycles per pixel. With -r it instead checks random
+ *               sizes, odd ones included, strides and plane offsets.
+ *               Needs no decoder hardware.
+ *
+ *  AU
+ *
+ *  HISTORY:
+ *
+ ********************************************************************
+ *
+ * This file is part of libcrystalhd.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *******************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <x86intrin.h>
+#include "libcrystalhd_copy.h"
+
+/* Output layouts */
+enum {
+	FMT_YUY2,
+	FMT_UYVY,
+	FMT_NV12,
+	FMT_I420,
+	FMT_YV12,	/* I420 with both chroma planes on one stride */
+	FMT_PLANE,	/* one plane of bytes, the plain memcpy path */
+};
+
+typedef struct _BENCH_CONV {
+	const char	*Name;
+	DTS_COPY_ROWS	Rows;
+	bool		b422;		/* YUY2 input, else NV12 */
+	uint32_t	Fmt;
+	uint32_t	Scale;		/* output size in quarters of the input, 0 for none */
+	bool		bCrop;		/* dstWidth out of srcWidth wide rows, else all of
+					   srcWidth into dstWidth wide rows */
+} BENCH_CONV;
+
+static const BENCH_CONV gConvs[] = {
+	{ "Memcpy",	DtsCopyPlaneRows,	false,	FMT_PLANE,	0,	true },
+	{ "422ToYUY2",	DtsCopy422ToYUY2,	true,	FMT_YUY2,	0,	false },
+	{ "422ToUYVY",	DtsCopy422ToUYVY,	true,	FMT_UYVY,	0,	false },
+	{ "422ToNV12",	DtsCopy422ToNV12,	true,	FMT_NV12,	0,	false },
+	{ "422ToI420",	DtsCopy422ToI420,	true,	FMT_I420,	0,	false },
+	{ "420ToNV12",	DtsCopy420ToNV12,	false,	FMT_NV12,	0,	false },
+	{ "420ToYUY2",	DtsCopy420ToYUY2,	false,	FMT_YUY2,	0,	false },
+	{ "420ToUYVY",	DtsCopy420ToUYVY,	false,	FMT_UYVY,	0,	false },
+	{ "420ToI420",	DtsCopy420ToI420,	false,	FMT_I420,	0,	false },
+	{ "420ToYV12",	DtsCopy420ToYV12,	false,	FMT_YV12,	0,	true },
+	{ "Scale420ToNV12", DtsScale420ToNV12,	false,	FMT_NV12,	2,	false },
+	{ "Scale3/4ToNV12", DtsScale420ToNV12,	false,	FMT_NV12,	3,	false },
+};
+
+static const struct { const char *Name; uint32_t Width, Height; } gSizes[] = {
+	{ "480p",	720,	480 },
+	{ "720p",	1280,	720 },
+	{ "1080p",	1920,	1080 },
+};
+
+/* Destination placement: byte offset of each plane and padding per row */
+static const struct { const char *Name; uint32_t Offset, Stride; } gLayouts[] = {
+	{ "aligned",	0,	0 },
+	{ "unaligned",	4,	0 },
+	{ "strided",	0,	40 },
+};
+
+#define BENCH_GUARD	0xA5
+#define BENCH_SLACK	64	/* guard bytes checked past the last row */
+
+typedef struct _BENCH_PIC {
+	uint8_t		*Buf[3];
+	uint32_t	BufSz;
+	uint32_t	Off[3];		/* where each plane starts in Buf */
+	uint32_t	Pitch[3];	/* bytes per row of each plane */
+	uint32_t	Planes;
+	uint32_t	Width;		/* pixels */
+	uint32_t	Height;
+} BENCH_PIC;
+
+static uint8_t *BenchAlloc(uint32_t sz)
+{
+	void *p = NULL;
+
+	if (posix_memalign(&p, 64, sz)) {
+		fprintf(stderr, "bench_copy: out of memory\n");
+		exit(2);
+	}
+	return (uint8_t *)p;
+}
+
+// stride is the padding per row of each plane, as in DTS_COPY_JOB
+static void BenchSetupPic(BENCH_PIC *pic, uint32_t fmt, uint32_t width, uint32_t height,
+			  const uint32_t off[3], const uint32_t stride[3])
+{
+	uint32_t i;
+
+	pic->Width = width;
+	pic->Height = height;
+	pic->Pitch[1] = pic->Pitch[2] = 0;
+	if (fmt == FMT_PLANE) {
+		pic->Planes = 1;
+		pic->Pitch[0] = width + stride[0];
+	} else if ((fmt == FMT_YUY2) || (fmt == FMT_UYVY)) {
+		pic->Planes = 1;
+		pic->Pitch[0] = width*2 + stride[0];
+	} else if (fmt == FMT_NV12) {
+		pic->Planes = 2;
+		pic->Pitch[0] = width + stride[0];
+		pic->Pitch[1] = width + stride[1];
+	} else {
+		pic->Planes = 3;
+		pic->Pitch[0] = width + stride[0];
+		pic->Pitch[1] = width/2 + stride[1];
+		pic->Pitch[2] = width/2 + stride[(fmt == FMT_YV12) ? 1 : 2];
+	}
+	for (i = 0; i < 3; i++)
+		pic->Off[i] = off[i];
+}
+
+// plane sizes of the largest picture, with room for the offsets
+static void BenchAllocPic(BENCH_PIC *pic)
+{
+	uint32_t i;
+
+	pic->BufSz = (1920*2 + 64) * 1088 + 64 + BENCH_SLACK;
+	for (i = 0; i < 3; i++)
+		pic->Buf[i] = BenchAlloc(pic->BufSz);
+}
+
+static void BenchFreePic(BENCH_PIC *pic)
+{
+	uint32_t i;
+
+	for (i = 0; i < 3; i++)
+		free(pic->Buf[i]);
+}
+
+static inline uint8_t *BenchRow(const BENCH_PIC *d, uint32_t plane, uint32_t y)
+{
+	return d->Buf[plane] + d->Off[plane] + y * d->Pitch[plane];
+}
+
+// bytes of a plane a conversion may touch, plus the trailing guard
+static uint32_t BenchUsed(const BENCH_PIC *d, uint32_t plane)
+{
+	uint32_t rows = plane ? (d->Height + 1)/2 : d->Height;
+	uint32_t n = d->Off[plane] + rows * d->Pitch[plane] + BENCH_SLACK;
+
+	return (n < d->BufSz) ? n : d->BufSz;
+}
+
+static void BenchClear(BENCH_PIC *d)
+{
+	uint32_t i;
+
+	for (i = 0; i < d->Planes; i++)
+		memset(d->Buf[i], BENCH_GUARD, BenchUsed(d, i));
+}
+
+//------------------------------------------------------------------------
+// Plain C references, written from the format definitions rather than
+// from the library code. Averaged chroma rounds up, as pavgb does. w
+// pixels of each row are converted out of source rows pitch pixels
+// apart. An odd last line has a chroma line of its own, an odd last
+// pixel keeps just its U and only where it shares bytes with the Y or
+// the chroma line is copied whole.
+//------------------------------------------------------------------------
+static void BenchRef422(BENCH_PIC *d, uint32_t fmt, const uint8_t *src, uint32_t pitch, uint32_t w)
+{
+	uint32_t x, y;
+
+	for (y = 0; y < d->Height; y++) {
+		const uint8_t *s = src + y * pitch * 2;
+		uint8_t *pY = BenchRow(d, 0, y);
+
+		for (x = 0; x < w; x++) {
+			switch (fmt) {
+			case FMT_YUY2:
+				pY[x*2] = s[x*2];
+				pY[x*2+1] = s[x*2+1];
+				break;
+			case FMT_UYVY:
+				pY[x*2] = s[x*2+1];
+				pY[x*2+1] = s[x*2];
+				break;
+			default:
+				pY[x] = s[x*2];
+				break;
+			}
+		}
+		// chroma from the first line of each pair
+		if ((y & 1) || (fmt == FMT_YUY2) || (fmt == FMT_UYVY))
+			continue;
+		for (x = 0; x < w/2; x++) {
+			if (fmt == FMT_NV12) {
+				BenchRow(d, 1, y/2)[x*2] = s[x*4+1];
+				BenchRow(d, 1, y/2)[x*2+1] = s[x*4+3];
+			} else {
+				BenchRow(d, 1, y/2)[x] = s[x*4+1];
+				BenchRow(d, 2, y/2)[x] = s[x*4+3];
+			}
+		}
+	}
+}
+
+static void BenchRef420(BENCH_PIC *d, uint32_t fmt, const uint8_t *srcY, const uint8_t *srcUV,
+			uint32_t pitch, uint32_t w)
+{
+	uint32_t x, y, h = d->Height;
+
+	for (y = 0; y < h; y++) {
+		const uint8_t *sY = srcY + y * pitch;
+		const uint8_t *c0 = srcUV + (y/2) * pitch;
+		// odd lines sit between two chroma lines, except the last pair
+		const uint8_t *c1 = ((y & 1) && (y/2 + 1 < (h + 1)/2)) ? c0 + pitch : c0;
+		uint8_t *pY = BenchRow(d, 0, y);
+
+		for (x = 0; x < w; x++) {
+			uint8_t c = (uint8_t)((c0[x] + c1[x] + 1) >> 1);
+			switch (fmt) {
+			case FMT_YUY2:
+				pY[x*2] = sY[x];
+				pY[x*2+1] = c;
+				break;
+			case FMT_UYVY:
+				pY[x*2] = c;
+				pY[x*2+1] = sY[x];
+				break;
+			default:
+				pY[x] = sY[x];
+				break;
+			}
+		}
+		if ((y & 1) || (fmt == FMT_YUY2) || (fmt == FMT_UYVY))
+			continue;
+		if (fmt == FMT_NV12) {
+			memcpy(BenchRow(d, 1, y/2), c0, w);
+			continue;
+		}
+		for (x = 0; x < w/2; x++) {
+			BenchRow(d, 1, y/2)[x] = c0[x*2];
+			BenchRow(d, 2, y/2)[x] = c0[x*2+1];
+		}
+	}
+}
+
+// source position of output sample i, pixel centres lined up, 8 bit fraction
+static void BenchScalePos(uint32_t i, uint32_t srcN, uint32_t dstN, uint32_t *s, uint32_t *f)
+{
+	uint32_t step = (srcN << 16) / dstN;
+	int32_t pos = (int32_t)(step * i + step/2) - 0x8000;
+
+	if (pos < 0)
+		pos = 0;
+	*s = (uint32_t)pos >> 16;
+	*f = ((uint32_t)pos >> 8) & 0xff;
+}
+
+// one plane of the scaler: exact halves are a rounded 2x2 mean, anything
+// else bilinear, vertical first with the intermediate rounded to 8 bits
+static void BenchRefScalePlane(BENCH_PIC *d, uint32_t plane, const uint8_t *src, uint32_t pitch,
+			       uint32_t srcW, uint32_t srcH, uint32_t dstW, uint32_t dstH, uint32_t bpp)
+{
+	static uint8_t tmp[DTS_SCALE_MAX_WIDTH];
+	uint32_t x, y, c, sy, fy, sx, fx;
+
+	for (y = 0; y < dstH; y++) {
+		uint8_t *out = BenchRow(d, plane, y);
+
+		if ((srcW == dstW*2) && (srcH == dstH*2)) {
+			const uint8_t *s0 = src + (y*2) * pitch, *s1 = s0 + pitch;
+			for (x = 0; x < dstW; x++)
+				for (c = 0; c < bpp; c++)
+					out[x*bpp+c] = (s0[x*2*bpp+c] + s0[(x*2+1)*bpp+c] +
+							s1[x*2*bpp+c] + s1[(x*2+1)*bpp+c] + 2) >> 2;
+			continue;
+		}
+
+		BenchScalePos(y, srcH, dstH, &sy, &fy);
+		for (x = 0; x < srcW * bpp; x++) {
+			const uint8_t *r0 = src + sy * pitch;
+			const uint8_t *r1 = (sy + 1 < srcH) ? r0 + pitch : r0;
+			tmp[x] = (uint8_t)((r0[x] * (256 - fy) + r1[x] * fy + 128) >> 8);
+		}
+		for (x = 0; x < dstW; x++) {
+			BenchScalePos(x, srcW, dstW, &sx, &fx);
+			for (c = 0; c < bpp; c++) {
+				uint32_t sx1 = (sx + 1 < srcW) ? sx + 1 : sx;
+				out[x*bpp+c] = (uint8_t)((tmp[sx*bpp+c] * (256 - fx) + tmp[sx1*bpp+c] * fx + 128) >> 8);
+			}
+		}
+	}
+}
+
+static void BenchRefScale(BENCH_PIC *d, const uint8_t *srcY, const uint8_t *srcUV, uint32_t srcW, uint32_t srcH)
+{
+	BenchRefScalePlane(d, 0, srcY, srcW, srcW, srcH, d->Width, d->Height, 1);
+	BenchRefScalePlane(d, 1, srcUV, srcW, srcW/2, srcH/2, d->Width/2, d->Height/2, 2);
+}
+
+static void BenchReference(BENCH_PIC *ref, const BENCH_CONV *cv, const uint8_t *srcY, const uint8_t *srcUV,
+			   uint32_t srcW, uint32_t srcH)
+{
+	uint32_t i, w = cv->bCrop ? ref->Width : srcW;
+
+	BenchClear(ref);
+	if (cv->Fmt == FMT_PLANE) {
+		for (i = 0; i < ref->Height; i++)
+			memcpy(BenchRow(ref, 0, i), srcY + i * srcW, w);
+	} else if (cv->Scale)
+		BenchRefScale(ref, srcY, srcUV, srcW, srcH);
+	else if (cv->b422)
+		BenchRef422(ref, cv->Fmt, srcY, srcW, w);
+	else
+		BenchRef420(ref, cv->Fmt, srcY, srcUV, srcW, w);
+}
+
+static void BenchSetupJob(DTS_COPY_JOB *job, const BENCH_CONV *cv, const BENCH_PIC *out,
+			  const uint8_t *srcY, const uint8_t *srcUV, uint32_t srcW, uint32_t srcH)
+{
+	memset(job, 0, sizeof(*job));
+	job->Rows = cv->Rows;
+	job->dstY = BenchRow(out, 0, 0);
+	job->dstU = BenchRow(out, 1, 0);
+	job->dstV = BenchRow(out, 2, 0);
+	job->srcY = srcY;
+	job->srcUV = srcUV;
+	job->srcWidth = srcW;
+	job->srcHeight = srcH;
+	job->dstWidth = out->Width;
+	job->height = out->Height;
+	if ((cv->Fmt == FMT_YUY2) || (cv->Fmt == FMT_UYVY))
+		job->strideY = out->Pitch[0] - out->Width*2;
+	else
+		job->strideY = out->Pitch[0] - out->Width;
+	if (cv->Fmt == FMT_NV12)
+		job->strideU = out->Pitch[1] - out->Width;
+	else if ((cv->Fmt == FMT_I420) || (cv->Fmt == FMT_YV12)) {
+		job->strideU = out->Pitch[1] - out->Width/2;
+		job->strideV = out->Pitch[2] - out->Width/2;
+	}
+}
+
+// first differing byte of the planes in use, -1 if none
+static long BenchCompare(const BENCH_PIC *a, const BENCH_PIC *b, uint32_t *plane)
+{
+	uint32_t i, n;
+
+	for (i = 0; i < a->Planes; i++) {
+		for (n = 0; n < BenchUsed(a, i); n++) {
+			if (a->Buf[i][n] != b->Buf[i][n]) {
+				*plane = i;
+				return (long)n;
+			}
+		}
+	}
+	return -1;
+}
+
+static double BenchNow(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char *BenchIsaName(uint32_t isa)
+{
+	switch (isa) {
+	case DTS_CPU_SSE2:	return "sse2";
+	case DTS_CPU_SSSE3:	return "ssse3";
+	case DTS_CPU_AVX2:	return "avx2";
+	default:		return "c";
+	}
+}
+
+static void BenchUsage(void)
+{
+	printf("usage: bench_copy [-i isamask] [-n iterations] [-t threads] [-k name] [-r cases [-s seed]]\n");
+	printf("  -i  DTS_CPU_xxx mask to allow, 0 for the C paths (default all)\n");
+	printf("  -n  timed runs per case (default 20)\n");
+	printf("  -t  copy threads, as DtsSetCopyThreads (default 1)\n");
+	printf("  -k  only conversions whose name contains this\n");
+	printf("  -r  instead of timing, check this many random cases: sizes, strides,\n");
+	printf("      plane offsets, instruction sets and cache policy\n");
+	printf("  -s  seed for -r (default 1)\n");
+}
+
+static uint32_t BenchRand(uint32_t lo, uint32_t hi)
+{
+	return lo + (uint32_t)rand() % (hi - lo + 1);
+}
+
+// weighted towards the narrow rows where the kernels hand over to the
+// scalar tails, odd ones too unless even is set
+static uint32_t BenchRandWidth(uint32_t max, bool even)
+{
+	uint32_t w = (rand() & 1) ? BenchRand(1, 80) : BenchRand(1, max);
+
+	if (even)
+		w = (w + 1) & ~1;
+	return w;
+}
+
+static void BenchStripe(void *arg, uint32_t y0, uint32_t y1)
+{
+	const DTS_COPY_JOB *j = (const DTS_COPY_JOB *)arg;
+
+	j->Rows(j, y0, y1);
+	if (j->copyFlags & DTS_COPY_NT)
+		gDtsCopyOps.Fence();
+}
+
+//------------------------------------------------------------------------
+// Randomised conformance run. Every case is checked byte for byte against
+// the references, guard bytes around each plane included. The pool, when
+// there is one, is driven directly so that even small pictures are split
+// into stripes.
+//------------------------------------------------------------------------
+static uint32_t BenchRandom(uint32_t cases, uint32_t seed, uint32_t isaMask, const char *filter,
+			    DTS_COPY_POOL *pool, const uint8_t *srcBufY, const uint8_t *srcBufUV,
+			    BENCH_PIC *out, BENCH_PIC *ref)
+{
+	static const uint32_t isas[] = { 0, DTS_CPU_SSE2, DTS_CPU_SSE2|DTS_CPU_SSSE3, 0xffffffff };
+	uint32_t convs[sizeof(gConvs)/sizeof(gConvs[0])];
+	uint32_t nConvs = 0, n, i, fails = 0;
+
+	for (i = 0; i < sizeof(gConvs)/sizeof(gConvs[0]); i++)
+		if (!filter || strstr(gConvs[i].Name, filter))
+			convs[nConvs++] = i;
+	if (!nConvs)
+		return 0;
+
+	srand(seed);
+	for (n = 0; n < cases; n++) {
+		const BENCH_CONV *cv = &gConvs[convs[BenchRand(0, nConvs - 1)]];
+		uint32_t isa = DtsInitCopyOps(isas[BenchRand(0, 3)] & isaMask);
+		uint32_t w, h, dw, dh, off[3], stride[3], plane = 0;
+		const uint8_t *srcY = srcBufY + BenchRand(0, 63);
+		const uint8_t *srcUV = srcBufUV + BenchRand(0, 63);
+		DTS_COPY_JOB job;
+		long bad;
+
+		// the scaler only takes even sizes
+		w = BenchRandWidth(cv->Scale ? DTS_SCALE_MAX_WIDTH : 1920, cv->Scale != 0);
+		h = cv->Scale ? BenchRand(1, 24) * 2 : BenchRand(1, 48);
+		dw = w;
+		dh = h;
+		// the picture can be narrower than the rows it is copied from or to,
+		// as with HWOutPicWidth against PicInfo.width
+		if (!cv->Scale && (rand() & 1))
+			dw = cv->bCrop ? BenchRand(1, w) : w + BenchRand(1, 64);
+		if (cv->Scale) {
+			if (!(w & 3) && !(h & 3) && (rand() & 1)) {
+				dw = w/2;
+				dh = h/2;
+			} else {
+				dw = BenchRand(1, w/2) * 2;
+				dh = BenchRand(1, h/2) * 2;
+			}
+		}
+		for (i = 0; i < 3; i++) {
+			off[i] = BenchRand(0, 63);
+			stride[i] = BenchRand(0, 3) ? BenchRand(0, 63) : 0;
+		}
+
+		BenchSetupPic(out, cv->Fmt, dw, dh, off, stride);
+		BenchSetupPic(ref, cv->Fmt, dw, dh, off, stride);
+		BenchReference(ref, cv, srcY, srcUV, w, h);
+		BenchSetupJob(&job, cv, out, srcY, srcUV, w, h);
+		job.copyFlags = (rand() & 1) ? DTS_COPY_NT : 0;
+
+		BenchClear(out);
+		if (pool)
+			DtsRunStripes(pool, BenchStripe, &job, job.height, 2);
+		else
+			BenchStripe(&job, 0, job.height);
+
+		bad = BenchCompare(out, ref, &plane);
+		if (bad >= 0) {
+			long rel = bad - (long)out->Off[plane];
+			printf("FAIL case %u: %s %s %s %ux%u -> %ux%u off %u/%u/%u pad %u/%u/%u: plane %u row %ld byte %ld\n",
+			       n, cv->Name, BenchIsaName(isa), job.copyFlags ? "stream" : "cached", w, h, dw, dh,
+			       off[0], off[1], off[2], stride[0], stride[1], stride[2], plane,
+			       rel < 0 ? -1 : rel / (long)out->Pitch[plane],
+			       rel < 0 ? rel : rel % (long)out->Pitch[plane]);
+			fails++;
+		}
+	}
+	printf("%u random case(s), seed %u, %u failed\n", cases, seed, fails);
+	return fails;
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t isaMask = 0xffffffff, iters = 20, threads = 1, cases = 0, seed = 1;
+	const char *filter = NULL;
+	uint32_t c, s, l, p, i, fails = 0;
+	uint8_t *srcY, *srcUV;
+	BENCH_PIC out, ref;
+	DTS_COPY_POOL *pool = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "i:n:t:k:r:s:h")) != -1) {
+		switch (opt) {
+		case 'i': isaMask = strtoul(optarg, NULL, 0); break;
+		case 'n': iters = strtoul(optarg, NULL, 0); break;
+		case 't': threads = strtoul(optarg, NULL, 0); break;
+		case 'k': filter = optarg; break;
+		case 'r': cases = strtoul(optarg, NULL, 0); break;
+		case 's': seed = strtoul(optarg, NULL, 0); break;
+		default: BenchUsage(); return 2;
+		}
+	}
+	if (!iters || (threads > DTS_COPY_MAX_THREADS)) {
+		BenchUsage();
+		return 2;
+	}
+
+	printf("cpu %s, using %s, %u thread(s), %u runs\n", BenchIsaName(DtsInitCopyOps(0xffffffff)),
+	       BenchIsaName(DtsInitCopyOps(isaMask)), threads ? threads : 1, iters);
+	if (threads > 1)
+		pool = DtsCreateCopyPool(threads - 1);
+
+	// source big enough for 1080p YUY2, and NV12 chroma after it, plus
+	// room for the random mode's offsets
+	srcY = BenchAlloc(1920*2*1088 + 64);
+	srcUV = BenchAlloc(1920*544 + 64);
+	srand(1);
+	for (i = 0; i < 1920*2*1088 + 64; i++)
+		srcY[i] = (uint8_t)rand();
+	for (i = 0; i < 1920*544 + 64; i++)
+		srcUV[i] = (uint8_t)rand();
+	BenchAllocPic(&out);
+	BenchAllocPic(&ref);
+
+	if (cases) {
+		fails = BenchRandom(cases, seed, isaMask, filter, pool, srcY, srcUV, &out, &ref);
+		goto done;
+	}
+
+	printf("%-15s %-6s %-10s %-7s %8s %8s  %s\n", "conversion", "size", "dst", "policy", "GB/s", "cyc/px", "check");
+
+	for (c = 0; c < sizeof(gConvs)/sizeof(gConvs[0]); c++) {
+		const BENCH_CONV *cv = &gConvs[c];
+		if (filter && !strstr(cv->Name, filter))
+			continue;
+		for (s = 0; s < sizeof(gSizes)/sizeof(gSizes[0]); s++) {
+			uint32_t w = gSizes[s].Width, h = gSizes[s].Height;
+			uint32_t dw = cv->Scale ? w*cv->Scale/4 : w, dh = cv->Scale ? h*cv->Scale/4 : h;
+			double bytes = cv->b422 ? w*h*2.0 : w*h*1.5;
+
+			if (cv->Fmt == FMT_PLANE)
+				bytes = w*h*2.0;
+			else
+				bytes += ((cv->Fmt == FMT_YUY2) || (cv->Fmt == FMT_UYVY)) ? dw*dh*2.0 : dw*dh*1.5;
+
+			for (l = 0; l < sizeof(gLayouts)/sizeof(gLayouts[0]); l++) {
+				uint32_t st = gLayouts[l].Stride;
+				uint32_t off[3] = { gLayouts[l].Offset, gLayouts[l].Offset, gLayouts[l].Offset };
+				uint32_t stride[3] = { st, ((cv->Fmt == FMT_I420) || (cv->Fmt == FMT_YV12)) ? st/2 : st, st/2 };
+				DTS_COPY_JOB job;
+
+				BenchSetupPic(&out, cv->Fmt, dw, dh, off, stride);
+				BenchSetupPic(&ref, cv->Fmt, dw, dh, off, stride);
+				BenchReference(&ref, cv, srcY, srcUV, w, h);
+				BenchSetupJob(&job, cv, &out, srcY, srcUV, w, h);
+
+				for (p = 0; p < 2; p++) {
+					uint32_t plane = 0;
+					long bad;
+					double t0, t;
+					uint64_t c0, cyc;
+
+					job.copyFlags = p ? 0 : DTS_COPY_NT;
+
+					BenchClear(&out);
+					DtsCopyFrame(pool, &job);
+					bad = BenchCompare(&out, &ref, &plane);
+
+					t0 = BenchNow();
+					c0 = __rdtsc();
+					for (i = 0; i < iters; i++)
+						DtsCopyFrame(pool, &job);
+					cyc = __rdtsc() - c0;
+					t = BenchNow() - t0;
+
+					printf("%-15s %-6s %-10s %-7s %8.2f %8.3f  ", cv->Name, gSizes[s].Name, gLayouts[l].Name,
+					       p ? "cached" : "stream", bytes * iters / t / 1e9, (double)cyc / iters / (w * h));
+					if (bad < 0) {
+						printf("ok\n");
+					} else {
+						bad -= out.Off[plane];
+						printf("FAIL plane %u row %ld byte %ld\n", plane,
+						       bad / (long)out.Pitch[plane], bad % (long)out.Pitch[plane]);
+						fails++;
+					}
+				}
+			}
+		}
+	}
+
+	if (fails)
+		printf("%u case(s) FAILED\n", fails);
+done:
+	BenchFreePic(&out);
+	BenchFreePic(&ref);
+	free(srcY);
+	free(srcUV);
+	if (pool)
+		DtsDeleteCopyPool(pool);
+
+	return fails ? 1 : 0;
+}
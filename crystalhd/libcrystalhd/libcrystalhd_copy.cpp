@@ -0,0 +1,711 @@
+/********************************************************************
+ * Copyright(c) 2006-2009 Broadcom Corporation.
+ *
+ *  Name: libcrystalhd_copy.cpp
+ *
+ *  Description: Picture copy kernels, C/SSE2 versions and the CPU
+ *               dispatch table.
+ *
+ *  AU
+ *
+ *  HISTORY:
+ *
+ ********************************************************************
+ *
+ * This file is part of libcrystalhd.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *******************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <cpuid.h>
+#include <emmintrin.h>
+#include "libcrystalhd_copy.h"
+
+#define DTS_ALIGNED16(p)	((((uintptr_t)(p)) & 0xf) == 0)
+
+//------------------------------------------------------------------------
+// C versions, for CPUs without SSE2. The row kernels leave everything to
+// the callers' scalar loops.
+//------------------------------------------------------------------------
+static void DtsFenceC(void)
+{
+}
+
+static void DtsMemcpyC(uint8_t *dst, const uint8_t *src, uint32_t count, uint32_t flags)
+{
+	memcpy(dst, src, count);
+}
+
+static uint32_t DtsYuy2ToUyvyC(uint8_t *dst, const uint8_t *src, uint32_t width, uint32_t flags)
+{
+	return 0;
+}
+
+static uint32_t DtsYuy2ToNv12C(uint8_t *dstY, uint8_t *dstUV, const uint8_t *src, uint32_t width, uint32_t flags)
+{
+	return 0;
+}
+
+static uint32_t DtsYuy2ToI420C(uint8_t *dstY, uint8_t *dstU, uint8_t *dstV, const uint8_t *src, uint32_t width, uint32_t flags)
+{
+	return 0;
+}
+
+static uint32_t DtsNv12ToPackedC(uint8_t *dst, const uint8_t *srcY, const uint8_t *srcUV, const uint8_t *srcUV2, uint32_t width, uint32_t flags)
+{
+	return 0;
+}
+
+static uint32_t DtsBox2RowC(uint8_t *dst, const uint8_t *src0, const uint8_t *src1, uint32_t width)
+{
+	return 0;
+}
+
+static uint32_t DtsBlendRowC(uint8_t *dst, const uint8_t *src0, const uint8_t *src1, uint32_t weight, uint32_t count)
+{
+	return 0;
+}
+
+static uint32_t DtsScaleRowHC(uint8_t *dst, const uint8_t *src, const DTS_SCALE_TAPS *taps, uint32_t count)
+{
+	return 0;
+}
+
+//------------------------------------------------------------------------
+// SSE2 versions
+//
+// With DTS_COPY_NT the kernels stream their stores past the cache. A row
+// whose destination is not aligned gets one unaligned block first, then
+// the loop restarts at the first aligned pixel and overlaps it, so the
+// rest of the row still streams.
+//------------------------------------------------------------------------
+static inline __m128i DtsLoad128(const uint8_t *src, bool aligned)
+{
+	if (aligned)
+		return _mm_load_si128((const __m128i *)src);
+	return _mm_loadu_si128((const __m128i *)src);
+}
+
+static inline void DtsStore128(uint8_t *dst, __m128i v, bool stream)
+{
+	if (stream)
+		_mm_stream_si128((__m128i *)dst, v);
+	else
+		_mm_storeu_si128((__m128i *)dst, v);
+}
+
+static inline void DtsPrefetch(const uint8_t *src)
+{
+	_mm_prefetch((const char *)(src + DTS_PREFETCH_AHEAD), _MM_HINT_NTA);
+}
+
+void DtsFenceSSE2(void)
+{
+	_mm_sfence();
+}
+
+void DtsMemcpySSE2(uint8_t *dst, const uint8_t *src, uint32_t count, uint32_t flags)
+{
+	bool stream = (flags & DTS_COPY_NT) != 0;
+	bool la;
+
+	if (stream) {
+		// bytes up to the first aligned destination byte
+		uint32_t head = DtsAlignPixel(dst, 1, 16);
+		if (head > count)
+			head = count;
+		count -= head;
+		while (head --)
+			*dst++ = *src++;
+	}
+	la = DTS_ALIGNED16(src);
+
+	while (count >= (16*4))
+	{
+		DtsPrefetch(src);
+		DtsStore128(dst+ 0*16, DtsLoad128(src+ 0*16, la), stream);
+		DtsStore128(dst+ 1*16, DtsLoad128(src+ 1*16, la), stream);
+		DtsStore128(dst+ 2*16, DtsLoad128(src+ 2*16, la), stream);
+		DtsStore128(dst+ 3*16, DtsLoad128(src+ 3*16, la), stream);
+		count -= 16*4;
+		src += 16*4;
+		dst += 16*4;
+	}
+
+	while (count >= 16)
+	{
+		DtsStore128(dst, DtsLoad128(src, la), stream);
+		count -= 16;
+		src += 16;
+		dst += 16;
+	}
+
+	while (count --)
+		*dst++ = *src++;
+}
+
+// swap the bytes of every Y/UV pair, 8 pixels at a time
+uint32_t DtsYuy2ToUyvySSE2(uint8_t *dst, const uint8_t *src, uint32_t width, uint32_t flags)
+{
+	uint32_t x = 0;
+	uint32_t start = DtsStreamStart(flags, DtsAlignPixel(dst, 2, 16), 8, width);
+	bool stream = (start == 0);
+	bool la = DTS_ALIGNED16(src);
+
+	while (x + 8 <= width)
+	{
+		DtsPrefetch(src+x*2);
+		__m128i v = DtsLoad128(src+x*2, la);
+		__m128i v1 = _mm_srli_epi16(v, 8);
+		__m128i v2 = _mm_slli_epi16(v, 8);
+		DtsStore128(dst+x*2, _mm_or_si128(v1, v2), stream);
+		x += 8;
+		if (!stream && (start != DTS_NO_ALIGN)) {
+			x = start;
+			stream = true;
+			la = DTS_ALIGNED16(src+x*2);
+		}
+	}
+	return x;
+}
+
+// split 16 pixels into Y and, when dstUV is set, interleaved UV
+uint32_t DtsYuy2ToNv12SSE2(uint8_t *dstY, uint8_t *dstUV, const uint8_t *src, uint32_t width, uint32_t flags)
+{
+	uint32_t x = 0;
+	const __m128i mask = _mm_set1_epi16(0x00ff);
+	uint32_t start = DtsStreamStart(flags, DtsAlignPixel(dstY, 1, 16), 16, width);
+	bool stream, la = DTS_ALIGNED16(src);
+
+	if (dstUV && (start != DTS_NO_ALIGN) && !DTS_ALIGNED16(dstUV+start))
+		start = DTS_NO_ALIGN;
+	stream = (start == 0);
+
+	while (x + 16 <= width)
+	{
+		DtsPrefetch(src+x*2);
+		__m128i s1 = DtsLoad128(src+x*2+ 0, la); // load 8 pixels
+		__m128i s2 = DtsLoad128(src+x*2+16, la); // load 8 more
+
+		__m128i y1 = _mm_and_si128(s1, mask); // mask out uvs
+		__m128i y2 = _mm_and_si128(s2, mask); // mask out uvs
+		DtsStore128(dstY+x, _mm_packus_epi16(y1, y2), stream); // store 16 Y
+
+		if (dstUV) {
+			s1 = _mm_srli_epi16(s1, 8); // get rid of Y
+			s2 = _mm_srli_epi16(s2, 8); // get rid of Y
+			DtsStore128(dstUV+x, _mm_packus_epi16(s1, s2), stream); // store 8 UV pairs
+		}
+		x += 16;
+		if (!stream && (start != DTS_NO_ALIGN)) {
+			x = start;
+			stream = true;
+			la = DTS_ALIGNED16(src+x*2);
+		}
+	}
+	return x;
+}
+
+// split 32 pixels into Y, U and V planes
+uint32_t DtsYuy2ToI420SSE2(uint8_t *dstY, uint8_t *dstU, uint8_t *dstV, const uint8_t *src, uint32_t width, uint32_t flags)
+{
+	uint32_t x = 0;
+	const __m128i mask = _mm_set1_epi16(0x00ff);
+	uint32_t start = DtsStreamStart(flags, DtsAlignPixel(dstY, 1, 16), 32, width);
+	bool stream, la = DTS_ALIGNED16(src);
+
+	if ((start != DTS_NO_ALIGN) && !(DTS_ALIGNED16(dstU+start/2) && DTS_ALIGNED16(dstV+start/2)))
+		start = DTS_NO_ALIGN;
+	stream = (start == 0);
+
+	while (x + 32 <= width)
+	{
+		DtsPrefetch(src+x*2);
+		__m128i s1 = DtsLoad128(src+x*2+ 0, la);
+		__m128i s2 = DtsLoad128(src+x*2+16, la);
+		__m128i s3 = DtsLoad128(src+x*2+32, la);
+		__m128i s4 = DtsLoad128(src+x*2+48, la);
+
+		__m128i y1 = _mm_packus_epi16(_mm_and_si128(s1, mask), _mm_and_si128(s2, mask));
+		__m128i y2 = _mm_packus_epi16(_mm_and_si128(s3, mask), _mm_and_si128(s4, mask));
+		__m128i uv1 = _mm_packus_epi16(_mm_srli_epi16(s1, 8), _mm_srli_epi16(s2, 8)); // 8 UV pairs
+		__m128i uv2 = _mm_packus_epi16(_mm_srli_epi16(s3, 8), _mm_srli_epi16(s4, 8)); // 8 more
+		__m128i u = _mm_packus_epi16(_mm_and_si128(uv1, mask), _mm_and_si128(uv2, mask));
+		__m128i v = _mm_packus_epi16(_mm_srli_epi16(uv1, 8), _mm_srli_epi16(uv2, 8));
+
+		DtsStore128(dstY+x+ 0, y1, stream);
+		DtsStore128(dstY+x+16, y2, stream);
+		DtsStore128(dstU+x/2, u, stream);
+		DtsStore128(dstV+x/2, v, stream);
+		x += 32;
+		if (!stream && (start != DTS_NO_ALIGN)) {
+			x = start;
+			stream = true;
+			la = DTS_ALIGNED16(src+x*2);
+		}
+	}
+	return x;
+}
+
+// interleave 16 Y with 8 UV pairs, averaged with the next chroma row if given.
+// bUVFirst selects UYVY instead of YUY2 order.
+static inline uint32_t DtsNv12ToPackedSSE2(uint8_t *dst, const uint8_t *srcY, const uint8_t *srcUV, const uint8_t *srcUV2,
+					   uint32_t width, uint32_t flags, bool bUVFirst)
+{
+	uint32_t x = 0;
+	uint32_t start = DtsStreamStart(flags, DtsAlignPixel(dst, 2, 16), 16, width);
+	bool stream = (start == 0);
+	bool la = DTS_ALIGNED16(srcY) && DTS_ALIGNED16(srcUV) && (!srcUV2 || DTS_ALIGNED16(srcUV2));
+
+	while (x + 16 <= width)
+	{
+		DtsPrefetch(srcY+x);
+		DtsPrefetch(srcUV+x);
+		__m128i y = DtsLoad128(srcY+x, la); // load 16 Y pixels
+		__m128i uv = DtsLoad128(srcUV+x, la); // load 8 UV
+		if (srcUV2)
+			uv = _mm_avg_epu8(uv, DtsLoad128(srcUV2+x, la));
+		if (bUVFirst) {
+			DtsStore128(dst+x*2+ 0, _mm_unpacklo_epi8(uv, y), stream); // store 8 pixels
+			DtsStore128(dst+x*2+16, _mm_unpackhi_epi8(uv, y), stream); // store 8 pixels
+		} else {
+			DtsStore128(dst+x*2+ 0, _mm_unpacklo_epi8(y, uv), stream); // store 8 pixels
+			DtsStore128(dst+x*2+16, _mm_unpackhi_epi8(y, uv), stream); // store 8 pixels
+		}
+		x += 16;
+		if (!stream && (start != DTS_NO_ALIGN)) {
+			x = start;
+			stream = true;
+			la = DTS_ALIGNED16(srcY+x) && DTS_ALIGNED16(srcUV+x) && (!srcUV2 || DTS_ALIGNED16(srcUV2+x));
+		}
+	}
+	return x;
+}
+
+uint32_t DtsNv12ToYuy2SSE2(uint8_t *dst, const uint8_t *srcY, const uint8_t *srcUV, const uint8_t *srcUV2, uint32_t width, uint32_t flags)
+{
+	return DtsNv12ToPackedSSE2(dst, srcY, srcUV, srcUV2, width, flags, false);
+}
+
+uint32_t DtsNv12ToUyvySSE2(uint8_t *dst, const uint8_t *srcY, const uint8_t *srcUV, const uint8_t *srcUV2, uint32_t width, uint32_t flags)
+{
+	return DtsNv12ToPackedSSE2(dst, srcY, srcUV, srcUV2, width, flags, true);
+}
+
+// 2x2 box average of 16 output pixels from 32 pixels of two rows. The
+// rounding matches the callers' scalar (a+b+c+d+2)>>2.
+uint32_t DtsBox2RowSSE2(uint8_t *dst, const uint8_t *src0, const uint8_t *src1, uint32_t width)
+{
+	uint32_t x = 0;
+	const __m128i mask = _mm_set1_epi16(0x00ff);
+	const __m128i two = _mm_set1_epi16(2);
+
+	while (x + 16 <= width)
+	{
+		__m128i a1 = _mm_loadu_si128((__m128i *) (src0+x*2+ 0));
+		__m128i a2 = _mm_loadu_si128((__m128i *) (src0+x*2+16));
+		__m128i b1 = _mm_loadu_si128((__m128i *) (src1+x*2+ 0));
+		__m128i b2 = _mm_loadu_si128((__m128i *) (src1+x*2+16));
+
+		// even + odd pixel of each row, then both rows
+		__m128i s1 = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a1, mask), _mm_srli_epi16(a1, 8)),
+					    _mm_add_epi16(_mm_and_si128(b1, mask), _mm_srli_epi16(b1, 8)));
+		__m128i s2 = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a2, mask), _mm_srli_epi16(a2, 8)),
+					    _mm_add_epi16(_mm_and_si128(b2, mask), _mm_srli_epi16(b2, 8)));
+		s1 = _mm_srli_epi16(_mm_add_epi16(s1, two), 2);
+		s2 = _mm_srli_epi16(_mm_add_epi16(s2, two), 2);
+
+		_mm_storeu_si128((__m128i *) (dst+x), _mm_packus_epi16(s1, s2)); // store 16 pixels
+		x += 16;
+	}
+	return x;
+}
+
+// Same for interleaved UV, 8 output pairs from 16 pairs of two rows
+uint32_t DtsBox2RowUVSSE2(uint8_t *dst, const uint8_t *src0, const uint8_t *src1, uint32_t width)
+{
+	uint32_t x = 0;
+	const __m128i one = _mm_set1_epi16(1);
+	const __m128i two = _mm_set1_epi32(2);
+
+	while (x + 8 <= width)
+	{
+		__m128i a1 = _mm_loadu_si128((__m128i *) (src0+x*4+ 0));
+		__m128i a2 = _mm_loadu_si128((__m128i *) (src0+x*4+16));
+		__m128i b1 = _mm_loadu_si128((__m128i *) (src1+x*4+ 0));
+		__m128i b2 = _mm_loadu_si128((__m128i *) (src1+x*4+16));
+
+		// bytes U0 V0 U1 V1: row sums as 16 bit, then madd adds the two pairs
+		__m128i s1 = _mm_add_epi16(_mm_unpacklo_epi8(a1, _mm_setzero_si128()), _mm_unpacklo_epi8(b1, _mm_setzero_si128()));
+		__m128i s2 = _mm_add_epi16(_mm_unpackhi_epi8(a1, _mm_setzero_si128()), _mm_unpackhi_epi8(b1, _mm_setzero_si128()));
+		__m128i s3 = _mm_add_epi16(_mm_unpacklo_epi8(a2, _mm_setzero_si128()), _mm_unpacklo_epi8(b2, _mm_setzero_si128()));
+		__m128i s4 = _mm_add_epi16(_mm_unpackhi_epi8(a2, _mm_setzero_si128()), _mm_unpackhi_epi8(b2, _mm_setzero_si128()));
+
+		// U0+U1 V0+V1 U2+U3 V2+V3 as 16 bit words: shuffle the words to U U V V first
+		s1 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s1, 0xD8), 0xD8);
+		s2 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s2, 0xD8), 0xD8);
+		s3 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s3, 0xD8), 0xD8);
+		s4 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s4, 0xD8), 0xD8);
+		s1 = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(s1, one), two), 2);
+		s2 = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(s2, one), two), 2);
+		s3 = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(s3, one), two), 2);
+		s4 = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(s4, one), two), 2);
+
+		// dwords U V U V, all < 256 so the signed packs are safe
+		__m128i w = _mm_packus_epi16(_mm_packs_epi32(s1, s2), _mm_packs_epi32(s3, s4));
+		_mm_storeu_si128((__m128i *) (dst+x*2), w); // store 8 pairs
+		x += 8;
+	}
+	return x;
+}
+
+// dst = (src0*(256-weight) + src1*weight + 128) >> 8, 16 bytes at a time
+uint32_t DtsBlendRowSSE2(uint8_t *dst, const uint8_t *src0, const uint8_t *src1, uint32_t weight, uint32_t count)
+{
+	uint32_t x = 0;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i w0 = _mm_set1_epi16((short)(256 - weight));
+	const __m128i w1 = _mm_set1_epi16((short)weight);
+	const __m128i half = _mm_set1_epi16(128);
+
+	while (x + 16 <= count)
+	{
+		__m128i a = _mm_loadu_si128((__m128i *) (src0+x));
+		__m128i b = _mm_loadu_si128((__m128i *) (src1+x));
+
+		// at most 255*256 + 128, fits an unsigned word
+		__m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), w0),
+							  _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), w1)), half);
+		__m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), w0),
+							  _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), w1)), half);
+
+		_mm_storeu_si128((__m128i *) (dst+x), _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+		x += 16;
+	}
+	return x;
+}
+
+// the two source bytes of tap n as one word, first tap in the low byte
+static inline short DtsTapPair(const uint8_t *src, const DTS_SCALE_TAPS *taps, uint32_t n)
+{
+	return (short)(src[taps->Off[n][0]] | (src[taps->Off[n][1]] << 8));
+}
+
+// taps n..n+7
+static inline __m128i DtsTapPairs(const uint8_t *src, const DTS_SCALE_TAPS *taps, uint32_t n)
+{
+	return _mm_setr_epi16(DtsTapPair(src, taps, n+0), DtsTapPair(src, taps, n+1),
+			      DtsTapPair(src, taps, n+2), DtsTapPair(src, taps, n+3),
+			      DtsTapPair(src, taps, n+4), DtsTapPair(src, taps, n+5),
+			      DtsTapPair(src, taps, n+6), DtsTapPair(src, taps, n+7));
+}
+
+// Horizontal bilinear step, 16 bytes at a time. There is no gather, so the
+// tap pairs go in a word at a time, then one pmaddwd per 4 bytes does both
+// multiplies and the add against the table's weight pairs.
+uint32_t DtsScaleRowHSSE2(uint8_t *dst, const uint8_t *src, const DTS_SCALE_TAPS *taps, uint32_t count)
+{
+	uint32_t x = 0;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i half = _mm_set1_epi32(128);
+
+	while (x + 16 <= count)
+	{
+		__m128i p0 = DtsTapPairs(src, taps, x);
+		__m128i p1 = DtsTapPairs(src, taps, x+8);
+		__m128i s0, s1, s2, s3;
+
+		// at most 255*256 + 128 per dword, and < 256 after the shift
+		s0 = _mm_madd_epi16(_mm_unpacklo_epi8(p0, zero), _mm_loadu_si128((const __m128i *) taps->Wt[x]));
+		s1 = _mm_madd_epi16(_mm_unpackhi_epi8(p0, zero), _mm_loadu_si128((const __m128i *) taps->Wt[x+4]));
+		s2 = _mm_madd_epi16(_mm_unpacklo_epi8(p1, zero), _mm_loadu_si128((const __m128i *) taps->Wt[x+8]));
+		s3 = _mm_madd_epi16(_mm_unpackhi_epi8(p1, zero), _mm_loadu_si128((const __m128i *) taps->Wt[x+12]));
+		s0 = _mm_srli_epi32(_mm_add_epi32(s0, half), 8);
+		s1 = _mm_srli_epi32(_mm_add_epi32(s1, half), 8);
+		s2 = _mm_srli_epi32(_mm_add_epi32(s2, half), 8);
+		s3 = _mm_srli_epi32(_mm_add_epi32(s3, half), 8);
+
+		_mm_storeu_si128((__m128i *) (dst+x), _mm_packus_epi16(_mm_packs_epi32(s0, s1), _mm_packs_epi32(s2, s3)));
+		x += 16;
+	}
+	return x;
+}
+
+//------------------------------------------------------------------------
+// Dispatch
+//------------------------------------------------------------------------
+
+// Valid before the library constructor has run.
+DTS_COPY_OPS gDtsCopyOps = {
+	DTS_CPU_SSE2,
+	DtsFenceSSE2,
+	DtsMemcpySSE2,
+	DtsYuy2ToUyvySSE2,
+	DtsYuy2ToNv12SSE2,
+	DtsYuy2ToI420SSE2,
+	DtsNv12ToYuy2SSE2,
+	DtsNv12ToUyvySSE2,
+	DtsBox2RowSSE2,
+	DtsBox2RowUVSSE2,
+	DtsBlendRowSSE2,
+	DtsScaleRowHSSE2,
+};
+
+static uint64_t DtsXgetbv(uint32_t idx)
+{
+	uint32_t eax, edx;
+	// xgetbv, spelled out for assemblers that do not know it
+	__asm__ __volatile__(".byte 0x0f, 0x01, 0xd0" : "=a"(eax), "=d"(edx) : "c"(idx));
+	return ((uint64_t)edx << 32) | eax;
+}
+
+//------------------------------------------------------------------------
+// Name: DtsGetCpuFeatures
+// Description: DTS_CPU_xxx mask of what this CPU and OS can run.
+//------------------------------------------------------------------------
+uint32_t DtsGetCpuFeatures(void)
+{
+	uint32_t eax, ebx, ecx, edx, maxLeaf;
+	uint32_t features = 0;
+
+	if (!(maxLeaf = __get_cpuid_max(0, NULL)))
+		return 0;
+
+	__cpuid(1, eax, ebx, ecx, edx);
+	if (edx & (1 << 26))
+		features |= DTS_CPU_SSE2;
+	if (ecx & (1 << 9))
+		features |= DTS_CPU_SSSE3;
+
+	// AVX2 also needs the OS to save YMM state: OSXSAVE and XCR0 bits 1,2
+	if ((maxLeaf >= 7) && (ecx & (1 << 27)) && (ecx & (1 << 28)) &&
+	    ((DtsXgetbv(0) & 0x6) == 0x6)) {
+		__cpuid_count(7, 0, eax, ebx, ecx, edx);
+		if (ebx & (1 << 5))
+			features |= DTS_CPU_AVX2;
+	}
+
+	return features;
+}
+
+//------------------------------------------------------------------------
+// Name: DtsInitCopyOps
+// Description: Fill gDtsCopyOps with the best kernels allowed by the CPU
+//              and IsaMask. Returns the level picked.
+//------------------------------------------------------------------------
+uint32_t DtsInitCopyOps(uint32_t IsaMask)
+{
+	DTS_COPY_OPS ops;
+	uint32_t features = DtsGetCpuFeatures() & IsaMask;
+
+	ops.Isa = 0;
+	ops.Fence = DtsFenceC;
+	ops.Memcpy = DtsMemcpyC;
+	ops.Yuy2ToUyvy = DtsYuy2ToUyvyC;
+	ops.Yuy2ToNv12 = DtsYuy2ToNv12C;
+	ops.Yuy2ToI420 = DtsYuy2ToI420C;
+	ops.Nv12ToYuy2 = DtsNv12ToPackedC;
+	ops.Nv12ToUyvy = DtsNv12ToPackedC;
+	ops.Box2Row = DtsBox2RowC;
+	ops.Box2RowUV = DtsBox2RowC;
+	ops.BlendRow = DtsBlendRowC;
+	ops.ScaleRowH = DtsScaleRowHC;
+
+	if (features & DTS_CPU_SSE2) {
+		ops.Isa = DTS_CPU_SSE2;
+		ops.Fence = DtsFenceSSE2;
+		ops.Memcpy = DtsMemcpySSE2;
+		ops.Yuy2ToUyvy = DtsYuy2ToUyvySSE2;
+		ops.Yuy2ToNv12 = DtsYuy2ToNv12SSE2;
+		ops.Yuy2ToI420 = DtsYuy2ToI420SSE2;
+		ops.Nv12ToYuy2 = DtsNv12ToYuy2SSE2;
+		ops.Nv12ToUyvy = DtsNv12ToUyvySSE2;
+		ops.Box2Row = DtsBox2RowSSE2;
+		ops.Box2RowUV = DtsBox2RowUVSSE2;
+		ops.BlendRow = DtsBlendRowSSE2;
+		ops.ScaleRowH = DtsScaleRowHSSE2;
+	}
+
+	// pshufb only helps the byte shuffles, the NV12 interleave stays SSE2
+	if ((features & (DTS_CPU_SSE2 | DTS_CPU_SSSE3)) == (DTS_CPU_SSE2 | DTS_CPU_SSSE3)) {
+		ops.Isa = DTS_CPU_SSSE3;
+		ops.Yuy2ToUyvy = DtsYuy2ToUyvySSSE3;
+		ops.Yuy2ToNv12 = DtsYuy2ToNv12SSSE3;
+	}
+
+	if ((ops.Isa == DTS_CPU_SSSE3) && (features & DTS_CPU_AVX2)) {
+		ops.Isa = DTS_CPU_AVX2;
+		ops.Memcpy = DtsMemcpyAVX2;
+		ops.Yuy2ToUyvy = DtsYuy2ToUyvyAVX2;
+		ops.Yuy2ToNv12 = DtsYuy2ToNv12AVX2;
+		ops.Yuy2ToI420 = DtsYuy2ToI420AVX2;
+		ops.Nv12ToYuy2 = DtsNv12ToYuy2AVX2;
+		ops.Nv12ToUyvy = DtsNv12ToUyvyAVX2;
+	}
+
+	gDtsCopyOps = ops;
+
+	return ops.Isa;
+}
+
+static void __attribute__((constructor)) DtsCopyOpsLoad(void)
+{
+	DtsInitCopyOps(DTS_CPU_SSE2 | DTS_CPU_SSSE3 | DTS_CPU_AVX2);
+}
+
+typedef struct _DTS_COPY_WORKER {
+	DTS_COPY_POOL	*pool;
+	uint32_t	idx;
+	pthread_t	thread;
+} DTS_COPY_WORKER;
+
+struct _DTS_COPY_POOL {
+	pthread_mutex_t	lock;
+	pthread_cond_t	start;		/* workers wait here for the next job */
+	pthread_cond_t	done;		/* the caller waits here for the stripes */
+	DTS_COPY_WORKER	*workers;
+	uint32_t	nWorkers;
+	uint32_t	gen;		/* bumped for every job */
+	uint32_t	pending;	/* worker stripes not finished yet */
+	bool		exit;
+
+	DTS_STRIPE_FN	fn;
+	void		*arg;
+	uint32_t	height;
+	uint32_t	rows;		/* stripe height */
+};
+
+static void *DtsCopyWorker(void *p)
+{
+	DTS_COPY_WORKER *w = (DTS_COPY_WORKER *)p;
+	DTS_COPY_POOL *pool = w->pool;
+	uint32_t gen = 0, y0, y1;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;)
+	{
+		while (!pool->exit && (pool->gen == gen))
+			pthread_cond_wait(&pool->start, &pool->lock);
+		if (pool->exit)
+			break;
+		gen = pool->gen;
+
+		// stripe 0 is the caller's
+		y0 = (w->idx + 1) * pool->rows;
+		y1 = y0 + pool->rows;
+		if (y0 > pool->height)
+			y0 = pool->height;
+		if (y1 > pool->height)
+			y1 = pool->height;
+		pthread_mutex_unlock(&pool->lock);
+
+		if (y0 < y1)
+			pool->fn(pool->arg, y0, y1);
+
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->pending == 0)
+			pthread_cond_signal(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+DTS_COPY_POOL *DtsCreateCopyPool(uint32_t nWorkers)
+{
+	DTS_COPY_POOL *pool;
+	uint32_t i;
+
+	if (!nWorkers || (nWorkers >= DTS_COPY_MAX_THREADS))
+		return NULL;
+
+	pool = (DTS_COPY_POOL *)malloc(sizeof(*pool));
+	if (!pool)
+		return NULL;
+	memset(pool, 0, sizeof(*pool));
+
+	pool->workers = (DTS_COPY_WORKER *)malloc(nWorkers * sizeof(DTS_COPY_WORKER));
+	if (!pool->workers) {
+		free(pool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->start, NULL);
+	pthread_cond_init(&pool->done, NULL);
+
+	for (i = 0; i < nWorkers; i++)
+	{
+		pool->workers[i].pool = pool;
+		pool->workers[i].idx = i;
+		if (pthread_create(&pool->workers[i].thread, NULL, DtsCopyWorker, &pool->workers[i]))
+			break;
+	}
+	pool->nWorkers = i;
+
+	if (pool->nWorkers != nWorkers) {
+		DtsDeleteCopyPool(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+void DtsDeleteCopyPool(DTS_COPY_POOL *pool)
+{
+	uint32_t i;
+
+	if (!pool)
+		return;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->exit = true;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->nWorkers; i++)
+		pthread_join(pool->workers[i].thread, NULL);
+
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->start);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->workers);
+	free(pool);
+}
+
+void DtsRunStripes(DTS_COPY_POOL *pool, DTS_STRIPE_FN fn, void *arg, uint32_t height, uint32_t align)
+{
+	uint32_t rows = (height + pool->nWorkers) / (pool->nWorkers + 1);
+
+	rows = (rows + align - 1) & ~(align - 1);
+
+	pthread_mutex_lock(&pool->lock);
+	pool->fn = fn;
+	pool->arg = arg;
+	pool->height = height;
+	pool->rows = rows;
+	pool->pending = pool->nWorkers;
+	pool->gen++;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+
+	fn(arg, 0, (rows < height) ? rows : height);
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->pending)
+		pthread_cond_wait(&pool->done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
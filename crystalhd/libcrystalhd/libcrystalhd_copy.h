@@ -0,0 +1,198 @@
+/********************************************************************
+ * Copyright(c) 2006-2009 Broadcom Corporation.
+ *
+ *  Name: libcrystalhd_copy.h
+ *
+ *  Description: Picture copy/conversion kernels and CPU dispatch.
+ *
+ *  AU
+ *
+ *  HISTORY:
+ *
+ ********************************************************************
+ *
+ * This file is part of libcrystalhd.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *******************************************************************/
+#ifndef _BCM_COPY_H_
+#define _BCM_COPY_H_
+
+#include <stdint.h>
+
+/* Instruction set levels, DtsGetCpuFeatures() returns a mask of these */
+#define DTS_CPU_SSE2	0x00000001
+#define DTS_CPU_SSSE3	0x00000002
+#define DTS_CPU_AVX2	0x00000004
+
+/* Kernel flags */
+#define DTS_COPY_NT	0x00000001	/* Stream stores past the cache, Fence() when done */
+
+/* Source bytes prefetched ahead of the loads, read once so NTA */
+#define DTS_PREFETCH_AHEAD	512
+
+/*
+ * Row kernels. Each converts as many whole vector blocks of a row as it can,
+ * starting at the given pointers, and returns the number of pixels done, an
+ * even number. The callers finish the rest of the row with their scalar
+ * loops. srcUV2 is the next chroma row to average with, or NULL.
+ *
+ * Streamed stores are weakly ordered. Whoever ran DTS_COPY_NT kernels calls
+ * Fence() on the same thread before the picture is handed on.
+ *
+ * Box2Row averages 2x2 blocks of src0/src1 into one pixel, Box2RowUV does the
+ * same for interleaved UV pairs. BlendRow mixes count bytes of two rows with
+ * src1 weighted weight/256, for the vertical step of bilinear scaling.
+ * ScaleRowH does the horizontal step, count output bytes from a tap table.
+ */
+typedef struct _DTS_SCALE_TAPS DTS_SCALE_TAPS;
+
+typedef struct _DTS_COPY_OPS {
+	uint32_t	Isa;		/* DTS_CPU_xxx level the table was built for, 0 for C */
+	void		(*Fence)(void);
+	void		(*Memcpy)(uint8_t *dst, const uint8_t *src, uint32_t count, uint32_t flags);
+	uint32_t	(*Yuy2ToUyvy)(uint8_t *dst, const uint8_t *src, uint32_t width, uint32_t flags);
+	uint32_t	(*Yuy2ToNv12)(uint8_t *dstY, uint8_t *dstUV, const uint8_t *src, uint32_t width, uint32_t flags);
+	uint32_t	(*Yuy2ToI420)(uint8_t *dstY, uint8_t *dstU, uint8_t *dstV, const uint8_t *src, uint32_t width, uint32_t flags);
+	uint32_t	(*Nv12ToYuy2)(uint8_t *dst, const uint8_t *srcY, const uint8_t *srcUV, const uint8_t *srcUV2, uint32_t width, uint32_t flags);
+	uint32_t	(*Nv12ToUyvy)(uint8_t *dst, const uint8_t *srcY, const uint8_t *srcUV, const uint8_t *srcUV2, uint32_t width, uint32_t flags);
+	/* Downscale kernels, width is in output pixels (UV pairs for Box2RowUV).
+	   They write through the cache, their output is small. */
+	uint32_t	(*Box2Row)(uint8_t *dst, const uint8_t *src0, const uint8_t *src1, uint32_t width);
+	uint32_t	(*Box2RowUV)(uint8_t *dst, const uint8_t *src0, const uint8_t *src1, uint32_t width);
+	uint32_t	(*BlendRow)(uint8_t *dst, const uint8_t *src0, const uint8_t *src1, uint32_t weight, uint32_t count);
+	uint32_t	(*ScaleRowH)(uint8_t *dst, const uint8_t *src, const DTS_SCALE_TAPS *taps, uint32_t count);
+} DTS_COPY_OPS;
+
+extern DTS_COPY_OPS gDtsCopyOps;
+
+uint32_t DtsGetCpuFeatures(void);
+uint32_t DtsInitCopyOps(uint32_t IsaMask);
+
+#define DTS_NO_ALIGN	0xffffffff
+
+/* First pixel x with dst + x*bpp aligned to align bytes, or DTS_NO_ALIGN */
+static inline uint32_t DtsAlignPixel(const uint8_t *dst, uint32_t bpp, uint32_t align)
+{
+	uint32_t m = (uint32_t)(-(uintptr_t)dst & (align - 1));
+
+	return (m % bpp) ? DTS_NO_ALIGN : m / bpp;
+}
+
+/*
+ * Pixel at which a kernel doing block pixels per step can switch to
+ * streaming, after one unaligned block, or DTS_NO_ALIGN to not stream.
+ */
+static inline uint32_t DtsStreamStart(uint32_t flags, uint32_t start, uint32_t block, uint32_t width)
+{
+	if (!(flags & DTS_COPY_NT) || (start == DTS_NO_ALIGN) || (start & 1) || (start + block > width))
+		return DTS_NO_ALIGN;
+	return start;
+}
+
+/*
+ * Stripe workers. DtsRunStripes() splits rows [0,height) into one stripe per
+ * worker plus one for the caller, each a multiple of align rows (a power of
+ * two), runs fn on all of them and returns when they are done. One caller
+ * at a time per pool.
+ */
+#define DTS_COPY_MAX_THREADS	8
+
+typedef void (*DTS_STRIPE_FN)(void *arg, uint32_t y0, uint32_t y1);
+typedef struct _DTS_COPY_POOL DTS_COPY_POOL;
+
+DTS_COPY_POOL *DtsCreateCopyPool(uint32_t nWorkers);
+void DtsDeleteCopyPool(DTS_COPY_POOL *pool);
+void DtsRunStripes(DTS_COPY_POOL *pool, DTS_STRIPE_FN fn, void *arg, uint32_t height, uint32_t align);
+
+/*
+ * One picture conversion, libcrystalhd_copy_frame.cpp. The row functions
+ * convert rows [y0,y1) of it, y0 always even, so a picture can be split
+ * into stripes for the copy pool. Widths are in pixels, strides are the
+ * padding added to each row.
+ */
+typedef struct _DTS_COPY_JOB DTS_COPY_JOB;
+typedef void (*DTS_COPY_ROWS)(const DTS_COPY_JOB *j, uint32_t y0, uint32_t y1);
+
+struct _DTS_COPY_JOB {
+	DTS_COPY_ROWS	Rows;
+	uint8_t		*dstY;
+	uint8_t		*dstU;		/* UV plane for NV12 */
+	uint8_t		*dstV;
+	const uint8_t	*srcY;
+	const uint8_t	*srcUV;
+	uint32_t	srcWidth;
+	uint32_t	srcHeight;	/* only when scaling, height is the output one */
+	uint32_t	dstWidth;
+	uint32_t	height;
+	uint32_t	strideY;
+	uint32_t	strideU;
+	uint32_t	strideV;
+	uint32_t	copyFlags;	/* DTS_COPY_xxx */
+};
+
+void DtsCopyFrame(DTS_COPY_POOL *pool, DTS_COPY_JOB *j);
+
+/* DtsCopyPlaneRows is a single plane with widths in bytes */
+void DtsCopyPlaneRows(const DTS_COPY_JOB *j, uint32_t y0, uint32_t y1);
+void DtsCopy422ToI420(const DTS_COPY_JOB *j, uint32_t y0, uint32_t y1);
+void DtsCopy422ToYUY2(const DTS_COPY_JOB *j, uint32_t y0, uint32_t y1);
+void DtsCopy422ToUYVY(const DTS_COPY_JOB *j, uint32_t y0, uint32_t y1);
+void DtsCopy422ToNV12(const DTS_COPY_JOB *j, uint32_t y0, uint32_t y1);
+void DtsCopy420ToI420(const DTS_COPY_JOB *j, uint32_t y0, uint32_t y1);
+void DtsCopy420ToYUY2(const DTS_COPY_JOB *j, uint32_t y0, uint32_t y1);
+void DtsCopy420ToUYVY(const DTS_COPY_JOB *j, uint32_t y0, uint32_t y1);
+void DtsCopy420ToNV12(const DTS_COPY_JOB *j, uint32_t y0, uint32_t y1);
+/* YV12 takes dstWidth out of srcWidth wide rows, as DtsCopyPlaneRows */
+void DtsCopy420ToYV12(const DTS_COPY_JOB *j, uint32_t y0, uint32_t y1);
+
+/* Downscale to dstWidth x height from srcWidth x srcHeight, 420 to NV12 */
+#define DTS_SCALE_MAX_WIDTH	2048
+void DtsScale420ToNV12(const DTS_COPY_JOB *j, uint32_t y0, uint32_t y1);
+
+/*
+ * Horizontal bilinear taps of one plane, worked out once per stripe: output
+ * byte n is (src[Off[n][0]]*Wt[n][0] + src[Off[n][1]]*Wt[n][1] + 128) >> 8.
+ * The weight pairs are laid out for pmaddwd.
+ */
+struct _DTS_SCALE_TAPS {
+	uint16_t	Off[DTS_SCALE_MAX_WIDTH][2];
+	int16_t		Wt[DTS_SCALE_MAX_WIDTH][2];
+};
+
+/* SSE2, libcrystalhd_copy.cpp */
+void DtsFenceSSE2(void);
+void DtsMemcpySSE2(uint8_t *dst, const uint8_t *src, uint32_t count, uint32_t flags);
+uint32_t DtsYuy2ToUyvySSE2(uint8_t *dst, const uint8_t *src, uint32_t width, uint32_t flags);
+uint32_t DtsYuy2ToNv12SSE2(uint8_t *dstY, uint8_t *dstUV, const uint8_t *src, uint32_t width, uint32_t flags);
+uint32_t DtsYuy2ToI420SSE2(uint8_t *dstY, uint8_t *dstU, uint8_t *dstV, const uint8_t *src, uint32_t width, uint32_t flags);
+uint32_t DtsNv12ToYuy2SSE2(uint8_t *dst, const uint8_t *srcY, const uint8_t *srcUV, const uint8_t *srcUV2, uint32_t width, uint32_t flags);
+uint32_t DtsNv12ToUyvySSE2(uint8_t *dst, const uint8_t *srcY, const uint8_t *srcUV, const uint8_t *srcUV2, uint32_t width, uint32_t flags);
+uint32_t DtsBox2RowSSE2(uint8_t *dst, const uint8_t *src0, const uint8_t *src1, uint32_t width);
+uint32_t DtsBox2RowUVSSE2(uint8_t *dst, const uint8_t *src0, const uint8_t *src1, uint32_t width);
+uint32_t DtsBlendRowSSE2(uint8_t *dst, const uint8_t *src0, const uint8_t *src1, uint32_t weight, uint32_t count);
+uint32_t DtsScaleRowHSSE2(uint8_t *dst, const uint8_t *src, const DTS_SCALE_TAPS *taps, uint32_t count);
+
+/* SSSE3, libcrystalhd_copy_ssse3.cpp, built with -mssse3 */
+uint32_t DtsYuy2ToUyvySSSE3(uint8_t *dst, const uint8_t *src, uint32_t width, uint32_t flags);
+uint32_t DtsYuy2ToNv12SSSE3(uint8_t *dstY, uint8_t *dstUV, const uint8_t *src, uint32_t width, uint32_t flags);
+
+/* AVX2, libcrystalhd_copy_avx2.cpp, built with -mavx2 */
+void DtsMemcpyAVX2(uint8_t *dst, const uint8_t *src, uint32_t count, uint32_t flags);
+uint32_t DtsYuy2ToUyvyAVX2(uint8_t *dst, const uint8_t *src, uint32_t width, uint32_t flags);
+uint32_t DtsYuy2ToNv12AVX2(uint8_t *dstY, uint8_t *dstUV, const uint8_t *src, uint32_t width, uint32_t flags);
+uint32_t DtsYuy2ToI420AVX2(uint8_t *dstY, uint8_t *dstU, uint8_t *dstV, const uint8_t *src, uint32_t width, uint32_t flags);
+uint32_t DtsNv12ToYuy2AVX2(uint8_t *dst, const uint8_t *srcY, const uint8_t *srcUV, const uint8_t *srcUV2, uint32_t width, uint32_t flags);
+uint32_t DtsNv12ToUyvyAVX2(uint8_t *dst, const uint8_t *srcY, const uint8_t *srcUV, const uint8_t *srcUV2, uint32_t width, uint32_t flags);
+
+#endif
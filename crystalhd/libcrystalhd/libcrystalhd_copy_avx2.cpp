@@ -0,0 +1,233 @@
+/********************************************************************
+ * Copyright(c) 2006-2009 Broadcom Corporation.
+ *
+ *  Name: libcrystalhd_copy_avx2.cpp
+ *
+ *  Description: AVX2 picture copy kernels. Built with -mavx2 and only
+ *               called through gDtsCopyOps when the CPU and OS have it.
+ *
+ *  AU
+ *
+ *  HISTORY:
+ *
+ ********************************************************************
+ *
+ * This file is part of libcrystalhd.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *******************************************************************/
+
+#include <immintrin.h>
+#include "libcrystalhd_copy.h"
+
+// Unaligned loads cost nothing extra on AVX2 parts, only the stores care
+// so that full aligned rows can bypass the cache. Unaligned rows get one
+// unaligned block first, as in the SSE2 kernels.
+#define DTS_ALIGNED32(p)	((((uintptr_t)(p)) & 0x1f) == 0)
+
+static inline void DtsStore256(uint8_t *dst, __m256i v, bool stream)
+{
+	if (stream)
+		_mm256_stream_si256((__m256i *)dst, v);
+	else
+		_mm256_storeu_si256((__m256i *)dst, v);
+}
+
+static inline void DtsPrefetch(const uint8_t *src)
+{
+	_mm_prefetch((const char *)(src + DTS_PREFETCH_AHEAD), _MM_HINT_NTA);
+}
+
+void DtsMemcpyAVX2(uint8_t *dst, const uint8_t *src, uint32_t count, uint32_t flags)
+{
+	bool stream = (flags & DTS_COPY_NT) != 0;
+
+	if (stream) {
+		// bytes up to the first aligned destination byte
+		uint32_t head = DtsAlignPixel(dst, 1, 32);
+		if (head > count)
+			head = count;
+		count -= head;
+		while (head --)
+			*dst++ = *src++;
+	}
+
+	while (count >= (32*4))
+	{
+		DtsPrefetch(src);
+		DtsPrefetch(src+64);
+		__m256i v0 = _mm256_loadu_si256((const __m256i *) (src+ 0*32));
+		__m256i v1 = _mm256_loadu_si256((const __m256i *) (src+ 1*32));
+		__m256i v2 = _mm256_loadu_si256((const __m256i *) (src+ 2*32));
+		__m256i v3 = _mm256_loadu_si256((const __m256i *) (src+ 3*32));
+		DtsStore256(dst+ 0*32, v0, stream);
+		DtsStore256(dst+ 1*32, v1, stream);
+		DtsStore256(dst+ 2*32, v2, stream);
+		DtsStore256(dst+ 3*32, v3, stream);
+		count -= 32*4;
+		src += 32*4;
+		dst += 32*4;
+	}
+
+	while (count >= 32)
+	{
+		DtsStore256(dst, _mm256_loadu_si256((const __m256i *) src), stream);
+		count -= 32;
+		src += 32;
+		dst += 32;
+	}
+
+	while (count --)
+		*dst++ = *src++;
+}
+
+// swap the bytes of every Y/UV pair, 16 pixels at a time
+uint32_t DtsYuy2ToUyvyAVX2(uint8_t *dst, const uint8_t *src, uint32_t width, uint32_t flags)
+{
+	uint32_t x = 0;
+	uint32_t start = DtsStreamStart(flags, DtsAlignPixel(dst, 2, 32), 16, width);
+	bool stream = (start == 0);
+	const __m256i swap = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+					      1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+
+	while (x + 16 <= width)
+	{
+		DtsPrefetch(src+x*2);
+		__m256i v = _mm256_loadu_si256((const __m256i *)(src+x*2));
+		DtsStore256(dst+x*2, _mm256_shuffle_epi8(v, swap), stream);
+		x += 16;
+		if (!stream && (start != DTS_NO_ALIGN)) {
+			x = start;
+			stream = true;
+		}
+	}
+	return x;
+}
+
+// 32 pixels at a time: pshufb splits each 128 bit lane into Y and UV
+// quadwords, the permutes put them back in row order.
+uint32_t DtsYuy2ToNv12AVX2(uint8_t *dstY, uint8_t *dstUV, const uint8_t *src, uint32_t width, uint32_t flags)
+{
+	uint32_t x = 0;
+	uint32_t start = DtsStreamStart(flags, DtsAlignPixel(dstY, 1, 32), 32, width);
+	bool stream;
+	const __m256i split = _mm256_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15,
+					       0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+
+	if (dstUV && (start != DTS_NO_ALIGN) && !DTS_ALIGNED32(dstUV+start))
+		start = DTS_NO_ALIGN;
+	stream = (start == 0);
+
+	while (x + 32 <= width)
+	{
+		DtsPrefetch(src+x*2);
+		__m256i s1 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *) (src+x*2+ 0)), split);
+		__m256i s2 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *) (src+x*2+32)), split);
+
+		// Y0 UV0 Y1 UV1 -> Y0 Y1 UV0 UV1
+		s1 = _mm256_permute4x64_epi64(s1, 0xD8);
+		s2 = _mm256_permute4x64_epi64(s2, 0xD8);
+
+		DtsStore256(dstY+x, _mm256_permute2x128_si256(s1, s2, 0x20), stream); // store 32 Y
+		if (dstUV)
+			DtsStore256(dstUV+x, _mm256_permute2x128_si256(s1, s2, 0x31), stream); // store 16 UV pairs
+		x += 32;
+		if (!stream && (start != DTS_NO_ALIGN)) {
+			x = start;
+			stream = true;
+		}
+	}
+	return x;
+}
+
+// split 32 pixels into Y, U and V planes. packus works per lane, the
+// permutes put the quadwords back in row order after each pack. Only the
+// Y stores stream, the 16 byte chroma halves go through the cache.
+uint32_t DtsYuy2ToI420AVX2(uint8_t *dstY, uint8_t *dstU, uint8_t *dstV, const uint8_t *src, uint32_t width, uint32_t flags)
+{
+	uint32_t x = 0;
+	uint32_t start = DtsStreamStart(flags, DtsAlignPixel(dstY, 1, 32), 32, width);
+	bool stream = (start == 0);
+	const __m256i mask = _mm256_set1_epi16(0x00ff);
+
+	while (x + 32 <= width)
+	{
+		DtsPrefetch(src+x*2);
+		__m256i s1 = _mm256_loadu_si256((const __m256i *) (src+x*2+ 0));
+		__m256i s2 = _mm256_loadu_si256((const __m256i *) (src+x*2+32));
+
+		__m256i y = _mm256_packus_epi16(_mm256_and_si256(s1, mask), _mm256_and_si256(s2, mask));
+		__m256i uv = _mm256_packus_epi16(_mm256_srli_epi16(s1, 8), _mm256_srli_epi16(s2, 8));
+		y = _mm256_permute4x64_epi64(y, 0xD8);
+		uv = _mm256_permute4x64_epi64(uv, 0xD8);
+
+		// U0-7 V0-7 | U8-15 V8-15 -> U0-15 | V0-15
+		__m256i u_v = _mm256_packus_epi16(_mm256_and_si256(uv, mask), _mm256_srli_epi16(uv, 8));
+		u_v = _mm256_permute4x64_epi64(u_v, 0xD8);
+
+		DtsStore256(dstY+x, y, stream); // store 32 Y
+		_mm_storeu_si128((__m128i *) (dstU+x/2), _mm256_castsi256_si128(u_v)); // store 16 U
+		_mm_storeu_si128((__m128i *) (dstV+x/2), _mm256_extracti128_si256(u_v, 1)); // store 16 V
+		x += 32;
+		if (!stream && (start != DTS_NO_ALIGN)) {
+			x = start;
+			stream = true;
+		}
+	}
+	return x;
+}
+
+// interleave 32 Y with 16 UV pairs, averaged with the next chroma row if given.
+static inline uint32_t DtsNv12ToPackedAVX2(uint8_t *dst, const uint8_t *srcY, const uint8_t *srcUV, const uint8_t *srcUV2,
+					   uint32_t width, uint32_t flags, bool bUVFirst)
+{
+	uint32_t x = 0;
+	uint32_t start = DtsStreamStart(flags, DtsAlignPixel(dst, 2, 32), 32, width);
+	bool stream = (start == 0);
+
+	while (x + 32 <= width)
+	{
+		DtsPrefetch(srcY+x);
+		DtsPrefetch(srcUV+x);
+		// in-lane unpacks, so put quadwords 0,2 in the low lane and 1,3 in the high one first
+		__m256i y = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i *) (srcY+x)), 0xD8);
+		__m256i uv = _mm256_loadu_si256((const __m256i *) (srcUV+x));
+		if (srcUV2)
+			uv = _mm256_avg_epu8(uv, _mm256_loadu_si256((const __m256i *) (srcUV2+x)));
+		uv = _mm256_permute4x64_epi64(uv, 0xD8);
+
+		if (bUVFirst) {
+			DtsStore256(dst+x*2+ 0, _mm256_unpacklo_epi8(uv, y), stream); // store 16 pixels
+			DtsStore256(dst+x*2+32, _mm256_unpackhi_epi8(uv, y), stream); // store 16 pixels
+		} else {
+			DtsStore256(dst+x*2+ 0, _mm256_unpacklo_epi8(y, uv), stream); // store 16 pixels
+			DtsStore256(dst+x*2+32, _mm256_unpackhi_epi8(y, uv), stream); // store 16 pixels
+		}
+		x += 32;
+		if (!stream && (start != DTS_NO_ALIGN)) {
+			x = start;
+			stream = true;
+		}
+	}
+	return x;
+}
+
+uint32_t DtsNv12ToYuy2AVX2(uint8_t *dst, const uint8_t *srcY, const uint8_t *srcUV, const uint8_t *srcUV2, uint32_t width, uint32_t flags)
+{
+	return DtsNv12ToPackedAVX2(dst, srcY, srcUV, srcUV2, width, flags, false);
+}
+
+uint32_t DtsNv12ToUyvyAVX2(uint8_t *dst, const uint8_t *srcY, const uint8_t *srcUV, const uint8_t *srcUV2, uint32_t width, uint32_t flags)
+{
+	return DtsNv12ToPackedAVX2(dst, srcY, srcUV, srcUV2, width, flags, true);
+}
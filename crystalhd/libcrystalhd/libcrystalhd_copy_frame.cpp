@@ -0,0 +1,495 @@
+/********************************************************************
+ * Copyright(c) 2006-2009 Broadcom Corporation.
+ *
+ *  Name: libcrystalhd_copy_frame.cpp
+ *
+ *  Description: Whole picture conversions from the hardware output
+ *               formats, built on the gDtsCopyOps row kernels. Nothing
+ *               here needs the device, so tools can link it on its own.
+ *
+ *  AU
+ *
+ *  HISTORY:
+ *
+ ********************************************************************
+ *
+ * This file is part of libcrystalhd.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *******************************************************************/
+
+#include <stddef.h>
+#include "libcrystalhd_copy.h"
+
+// Below this many pixels the workers cost more than they save
+#define DTS_COPY_MT_MIN_PIXELS	(1280*720/2)
+
+static void DtsCopyStripe(void *arg, uint32_t y0, uint32_t y1)
+{
+	const DTS_COPY_JOB *j = (const DTS_COPY_JOB *)arg;
+
+	j->Rows(j, y0, y1);
+	// streamed stores are only ordered by a fence on the thread that made them
+	if (j->copyFlags & DTS_COPY_NT)
+		gDtsCopyOps.Fence();
+}
+
+//------------------------------------------------------------------------
+// Name: DtsCopyFrame
+// Description: Run a whole picture conversion, split into stripes over
+//              pool when there is one and the picture is big enough.
+//------------------------------------------------------------------------
+void DtsCopyFrame(DTS_COPY_POOL *pool, DTS_COPY_JOB *j)
+{
+	if (pool && (j->dstWidth * j->height >= DTS_COPY_MT_MIN_PIXELS))
+		DtsRunStripes(pool, DtsCopyStripe, j, j->height, 2);
+	else
+		DtsCopyStripe(j, 0, j->height);
+}
+
+// a single plane, widths in bytes here: dstWidth per row out of srcWidth
+void DtsCopyPlaneRows(const DTS_COPY_JOB *j, uint32_t y0, uint32_t y1)
+{
+	uint32_t y;
+	uint8_t *pDest = j->dstY + y0 * (j->dstWidth + j->strideY);
+	const uint8_t *pSrc = j->srcY + y0 * j->srcWidth;
+
+	for (y = y0; y < y1; y++)
+	{
+		gDtsCopyOps.Memcpy(pDest, pSrc, j->dstWidth, j->copyFlags);
+		pDest += j->dstWidth + j->strideY;
+		pSrc += j->srcWidth;
+	}
+}
+
+
+// convert to three plane 420, taking chroma from the first line of each pair
+void DtsCopy422ToI420(const DTS_COPY_JOB *j, uint32_t y0, uint32_t y1)
+{
+	uint32_t x, __y;
+	uint32_t srcWidth = j->srcWidth;
+	uint32_t strideY = j->strideY + j->dstWidth;
+	uint32_t strideU = j->strideU + j->dstWidth/2;
+	uint32_t strideV = j->strideV + j->dstWidth/2;
+	uint8_t *dstY = j->dstY + y0 * strideY;
+	uint8_t *dstU = j->dstU + (y0/2) * strideU;
+	uint8_t *dstV = j->dstV + (y0/2) * strideV;
+	const uint8_t *srcY = j->srcY + y0 * srcWidth*2;
+
+	for (__y = y0; __y < y1; __y += 2)
+	{
+		// first line: Y, U and V
+		x = gDtsCopyOps.Yuy2ToI420(dstY, dstU, dstV, srcY, srcWidth, j->copyFlags);
+		for (; x + 1 < srcWidth; x += 2)
+		{
+			dstY[x+0]   = srcY[x*2+0]; // Y
+			dstU[x/2]   = srcY[x*2+1]; // U
+			dstY[x+1]   = srcY[x*2+2]; // Y
+			dstV[x/2]   = srcY[x*2+3]; // V
+		}
+		if (x < srcWidth)
+			dstY[x] = srcY[x*2];
+
+		srcY += srcWidth*2;
+		dstY += strideY;
+		dstU += strideU;
+		dstV += strideV;
+
+		if (__y + 1 >= y1)
+			break;
+
+		// second line: just Y
+		x = gDtsCopyOps.Yuy2ToNv12(dstY, NULL, srcY, srcWidth, j->copyFlags);
+		for (; x < srcWidth; x++)
+			dstY[x] = srcY[x*2];
+
+		srcY += srcWidth*2;
+		dstY += strideY;
+	}
+}
+
+// this is just a memcpy
+void DtsCopy422ToYUY2(const DTS_COPY_JOB *j, uint32_t y0, uint32_t y1)
+{ // copy YUY2 to YUY2
+	uint32_t y;
+	uint32_t srcWidth = j->srcWidth;
+	uint32_t strideY = j->strideY + j->dstWidth*2;
+	uint8_t *dstY = j->dstY + y0 * strideY;
+	const uint8_t *srcY = j->srcY + y0 * srcWidth*2;
+
+	for (y = y0; y < y1; y++)
+	{
+		gDtsCopyOps.Memcpy(dstY, srcY, srcWidth*2, j->copyFlags);
+		srcY += srcWidth*2;
+		dstY += strideY;
+	}
+}
+
+// almost a memcpy, we just need to shuffle YUV's around
+void DtsCopy422ToUYVY(const DTS_COPY_JOB *j, uint32_t y0, uint32_t y1)
+{
+	uint32_t x, __y;
+	uint32_t srcWidth = j->srcWidth;
+	uint32_t strideY = j->strideY + j->dstWidth*2;
+	uint8_t *dstY = j->dstY + y0 * strideY;
+	const uint8_t *srcY = j->srcY + y0 * srcWidth*2;
+
+	for (__y = y0; __y < y1; __y++)
+	{
+		x = gDtsCopyOps.Yuy2ToUyvy(dstY, srcY, srcWidth, j->copyFlags);
+
+		for (; x < srcWidth; x++)
+		{
+			dstY[x*2+0] = srcY[x*2+1];
+			dstY[x*2+1] = srcY[x*2+0];
+		}
+
+		srcY += srcWidth*2;
+		dstY += strideY;
+	}
+}
+
+// convert to NV12
+void DtsCopy422ToNV12(const DTS_COPY_JOB *j, uint32_t y0, uint32_t y1)
+{
+	// tested
+	uint32_t x, __y;
+	uint32_t srcWidth = j->srcWidth;
+	uint32_t strideY = j->strideY + j->dstWidth;
+	uint32_t strideUV = j->strideU + j->dstWidth;
+	uint8_t *dstY = j->dstY + y0 * strideY;
+	uint8_t *dstUV = j->dstU + (y0/2) * strideUV;
+	const uint8_t *srcY = j->srcY + y0 * srcWidth*2;
+
+	for (__y = y0; __y < y1; __y += 2)
+	{
+		// first line: Y and UV extraction
+		x = gDtsCopyOps.Yuy2ToNv12(dstY, dstUV, srcY, srcWidth, j->copyFlags);
+
+		for (; x + 1 < srcWidth; x += 2)
+		{
+			dstY [x+0] = srcY[x*2+0]; // Y
+			dstUV[x+0] = srcY[x*2+1]; // U
+			dstY [x+1] = srcY[x*2+2]; // Y
+			dstUV[x+1] = srcY[x*2+3]; // V
+		}
+		if (x < srcWidth)
+			dstY[x] = srcY[x*2];
+
+		srcY += srcWidth*2;
+		dstY += strideY;
+		dstUV += strideUV;
+
+		if (__y + 1 >= y1)
+			break;
+
+		// second line: just Y
+		x = gDtsCopyOps.Yuy2ToNv12(dstY, NULL, srcY, srcWidth, j->copyFlags);
+		for (; x < srcWidth; x++)
+			dstY[x] = srcY[x*2];
+
+		srcY += srcWidth*2;
+		dstY += strideY;
+	}
+}
+
+
+// split the NV12 chroma into separate U and V planes
+void DtsCopy420ToI420(const DTS_COPY_JOB *j, uint32_t y0, uint32_t y1)
+{
+	uint32_t x, __y;
+	uint32_t srcWidth = j->srcWidth;
+	uint32_t strideY = j->strideY + j->dstWidth;
+	uint32_t strideU = j->strideU + j->dstWidth/2;
+	uint32_t strideV = j->strideV + j->dstWidth/2;
+	uint8_t *dstY = j->dstY + y0 * strideY;
+	uint8_t *dstU = j->dstU + (y0/2) * strideU;
+	uint8_t *dstV = j->dstV + (y0/2) * strideV;
+	const uint8_t *srcY = j->srcY + y0 * srcWidth;
+	const uint8_t *srcUV = j->srcUV + (y0/2) * srcWidth;
+
+	for (__y = y0; __y < y1; __y++)
+	{
+		gDtsCopyOps.Memcpy(dstY, srcY, srcWidth, j->copyFlags);
+		dstY += strideY;
+		srcY += srcWidth;
+	}
+
+	// UV pairs split the same way YUY2 splits into Y and UV, an odd last
+	// line has a chroma line of its own
+	for (__y = y0/2; __y < (y1+1)/2; __y++)
+	{
+		x = gDtsCopyOps.Yuy2ToNv12(dstU, dstV, srcUV, srcWidth/2, j->copyFlags);
+		for (; x < srcWidth/2; x++)
+		{
+			dstU[x] = srcUV[x*2+0];
+			dstV[x] = srcUV[x*2+1];
+		}
+		srcUV += srcWidth;
+		dstU += strideU;
+		dstV += strideV;
+	}
+}
+
+void DtsCopy420ToYUY2(const DTS_COPY_JOB *j, uint32_t y0, uint32_t y1)
+{
+	uint32_t x, __y;
+	uint32_t srcWidth = j->srcWidth;
+	uint32_t height = j->height;
+	uint32_t strideY = j->strideY + j->dstWidth*2;
+	uint8_t *dstY = j->dstY + y0 * strideY;
+	const uint8_t *srcY = j->srcY + y0 * srcWidth;
+	const uint8_t *srcUV = j->srcUV + (y0/2) * srcWidth;
+
+	for (__y = y0; __y < y1; __y++)
+	{
+		// odd lines sit between two chroma lines, except the last one.
+		// Average them rounding up, as pavgb does.
+		const uint8_t *srcUV2 = ((__y & 1) && (__y + 1 < height)) ? srcUV + srcWidth : NULL;
+
+		x = gDtsCopyOps.Nv12ToYuy2(dstY, srcY, srcUV, srcUV2, srcWidth, j->copyFlags);
+
+		for (; x + 1 < srcWidth; x += 2)
+		{
+			dstY[x*2+0] = srcY[x+0];
+			dstY[x*2+1] = srcUV2 ? (srcUV[x+0] + srcUV2[x+0] + 1)/2 : srcUV[x+0];
+			dstY[x*2+2] = srcY[x+1];
+			dstY[x*2+3] = srcUV2 ? (srcUV[x+1] + srcUV2[x+1] + 1)/2 : srcUV[x+1];
+		}
+		// odd width, the last pixel only has room for its U
+		if (x < srcWidth)
+		{
+			dstY[x*2+0] = srcY[x];
+			dstY[x*2+1] = srcUV2 ? (srcUV[x] + srcUV2[x] + 1)/2 : srcUV[x];
+		}
+
+		srcY += srcWidth;
+		dstY += strideY;
+		if (__y & 1)
+			srcUV += srcWidth;
+	}
+}
+
+void DtsCopy420ToUYVY(const DTS_COPY_JOB *j, uint32_t y0, uint32_t y1)
+{
+	uint32_t x, __y;
+	uint32_t srcWidth = j->srcWidth;
+	uint32_t height = j->height;
+	uint32_t strideY = j->strideY + j->dstWidth*2;
+	uint8_t *dstY = j->dstY + y0 * strideY;
+	const uint8_t *srcY = j->srcY + y0 * srcWidth;
+	const uint8_t *srcUV = j->srcUV + (y0/2) * srcWidth;
+
+	for (__y = y0; __y < y1; __y++)
+	{
+		// chroma as in DtsCopy420ToYUY2
+		const uint8_t *srcUV2 = ((__y & 1) && (__y + 1 < height)) ? srcUV + srcWidth : NULL;
+
+		x = gDtsCopyOps.Nv12ToUyvy(dstY, srcY, srcUV, srcUV2, srcWidth, j->copyFlags);
+
+		for (; x + 1 < srcWidth; x += 2)
+		{
+			dstY[x*2+1] = srcY[x+0];
+			dstY[x*2+0] = srcUV2 ? (srcUV[x+0] + srcUV2[x+0] + 1)/2 : srcUV[x+0];
+			dstY[x*2+3] = srcY[x+1];
+			dstY[x*2+2] = srcUV2 ? (srcUV[x+1] + srcUV2[x+1] + 1)/2 : srcUV[x+1];
+		}
+		if (x < srcWidth)
+		{
+			dstY[x*2+1] = srcY[x];
+			dstY[x*2+0] = srcUV2 ? (srcUV[x] + srcUV2[x] + 1)/2 : srcUV[x];
+		}
+
+		srcY += srcWidth;
+		dstY += strideY;
+		if (__y & 1)
+			srcUV += srcWidth;
+	}
+}
+
+void DtsCopy420ToNV12(const DTS_COPY_JOB *j, uint32_t y0, uint32_t y1)
+{ // tested
+	uint32_t __y;
+	uint32_t srcWidth = j->srcWidth;
+	uint32_t strideY = j->strideY + j->dstWidth;
+	uint32_t strideUV = j->strideU + j->dstWidth;
+	uint8_t *dstY = j->dstY + y0 * strideY;
+	uint8_t *dstUV = j->dstU + (y0/2) * strideUV;
+	const uint8_t *srcY = j->srcY + y0 * srcWidth;
+	const uint8_t *srcUV = j->srcUV + (y0/2) * srcWidth;
+
+	// first copy Y
+	for (__y = y0; __y < y1; __y++)
+	{
+		gDtsCopyOps.Memcpy(dstY, srcY, srcWidth, j->copyFlags);
+		dstY += strideY;
+		srcY += srcWidth;
+	}
+
+	// now copy uvs, an odd last line has a chroma line of its own
+	for (__y = y0/2; __y < (y1+1)/2; __y++)
+	{
+		gDtsCopyOps.Memcpy(dstUV, srcUV, srcWidth, j->copyFlags);
+		srcUV += srcWidth;
+		dstUV += strideUV;
+
+	}
+}
+
+// three plane 420 as DtsCopyNV12ToYV12 wants it: widths as in
+// DtsCopyPlaneRows, dstWidth pixels out of rows srcWidth apart, and the
+// chroma planes share strideU
+void DtsCopy420ToYV12(const DTS_COPY_JOB *j, uint32_t y0, uint32_t y1)
+{
+	uint32_t x, __y;
+	uint32_t dstWidth = j->dstWidth;
+	uint32_t strideY = j->strideY + dstWidth;
+	uint32_t strideUV = j->strideU + dstWidth/2;
+	uint8_t *dstY = j->dstY + y0 * strideY;
+	uint8_t *dstU = j->dstU + (y0/2) * strideUV;
+	uint8_t *dstV = j->dstV + (y0/2) * strideUV;
+	const uint8_t *srcY = j->srcY + y0 * j->srcWidth;
+	const uint8_t *srcUV = j->srcUV + (y0/2) * j->srcWidth;
+
+	for (__y = y0; __y < y1; __y++)
+	{
+		gDtsCopyOps.Memcpy(dstY, srcY, dstWidth, j->copyFlags);
+		dstY += strideY;
+		srcY += j->srcWidth;
+	}
+
+	for (__y = y0/2; __y < (y1+1)/2; __y++)
+	{
+		x = gDtsCopyOps.Yuy2ToNv12(dstU, dstV, srcUV, dstWidth/2, j->copyFlags);
+		for (; x < dstWidth/2; x++)
+		{
+			dstU[x] = srcUV[x*2+0];
+			dstV[x] = srcUV[x*2+1];
+		}
+		srcUV += j->srcWidth;
+		dstU += strideUV;
+		dstV += strideUV;
+	}
+}
+
+
+// Scaling works on the source in place, a row at a time, so the full size
+// picture is never written out. tmp holds one vertically blended row.
+
+// horizontal taps for a srcW to dstW resample, bpp is 1 for Y and 2 for UV pairs
+static void DtsScaleTaps(DTS_SCALE_TAPS *taps, uint32_t srcW, uint32_t dstW, uint32_t bpp)
+{
+	uint32_t x, c, n = 0;
+	int32_t step = (int32_t)((srcW << 16) / dstW);
+	int32_t pos = step/2 - 0x8000;	// pixel centres line up
+
+	for (x = 0; x < dstW; x++, pos += step)
+	{
+		uint32_t p = (pos > 0) ? (uint32_t)pos : 0;
+		uint32_t sx = p >> 16;
+		uint32_t f = (p >> 8) & 0xff;
+		uint32_t sx1 = (sx + 1 < srcW) ? sx + 1 : sx;
+
+		for (c = 0; c < bpp; c++, n++)
+		{
+			taps->Off[n][0] = (uint16_t)(sx*bpp+c);
+			taps->Off[n][1] = (uint16_t)(sx1*bpp+c);
+			taps->Wt[n][0] = (int16_t)(256 - f);
+			taps->Wt[n][1] = (int16_t)f;
+		}
+	}
+}
+
+// output row y of a srcW x srcH plane scaled to dstW x dstH
+static void DtsScaleRow(uint8_t *dst, const uint8_t *src, uint32_t pitch, uint32_t srcW, uint32_t srcH,
+			uint32_t dstW, uint32_t dstH, uint32_t y, uint32_t bpp, uint8_t *tmp,
+			const DTS_SCALE_TAPS *taps)
+{
+	uint32_t x, n;
+	const uint8_t *row0, *row1;
+
+	if ((srcW == dstW*2) && (srcH == dstH*2)) {
+		// exactly half, 2x2 box
+		row0 = src + (y*2) * pitch;
+		row1 = row0 + pitch;
+		if (bpp == 1) {
+			x = gDtsCopyOps.Box2Row(dst, row0, row1, dstW);
+			for (; x < dstW; x++)
+				dst[x] = (row0[x*2] + row0[x*2+1] + row1[x*2] + row1[x*2+1] + 2) >> 2;
+		} else {
+			x = gDtsCopyOps.Box2RowUV(dst, row0, row1, dstW);
+			for (n = x*2; n < dstW*2; n++)
+				dst[n] = (row0[(n&~1)*2+(n&1)] + row0[(n&~1)*2+(n&1)+2] +
+					  row1[(n&~1)*2+(n&1)] + row1[(n&~1)*2+(n&1)+2] + 2) >> 2;
+		}
+		return;
+	}
+
+	// vertical step into tmp, or straight into dst when the width stays
+	{
+		uint32_t step = (srcH << 16) / dstH;
+		int32_t pos = (int32_t)(step * y + step/2) - 0x8000;
+		uint32_t p = (pos > 0) ? (uint32_t)pos : 0;
+		uint32_t sy = p >> 16;
+		uint32_t f = (p >> 8) & 0xff;
+		uint8_t *out = (srcW == dstW) ? dst : tmp;
+
+		row0 = src + sy * pitch;
+		row1 = (sy + 1 < srcH) ? row0 + pitch : row0;
+		if (f) {
+			n = srcW * bpp;
+			x = gDtsCopyOps.BlendRow(out, row0, row1, f, n);
+			for (; x < n; x++)
+				out[x] = (uint8_t)((row0[x] * (256 - f) + row1[x] * f + 128) >> 8);
+			row0 = out;
+		} else if (srcW == dstW) {
+			gDtsCopyOps.Memcpy(dst, row0, srcW * bpp, 0);
+		}
+	}
+
+	if (srcW != dstW) {
+		n = dstW * bpp;
+		x = gDtsCopyOps.ScaleRowH(dst, row0, taps, n);
+		for (; x < n; x++)
+			dst[x] = (uint8_t)((row0[taps->Off[x][0]] * taps->Wt[x][0] +
+					    row0[taps->Off[x][1]] * taps->Wt[x][1] + 128) >> 8);
+	}
+}
+
+// taps are only needed off the 2x2 box path and when the width changes
+static bool DtsScaleNeedTaps(uint32_t srcW, uint32_t srcH, uint32_t dstW, uint32_t dstH)
+{
+	return (srcW != dstW) && !((srcW == dstW*2) && (srcH == dstH*2));
+}
+
+void DtsScale420ToNV12(const DTS_COPY_JOB *j, uint32_t y0, uint32_t y1)
+{
+	uint32_t y;
+	uint8_t tmp[DTS_SCALE_MAX_WIDTH];
+	DTS_SCALE_TAPS taps;
+	uint32_t strideY = j->strideY + j->dstWidth;
+	uint32_t strideUV = j->strideU + j->dstWidth;
+
+	if (DtsScaleNeedTaps(j->srcWidth, j->srcHeight, j->dstWidth, j->height))
+		DtsScaleTaps(&taps, j->srcWidth, j->dstWidth, 1);
+	for (y = y0; y < y1; y++)
+		DtsScaleRow(j->dstY + y * strideY, j->srcY, j->srcWidth, j->srcWidth, j->srcHeight,
+			    j->dstWidth, j->height, y, 1, tmp, &taps);
+
+	// UV pairs, half the size both ways
+	if (DtsScaleNeedTaps(j->srcWidth/2, j->srcHeight/2, j->dstWidth/2, j->height/2))
+		DtsScaleTaps(&taps, j->srcWidth/2, j->dstWidth/2, 2);
+	for (y = y0/2; y < y1/2; y++)
+		DtsScaleRow(j->dstU + y * strideUV, j->srcUV, j->srcWidth, j->srcWidth/2, j->srcHeight/2,
+			    j->dstWidth/2, j->height/2, y, 2, tmp, &taps);
+}
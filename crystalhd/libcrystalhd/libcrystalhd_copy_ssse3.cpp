@@ -0,0 +1,104 @@
+/********************************************************************
+ * Copyright(c) 2006-2009 Broadcom Corporation.
+ *
+ *  Name: libcrystalhd_copy_ssse3.cpp
+ *
+ *  Description: SSSE3 picture copy kernels. Built with -mssse3 and only
+ *               called through gDtsCopyOps when the CPU has it.
+ *
+ *  AU
+ *
+ *  HISTORY:
+ *
+ ********************************************************************
+ *
+ * This file is part of libcrystalhd.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *******************************************************************/
+
+#include <tmmintrin.h>
+#include "libcrystalhd_copy.h"
+
+#define DTS_ALIGNED16(p)	((((uintptr_t)(p)) & 0xf) == 0)
+
+// Same streaming and head peeling as the SSE2 kernels
+static inline __m128i DtsLoad128(const uint8_t *src, bool aligned)
+{
+	if (aligned)
+		return _mm_load_si128((const __m128i *)src);
+	return _mm_loadu_si128((const __m128i *)src);
+}
+
+static inline void DtsStore128(uint8_t *dst, __m128i v, bool stream)
+{
+	if (stream)
+		_mm_stream_si128((__m128i *)dst, v);
+	else
+		_mm_storeu_si128((__m128i *)dst, v);
+}
+
+// swap the bytes of every Y/UV pair with one pshufb, 8 pixels at a time
+uint32_t DtsYuy2ToUyvySSSE3(uint8_t *dst, const uint8_t *src, uint32_t width, uint32_t flags)
+{
+	uint32_t x = 0;
+	const __m128i swap = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+	uint32_t start = DtsStreamStart(flags, DtsAlignPixel(dst, 2, 16), 8, width);
+	bool stream = (start == 0);
+	bool la = DTS_ALIGNED16(src);
+
+	while (x + 8 <= width)
+	{
+		_mm_prefetch((const char *)(src+x*2+DTS_PREFETCH_AHEAD), _MM_HINT_NTA);
+		__m128i v = DtsLoad128(src+x*2, la);
+		DtsStore128(dst+x*2, _mm_shuffle_epi8(v, swap), stream);
+		x += 8;
+		if (!stream && (start != DTS_NO_ALIGN)) {
+			x = start;
+			stream = true;
+			la = DTS_ALIGNED16(src+x*2);
+		}
+	}
+	return x;
+}
+
+// gather Y to the low and UV to the high half of each load, then combine halves
+uint32_t DtsYuy2ToNv12SSSE3(uint8_t *dstY, uint8_t *dstUV, const uint8_t *src, uint32_t width, uint32_t flags)
+{
+	uint32_t x = 0;
+	const __m128i split = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+	uint32_t start = DtsStreamStart(flags, DtsAlignPixel(dstY, 1, 16), 16, width);
+	bool stream, la = DTS_ALIGNED16(src);
+
+	if (dstUV && (start != DTS_NO_ALIGN) && !DTS_ALIGNED16(dstUV+start))
+		start = DTS_NO_ALIGN;
+	stream = (start == 0);
+
+	while (x + 16 <= width)
+	{
+		_mm_prefetch((const char *)(src+x*2+DTS_PREFETCH_AHEAD), _MM_HINT_NTA);
+		__m128i s1 = _mm_shuffle_epi8(DtsLoad128(src+x*2+ 0, la), split);
+		__m128i s2 = _mm_shuffle_epi8(DtsLoad128(src+x*2+16, la), split);
+
+		DtsStore128(dstY+x, _mm_unpacklo_epi64(s1, s2), stream); // store 16 Y
+		if (dstUV)
+			DtsStore128(dstUV+x, _mm_unpackhi_epi64(s1, s2), stream); // store 8 UV pairs
+		x += 16;
+		if (!stream && (start != DTS_NO_ALIGN)) {
+			x = start;
+			stream = true;
+			la = DTS_ALIGNED16(src+x*2);
+		}
+	}
+	return x;
+}
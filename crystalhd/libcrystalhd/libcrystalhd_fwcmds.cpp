@@ -61,7 +61,7 @@ DtsFWInitialize(
 
 	DTS_GET_CTX(hDevice,Ctx);
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, fwCmd)))
 		return BC_STS_INSUFF_RES;
 
 	vi = (C011CmdInit*)&pIocData->u.fwCmd.cmd;
@@ -116,7 +116,7 @@ DtsFWOpenChannel(
 		return BC_STS_ERR_USAGE;
 	}
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, fwCmd)))
 		return BC_STS_INSUFF_RES;
 
 	if (Ctx->DevId != BC_PCI_DEVID_FLEA)
@@ -227,7 +227,7 @@ DtsFWActivateDecoder(
 		return BC_STS_SUCCESS;
 	}
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, fwCmd)))
 		return BC_STS_INSUFF_RES;
 
 
@@ -277,7 +277,7 @@ DtsFWSetSingleField(
 		return BC_STS_DEC_NOT_OPEN;
 	}
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, fwCmd)))
 		return BC_STS_INSUFF_RES;
 
 
@@ -324,7 +324,7 @@ DtsFWHwSelfTest(
 
 	DTS_GET_CTX(hDevice,Ctx);
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, fwCmd)))
 		return BC_STS_INSUFF_RES;
 
 	stest = (C011CmdSelfTest *)&pIocData->u.fwCmd.cmd;
@@ -382,7 +382,7 @@ DtsFWVersion(
 		return BC_STS_INV_ARG;
 	}
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, fwCmd)))
 		return BC_STS_INSUFF_RES;
 
 	ver = (C011CmdGetVersion *)&pIocData->u.fwCmd.cmd;
@@ -439,7 +439,7 @@ DtsFWFifoStatus(
 		return BC_STS_INV_ARG;
 	}
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, fwCmd)))
 		return BC_STS_INSUFF_RES;
 
 	pCmd = (DecCmdChannelStatus *)&pIocData->u.fwCmd.cmd;
@@ -489,7 +489,7 @@ DtsFWCloseChannel(
 		return BC_STS_SUCCESS;
 	}
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, fwCmd)))
 		return BC_STS_INSUFF_RES;
 
 	pCmd  = ((DecCmdChannelClose*)&pIocData->u.fwCmd.cmd);
@@ -541,7 +541,7 @@ DtsFWSetVideoInput(
 		return BC_STS_DEC_NOT_OPEN;
 	}
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, fwCmd)))
 		return BC_STS_INSUFF_RES;
 
 	vi = (DecCmdChannelSetInputParams*)&pIocData->u.fwCmd.cmd;
@@ -585,7 +585,7 @@ DtsFWSetVideoPID(
 		return BC_STS_DEC_NOT_OPEN;
 	}
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, fwCmd)))
 		return BC_STS_INSUFF_RES;
 
 	spid = (DecCmdChannelSetTSPIDs*)&pIocData->u.fwCmd.cmd;
@@ -633,7 +633,7 @@ DtsFWFlushDecoder(
 		return BC_STS_DEC_NOT_OPEN;
 	}
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, fwCmd)))
 		return BC_STS_INSUFF_RES;
 
 	fl = (DecCmdChannelFlush *)&pIocData->u.fwCmd.cmd;
@@ -685,7 +685,7 @@ DtsFWStartVideo(
 		return BC_STS_DEC_NOT_OPEN;
 	}
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, fwCmd)))
 		return BC_STS_INSUFF_RES;
 
 	sVid = (DecCmdChannelStartVideo *)&pIocData->u.fwCmd.cmd;
@@ -769,7 +769,7 @@ DtsFWStopVideo(
 		return BC_STS_DEC_NOT_STARTED;
 	}
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, fwCmd)))
 		return BC_STS_INSUFF_RES;
 
 	sVid = (DecCmdChannelStopVideo *)&pIocData->u.fwCmd.cmd;
@@ -826,7 +826,7 @@ DtsFWDecFlushChannel(
 	if( (Operation <0) || (Operation > 2) )
 		return BC_STS_INV_ARG;
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, fwCmd)))
 		return BC_STS_INSUFF_RES;
 
 	cFlush = (DecCmdChannelFlush *)&pIocData->u.fwCmd.cmd;
@@ -892,7 +892,7 @@ DtsFWPauseVideo(
 		return BC_STS_DEC_NOT_STARTED;
 	}
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, fwCmd)))
 		return BC_STS_INSUFF_RES;
 
 	cPause = (DecCmdChannelPause *)&pIocData->u.fwCmd.cmd;
@@ -938,7 +938,7 @@ DtsFWSetTrickPlay(
 
 	DTS_GET_CTX(hDevice,Ctx);
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, fwCmd)))
 		return BC_STS_INSUFF_RES;
 
 	cTrickPlay = (DecCmdChannelTrickPlay *)&pIocData->u.fwCmd.cmd;
@@ -989,7 +989,7 @@ DtsFWSetHostTrickMode(
 	if (Ctx->DevId == BC_PCI_DEVID_FLEA)
 		return BC_STS_SUCCESS;
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, fwCmd)))
 		return BC_STS_INSUFF_RES;
 
 	cHostTrickMode = (DecCmdChannelSetHostTrickMode *)&pIocData->u.fwCmd.cmd;
@@ -1034,7 +1034,7 @@ DtsFWSetFFRate(
 
 	DTS_GET_CTX(hDevice,Ctx);
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, fwCmd)))
 		return BC_STS_INSUFF_RES;
 
 	cFFRate = (DecCmdChannelSetFFRate *)&pIocData->u.fwCmd.cmd;
@@ -1082,7 +1082,7 @@ DtsFWSetSlowMotionRate(
 	if (Ctx->DevId == BC_PCI_DEVID_FLEA)
 		return BC_STS_SUCCESS;
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, fwCmd)))
 		return BC_STS_INSUFF_RES;
 
 	cSMRate = (DecCmdChannelSetSlowMotionRate *)&pIocData->u.fwCmd.cmd;
@@ -1127,7 +1127,7 @@ DtsFWSetSkipPictureMode(
 
 	DTS_GET_CTX(hDevice,Ctx);
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, fwCmd)))
 		return BC_STS_INSUFF_RES;
 
 	cSkipPictureMode = (DecCmdChannelSetSkipPictureMode *)&pIocData->u.fwCmd.cmd;
@@ -1171,7 +1171,7 @@ DtsFWFrameAdvance(
 
 	DTS_GET_CTX(hDevice,Ctx);
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, fwCmd)))
 		return BC_STS_INSUFF_RES;
 
 	cFrameAdvance = (DecCmdChannelFrameAdvance *)&pIocData->u.fwCmd.cmd;
@@ -1220,7 +1220,7 @@ DtsFWSetContentKeys(
 		return BC_STS_INV_ARG;
 	}
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, fwCmd)))
 		return BC_STS_INSUFF_RES;
 
 	cKeys = (DecCmdSetContentKey *)&pIocData->u.fwCmd.cmd;
@@ -1274,7 +1274,7 @@ DtsFWSetSessionKeys(
 		return BC_STS_INV_ARG;
 	}
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, fwCmd)))
 		return BC_STS_INSUFF_RES;
 
 	sKey = (DecCmdSetSessionKey *)&pIocData->u.fwCmd.cmd;
@@ -1314,7 +1314,7 @@ DtsFormatChangeAck(HANDLE hDevice, uint32_t flags)
 	BC_IOCTL_DATA				*pIocData = NULL;
 
 	DTS_GET_CTX(hDevice,Ctx);
-	if (!(pIocData = DtsAllocIoctlData(Ctx)))
+	if (!(pIocData = DtsAllocIoctlDataFor(Ctx, fwCmd)))
 		return BC_STS_INSUFF_RES;
 
 	Ack = (DecCmdFormatChangeAck *) &pIocData->u.fwCmd.cmd;
@@ -1368,7 +1368,7 @@ DtsFWDrop(
 		DebugLog_Trace(LDIL_DBG,"DtsFWDrop: Channel is not Start\n");
 		return BC_STS_DEC_NOT_STARTED;
 	}
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, fwCmd)))
 		return BC_STS_INSUFF_RES;
 
 	cDrop = (DecCmdChannelDrop *)&pIocData->u.fwCmd.cmd;
@@ -41,6 +41,7 @@
 #include "libcrystalhd_int_if.h"
 #include "libcrystalhd_fwcmds.h"
 #include "libcrystalhd_fwload_if.h"
+#include "libcrystalhd_copy.h"
 
 #if (!__STDC_WANT_SECURE_LIB__)
 inline bool memcpy_s(void *dest, size_t sizeInBytes, void *src, size_t count)
@@ -414,6 +415,7 @@ DtsDeviceOpen(
 		DIL_MAJOR_VERSION,DIL_MINOR_VERSION,DIL_REVISION );
 
 	processID = getpid();
+	*hDevice = NULL;
 
 	FixFlags = mode;
 	mode &= 0xFF;
@@ -449,6 +451,14 @@ DtsDeviceOpen(
 		globMode = DtsGetOPMode();
 	}
 
+	/* The driver refuses a second playback handle, say so before opening */
+	if( ((mode == DTS_PLAYBACK_MODE) || (mode == DTS_DIAG_MODE)) &&
+		(DtsProcHandles(DTS_PLAYBACK_MODE) || DtsProcHandles(DTS_DIAG_MODE)) ){
+		DebugLog_Trace(LDIL_ERR,"DtsDeviceOpen: Only one playback handle at a time\n");
+		DtsDelDilShMem();
+		return BC_STS_DEC_EXIST_OPEN;
+	}
+
 	if (mode == DTS_HWINIT_MODE)
 		DtsSetHwInitSts(BC_DIL_HWINIT_IN_PROGRESS);
 
@@ -464,14 +474,16 @@ DtsDeviceOpen(
 	/* Initialize Internal Driver interfaces.. */
 	if( (Sts = DtsInitInterface(drvHandle,hDevice, mode)) != BC_STS_SUCCESS){
 		DebugLog_Trace(LDIL_ERR,"DtsDeviceOpen: Interface Init Failed:%x\n",Sts);
-		DtsReleaseInterface(DtsGetContext(*hDevice));
-		DtsDelDilShMem();
+		/* Releasing the context drops its hold on the shared area */
+		if(DtsReleaseInterface(DtsGetContext(*hDevice)) != BC_STS_SUCCESS){
+			close(drvHandle);
+			DtsDelDilShMem();
+		}
 		return Sts;
 	}
 	if( (Sts = DtsGetHwType(*hDevice,&DeviceID,&VendorID,&RevID))!=BC_STS_SUCCESS){
 		DebugLog_Trace(LDIL_DBG,"Get Hardware Type Failed\n");
 		DtsReleaseInterface(DtsGetContext(*hDevice));
-		DtsDelDilShMem();
 		return Sts;
 	}
 
@@ -494,9 +506,12 @@ DtsDeviceOpen(
 	if ((Sts = DtsGetVersion(*hDevice, &drvVer, &dilVer)) != BC_STS_SUCCESS) {
 		DebugLog_Trace(LDIL_DBG,"Get drv ver failed\n");
 		DtsReleaseInterface(DtsGetContext(*hDevice));
-		DtsDelDilShMem();
 		return Sts;
 	}
+	/* Blocking fetch with cancel and poll */
+	DtsGetContext(*hDevice)->DrvFetchWait = ((drvVer & 0xFFFF0000) >=
+			BC_DRV_VERSION(BC_DRV_MAJOR_FETCH_WAIT, BC_DRV_MINOR_FETCH_WAIT));
+
 	/* If driver minor version is more than 13, enable DTS_SKIP_TX_CHK_CPB feature */
 	if (FixFlags & DTS_SKIP_TX_CHK_CPB) {
 		if (((drvVer >> 16) & 0xFF) > 13)
@@ -530,10 +545,15 @@ DtsDeviceOpen(
 	else
 		drvMode = FixFlags;
 
+	/* Library only flags stay out of the driver's mode */
+	drvMode &= ~DTS_INPUT_IN_PLACE;
+
 	if( (Sts = DtsNotifyOperatingMode(*hDevice,drvMode)) != BC_STS_SUCCESS){
 		DebugLog_Trace(LDIL_DBG,"Notify Operating Mode Failed\n");
 		DtsReleaseInterface(DtsGetContext(*hDevice));
-		DtsDelDilShMem();
+		/* Playback handle of a process that does not share our area */
+		if((Sts == BC_STS_ERR_USAGE) && ((mode == DTS_PLAYBACK_MODE) || (mode == DTS_DIAG_MODE)))
+			Sts = BC_STS_DEC_EXIST_OPEN;
 		return Sts;
 	}
 
@@ -583,8 +603,6 @@ DtsDeviceOpen(
 		if(Sts != BC_STS_SUCCESS )
 		{
 			DtsReleaseInterface(DtsGetContext(*hDevice));
-	DebugLog_Trace(LDIL_DBG,"RB3 voor del seg\n");
-			DtsDelDilShMem();
 			goto exit;
 		}
 	}
@@ -621,12 +639,15 @@ DtsDeviceClose(
 	if (!DtsChkPID(Ctx->ProcessID))
 		return BC_STS_ERROR;
 
+	/* Hand its buffers back before the decoder goes away */
+	DtsStopAsyncOut(Ctx);
+
 	if(Ctx->State != BC_DEC_STATE_CLOSE){
 		DtsCloseDecoder(hDevice);
 	}
 
 	DtsCancelFetchOutInt(Ctx);
-	/* Unmask the mode */
+	/* Unmask the mode, unless another handle of this process has it */
 	globMode = DtsGetOPMode( );
 
 	// Make sure we are in playback mode before freeing up playback resources
@@ -635,7 +656,9 @@ DtsDeviceClose(
 		DtsFlushRxCapture(hDevice,false); // Make sure that all buffers and DMA engines are freed up
 	}
 
-	if(Ctx->OpMode == DTS_PLAYBACK_MODE){
+	if(DtsProcHandles(Ctx->OpMode) > 1){
+		/* Still in use */
+	} else if(Ctx->OpMode == DTS_PLAYBACK_MODE){
 		globMode &= (~0x1);
 	} else if(Ctx->OpMode == DTS_DIAG_MODE){
 		globMode &= (~0x2);
@@ -668,7 +691,7 @@ DtsGetVersion(
 
 	DTS_GET_CTX(hDevice,Ctx);
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, VerInfo)))
 		return BC_STS_INSUFF_RES;
 
 	pVerInfo = 	&pIocData->u.VerInfo;
@@ -858,6 +881,9 @@ DtsOpenDecoder(
 	Ctx->CapState = 0;
 	Ctx->hw_paused = false;
 	Ctx->fw_cmd_issued = false;
+	// Size the TX ring for the new stream before its first input
+	Ctx->txBufResize = true;
+	Ctx->MDReorderWindow = DtsMdataReorderWindow(Ctx);
 
 	sts = DtsSetVideoClock(hDevice,0);
 	if (sts != BC_STS_SUCCESS)
@@ -1321,7 +1347,7 @@ DtsStartCaptureImmidiate(HANDLE		hDevice,
 	if (!DtsChkPID(Ctx->ProcessID))
 		return BC_STS_ERROR;
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, RxCap)))
 		return BC_STS_INSUFF_RES;
 
 	if(Ctx->CfgFlags & BC_ADDBUFF_MOVE){
@@ -1374,7 +1400,7 @@ DtsStartCapture(HANDLE  hDevice)
 		return BC_STS_DEC_NOT_STARTED;
 	}
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, RxCap)))
 		return BC_STS_INSUFF_RES;
 
 	if(Ctx->CfgFlags & BC_ADDBUFF_MOVE){
@@ -1432,7 +1458,7 @@ DtsFlushRxCapture(
 		return BC_STS_DEC_NOT_OPEN;
 	}
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, FlushRxCap)))
 		return BC_STS_INSUFF_RES;
 
 	pIocData->u.FlushRxCap.bDiscardOnly = bDiscardOnly;
@@ -1465,6 +1491,7 @@ DtsProcOutput(
 	BC_STATUS	stRel,sts = BC_STS_SUCCESS;
 	BC_DTS_PROC_OUT OutBuffs;
 	uint32_t	width=0, savFlags=0;
+	uint64_t	trStart;
 
 	DTS_LIB_CONTEXT		*Ctx = NULL;
 
@@ -1583,6 +1610,7 @@ DtsProcOutput(
 				return sts;
 			}
 			pOut->DropFrames--;
+			DTS_STAT_ADD(Ctx->Counters.Dropped, 1);
 
 			/* Get back the original flags */
 			pOut->PoutFlags = savFlags;
@@ -1618,7 +1646,10 @@ DtsProcOutput(
 					&OutBuffs);
 	}
 
-	if (pOut->PoutFlags & BC_POUT_FLAGS_MODE) {
+	trStart = DTS_TRACE_BEGIN(Ctx);
+	if (pOut->PoutFlags & (BC_POUT_FLAGS_MODE | BC_POUT_FLAGS_SCALE)) {
+		if (!(pOut->PoutFlags & BC_POUT_FLAGS_MODE))
+			pOut->b422Mode = Ctx->b422Mode;
 		sts = DtsCopyFormat(Ctx,pOut,&OutBuffs);
 	} else {
 		pOut->b422Mode = Ctx->b422Mode;
@@ -1632,6 +1663,7 @@ DtsProcOutput(
 			}
 		}
 	}
+	DTS_TRACE(Ctx, DTS_TR_COPY, trStart, OutBuffs.PicInfo.timeStamp, OutBuffs.PicInfo.picture_number);
 
 	if(pOut->PoutFlags & BC_POUT_FLAGS_PIB_VALID){
 		pOut->PicInfo = OutBuffs.PicInfo;
@@ -1737,6 +1769,7 @@ DtsProcOutputNoCopy(
 				return sts;
 			}
 			pOut->DropFrames--;
+			DTS_STAT_ADD(Ctx->Counters.Dropped, 1);
 		}
 		else
 			break;
@@ -1763,6 +1796,196 @@ DtsReleaseOutputBuffs(
 	return DtsRelRxBuff(Ctx, &Ctx->pOutData->u.RxBuffs, FALSE);
 }
 
+DRVIFLIB_API BC_STATUS
+DtsGetOutBuffReq(
+    HANDLE  hDevice,
+	uint32_t *pBuffSz,
+	uint32_t *pUVOffset)
+{
+	DTS_LIB_CONTEXT		*Ctx = NULL;
+
+	DTS_GET_CTX(hDevice,Ctx);
+
+	if(!pBuffSz || !pUVOffset)
+		return BC_STS_INV_ARG;
+
+	DtsGetRxBuffReq(Ctx, pBuffSz, pUVOffset);
+
+	return BC_STS_SUCCESS;
+}
+
+DRVIFLIB_API BC_STATUS
+DtsRegisterOutBuffs(
+    HANDLE  hDevice,
+	BC_DTS_OUT_BUFF *pBuffs,
+	uint32_t nBuffs)
+{
+	DTS_LIB_CONTEXT		*Ctx = NULL;
+
+	DTS_GET_CTX(hDevice,Ctx);
+
+	if (!DtsChkPID(Ctx->ProcessID))
+		return BC_STS_ERROR;
+
+	/* The async output thread owns the buffers until it is stopped */
+	if(Ctx->AsyncOut)
+		return BC_STS_BUSY;
+
+	return DtsSetOutBuffPool(Ctx, pBuffs, nBuffs);
+}
+
+DRVIFLIB_API BC_STATUS
+DtsProcOutputZeroCopy(
+    HANDLE  hDevice,
+	uint32_t		milliSecWait,
+	BC_DTS_PROC_OUT *pOut,
+	uint32_t	*pBuffIdx)
+{
+	BC_STATUS	sts;
+	DTS_LIB_CONTEXT		*Ctx = NULL;
+
+	DTS_GET_CTX(hDevice,Ctx);
+
+	if(!pOut || !pBuffIdx)
+		return BC_STS_INV_ARG;
+
+	if(!DtsHasAppOutBuffs(Ctx)){
+		DebugLog_Trace(LDIL_DBG,"DtsProcOutputZeroCopy: No registered buffers\n");
+		return BC_STS_ERR_USAGE;
+	}
+
+	if((sts = DtsProcOutputNoCopy(hDevice, milliSecWait, pOut)) != BC_STS_SUCCESS)
+		return sts;
+
+	/* Rows are as far apart as the hardware wrote them */
+	if((pOut->PoutFlags & BC_POUT_FLAGS_PIB_VALID) && (Ctx->HWOutPicWidth >= pOut->PicInfo.width)){
+		pOut->StrideSz = Ctx->HWOutPicWidth - pOut->PicInfo.width;
+		pOut->PoutFlags |= BC_POUT_FLAGS_STRIDE;
+	}
+
+	return DtsTakeOutBuff(Ctx, pBuffIdx);
+}
+
+DRVIFLIB_API BC_STATUS
+DtsReleaseOutBuff(
+    HANDLE  hDevice,
+	uint32_t	BuffIdx)
+{
+	DTS_LIB_CONTEXT		*Ctx = NULL;
+
+	DTS_GET_CTX(hDevice,Ctx);
+
+	return DtsGiveOutBuff(Ctx, BuffIdx);
+}
+
+DRVIFLIB_API BC_STATUS
+DtsInterruptProcOutput(
+    HANDLE  hDevice)
+{
+	DTS_LIB_CONTEXT		*Ctx = NULL;
+
+	DTS_GET_CTX(hDevice,Ctx);
+
+	if(Ctx->DrvFetchWait)
+		return DtsDrvCmd(Ctx,BCM_IOC_CANCEL_FETCH,0,NULL,FALSE);
+
+	/* Seen by the fetch within the driver's own wait */
+	__sync_lock_test_and_set(&Ctx->FetchInterrupt, 1);
+	return BC_STS_SUCCESS;
+}
+
+DRVIFLIB_API BC_STATUS
+DtsGetOutputFd(
+    HANDLE  hDevice,
+	int		*pFd)
+{
+	DTS_LIB_CONTEXT		*Ctx = NULL;
+
+	DTS_GET_CTX(hDevice,Ctx);
+
+	if(!pFd)
+		return BC_STS_INV_ARG;
+
+	if(!Ctx->DrvFetchWait)
+		return BC_STS_NOT_IMPL;
+
+	*pFd = Ctx->DevHandle;
+	return BC_STS_SUCCESS;
+}
+
+DRVIFLIB_API BC_STATUS
+DtsStartAsyncOutput(
+    HANDLE  hDevice,
+	uint32_t	QueueDepth,
+	dts_completion_callback CallBack,
+	void	*CbContext)
+{
+	DTS_LIB_CONTEXT		*Ctx = NULL;
+
+	DTS_GET_CTX(hDevice,Ctx);
+
+	if (!DtsChkPID(Ctx->ProcessID))
+		return BC_STS_ERROR;
+
+	if(!DtsHasAppOutBuffs(Ctx)){
+		DebugLog_Trace(LDIL_DBG,"DtsStartAsyncOutput: No registered buffers\n");
+		return BC_STS_ERR_USAGE;
+	}
+
+	return DtsStartAsyncOut(Ctx, QueueDepth, CallBack, CbContext);
+}
+
+DRVIFLIB_API BC_STATUS
+DtsGetCompletions(
+    HANDLE  hDevice,
+	BC_DTS_COMPLETION *pComp,
+	uint32_t	MaxCount,
+	uint32_t	milliSecWait,
+	uint32_t	*pCount)
+{
+	DTS_LIB_CONTEXT		*Ctx = NULL;
+
+	DTS_GET_CTX(hDevice,Ctx);
+
+	if(!pComp || !MaxCount || !pCount)
+		return BC_STS_INV_ARG;
+
+	return DtsGetCompletionsInt(Ctx, pComp, MaxCount, milliSecWait, pCount);
+}
+
+DRVIFLIB_API BC_STATUS
+DtsStopAsyncOutput(
+    HANDLE  hDevice)
+{
+	DTS_LIB_CONTEXT		*Ctx = NULL;
+
+	DTS_GET_CTX(hDevice,Ctx);
+
+	DtsStopAsyncOut(Ctx);
+	return BC_STS_SUCCESS;
+}
+
+//------------------------------------------------------------------------
+// Name: DtsReserveTxData
+// Description: Wait for and reserve space in the TX ring. The caller fills
+//              it in with txBufWrite() and publishes it with txBufCommit().
+//------------------------------------------------------------------------
+static BC_STATUS
+DtsReserveTxData(DTS_LIB_CONTEXT *Ctx, uint32_t ulSizeInBytes)
+{
+	if(ulSizeInBytes > Ctx->circBuf.totalSize)
+		return BC_STS_INV_ARG;
+
+	// Wait for the TX thread to free up enough space. It wakes us as soon as
+	// it consumes data, the timeout is only there to re-check the decoder state.
+	while(txBufReserve(&Ctx->circBuf, ulSizeInBytes) != BC_STS_SUCCESS) {
+		txBufWaitSpace(&Ctx->circBuf, ulSizeInBytes, 5);
+		if (Ctx->State !=  BC_DEC_STATE_START && Ctx->State != BC_DEC_STATE_PAUSE)
+			return BC_STS_IO_USER_ABORT;
+	}
+	return BC_STS_SUCCESS;
+}
+
 DRVIFLIB_INT_API BC_STATUS
 DtsSendData( HANDLE  hDevice ,
 				 uint8_t *pUserData,
@@ -1772,16 +1995,20 @@ DtsSendData( HANDLE  hDevice ,
 			    )
 {
 	DTS_LIB_CONTEXT		*Ctx = NULL;
+	BC_STATUS	sts;
 
 	DTS_GET_CTX(hDevice,Ctx);
 
-	// for now check the sizes here and wait if there is not enough space
-	while(ulSizeInBytes > Ctx->circBuf.freeSize) {
-		usleep(5 * 1000);
-		if (Ctx->State !=  BC_DEC_STATE_START && Ctx->State != BC_DEC_STATE_PAUSE)
-			return BC_STS_IO_USER_ABORT;
-	}
-	return txBufPush(&Ctx->circBuf, pUserData, ulSizeInBytes);
+	if(!pUserData)
+		return BC_STS_INV_ARG;
+
+	if((sts = DtsReserveTxData(Ctx, ulSizeInBytes)) != BC_STS_SUCCESS)
+		return sts;
+
+	txBufWrite(&Ctx->circBuf, 0, pUserData, ulSizeInBytes);
+	txBufCommit(&Ctx->circBuf, ulSizeInBytes);
+
+	return BC_STS_SUCCESS;
 }
 
 DRVIFLIB_API uint32_t
@@ -1791,7 +2018,129 @@ DtsTxFreeSize( HANDLE hDevice )
 
 	DTS_GET_CTX(hDevice,Ctx);
 
-	return Ctx->circBuf.freeSize;
+	return txBufFreeSize(&Ctx->circBuf);
+}
+
+DRVIFLIB_API BC_STATUS
+DtsSetTxBufferSize( HANDLE hDevice, uint32_t size )
+{
+	DTS_LIB_CONTEXT                *Ctx = NULL;
+
+	DTS_GET_CTX(hDevice,Ctx);
+
+	if (size && ((size < TX_BUF_MIN_SIZE) || (size > TX_BUF_MAX_SIZE) || (size & (TX_BUF_ALIGN - 1))))
+		return BC_STS_INV_ARG;
+
+	/* DtsOpenDecoder sizes the ring, it must not change under queued input */
+	if (Ctx->State != BC_DEC_STATE_CLOSE)
+		return BC_STS_BUSY;
+
+	Ctx->txBufSizeReq = size;
+
+	return BC_STS_SUCCESS;
+}
+
+DRVIFLIB_API BC_STATUS
+DtsGetTxBufferStats( HANDLE hDevice, BC_DTS_TXBUF_STATS *pStats, BOOL bReset )
+{
+	DTS_LIB_CONTEXT                *Ctx = NULL;
+
+	DTS_GET_CTX(hDevice,Ctx);
+
+	if (!pStats)
+		return BC_STS_INV_ARG;
+
+	pStats->RingSize = Ctx->circBuf.totalSize;
+	pStats->BusySize = txBufBusySize(&Ctx->circBuf);
+	pStats->HighWater = Ctx->circBuf.highWater;
+	pStats->FullWaits = Ctx->circBuf.fullWaits;
+	pStats->StreamSize = DtsTxBufSizeForStream(Ctx);
+
+	if (bReset) {
+		Ctx->circBuf.highWater = 0;
+		Ctx->circBuf.fullWaits = 0;
+	}
+
+	return BC_STS_SUCCESS;
+}
+
+DRVIFLIB_API BC_STATUS
+DtsGetDecodeStats( HANDLE hDevice, BC_DTS_DEC_STATS *pStats, BOOL bReset )
+{
+	DTS_LIB_CONTEXT                *Ctx = NULL;
+	DTS_DEC_COUNTERS               *c;
+	BC_DTS_DEC_STATS               *base, now;
+	uint32_t i;
+
+	DTS_GET_CTX(hDevice,Ctx);
+
+	if (!pStats)
+		return BC_STS_INV_ARG;
+
+	c = &Ctx->Counters;
+	base = &Ctx->StatsBase;
+
+	/* Each counter is read on its own, no ioctl and no lock */
+	now.InUnits = DTS_STAT_GET(c->InUnits);
+	now.InBytes = DTS_STAT_GET(c->InBytes);
+	now.TxBytes = DTS_STAT_GET(c->TxBytes);
+	now.OutFrames = DTS_STAT_GET(c->OutFrames);
+	now.Dropped = DTS_STAT_GET(c->Dropped);
+	now.Repeated = DTS_STAT_GET(c->Repeated);
+	now.PibMisses = DTS_STAT_GET(c->PibMisses);
+	now.MdataEvicted = DTS_STAT_GET(Ctx->MDEvictCnt);
+	for (i = 0; i < BC_DTS_LAT_BUCKETS; i++)
+		now.FetchLatency[i] = DTS_STAT_GET(c->FetchLatency[i]);
+
+	pStats->InUnits = now.InUnits - base->InUnits;
+	pStats->InBytes = now.InBytes - base->InBytes;
+	pStats->TxBytes = now.TxBytes - base->TxBytes;
+	pStats->OutFrames = now.OutFrames - base->OutFrames;
+	pStats->Dropped = now.Dropped - base->Dropped;
+	pStats->Repeated = now.Repeated - base->Repeated;
+	pStats->PibMisses = now.PibMisses - base->PibMisses;
+	pStats->MdataEvicted = now.MdataEvicted - base->MdataEvicted;
+	for (i = 0; i < BC_DTS_LAT_BUCKETS; i++)
+		pStats->FetchLatency[i] = now.FetchLatency[i] - base->FetchLatency[i];
+
+	pStats->RingSize = Ctx->circBuf.totalSize;
+	pStats->RingBusy = txBufBusySize(&Ctx->circBuf);
+	pStats->RingHighWater = Ctx->circBuf.highWater;
+	pStats->Reserved = 0;
+
+	/* The writers never see a reset, the next read counts from here */
+	if (bReset)
+		*base = now;
+
+	return BC_STS_SUCCESS;
+}
+
+DRVIFLIB_API BC_STATUS
+DtsSetTrace( HANDLE hDevice, uint32_t Depth )
+{
+	DTS_LIB_CONTEXT                *Ctx = NULL;
+
+	DTS_GET_CTX(hDevice,Ctx);
+
+	if (!Depth) {
+		DtsTraceStop(Ctx);
+		return BC_STS_SUCCESS;
+	}
+
+	return DtsTraceStart(Ctx, Depth);
+}
+
+DRVIFLIB_API BC_STATUS
+DtsDumpTrace( HANDLE hDevice, const char *FileName )
+{
+	DTS_LIB_CONTEXT                *Ctx = NULL;
+
+	DTS_GET_CTX(hDevice,Ctx);
+
+	if (!FileName)
+		return BC_STS_INV_ARG;
+
+	return DtsTraceDump(Ctx, FileName);
 }
 
 DRVIFLIB_API BC_STATUS
@@ -1876,14 +2225,12 @@ DtsAlignSendData( HANDLE  hDevice ,
 {
 	BC_STATUS	sts = BC_STS_SUCCESS;
 	DTS_LIB_CONTEXT		*Ctx = NULL;
-	uint8_t	oddBytes = 0;
 
-	uint8_t* alignBuf;
+	// PES header is built here and goes into the TX ring along with the payload
+	uint8_t pesHdr[9 + 0xFF];
 
 	DTS_GET_CTX(hDevice,Ctx);
 
-	alignBuf = Ctx->alignBuf;
-
 	uint32_t ulRestBytes = ulSizeInBytes;
 	uint32_t ulDeliverBytes = 0;
 	uint32_t ulPktLength;
@@ -1927,9 +2274,6 @@ DtsAlignSendData( HANDLE  hDevice ,
 			continue;
 		}
 
-		/* Copy the non-DWORD aligned buffer first */
-		oddBytes = (uint8_t)((uintptr_t)pDeliverBuf % 4);
-
 		if (Ctx->VidParams.StreamType == BC_STREAM_TYPE_ES)
 		{
 			// SPES Mode
@@ -1940,16 +2284,9 @@ DtsAlignSendData( HANDLE  hDevice ,
 			}
 			timeStamp = 0;
 
-			if(oddBytes)
-			{
-				if (ulRestBytes > ALIGN_BUF_SIZE)
-					ulDeliverBytes = ALIGN_BUF_SIZE - oddBytes;
-				else
-					ulDeliverBytes = ulRestBytes;
-
-				memcpy(alignBuf, pDeliverBuf, ulDeliverBytes);
-				pDeliverBuf = alignBuf;
-			}
+			// The TX ring takes care of alignment, just keep each push well within it
+			if (ulDeliverBytes > Ctx->circBuf.totalSize / 2)
+				ulDeliverBytes = Ctx->circBuf.totalSize / 2;
 			ulUsedDataBytes = ulDeliverBytes;
 		}
 		else if (Ctx->VidParams.StreamType == BC_STREAM_TYPE_PES)
@@ -1986,39 +2323,39 @@ DtsAlignSendData( HANDLE  hDevice ,
 			ulDeliverBytes = ulPktLength + 6;
 
 
-			memcpy(alignBuf,(uint8_t *)b_pes_header, 9);
-			*((uint16_t *)(alignBuf + 4)) = WORD_SWAP((uint16_t)ulPktLength);
-			*(alignBuf + 8) = (uint8_t)ulPktHeaderSz;
+			memcpy(pesHdr,(uint8_t *)b_pes_header, 9);
+			*((uint16_t *)(pesHdr + 4)) = WORD_SWAP((uint16_t)ulPktLength);
+			*(pesHdr + 8) = (uint8_t)ulPktHeaderSz;
 
 			j = 9;
 			if (bAddPTS)
 			{
-				*(alignBuf + 7) = 0x80;
-				PTS2MakerBit5Bytes(alignBuf + j, timeStamp);
+				*(pesHdr + 7) = 0x80;
+				PTS2MakerBit5Bytes(pesHdr + j, timeStamp);
 				j += 5;
 			}
 
 			if (bPrivData || bExtData)
 			{
-				*(alignBuf + 7) |= 0x01;
-			    *(alignBuf + j) = 0x00;
+				*(pesHdr + 7) |= 0x01;
+			    *(pesHdr + j) = 0x00;
 				if (bPrivData)
-					*(alignBuf + j) |= 0x80;
+					*(pesHdr + j) |= 0x80;
 				if (bExtData)
-					*(alignBuf + j) |= 0x01;
+					*(pesHdr + j) |= 0x01;
 				j++;
 			}
 
 			if (bPrivData)
 			{
-				memcpy(alignBuf + j, pPrivData, 16);
+				memcpy(pesHdr + j, pPrivData, 16);
 				j += 16;
 			}
 			if (bExtData)
 			{
-				*(alignBuf + j) = 0x80 | nExtDataLen;
+				*(pesHdr + j) = 0x80 | nExtDataLen;
 				j++;
-				memcpy(alignBuf + j, pExtData, nExtDataLen);
+				memcpy(pesHdr + j, pExtData, nExtDataLen);
 				j += nExtDataLen;
 			}
 
@@ -2026,17 +2363,27 @@ DtsAlignSendData( HANDLE  hDevice ,
 			{
 				for (k = 0; k < nStuffingBytes; k ++, j++)
 				{
-					*(alignBuf + j) = 0xFF;
+					*(pesHdr + j) = 0xFF;
 				}
 			}
-			memcpy(alignBuf + j, pDeliverBuf, ulUsedDataBytes);
-			pDeliverBuf = alignBuf;
 
 		}
 
 		if (ulDeliverBytes)
 		{
-			sts = DtsSendData(hDevice,pDeliverBuf ,ulDeliverBytes, 0, encrypted);
+			if (Ctx->VidParams.StreamType == BC_STREAM_TYPE_PES)
+			{
+				// Header and payload go straight into ring memory
+				sts = DtsReserveTxData(Ctx, ulDeliverBytes);
+				if (sts == BC_STS_SUCCESS)
+				{
+					txBufWrite(&Ctx->circBuf, 0, pesHdr, j);
+					txBufWrite(&Ctx->circBuf, j, pDeliverBuf, ulUsedDataBytes);
+					txBufCommit(&Ctx->circBuf, ulDeliverBytes);
+				}
+			}
+			else
+				sts = DtsSendData(hDevice,pDeliverBuf ,ulDeliverBytes, 0, encrypted);
 
 			if(sts == BC_STS_BUSY )
 			{
@@ -2072,20 +2419,14 @@ DtsAlignSendData( HANDLE  hDevice ,
 	return sts;
 }
 
-DRVIFLIB_API BC_STATUS
-DtsProcInput( HANDLE  hDevice ,
-				 uint8_t *pUserData,
-				 uint32_t ulSizeInBytes,
-				 uint64_t timeStamp,
-				 BOOL  encrypted
-			    )
+//------------------------------------------------------------------------
+// Name: DtsProcInputBegin
+// Description: Per-call part of DtsProcInput/DtsProcInputV. Opens and
+//              starts the decoder on first use and clears the EOS state.
+//------------------------------------------------------------------------
+static BC_STATUS DtsProcInputBegin(HANDLE hDevice, DTS_LIB_CONTEXT *Ctx)
 {
 	BC_STATUS	sts = BC_STS_SUCCESS;
-	DTS_LIB_CONTEXT		*Ctx = NULL;
-
-	uint32_t Offset = 0;
-
-	DTS_GET_CTX(hDevice,Ctx);
 
 	if (!DtsChkPID(Ctx->ProcessID))
 		return BC_STS_ERROR;
@@ -2095,7 +2436,7 @@ DtsProcInput( HANDLE  hDevice ,
 
 	if (Ctx->State != BC_DEC_STATE_START)
 	{
-		if (!DtsIsDecOpened(0))
+		if (Ctx->State == BC_DEC_STATE_CLOSE)
 		{
 			DtsLock(Ctx);
 			sts = DtsOpenDecoder(hDevice, Ctx->VidParams.StreamType);
@@ -2114,6 +2455,32 @@ DtsProcInput( HANDLE  hDevice ,
 	Ctx->bEOSCheck = false;
 	Ctx->bEOS = false;
 
+	// The ring can only be reallocated here, with no lock held and on the
+	// thread that fills it
+	if (Ctx->txBufResize)
+		DtsResizeTxBuffer(Ctx);
+
+	return BC_STS_SUCCESS;
+}
+
+//------------------------------------------------------------------------
+// Name: DtsProcInputUnit
+// Description: Per-unit part of DtsProcInput/DtsProcInputV. Converts the
+//              timestamp, adds sequence headers and start codes as needed
+//              and queues the unit on the TX ring.
+//------------------------------------------------------------------------
+static BC_STATUS DtsProcInputUnit(HANDLE hDevice, DTS_LIB_CONTEXT *Ctx,
+				 uint8_t *pUserData,
+				 uint32_t ulSizeInBytes,
+				 uint64_t timeStamp,
+				 BOOL  encrypted
+			    )
+{
+	BC_STATUS	sts = BC_STS_SUCCESS;
+	uint32_t Offset = 0;
+	uint64_t inTimeStamp = timeStamp;
+	uint64_t trStart = DTS_TRACE_BEGIN(Ctx);
+
 	// According to ASF spec special timestamps can be 0x1FFFFFFFF or 0x1FFFFFFFE
 	// NAREN - FIXME - should we add support for these pre-roll timestamps
 	if (Ctx->DevId == BC_PCI_DEVID_FLEA && timeStamp != 0xFFFFFFFFFFFFFFFFULL)
@@ -2162,9 +2529,10 @@ DtsProcInput( HANDLE  hDevice ,
 		return BC_STS_ERROR;
 	}
 
+	sts = BC_STS_ERROR;
 	if (Ctx->VidParams.StreamType == BC_STREAM_TYPE_PES || timeStamp == 0)
 	{
-		return DtsAlignSendData(hDevice, pUserData, ulSizeInBytes, timeStamp, encrypted);
+		sts = DtsAlignSendData(hDevice, pUserData, ulSizeInBytes, timeStamp, encrypted);
 	}
 	else
 	{
@@ -2175,18 +2543,136 @@ DtsProcInput( HANDLE  hDevice ,
 		}
 		if(Offset == 0)
 		{
-			return DtsAlignSendData(hDevice, pUserData, ulSizeInBytes, timeStamp, encrypted);
+			sts = DtsAlignSendData(hDevice, pUserData, ulSizeInBytes, timeStamp, encrypted);
 		}
 		else
 		{
-			if ((sts=DtsAlignSendData(hDevice, pUserData, Offset, 0, encrypted)) != BC_STS_SUCCESS)
-				return sts;
+			sts = DtsAlignSendData(hDevice, pUserData, Offset, 0, encrypted);
+
+			if(sts == BC_STS_SUCCESS && ulSizeInBytes > Offset)
+				sts = DtsAlignSendData(hDevice, pUserData+Offset, ulSizeInBytes-Offset, timeStamp, encrypted);
+			else if(sts == BC_STS_SUCCESS)
+				sts = BC_STS_ERROR;
+		}
+	}
+
+	// Data is in the TX ring now, give the application its buffer back
+	DtsRestoreH264SCode(hDevice);
+
+	if(sts == BC_STS_SUCCESS){
+		DTS_STAT_ADD(Ctx->Counters.InUnits, 1);
+		DTS_STAT_ADD(Ctx->Counters.InBytes, ulSizeInBytes);
+		DTS_TRACE(Ctx, DTS_TR_PUSH, 0, inTimeStamp, txBufBusySize(&Ctx->circBuf));
+		DTS_TRACE(Ctx, DTS_TR_INPUT, trStart, inTimeStamp, ulSizeInBytes);
+	}
+
+	return sts;
+}
+
+DRVIFLIB_API BC_STATUS
+DtsProcInput( HANDLE  hDevice ,
+				 uint8_t *pUserData,
+				 uint32_t ulSizeInBytes,
+				 uint64_t timeStamp,
+				 BOOL  encrypted
+			    )
+{
+	BC_STATUS	sts = BC_STS_SUCCESS;
+	DTS_LIB_CONTEXT		*Ctx = NULL;
+
+	DTS_GET_CTX(hDevice,Ctx);
+
+	if ((sts = DtsProcInputBegin(hDevice, Ctx)) != BC_STS_SUCCESS)
+		return sts;
+
+	return DtsProcInputUnit(hDevice, Ctx, pUserData, ulSizeInBytes, timeStamp, encrypted);
+}
+
+DRVIFLIB_API BC_STATUS
+DtsProcInputAsync( HANDLE  hDevice ,
+				 uint8_t *pUserData,
+				 uint32_t ulSizeInBytes,
+				 uint64_t timeStamp,
+				 BOOL  encrypted,
+				 uint64_t Cookie
+			    )
+{
+	BC_STATUS	sts = BC_STS_SUCCESS;
+	DTS_LIB_CONTEXT		*Ctx = NULL;
+
+	DTS_GET_CTX(hDevice,Ctx);
+
+	if ((sts = DtsProcInputBegin(hDevice, Ctx)) != BC_STS_SUCCESS)
+		return sts;
+
+	/* DtsPrepareMdata stores it with the unit's timestamp */
+	Ctx->InCookie = Cookie;
+	sts = DtsProcInputUnit(hDevice, Ctx, pUserData, ulSizeInBytes, timeStamp, encrypted);
+	Ctx->InCookie = 0;
+
+	return sts;
+}
 
-			if(ulSizeInBytes > Offset)
-				return DtsAlignSendData(hDevice, pUserData+Offset, ulSizeInBytes-Offset, timeStamp, encrypted);
+DRVIFLIB_API BC_STATUS
+DtsProcInputV( HANDLE  hDevice ,
+				 BC_DTS_INPUT_UNIT *pUnits,
+				 uint32_t nUnits,
+				 BOOL  encrypted,
+				 uint32_t *pUnitsDone
+			    )
+{
+	BC_STATUS	sts = BC_STS_SUCCESS;
+	DTS_LIB_CONTEXT		*Ctx = NULL;
+	uint32_t	i = 0, chunk;
+
+	DTS_GET_CTX(hDevice,Ctx);
+
+	if (pUnitsDone)
+		*pUnitsDone = 0;
+
+	if (!pUnits || !nUnits)
+		return BC_STS_INV_ARG;
+
+	for (i = 0; i < nUnits; i++) {
+		if (!pUnits[i].pData || !pUnits[i].dataSz || pUnits[i].Flags)
+			return BC_STS_INV_ARG;
+	}
+
+	if ((sts = DtsProcInputBegin(hDevice, Ctx)) != BC_STS_SUCCESS)
+		return sts;
+
+	// Hold the ring updates back so the TX thread wakes up once for the
+	// whole batch instead of once per unit. The ring still publishes early
+	// if it fills up before the end of the batch.
+	txBufBeginBatch(&Ctx->circBuf);
+
+	for (i = 0; i < nUnits && sts == BC_STS_SUCCESS; ) {
+		chunk = nUnits - i;
+		if (chunk > BC_INPUT_MDATA_BATCH_SZ)
+			chunk = BC_INPUT_MDATA_BATCH_SZ;
+
+		// Meta data for the chunk in one pass over the pool; a short
+		// allocation falls back to the per-unit path in DtsPrepareMdata
+		DtsAllocMdataBatch(Ctx, chunk);
+
+		for (; chunk; chunk--, i++) {
+			sts = DtsProcInputUnit(hDevice, Ctx, pUnits[i].pData, pUnits[i].dataSz,
+					       pUnits[i].timeStamp, encrypted);
+			if (sts != BC_STS_SUCCESS) {
+				DebugLog_Trace(LDIL_DBG,"DtsProcInputV: unit %d failed %x\n", i, sts);
+				break;
+			}
 		}
+
+		DtsFreeMdataBatch(Ctx);
 	}
-	return BC_STS_ERROR;
+
+	txBufEndBatch(&Ctx->circBuf);
+
+	if (pUnitsDone)
+		*pUnitsDone = i;
+
+	return sts;
 }
 
 DRVIFLIB_API BC_STATUS
@@ -2299,6 +2785,8 @@ DtsSendEOS( HANDLE  hDevice, uint32_t Op
 			sts = DtsAlignSendData(hDevice, pEOS, nEOSLen, 0, 0);
 		}
 		Ctx->bEOSCheck = true;
+		// Have the TX thread start polling for the last picture
+		txBufWakeUp(&Ctx->circBuf);
 	}
 
 	//Reset
@@ -2789,6 +3277,37 @@ DtsSetColorSpace(
 	return sts;
 }
 
+DRVIFLIB_API BC_STATUS
+DtsSetCopyThreads(
+	HANDLE  hDevice,
+	uint32_t	nThreads
+)
+{
+	BC_STATUS	sts = BC_STS_SUCCESS;
+	DTS_LIB_CONTEXT		*Ctx = NULL;
+
+	DTS_GET_CTX(hDevice,Ctx);
+
+	if(nThreads > DTS_COPY_MAX_THREADS)
+		return BC_STS_INV_ARG;
+
+	/* Waits for a copy in progress, the pool can't change under it */
+	DtsCopyLock(Ctx);
+
+	DtsDeleteCopyPool(Ctx->CopyPool);
+	Ctx->CopyPool = NULL;
+
+	/* The calling thread does one of the stripes */
+	if((nThreads >= 2) && !(Ctx->CopyPool = DtsCreateCopyPool(nThreads - 1))){
+		DebugLog_Trace(LDIL_DBG,"DtsSetCopyThreads: Failed to start %u workers\n", nThreads - 1);
+		sts = BC_STS_INSUFF_RES;
+	}
+
+	DtsCopyUnLock(Ctx);
+
+	return sts;
+}
+
 DRVIFLIB_API BC_STATUS
 DtsGetDILPath(
     HANDLE  hDevice,
@@ -2897,6 +3416,7 @@ DtsGetDriverStatus( HANDLE  hDevice,
 	pStatus->cpbEmptySize		= temp.DrvcpbEmptySize;
 	pStatus->picNumFlags		= temp.picNumFlags;
 	pStatus->PowerStateChange	= temp.pwr_state_change;
+	pStatus->MdataEvicted		= DTS_STAT_GET(Ctx->MDEvictCnt);
 
 	if(temp.eosDetected)
 	{
@@ -2920,7 +3440,7 @@ DtsGetDriverStatus( HANDLE  hDevice,
 	}
 
 	if(!realHWCPBSize)
-		pStatus->cpbEmptySize = Ctx->circBuf.freeSize;
+		pStatus->cpbEmptySize = txBufFreeSize(&Ctx->circBuf);
 
 	if(!readTXinfoOnly)
 	{
@@ -131,6 +131,11 @@ Description:
 
     Must be called once when the application opens the decoder for use.
 
+    Each handle has its own decoder state, counters and output, but the
+    driver takes only one playback handle at a time. A second playback
+    open, from this process or another, fails with BC_STS_DEC_EXIST_OPEN
+    until the first handle is closed.
+
 Parameters:
 
     *hDevice    Pointer to device handle that will be filled in after the
@@ -139,6 +144,7 @@ Parameters:
     mode        Controls the mode in which the device is opened.
                 Currently only mode 0 (normal playback) is supported.
                 All other values will return BC_STS_INV_ARG.
+                DTS_INPUT_IN_PLACE may be or'ed in, see DtsProcInput.
 
 Return:
 
@@ -811,7 +817,8 @@ Parameters:
     hDevice         Handle to device. This is obtained via a prior call to
                     DtsDeviceOpen.
     milliSecWait    Timeout parameter. DtsProcOutput will fail is no picture
-                    is received in this time.
+                    is received in this time. BC_POUT_WAIT_INFINITE waits
+                    until a picture comes, see DtsInterruptProcOutput().
     *pOut           This is a pointer to the BC_DTS_PROC_OUT structure that is
                     allocated by the caller. The decoded picture is returned
                     in this structure. This structure is described in the
@@ -820,9 +827,28 @@ Parameters:
                     Data is copied from the decoder to the buffers before this
                     function returns. [INPUT/OUTPUT]
 
+                    With BC_POUT_FLAGS_MODE set, a b422Mode of
+                    OUTPUT_MODE420_I420 or OUTPUT_MODE420_YV12 returns three
+                    plane 420. By default
+                    both chroma planes follow each other in UVbuff, in the
+                    order of the mode. To place the V plane elsewhere pass a
+                    BC_DTS_PROC_OUT_EX with BC_POUT_FLAGS_EXT and ExSize set,
+                    UVbuff then holds U and Vbuff holds V.
+
+                    BC_POUT_FLAGS_SCALE with a BC_DTS_PROC_OUT_EX downscales
+                    to ScaleWidth x ScaleHeight while copying, the full size
+                    picture is never written. Halving is a 2x2 box, other
+                    sizes are bilinear. NV12 output of 420 pictures only.
+
+                    The copy bypasses the CPU cache by default, which suits
+                    pictures that go straight to the GPU or another device.
+                    Set BC_POUT_FLAGS_CACHED when the CPU works on the
+                    picture next, so that it finds it in cache.
+
 Return:
 
     BC_STS_SUCCESS will be returned on successful completion.
+    BC_STS_NOT_IMPL if scaling was asked for another format.
 
 *****************************************************************************/
 DRVIFLIB_API BC_STATUS
@@ -864,7 +890,8 @@ Parameters:
     hDevice         Handle to device. This is obtained via a prior call to
                     DtsDeviceOpen.
     milliSecWait    Timeout parameter. DtsProcOoutput will fail is no picture
-                    is received in this time.
+                    is received in this time. BC_POUT_WAIT_INFINITE waits
+                    until a picture comes, see DtsInterruptProcOutput().
     *pOut           This is a pointer to the BC_DTS_PROC_OUT structure that is
                     allocated by the caller. The decoded picture is returned
                     in this structure.
@@ -911,6 +938,335 @@ DtsReleaseOutputBuffs(
     BOOL   fChange
     );
 
+/*****************************************************************************
+
+Function name:
+
+    DtsGetOutBuffReq
+
+Description:
+
+    Returns the size and layout of one output buffer for
+    DtsRegisterOutBuffs(). Depends on the 422 mode, so call it after
+    DtsSet422Mode().
+
+Parameters:
+
+    hDevice         Handle to device. This is obtained via a prior call to
+                    DtsDeviceOpen.
+    *pBuffSz        Minimum buffer size in bytes. [OUTPUT]
+    *pUVOffset      Offset of the UV plane in the buffer, 0 in 422 mode.
+                    [OUTPUT]
+
+Return:
+
+    BC_STS_SUCCESS will be returned on successful completion.
+
+*****************************************************************************/
+DRVIFLIB_API BC_STATUS
+DtsGetOutBuffReq(
+    HANDLE   hDevice,
+    uint32_t *pBuffSz,
+    uint32_t *pUVOffset
+    );
+
+/*****************************************************************************
+
+Function name:
+
+    DtsRegisterOutBuffs
+
+Description:
+
+    Has the driver DMA decoded pictures straight into application buffers
+    instead of the library's own, so DtsProcOutputZeroCopy() can return
+    them without a copy. The buffers replace the library's output buffers
+    until they are unregistered or the device is closed.
+
+    Must be called before DtsStartCapture(), or after
+    DtsFlushRxCapture(hDevice, FALSE). The buffers must stay valid until
+    they are unregistered.
+
+Parameters:
+
+    hDevice         Handle to device. This is obtained via a prior call to
+                    DtsDeviceOpen.
+    *pBuffs         Array of nBuffs buffers, each 4 byte aligned and at least
+                    DtsGetOutBuffReq() bytes. The array itself is copied.
+    nBuffs          Between 4 and 16. 0 unregisters the buffers and goes
+                    back to the library's own.
+
+Return:
+
+    BC_STS_SUCCESS will be returned on successful completion.
+    BC_STS_BUSY if capture or the async output is running.
+
+*****************************************************************************/
+DRVIFLIB_API BC_STATUS
+DtsRegisterOutBuffs(
+    HANDLE   hDevice,
+    BC_DTS_OUT_BUFF *pBuffs,
+    uint32_t nBuffs
+    );
+
+/*****************************************************************************
+
+Function name:
+
+    DtsProcOutputZeroCopy
+
+Description:
+
+    Returns one decoded picture in one of the buffers registered with
+    DtsRegisterOutBuffs(). Works like DtsProcOutputNoCopy(), except the
+    buffer stays with the application until DtsReleaseOutBuff() and
+    several can be held at once.
+
+    The Ybuff and UVbuff fields of pOut point into the buffer, in the
+    hardware layout. When the PIB is valid StrideSz holds the row padding
+    and BC_POUT_FLAGS_STRIDE is set. With a driver that passes the PIB
+    beside the picture the library never reads the buffer, and the PIB
+    is valid with PIB encryption on too.
+
+Parameters:
+
+    hDevice         Handle to device. This is obtained via a prior call to
+                    DtsDeviceOpen.
+    milliSecWait    Timeout parameter. Fails if no picture is received in
+                    this time.
+    *pOut           Returns the picture info and plane pointers. [OUTPUT]
+    *pBuffIdx       Index of the buffer in the registered array. [OUTPUT]
+
+Return:
+
+    BC_STS_SUCCESS will be returned on successful completion.
+    BC_STS_ERR_USAGE if no buffers are registered.
+
+*****************************************************************************/
+DRVIFLIB_API BC_STATUS
+DtsProcOutputZeroCopy(
+    HANDLE   hDevice,
+    uint32_t milliSecWait,
+    BC_DTS_PROC_OUT *pOut,
+    uint32_t *pBuffIdx
+    );
+
+/*****************************************************************************
+
+Function name:
+
+    DtsReleaseOutBuff
+
+Description:
+
+    Gives a buffer returned by DtsProcOutputZeroCopy() back to the driver.
+    Too few released buffers stalls the decoder.
+
+Parameters:
+
+    hDevice         Handle to device. This is obtained via a prior call to
+                    DtsDeviceOpen.
+    BuffIdx         Index returned by DtsProcOutputZeroCopy().
+
+Return:
+
+    BC_STS_SUCCESS will be returned on successful completion.
+    BC_STS_INV_ARG if the buffer is not held by the application.
+
+*****************************************************************************/
+DRVIFLIB_API BC_STATUS
+DtsReleaseOutBuff(
+    HANDLE   hDevice,
+    uint32_t BuffIdx
+    );
+
+/*****************************************************************************
+
+Function name:
+
+    DtsInterruptProcOutput
+
+Description:
+
+    Wakes a DtsProcOutput(), DtsProcOutputNoCopy() or
+    DtsProcOutputZeroCopy() waiting on this handle, which then returns
+    BC_STS_IO_USER_ABORT. If none is waiting the next one returns at once,
+    so there is no race with a thread just about to wait. Does not block
+    and can be called from any thread, unlike stopping or flushing.
+
+    With current drivers the wait ends right away. Older drivers only
+    look between their own fetch timeouts, up to a couple of seconds.
+
+Parameters:
+
+    hDevice         Handle to device. This is obtained via a prior call to
+                    DtsDeviceOpen.
+
+Return:
+
+    BC_STS_SUCCESS will be returned on successful completion.
+
+*****************************************************************************/
+DRVIFLIB_API BC_STATUS
+DtsInterruptProcOutput(
+    HANDLE   hDevice
+    );
+
+/*****************************************************************************
+
+Function name:
+
+    DtsGetOutputFd
+
+Description:
+
+    Returns a descriptor for poll()/select() that is readable while a
+    picture is waiting for this handle, so an output thread can sleep in
+    its own event loop. Once it is readable a ProcOutput call with a
+    milliSecWait of 0 gets the picture. The descriptor belongs to the
+    handle: do not read from or close it.
+
+Parameters:
+
+    hDevice         Handle to device. This is obtained via a prior call to
+                    DtsDeviceOpen.
+    *pFd            Returns the descriptor. [OUTPUT]
+
+Return:
+
+    BC_STS_SUCCESS will be returned on successful completion.
+    BC_STS_NOT_IMPL if the driver is too old to support it.
+
+*****************************************************************************/
+DRVIFLIB_API BC_STATUS
+DtsGetOutputFd(
+    HANDLE   hDevice,
+    int      *pFd
+    );
+
+/*****************************************************************************
+
+Function name:
+
+    DtsStartAsyncOutput
+
+Description:
+
+    Starts a library thread that fetches decoded pictures into the buffers
+    registered with DtsRegisterOutBuffs() and delivers them as
+    BC_DTS_COMPLETION entries, so demux, decode and render can each run on
+    their own thread without blocking inside the library.
+
+    Without a CallBack the completions are queued and taken in batches
+    with DtsGetCompletions(). When the queue is full the thread waits, and
+    the decoder holds on to its pictures, until the application takes some.
+    With a CallBack it is called on the library's thread for each
+    completion instead, and must return quickly.
+
+    A completion with Status BC_STS_SUCCESS is a picture. Its buffer is
+    the application's until it is given back with DtsReleaseOutBuff().
+    BC_STS_FMT_CHANGE carries the new format in PicInfo and no buffer.
+    BC_STS_NO_DATA with VDEC_FLAG_EOS in PicInfo.flags is an end of stream
+    that came without a picture. Cookie is the one given to
+    DtsProcInputAsync() for the input the picture was decoded from.
+
+    While it runs, the thread is the only caller of the ProcOutput
+    functions for this handle and the registered buffers can't change.
+
+Parameters:
+
+    hDevice         Handle to device. This is obtained via a prior call to
+                    DtsDeviceOpen.
+    QueueDepth      Completions that can wait in the queue, up to 256.
+                    0 for the default of 16. Unused with a CallBack.
+    CallBack        Optional. Called with CbContext for each completion.
+    CbContext       Passed to CallBack.
+
+Return:
+
+    BC_STS_SUCCESS will be returned on successful completion.
+    BC_STS_ERR_USAGE if no buffers are registered.
+    BC_STS_BUSY if the async output is already running.
+
+*****************************************************************************/
+DRVIFLIB_API BC_STATUS
+DtsStartAsyncOutput(
+    HANDLE   hDevice,
+    uint32_t QueueDepth,
+    dts_completion_callback CallBack,
+    void     *CbContext
+    );
+
+/*****************************************************************************
+
+Function name:
+
+    DtsGetCompletions
+
+Description:
+
+    Takes the completions the async output has queued, oldest first, up
+    to MaxCount of them. Waits up to milliSecWait for the first one when
+    the queue is empty, but never for more than are already there.
+
+Parameters:
+
+    hDevice         Handle to device. This is obtained via a prior call to
+                    DtsDeviceOpen.
+    pComp           Array of MaxCount entries to fill in. [OUTPUT]
+    MaxCount        Size of pComp.
+    milliSecWait    Maximum wait in ms, 0 to only take what is queued,
+                    BC_POUT_WAIT_INFINITE until one comes or the async
+                    output is stopped.
+    *pCount         Number of entries filled in. [OUTPUT]
+
+Return:
+
+    BC_STS_SUCCESS when at least one completion was taken.
+    BC_STS_NO_DATA or BC_STS_TIMEOUT when none was queued, without and
+    with a wait.
+    BC_STS_ERR_USAGE if the async output is not running or has a CallBack.
+
+*****************************************************************************/
+DRVIFLIB_API BC_STATUS
+DtsGetCompletions(
+    HANDLE   hDevice,
+    BC_DTS_COMPLETION *pComp,
+    uint32_t MaxCount,
+    uint32_t milliSecWait,
+    uint32_t *pCount
+    );
+
+/*****************************************************************************
+
+Function name:
+
+    DtsStopAsyncOutput
+
+Description:
+
+    Stops the async output thread and waits for it to exit. Buffers of
+    completions still in the queue go back to the decoder, the ones
+    already taken stay with the application until released. Threads
+    waiting in DtsGetCompletions() return, this call waits for them to
+    leave. Must not be called from the CallBack. DtsDeviceClose() stops
+    it as well.
+
+Parameters:
+
+    hDevice         Handle to device. This is obtained via a prior call to
+                    DtsDeviceOpen.
+
+Return:
+
+    BC_STS_SUCCESS will be returned on successful completion.
+
+*****************************************************************************/
+DRVIFLIB_API BC_STATUS
+DtsStopAsyncOutput(
+    HANDLE   hDevice
+    );
+
 
 /*****************************************************************************
 
@@ -926,6 +1282,13 @@ Description:
     In addition, suitable keys must have been exchanged for decryption and
     decode to be successful.
 
+    If the device was opened with DTS_INPUT_IN_PLACE in the mode, the NAL
+    lengths of BC_MSUBTYPE_AVC1 input with 4 byte lengths are replaced
+    with start codes in pUserData while the call runs, and put back before
+    it returns. This saves copying the sample, but pUserData must then be
+    writable and must not be read by other threads during the call.
+    Without the flag pUserData is never written.
+
 Parameters:
 
     hDevice     Handle to device. This is obtained via a prior call to
@@ -961,6 +1324,96 @@ DtsProcInput(
 
 /*****************************************************************************
 
+Function name:
+
+    DtsProcInputAsync
+
+Description:
+
+    DtsProcInput() with a cookie that the async output hands back in the
+    completion for the picture decoded from this input, see
+    DtsStartAsyncOutput().
+
+    The cookie is kept with the input's timestamp metadata and comes back
+    with it, so only input with a non-zero timestamp gets one and any
+    timestamp, repeated or not, will do. Input whose picture never comes
+    out gets no completion with its cookie, nor does input the driver
+    drops in a flush. BCM70015 in PES mode carries the timestamp in the
+    stream instead, so there Cookie is always zero.
+
+Parameters:
+
+    hDevice     Handle to device. This is obtained via a prior call to
+                DtsDeviceOpen.
+    pUserData   Same as for DtsProcInput.
+    sizeInBytes Same as for DtsProcInput.
+    Timestamp   Same as for DtsProcInput.
+    Encrypted   Same as for DtsProcInput.
+    Cookie      Any value, returned in BC_DTS_COMPLETION.Cookie.
+
+Return:
+
+    Same as for DtsProcInput.
+
+*****************************************************************************/
+DRVIFLIB_API BC_STATUS
+DtsProcInputAsync(
+    HANDLE   hDevice,
+    uint8_t  *pUserData,
+    uint32_t ulSizeInBytes,
+    uint64_t timeStamp,
+    BOOL     encrypted,
+    uint64_t Cookie
+    );
+
+/*****************************************************************************
+
+Function name:
+
+    DtsProcInputV
+
+Description:
+
+    Sends a batch of compressed access units to the decoder. Each unit is
+    handled exactly as a DtsProcInput call with the same data, size and
+    timestamp would be, in array order.
+
+    The per-call work (state checks, decoder auto start) is done once for
+    the batch, the meta data for the units is taken from the pool in
+    groups, and the transmit thread is woken once for the batch instead of
+    once per unit.
+
+Parameters:
+
+    hDevice     Handle to device. This is obtained via a prior call to
+                DtsDeviceOpen.
+    pUnits      Array of BC_DTS_INPUT_UNIT describing the units to send.
+                Every unit must have a data pointer, a non-zero size and
+                Flags set to zero. [INPUT]
+    nUnits      Number of entries in pUnits.
+    Encrypted   Same as for DtsProcInput, applies to all units.
+    pUnitsDone  Optional. Receives the number of units queued. On failure
+                this is the index of the unit that failed; units before it
+                have been queued. [OUTPUT]
+
+Return:
+
+    BC_STS_SUCCESS will be returned when all units have been queued.
+    BC_STS_INV_ARG if the array or any unit in it is invalid, in which
+    case nothing is sent. Otherwise the status of the failing unit.
+
+*****************************************************************************/
+DRVIFLIB_API BC_STATUS
+DtsProcInputV(
+    HANDLE   hDevice,
+    BC_DTS_INPUT_UNIT *pUnits,
+    uint32_t nUnits,
+    BOOL     encrypted,
+    uint32_t *pUnitsDone
+    );
+
+/*****************************************************************************
+
 Function name:
 
     DtsGetColorPrimaries
@@ -1302,6 +1755,38 @@ DtsSet422Mode(
 
 /*****************************************************************************
 
+Function name:
+
+    DtsSetCopyThreads
+
+Description:
+
+    Sets how many threads DtsProcOutput() uses to copy or convert large
+    pictures into the caller's buffers. Each takes a horizontal stripe of
+    the picture, the calling thread is one of them. Off by default.
+
+    May be called while another thread is in DtsProcOutput(), a picture
+    copy in progress finishes on the old threads first.
+
+Parameters:
+
+    hDevice     Handle to device. This is obtained via a prior call to
+                DtsDeviceOpen.
+    nThreads    0 or 1 to copy on the calling thread only, up to 8.
+
+Return:
+
+    BC_STS_SUCCESS will be returned on successful completion.
+
+*****************************************************************************/
+DRVIFLIB_API BC_STATUS
+DtsSetCopyThreads(
+    HANDLE   hDevice,
+    uint32_t nThreads
+    );
+
+/*****************************************************************************
+
 Function name:
 
     DtsGetDILPath
@@ -1533,6 +2018,189 @@ DtsTxFreeSize(
     HANDLE  hDevice
 );
 
+/*****************************************************************************
+
+Function name:
+
+    DtsSetTxBufferSize
+
+Description:
+
+    Overrides the size of the tx circular buffer. By default the buffer is
+    sized from the stream when the decoder is opened: the H.264 level's
+    maximum bit rate and the picture size set with DtsSetInputFormat.
+
+    Must be called while the decoder is closed, the size is applied by the
+    next DtsOpenDecoder. It is rounded up to a power of two.
+
+Parameters:
+
+    hDevice     Handle to device. This is obtained via a prior call to
+                DtsDeviceOpen.
+    size        Buffer size in bytes, a multiple of 4KB from 128KB to 8MB.
+                Zero to go back to sizing from the stream.
+
+Return:
+
+    BC_STS_SUCCESS will be returned on successful completion.
+    BC_STS_INV_ARG if the size is out of range or not a multiple of 4KB.
+    BC_STS_BUSY if the decoder is open.
+
+*****************************************************************************/
+DRVIFLIB_API BC_STATUS
+DtsSetTxBufferSize(
+    HANDLE  hDevice,
+    uint32_t size
+);
+
+/*****************************************************************************
+
+Function name:
+
+    DtsGetTxBufferStats
+
+Description:
+
+    Returns the size and fill statistics of the tx circular buffer, to tune
+    DtsSetTxBufferSize. A high water mark close to the buffer size, or a
+    growing FullWaits count, means DtsProcInput had to wait for the buffer
+    to drain.
+
+Parameters:
+
+    hDevice     Handle to device. This is obtained via a prior call to
+                DtsDeviceOpen.
+    pStats      Receives the statistics. [OUTPUT]
+    bReset      Restart the high water mark and wait count after reading.
+
+Return:
+
+    BC_STS_SUCCESS will be returned on successful completion.
+
+*****************************************************************************/
+DRVIFLIB_API BC_STATUS
+DtsGetTxBufferStats(
+    HANDLE  hDevice,
+    BC_DTS_TXBUF_STATS *pStats,
+    BOOL    bReset
+);
+
+/*****************************************************************************
+
+Function name:
+
+    DtsGetDecodeStats
+
+Description:
+
+    Returns the decode counters of this handle: input units and bytes,
+    pictures delivered, dropped and repeated, PIB misses, evicted metadata
+    entries, the tx ring fill and a histogram of the time spent in the
+    output fetch. FetchLatency[0] counts fetches under 1ms and each
+    following bucket doubles the bound; the last one holds everything
+    slower.
+
+    The counters are updated without locks by the input and output paths
+    and this call only reads them, so it is cheap enough to poll every
+    frame. Counters updated by different threads are not sampled at the
+    same instant.
+
+Parameters:
+
+    hDevice     Handle to device. This is obtained via a prior call to
+                DtsDeviceOpen.
+    pStats      Receives the statistics. [OUTPUT]
+    bReset      Start counting from zero after reading. Only affects
+                this function's view; DtsGetDrvStat keeps its own.
+
+Return:
+
+    BC_STS_SUCCESS will be returned on successful completion.
+
+*****************************************************************************/
+DRVIFLIB_API BC_STATUS
+DtsGetDecodeStats(
+    HANDLE  hDevice,
+    BC_DTS_DEC_STATS *pStats,
+    BOOL    bReset
+);
+
+/*****************************************************************************
+
+Function name:
+
+    DtsSetTrace
+
+Description:
+
+    Starts or stops recording decode trace points for this handle, to see
+    where the time goes between DtsProcInput and DtsProcOutput. Tracing is
+    off by default and then costs one load per trace point.
+
+    The points are: each input unit from the DtsProcInput call until it
+    is in the tx ring, the tx DMA of each chunk, changes of the driver's
+    ready picture count, each successful picture fetch including the wait
+    for it, and the copy to the application buffer. Input, fetch and copy
+    events carry the picture timestamp so one picture can be followed
+    through the pipeline.
+
+    Events go to a ring in memory with monotonic timestamps, the oldest
+    are overwritten when it is full. The ring is allocated by the first
+    call and kept until DtsDeviceClose; later calls reuse it and only
+    restart the recording.
+
+Parameters:
+
+    hDevice     Handle to device. This is obtained via a prior call to
+                DtsDeviceOpen.
+    Depth       Number of events the ring holds, rounded up to a power of
+                two between 1024 and 1048576. Only used by the first call.
+                Zero stops recording and keeps the events for DtsDumpTrace.
+
+Return:
+
+    BC_STS_SUCCESS will be returned on successful completion.
+    BC_STS_INSUFF_RES if the ring can not be allocated.
+
+*****************************************************************************/
+DRVIFLIB_API BC_STATUS
+DtsSetTrace(
+    HANDLE  hDevice,
+    uint32_t Depth
+);
+
+/*****************************************************************************
+
+Function name:
+
+    DtsDumpTrace
+
+Description:
+
+    Writes the events recorded since the last DtsSetTrace to a file in the
+    Chrome trace event JSON format, which chrome://tracing and Perfetto
+    open directly. Each thread shows as its own track, the ready count
+    as a counter. Recording may continue during the dump.
+
+Parameters:
+
+    hDevice     Handle to device. This is obtained via a prior call to
+                DtsDeviceOpen.
+    FileName    File to create or overwrite.
+
+Return:
+
+    BC_STS_SUCCESS will be returned on successful completion.
+    BC_STS_ERR_USAGE if tracing was never started on this handle.
+    BC_STS_IO_ERROR if the file can not be written.
+
+*****************************************************************************/
+DRVIFLIB_API BC_STATUS
+DtsDumpTrace(
+    HANDLE  hDevice,
+    const char *FileName
+);
+
 #ifdef __cplusplus
 }
 #endif
@@ -26,14 +26,14 @@
  *
  *******************************************************************/
 
+#include <stddef.h>
 #include "7411d.h"
 #include "bc_defines.h"
 #include "bc_decoder_regs.h"
 #include "libcrystalhd_priv.h"
 #include "libcrystalhd_int_if.h"
 #include "libcrystalhd_fwcmds.h"
-
-#include <emmintrin.h>
+#include "libcrystalhd_copy.h"
 
 #define SV_MAX_LINE_SZ 128
 #define PCI_GLOBAL_CONTROL MISC2_GLOBAL_CTRL
@@ -61,7 +61,7 @@ DtsGetHwType(
 
 	DTS_GET_CTX(hDevice,Ctx);
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, hwType)))
 		return BC_STS_INSUFF_RES;
 
 	pHWInfo = 	&pIocData->u.hwType;
@@ -555,7 +555,7 @@ DtsGetPciConfigSpace(
 		return BC_STS_ERROR;
 	}
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, pciCfg)))
 		return BC_STS_INSUFF_RES;
 
 	pciInfo = (BC_PCI_CFG *)&pIocData->u.pciCfg;
@@ -592,7 +592,7 @@ DtsDevRegisterRead(
 
 	DTS_GET_CTX(hDevice,Ctx);
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, regAcc)))
 		return BC_STS_INSUFF_RES;
 
 
@@ -633,7 +633,7 @@ DtsDevRegisterWr(
 
 	DTS_GET_CTX(hDevice, Ctx);
 
-	if (!(pIocData = DtsAllocIoctlData(Ctx)))
+	if (!(pIocData = DtsAllocIoctlDataFor(Ctx, regAcc)))
 		return BC_STS_INSUFF_RES;
 
 	reg_acc_wr = (BC_CMD_REG_ACC *) &pIocData->u.regAcc;
@@ -667,7 +667,7 @@ DtsFPGARegisterRead(
 
 	DTS_GET_CTX(hDevice,Ctx);
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, regAcc)))
 		return BC_STS_INSUFF_RES;
 
 
@@ -707,7 +707,7 @@ DtsFPGARegisterWr(
 
 	DTS_GET_CTX(hDevice,Ctx);
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, regAcc)))
 		return BC_STS_INSUFF_RES;
 
 	reg_acc_wr = (BC_CMD_REG_ACC *) &pIocData->u.regAcc;
@@ -738,7 +738,7 @@ DtsDevMemRd(
     )
 {
 	uint8_t					*pXferBuff;
-	uint32_t					IOcCode,size_in_dword;
+	uint32_t					size_in_dword;
 	BC_IOCTL_DATA		*pIoctlData;
 	BC_CMD_DEV_MEM		*pMemAccessRd;
 	uint32_t					BytesReturned,AllocSz;
@@ -782,7 +782,6 @@ DtsDevMemRd(
 	memset(pXferBuff,'a',BuffSz);
 	/* The size is passed in Bytes*/
 	pMemAccessRd->NumDwords = size_in_dword;
-	IOcCode = BCM_IOC_MEM_RD;
 	if(!DtsDrvIoctl(hDevice,
 					BCM_IOC_MEM_RD,
 					pIoctlData,
@@ -821,7 +820,7 @@ DtsDevMemWr(
     )
 {
 	uint8_t					*pXferBuff;
-	uint32_t					IOcCode,size_in_dword;
+	uint32_t					size_in_dword;
 	BC_IOCTL_DATA		*pIoctlData;
 	BC_CMD_DEV_MEM		*pMemAccessRd;
 	uint32_t					BytesReturned,AllocSz;
@@ -868,7 +867,6 @@ DtsDevMemWr(
 	memcpy(pXferBuff,Buffer,BuffSz);
 	/* The size is passed in Bytes*/
 	pMemAccessRd->NumDwords = size_in_dword;
-	IOcCode = BCM_IOC_MEM_WR;
 	if(!DtsDrvIoctl(hDevice,
 					BCM_IOC_MEM_WR,
 					pIoctlData,
@@ -919,7 +917,7 @@ DtsTxDmaText( HANDLE  hDevice ,
 	pDmaBuff = pUserData;
 	ulDmaSz = ulSizeInBytes;
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, ProcInput)))
 		return BC_STS_INSUFF_RES;
 
 	pIocData->RetSts = BC_STS_ERROR;
@@ -1023,7 +1021,7 @@ DtsGetDrvStat(
 		return BC_STS_ERROR;
 	}
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, drvStat)))
 		return BC_STS_INSUFF_RES;
 
 	if(Ctx->SingleThreadedAppMode)
@@ -1036,9 +1034,11 @@ DtsGetDrvStat(
 	}
 
 	/* DIL counters */
-	pIntDrvStat = DtsGetgStats ( );
+	pIntDrvStat = &Ctx->Stats;
 	//memcpy_s(pDrvStat, 128, pIntDrvStat, 128);
 	memcpy(pDrvStat, pIntDrvStat, 128);
+	pDrvStat->ipSampleCnt = (uint32_t)(DTS_STAT_GET(Ctx->Counters.TxChunks) - Ctx->DrvStatInBase[0]);
+	pDrvStat->ipTotalSize = DTS_STAT_GET(Ctx->Counters.TxBytes) - Ctx->DrvStatInBase[1];
 
 	/* Driver counters */
 	pIntDrvStat = (BC_DTS_STATS *)&pIocData->u.drvStat;
@@ -1157,7 +1157,9 @@ DtsRstDrvStat(
 	}
 
 	/* DIL related counters */
-	DtsRstStats( );
+	memset(&Ctx->Stats, 0, sizeof(Ctx->Stats));
+	Ctx->DrvStatInBase[0] = DTS_STAT_GET(Ctx->Counters.TxChunks);
+	Ctx->DrvStatInBase[1] = DTS_STAT_GET(Ctx->Counters.TxBytes);
 
 	DtsRelIoctlData(Ctx,pIocData);
 
@@ -1207,15 +1209,32 @@ DtsDownloadFWBin(HANDLE	hDevice, uint8_t *binBuff, uint32_t buffsize, uint32_t d
 	return rstatus;
 }
 
+// Stream the picture past the cache unless the app reads it back itself
+static uint32_t DtsCopyFlags(BC_DTS_PROC_OUT *Vout)
+{
+	return (Vout->PoutFlags & BC_POUT_FLAGS_CACHED) ? 0 : DTS_COPY_NT;
+}
+
+// The conversions themselves live in libcrystalhd_copy_frame.cpp. CopyLock
+// keeps DtsSetCopyThreads from swapping the pool under a copy.
+static BC_STATUS DtsRunCopyJob(DTS_LIB_CONTEXT *Ctx, DTS_COPY_JOB *j)
+{
+	DtsCopyLock(Ctx);
+	DtsCopyFrame(Ctx->CopyPool, j);
+	DtsCopyUnLock(Ctx);
+
+	return BC_STS_SUCCESS;
+}
+
 BC_STATUS
 DtsCopyRawDataToOutBuff(DTS_LIB_CONTEXT	*Ctx,
 						BC_DTS_PROC_OUT *Vout,
 						BC_DTS_PROC_OUT *Vin)
 {
-	uint32_t	y,lDestStride=0;
-	uint8_t	*pSrc = NULL, *pDest=NULL;
+	uint32_t	lDestStride=0;
 	uint32_t	dstWidthInPixels, dstHeightInPixels;
-	uint32_t srcWidthInPixels = 0, srcHeightInPixels;
+	uint32_t srcWidthInPixels = 0;
+	DTS_COPY_JOB	job;
 	BC_STATUS	Sts = BC_STS_SUCCESS;
 
 	if ( (Sts = DtsChkYUVSizes(Ctx,Vout,Vin)) != BC_STS_SUCCESS)
@@ -1240,7 +1259,6 @@ DtsCopyRawDataToOutBuff(DTS_LIB_CONTEXT	*Ctx,
 		}
 #endif
 		srcWidthInPixels = Ctx->HWOutPicWidth;
-		srcHeightInPixels = dstHeightInPixels;
 	} else {
 		dstWidthInPixels = Vin->PicInfo.width;
 		dstHeightInPixels = Vin->PicInfo.height;
@@ -1249,24 +1267,24 @@ DtsCopyRawDataToOutBuff(DTS_LIB_CONTEXT	*Ctx,
 	lDestStride = lDestStride*2;
 	dstWidthInPixels = dstWidthInPixels*2;
 	srcWidthInPixels = srcWidthInPixels*2;
+	memset(&job, 0, sizeof(job));
+	job.copyFlags = DtsCopyFlags(Vout);
+	job.Rows = DtsCopyPlaneRows;
+	job.dstY = Vout->Ybuff;
+	job.srcY = Vin->Ybuff;
+	job.dstWidth = dstWidthInPixels;
+	job.height = dstHeightInPixels;
+
 	// Do a strided copy only if the stride is non-zero
 	if( (lDestStride != 0)|| (srcWidthInPixels != dstWidthInPixels) ) {
-		// Y plane
-		pDest = Vout->Ybuff;
-		pSrc = Vin->Ybuff;
-		for (y = 0; y < dstHeightInPixels; y++){
-			memcpy(pDest,pSrc,dstWidthInPixels);
-			//memcpy_fast(pDest,pSrc,dstWidthInPixels*2);
-			pDest += dstWidthInPixels + lDestStride;
-			pSrc += (srcWidthInPixels);
-		}
+		job.srcWidth = srcWidthInPixels;
+		job.strideY = lDestStride;
 	} else {
-		// Y Plane
-		memcpy(Vout->Ybuff, Vin->Ybuff, dstHeightInPixels * dstWidthInPixels);
-		//memcpy_fast(Vout->Ybuff, Vin->Ybuff, dstHeightInPixels * dstWidthInPixels * 2);
+		job.srcWidth = dstWidthInPixels;
 	}
 
-	return BC_STS_SUCCESS;
+	// Y plane
+	return DtsRunCopyJob(Ctx, &job);
 }
 /***/
 //FIX_ME:: This routine assumes, Y & UV buffs are contiguous..
@@ -1277,10 +1295,10 @@ BC_STATUS DtsCopyNV12ToYV12(DTS_LIB_CONTEXT	*Ctx, BC_DTS_PROC_OUT *Vout, BC_DTS_
 	uint8_t	*yv12buff = NULL;
 	uint32_t uvbase=0;
 	BC_STATUS	Sts = BC_STS_SUCCESS;
-	uint32_t	x,y,lDestStrideY=0, lDestStrideUV=0;
-	uint8_t	*pSrc = NULL, *pDest=NULL;
+	uint32_t	x,lDestStrideY=0, lDestStrideUV=0;
 	uint32_t	dstWidthInPixels, dstHeightInPixels;
-	uint32_t srcWidthInPixels, srcHeightInPixels;
+	uint32_t srcWidthInPixels;
+	DTS_COPY_JOB	job;
 
 
 	if ( (Sts = DtsChkYUVSizes(Ctx,Vout,Vin)) != BC_STS_SUCCESS)
@@ -1308,51 +1326,42 @@ BC_STATUS DtsCopyNV12ToYV12(DTS_LIB_CONTEXT	*Ctx, BC_DTS_PROC_OUT *Vout, BC_DTS_
 			return BC_STS_IO_XFR_ERROR;
 		}
 		srcWidthInPixels = Ctx->HWOutPicWidth;
-		srcHeightInPixels = dstHeightInPixels;
 
-		//copy luma
-		pDest = Vout->Ybuff;
-		pSrc = Vin->Ybuff;
-		for (y = 0; y < dstHeightInPixels; y++)
-		{
-			memcpy(pDest,pSrc,dstWidthInPixels);
-			pDest += dstWidthInPixels + lDestStrideY;
-			pSrc += srcWidthInPixels;
-		}
-		//copy chroma
-		pDest = Vout->UVbuff;
-		pSrc = Vin->UVbuff;
-		uvbase = (dstWidthInPixels + lDestStrideY) * dstHeightInPixels/4 ;//(Vin->UVBuffDoneSz * 4/2);
-		for (y = 0; y < dstHeightInPixels/2; y++)
-		{
-			for(x = 0; x < dstWidthInPixels; x += 2)
-			{
-				pDest[x/2] = pSrc[x+1];
-				pDest[uvbase + x/2] = pSrc[x];
-			}
-			pDest += dstWidthInPixels / 2 + lDestStrideUV;
-			pSrc += srcWidthInPixels;
-		}
+		// V plane first then U, each sized for the luma stride. An odd
+		// height has one more chroma line.
+		uvbase = (dstWidthInPixels + lDestStrideY) * ((dstHeightInPixels + 1) & ~1) / 4;
+
+		memset(&job, 0, sizeof(job));
+		job.Rows = DtsCopy420ToYV12;
+		job.copyFlags = DtsCopyFlags(Vout);
+		job.dstY = Vout->Ybuff;
+		job.dstU = Vout->UVbuff + uvbase;
+		job.dstV = Vout->UVbuff;
+		job.srcY = Vin->Ybuff;
+		job.srcUV = Vin->UVbuff;
+		job.srcWidth = srcWidthInPixels;
+		job.dstWidth = dstWidthInPixels;
+		job.height = dstHeightInPixels;
+		job.strideY = lDestStrideY;
+		job.strideU = lDestStrideUV;
+		return DtsRunCopyJob(Ctx, &job);
 	}
 	else
 	{
 		/* Y-Buff loop */
-		buff = Vin->Ybuff;
-		yv12buff = Vout->Ybuff;
-		for(uint32_t i = 0; i < Vin->YBuffDoneSz*4; i += 2) {
-			yv12buff[i] = buff[i];
-			yv12buff[i+1] = buff[i+1];
-		}
+		gDtsCopyOps.Memcpy(Vout->Ybuff, Vin->Ybuff, Vin->YBuffDoneSz*4, DtsCopyFlags(Vout));
 
 		/* UV-Buff loop */
 		buff = Vin->UVbuff;
 		yv12buff = Vout->UVbuff;
 		uvbase = (Vin->UVBuffDoneSz * 4/2);
-		for(uint32_t i = 0; i < Vin->UVBuffDoneSz*4; i += 2) {
+		x = 2 * gDtsCopyOps.Yuy2ToNv12(yv12buff + uvbase, yv12buff, buff, uvbase, DtsCopyFlags(Vout));
+		for(uint32_t i = x; i < Vin->UVBuffDoneSz*4; i += 2) {
 			yv12buff[i/2] = buff[i+1];
 			yv12buff[uvbase + (i/2)] = buff[i];
 		}
 	}
+	gDtsCopyOps.Fence();
 
 	return BC_STS_SUCCESS;
 }
@@ -1360,10 +1369,10 @@ BC_STATUS DtsCopyNV12ToYV12(DTS_LIB_CONTEXT	*Ctx, BC_DTS_PROC_OUT *Vout, BC_DTS_
 
 BC_STATUS DtsCopyNV12(DTS_LIB_CONTEXT *Ctx, BC_DTS_PROC_OUT *Vout, BC_DTS_PROC_OUT *Vin)
 {
-	uint32_t y,lDestStrideY=0,lDestStrideUV=0;
-	uint8_t	*pSrc = NULL, *pDest=NULL;
+	uint32_t lDestStrideY=0,lDestStrideUV=0;
 	uint32_t dstWidthInPixels, dstHeightInPixels;
-	uint32_t srcWidthInPixels=0, srcHeightInPixels;
+	uint32_t srcWidthInPixels=0;
+	DTS_COPY_JOB job;
 
 	BC_STATUS	Sts = BC_STS_SUCCESS;
 
@@ -1387,7 +1396,6 @@ BC_STATUS DtsCopyNV12(DTS_LIB_CONTEXT *Ctx, BC_DTS_PROC_OUT *Vout, BC_DTS_PROC_O
 			(Vout->UVBuffDoneSz < (dstWidthInPixels * dstHeightInPixels/2 / 4)))
 			return BC_STS_IO_XFR_ERROR;
 		srcWidthInPixels = Ctx->HWOutPicWidth;
-		srcHeightInPixels = dstHeightInPixels;
 	} else {
 		dstWidthInPixels = Vin->PicInfo.width;
 		dstHeightInPixels = Vin->PicInfo.height;
@@ -1395,639 +1403,58 @@ BC_STATUS DtsCopyNV12(DTS_LIB_CONTEXT *Ctx, BC_DTS_PROC_OUT *Vout, BC_DTS_PROC_O
 
 	// NV12 is planar: Y plane, followed by packed U-V plane.
 
-	// Do a strided copy only if the stride is non-zero
-	if((lDestStrideY != 0) || (lDestStrideUV != 0) || (srcWidthInPixels != dstWidthInPixels)) {
-		// Y plane
-		pDest = Vout->Ybuff;
-		pSrc = Vin->Ybuff;
-		for (y = 0; y < dstHeightInPixels; y++){
-			memcpy(pDest,pSrc,dstWidthInPixels);
-			pDest += dstWidthInPixels + lDestStrideY;
-			pSrc += srcWidthInPixels;
-		}
-	// U-V plane
-		pDest = Vout->UVbuff;
-		pSrc = Vin->UVbuff;
-		for (y = 0; y < dstHeightInPixels/2; y++){
-			memcpy(pDest,pSrc,dstWidthInPixels);
-			pDest += dstWidthInPixels + lDestStrideUV;
-			pSrc += srcWidthInPixels;
-		}
-	} else {
-		// Y Plane
-		memcpy(Vout->Ybuff, Vin->Ybuff, dstHeightInPixels * dstWidthInPixels);
-		// UV Plane
-		memcpy(Vout->UVbuff, Vin->UVbuff, dstHeightInPixels/2 * dstWidthInPixels);
-
-	}
-
-	return BC_STS_SUCCESS;
-}
-
-// TODO: add sse2 detection
-static bool gSSE2 = true; // most of the platforms will have it anyway:
-// 64 bits: no test necessary
-// mac: no test necessary
-// linux/windows: we might have to do the test.
-
-static void fast_memcpy(uint8_t *dst, const uint8_t *src, uint32_t count)
-{
-	// tested
-	if (gSSE2)
-	{
-		if (((((uintptr_t) dst) & 0xf) == 0) && ((((uintptr_t) src) & 0xf) == 0))
-		{
-			while (count >= (16*4))
-			{
-				_mm_stream_si128((__m128i *) (dst+ 0*16),  _mm_load_si128((__m128i *) (src+ 0*16)));
-				_mm_stream_si128((__m128i *) (dst+ 1*16),  _mm_load_si128((__m128i *) (src+ 1*16)));
-				_mm_stream_si128((__m128i *) (dst+ 2*16),  _mm_load_si128((__m128i *) (src+ 2*16)));
-				_mm_stream_si128((__m128i *) (dst+ 3*16),  _mm_load_si128((__m128i *) (src+ 3*16)));
-				count -= 16*4;
-				src += 16*4;
-				dst += 16*4;
-			}
-		}
-		else
-		{
-			while (count >= (16*4))
-			{
-				_mm_storeu_si128((__m128i *) (dst+ 0*16),  _mm_loadu_si128((__m128i *) (src+ 0*16)));
-				_mm_storeu_si128((__m128i *) (dst+ 1*16),  _mm_loadu_si128((__m128i *) (src+ 1*16)));
-				_mm_storeu_si128((__m128i *) (dst+ 2*16),  _mm_loadu_si128((__m128i *) (src+ 2*16)));
-				_mm_storeu_si128((__m128i *) (dst+ 3*16),  _mm_loadu_si128((__m128i *) (src+ 3*16)));
-				count -= 16*4;
-				src += 16*4;
-				dst += 16*4;
-			}
-		}
-	}
-
-	while (count --)
-		*dst++ = *src++;
-}
-
-// this is not good.
-// if we have 3 buffers, we cannot assume V is after U
-static BC_STATUS DtsCopy422ToYV12(uint8_t *dstY, uint8_t *dstUV, const uint8_t *srcY, uint32_t srcWidth, uint32_t dstWidth, uint32_t height, uint32_t strideY, uint32_t strideUV)
-{ // copy YUY2 to YV12
-	// TODO
-	// NOTE: if we want to support this porperly, we will need to add a Vbuffer pointer
-	// if we have 3 destination buffers, there's no guarantee that V buffer is derivable from UV pointer.
-	return BC_STS_INV_ARG;
-}
-
-// this is just a memcpy
-static BC_STATUS DtsCopy422ToYUY2(uint8_t *dstY, uint8_t *dstUV, const uint8_t *srcY, uint32_t srcWidth, uint32_t dstWidth, uint32_t height, uint32_t strideY, uint32_t strideUV)
-{ // copy YUY2 to YUY2
-	uint32_t y;
-
-	// TODO: test this
-	strideY += dstWidth*2;
-
-	for (y = 0; y < height; y++)
-	{
-		fast_memcpy(dstY, srcY, srcWidth*2);
-		srcY += srcWidth*2;
-		dstY += strideY;
-	}
-	return BC_STS_SUCCESS;
-}
-
-// almost a memcpy, we just need to shuffle YUV's around
-static BC_STATUS DtsCopy422ToUYVY(uint8_t *dstY, uint8_t *dstUV, const uint8_t *srcY, uint32_t srcWidth, uint32_t dstWidth, uint32_t height, uint32_t strideY, uint32_t strideUV)
-{
-	// TODO, test this
-	uint32_t x = 0, __y;
-
-	strideY += dstWidth*2;
-
-	for (__y = 0; __y < height; __y++)
-	{
-		if (gSSE2)
-		{
-			if (((((uintptr_t) dstY) & 0xf) == 0) && ((((uintptr_t) srcY) & 0xf) == 0))
-			{
-				while (x < srcWidth-7)
-				{
-					__m128i v = _mm_load_si128((__m128i *)(srcY+x*2));
-					__m128i v1 = _mm_srli_epi16(v, 8);
-					__m128i v2 = _mm_slli_epi16(v, 8);
-					_mm_stream_si128((__m128i *)(dstY+x*2), _mm_or_si128(v1, v2));
-					x += 8;
-				}
-			}
-			else
-			{
-				while (x < srcWidth-7)
-				{
-					__m128i v = _mm_loadu_si128((__m128i *)(srcY+x*2));
-					__m128i v1 = _mm_srli_epi16(v, 8);
-					__m128i v2 = _mm_slli_epi16(v, 8);
-					_mm_storeu_si128((__m128i *)(dstY+x*2), _mm_or_si128(v1, v2));
-					x += 8;
-				}
-			}
-		}
-
-		while (x < srcWidth-1)
-		{
-			dstY[x*2+0] = srcY[x+1];
-			dstY[x*2+1] = srcY[x+0];
-			dstY[x*2+2] = srcY[x+3];
-			dstY[x*2+3] = srcY[x+2];
-			x += 2;
-		}
-
-		srcY += srcWidth*2;
-		dstY += strideY;
-	}
-	return BC_STS_SUCCESS;
-}
-
-// convert to NV12
-static BC_STATUS DtsCopy422ToNV12(uint8_t *dstY, uint8_t *dstUV, const uint8_t *srcY, uint32_t srcWidth, uint32_t dstWidth, uint32_t height, uint32_t strideY, uint32_t strideUV)
-{
-	// tested
-	uint32_t x, __y;
-
-	strideY += dstWidth;
-	strideUV += dstWidth;
-
-	static __m128i mask = _mm_set_epi16(0x00ff, 0x00ff, 0x00ff, 0x00ff, 0x00ff, 0x00ff, 0x00ff, 0x00ff);
-
-	for (__y = 0; __y < height; __y += 2)
-	{
-		x = 0;
-
-		// first line: Y and UV extraction
+	memset(&job, 0, sizeof(job));
+	job.copyFlags = DtsCopyFlags(Vout);
+	job.Rows = DtsCopyPlaneRows;
+	job.dstWidth = dstWidthInPixels;
 
-		if (gSSE2)
-		{
-			if (((((uintptr_t) dstY) & 0xf) == 0) && ((((uintptr_t) srcY) & 0xf) == 0) && ((((uintptr_t) dstUV) & 0xf) == 0))
-			{
-				while (x < srcWidth-15)
-				{
-					__m128i s1 = _mm_load_si128((__m128i *) (srcY+x*2+ 0)); // load 8 pixels
-					__m128i s2 = _mm_load_si128((__m128i *) (srcY+x*2+16)); // load 8 more
-
-					__m128i y1 = _mm_and_si128(s1, mask); // mask out uvs
-					__m128i y2 = _mm_and_si128(s2, mask); // mask out uvs
-					__m128i y = _mm_packus_epi16 (y1, y2); // get the y together
-					_mm_stream_si128((__m128i *) (dstY+x), y); // store 16 Y
-
-					s1 = _mm_srli_epi16(s1, 8); // get rid of Y
-					s2 = _mm_srli_epi16(s2, 8); // get rid of Y
-					__m128i uv = _mm_packus_epi16 (s1, s2); // get the uv together
-					_mm_stream_si128((__m128i *) (dstUV+x), uv); // store 8 UV pairs
-
-					x += 16;
-				}
-			}
-			else
-			{
-				while (x < srcWidth-15)
-				{
-					__m128i s1 = _mm_loadu_si128((__m128i *) (srcY+x*2+ 0)); // load 8 pixels
-					__m128i s2 = _mm_loadu_si128((__m128i *) (srcY+x*2+16)); // load 8 more
-
-					__m128i y1 = _mm_and_si128(s1, mask); // mask out uvs
-					__m128i y2 = _mm_and_si128(s2, mask); // mask out uvs
-					__m128i y = _mm_packus_epi16 (y1, y2); // get the y together
-					_mm_storeu_si128((__m128i *) (dstY+x), y); // store 16 Y
-
-					s1 = _mm_srli_epi16(s1, 8); // get rid of Y
-					s2 = _mm_srli_epi16(s2, 8); // get rid of Y
-					__m128i uv = _mm_packus_epi16 (s1, s2); // get the uv together
-					_mm_storeu_si128((__m128i *) (dstUV+x), uv); // store 8 UV pairs
-
-					x += 16;
-				}
-			}
-		}
-
-
-		while (x < srcWidth-1)
-		{
-			dstY [x+0] = srcY[x*2+0]; // Y
-			dstUV[x+0] = srcY[x*2+1]; // U
-			dstY [x+1] = srcY[x*2+2]; // Y
-			dstUV[x+1] = srcY[x*2+3]; // V
-			x += 2;
-		}
-
-		srcY += srcWidth*2;
-		dstY += strideY;
-		dstUV += strideUV;
-
-		// second line: just Y
-		x = 0;
-		if (gSSE2)
-		{
-			if (((((uintptr_t) dstY) & 0xf) == 0) && ((((uintptr_t) srcY) & 0xf) == 0))
-			{
-				while (x < srcWidth-15)
-				{
-					__m128i s1 = _mm_load_si128((__m128i *) (srcY+x*2+ 0)); // load 8 pixels
-					__m128i s2 = _mm_load_si128((__m128i *) (srcY+x*2+16)); // load 8 more
-
-					__m128i y1 = _mm_and_si128(s1, mask); // mask out uvs
-					__m128i y2 = _mm_and_si128(s2, mask); // mask out uvs
-					__m128i y = _mm_packus_epi16 (y1, y2); // get the y
-					_mm_stream_si128((__m128i *) (dstY+x), y); // store 16 Y
-
-					x += 16;
-				}
-			}
-			else
-			{
-				while (x < srcWidth-15)
-				{
-					__m128i s1 = _mm_loadu_si128((__m128i *) (srcY+x*2+ 0)); // load 8 pixels
-					__m128i s2 = _mm_loadu_si128((__m128i *) (srcY+x*2+16)); // load 8 more
-
-					__m128i y1 = _mm_and_si128(s1, mask); // mask out uvs
-					__m128i y2 = _mm_and_si128(s2, mask); // mask out uvs
-					__m128i y = _mm_packus_epi16 (y1, y2); // get the y
-					_mm_storeu_si128((__m128i *) (dstY+x), y); // store 16 Y
-
-					x += 16;
-				}
-			}
-		}
-
-		while (x < srcWidth-1)
-		{
-			dstY [x+0] = srcY[x*2+0]; // Y
-			dstY [x+1] = srcY[x*2+2]; // Y
-			x += 2;
-		}
-
-		srcY += srcWidth*2;
-		dstY += strideY;
-	}
-	return BC_STS_SUCCESS;
-}
+	// Do a strided copy only if the stride is non-zero
+	if((lDestStrideY != 0) || (lDestStrideUV != 0) || (srcWidthInPixels != dstWidthInPixels))
+		job.srcWidth = srcWidthInPixels;
+	else
+		job.srcWidth = dstWidthInPixels;
 
+	// Y plane
+	job.dstY = Vout->Ybuff;
+	job.srcY = Vin->Ybuff;
+	job.height = dstHeightInPixels;
+	job.strideY = lDestStrideY;
+	DtsRunCopyJob(Ctx, &job);
 
-// this is not good.
-// if we have 3 textures, we cannot assume V is after U
-static BC_STATUS DtsCopy420ToYV12(uint8_t *dstY, uint8_t *dstUV, const uint8_t *srcY, const uint8_t *srcUV, uint32_t srcWidth, uint32_t dstWidth, uint32_t height, uint32_t strideY, uint32_t strideUV)
-{
-	// TODO
-	// NOTE: if we want to support this porperly, we will need to add a Vbuffer pointer
-	return BC_STS_INV_ARG;
+	// U-V plane
+	job.dstY = Vout->UVbuff;
+	job.srcY = Vin->UVbuff;
+	job.height = dstHeightInPixels/2;
+	job.strideY = lDestStrideUV;
+	return DtsRunCopyJob(Ctx, &job);
 }
 
-static BC_STATUS DtsCopy420ToYUY2(uint8_t *dstY, uint8_t *dstUV, const uint8_t *srcY, const uint8_t *srcUV, uint32_t srcWidth, uint32_t dstWidth, uint32_t height, uint32_t strideY, uint32_t strideUV)
-{
-	// TODO, test this
-	uint32_t x, __y;
-
-	strideY += dstWidth*2;
+// ExSize a caller needs for the EX fields up to and including f
+#define DTS_PROC_OUT_EX_END(f)	(offsetof(BC_DTS_PROC_OUT_EX, f) + sizeof(((BC_DTS_PROC_OUT_EX *)0)->f))
 
-	__y = 0;
-	while (__y < height-2)
-	{
-		// first line
-		x = 0;
-
-		if (gSSE2)
-		{
-			if (((((uintptr_t) dstY) & 0xf) == 0) && ((((uintptr_t) srcY) & 0xf) == 0))
-			{
-				while (x < srcWidth-15)
-				{
-					__m128i y = _mm_load_si128((__m128i *) (srcY+x)); // load 16 Y pixels
-					__m128i uv = _mm_load_si128((__m128i *) (srcUV+x)); // load 8 UV
-					_mm_stream_si128((__m128i *) (dstY+x*2+ 0), _mm_unpacklo_epi8(y, uv)); // store 8 pixels
-					_mm_stream_si128((__m128i *) (dstY+x*2+16), _mm_unpackhi_epi8(y, uv)); // store 8 pixels
-
-					x += 16;
-				}
-			}
-			else
-			{
-				while (x < srcWidth-15)
-				{
-					__m128i y = _mm_loadu_si128((__m128i *) (srcY+x)); // load 16 Y pixels
-					__m128i uv = _mm_loadu_si128((__m128i *) (srcUV+x)); // load 8 UV
-					_mm_storeu_si128((__m128i *) (dstY+x*2+ 0), _mm_unpacklo_epi8(y, uv)); // store 8 pixels
-					_mm_storeu_si128((__m128i *) (dstY+x*2+16), _mm_unpackhi_epi8(y, uv)); // store 8 pixels
-
-					x += 16;
-				}
-			}
-		}
-
-		while (x < srcWidth-1)
-		{
-			dstY[x*2+0] = srcY [x+0];
-			dstY[x*2+1] = srcUV[x+0];
-			dstY[x*2+2] = srcY [x+1];
-			dstY[x*2+3] = srcUV[x+1];
-
-			x += 2;
-		}
-
-		srcY += srcWidth;
-		dstY += strideY;
-
-		// second line
-
-		x = 0;
-
-		if (gSSE2)
-		{
-			if (((((uintptr_t) dstY) & 0xf) == 0) && ((((uintptr_t) srcY) & 0xf) == 0))
-			{
-				while (x < srcWidth-15)
-				{
-					__m128i y = _mm_load_si128((__m128i *) (srcY+x)); // load 16 Y pixels
-					__m128i uv1 = _mm_load_si128((__m128i *) (srcUV+x)); // load 8 UV
-					__m128i uv2 = _mm_load_si128((__m128i *) (srcUV+x+srcWidth)); // load 8 UV
-					__m128i uv = _mm_avg_epu8(uv1, uv2);
-					_mm_stream_si128((__m128i *) (dstY+x*2+ 0), _mm_unpacklo_epi8(y, uv)); // store 8 pixels
-					_mm_stream_si128((__m128i *) (dstY+x*2+16), _mm_unpackhi_epi8(y, uv)); // store 8 pixels
-
-					x += 16;
-				}
-			}
-			else
-			{
-				while (x < srcWidth-15)
-				{
-					__m128i y = _mm_loadu_si128((__m128i *) (srcY+x)); // load 16 Y pixels
-					__m128i uv1 = _mm_loadu_si128((__m128i *) (srcUV+x)); // load 8 UV
-					__m128i uv2 = _mm_loadu_si128((__m128i *) (srcUV+x+srcWidth)); // load 8 UV
-					__m128i uv = _mm_avg_epu8(uv1, uv2);
-					_mm_storeu_si128((__m128i *) (dstY+x*2+ 0), _mm_unpacklo_epi8(y, uv)); // store 8 pixels
-					_mm_storeu_si128((__m128i *) (dstY+x*2+16), _mm_unpackhi_epi8(y, uv)); // store 8 pixels
-
-					x += 16;
-				}
-			}
-		}
-
-		while (x < srcWidth-1)
-		{
-			dstY[x*2+0] = srcY [x+0];
-			dstY[x*2+1] = (srcUV[x+0] + srcUV[x+0+srcWidth])/2;
-			dstY[x*2+2] = srcY [x+1];
-			dstY[x*2+3] = (srcUV[x+1] + srcUV[x+1+srcWidth])/2;
-
-			x += 2;
-		}
-
-		srcY += srcWidth;
-		srcUV += srcWidth;
-		dstY += strideY;
-
-		__y += 2;
-	}
-
-	// last 2 lines
-	while (__y < height)
-	{
-		x = 0;
-
-		if (gSSE2)
-		{
-			if (((((uintptr_t) dstY) & 0xf) == 0) && ((((uintptr_t) srcY) & 0xf) == 0))
-			{
-				while (x < srcWidth-15)
-				{
-					__m128i y = _mm_load_si128((__m128i *) (srcY+x)); // load 16 Y pixels
-					__m128i uv = _mm_load_si128((__m128i *) (srcUV+x)); // load 8 UV
-					_mm_stream_si128((__m128i *) (dstY+x*2+ 0), _mm_unpacklo_epi8(y, uv)); // store 8 pixels
-					_mm_stream_si128((__m128i *) (dstY+x*2+16), _mm_unpackhi_epi8(y, uv)); // store 8 pixels
-
-					x += 16;
-				}
-			}
-			else
-			{
-				while (x < srcWidth-15)
-				{
-					__m128i y = _mm_loadu_si128((__m128i *) (srcY+x)); // load 16 Y pixels
-					__m128i uv = _mm_loadu_si128((__m128i *) (srcUV+x)); // load 8 UV
-					_mm_storeu_si128((__m128i *) (dstY+x*2+ 0), _mm_unpacklo_epi8(y, uv)); // store 8 pixels
-					_mm_storeu_si128((__m128i *) (dstY+x*2+16), _mm_unpackhi_epi8(y, uv)); // store 8 pixels
-
-					x += 16;
-				}
-			}
-		}
-
-		while (x < srcWidth-1)
-		{
-			dstY[x*2+0] = srcY [x+0];
-			dstY[x*2+1] = srcUV[x+0];
-			dstY[x*2+2] = srcY [x+1];
-			dstY[x*2+3] = srcUV[x+1];
-
-			x += 2;
-		}
-
-		srcY += srcWidth;
-		dstY += strideY;
-
-		__y++;
-	}
-
-	return BC_STS_SUCCESS;
-}
-
-static BC_STATUS DtsCopy420ToUYVY(uint8_t *dstY, uint8_t *dstUV, const uint8_t *srcY, const uint8_t *srcUV, uint32_t srcWidth, uint32_t dstWidth, uint32_t height, uint32_t strideY, uint32_t strideUV)
+//------------------------------------------------------------------------
+// Name: DtsGetProcOutEx
+// Description: The extended ProcOut Vout heads, if the caller passed one
+//              new enough to hold NeedSz bytes of it.
+//------------------------------------------------------------------------
+static BC_DTS_PROC_OUT_EX *DtsGetProcOutEx(BC_DTS_PROC_OUT *Vout, uint32_t NeedSz)
 {
-	// TODO, test this
-	uint32_t x, __y;
-
-	strideY += dstWidth*2;
-
-	__y = 0;
-	while (__y < height-2)
-	{
-		// first line
-		x = 0;
+	BC_DTS_PROC_OUT_EX *VoutEx = (BC_DTS_PROC_OUT_EX *)Vout;
 
-		if (gSSE2)
-		{
-			if (((((uintptr_t) dstY) & 0xf) == 0) && ((((uintptr_t) srcY) & 0xf) == 0))
-			{
-				while (x < srcWidth-15)
-				{
-					__m128i y = _mm_load_si128((__m128i *) (srcY+x)); // load 16 Y pixels
-					__m128i uv = _mm_load_si128((__m128i *) (srcUV+x)); // load 8 UV
-					_mm_stream_si128((__m128i *) (dstY+x*2+ 0), _mm_unpacklo_epi8(uv, y)); // store 8 pixels
-					_mm_stream_si128((__m128i *) (dstY+x*2+16), _mm_unpackhi_epi8(uv, y)); // store 8 pixels
-
-					x += 16;
-				}
-			}
-			else
-			{
-				while (x < srcWidth-15)
-				{
-					__m128i y = _mm_loadu_si128((__m128i *) (srcY+x)); // load 16 Y pixels
-					__m128i uv = _mm_loadu_si128((__m128i *) (srcUV+x)); // load 8 UV
-					_mm_storeu_si128((__m128i *) (dstY+x*2+ 0), _mm_unpacklo_epi8(uv, y)); // store 8 pixels
-					_mm_storeu_si128((__m128i *) (dstY+x*2+16), _mm_unpackhi_epi8(uv, y)); // store 8 pixels
-
-					x += 16;
-				}
-			}
-		}
-
-		while (x < srcWidth-1)
-		{
-			dstY[x*2+1] = srcY [x+0];
-			dstY[x*2+0] = srcUV[x+0];
-			dstY[x*2+3] = srcY [x+1];
-			dstY[x*2+2] = srcUV[x+1];
+	if (!(Vout->PoutFlags & BC_POUT_FLAGS_EXT))
+		return NULL;
+	if (VoutEx->ExSize < NeedSz)
+		return NULL;
 
-			x += 2;
-		}
-
-		srcY += srcWidth;
-		dstY += strideY;
-
-		// second line
-
-		x = 0;
-
-		if (gSSE2)
-		{
-			if (((((uintptr_t) dstY) & 0xf) == 0) && ((((uintptr_t) srcY) & 0xf) == 0))
-			{
-				while (x < srcWidth-15)
-				{
-					__m128i y = _mm_load_si128((__m128i *) (srcY+x)); // load 16 Y pixels
-					__m128i uv1 = _mm_load_si128((__m128i *) (srcUV+x)); // load 8 UV
-					__m128i uv2 = _mm_load_si128((__m128i *) (srcUV+x+srcWidth)); // load 8 UV
-					__m128i uv = _mm_avg_epu8(uv1, uv2);
-					_mm_stream_si128((__m128i *) (dstY+x*2+ 0), _mm_unpacklo_epi8(uv, y)); // store 8 pixels
-					_mm_stream_si128((__m128i *) (dstY+x*2+16), _mm_unpackhi_epi8(uv, y)); // store 8 pixels
-
-					x += 16;
-				}
-			}
-			else
-			{
-				while (x < srcWidth-15)
-				{
-					__m128i y = _mm_loadu_si128((__m128i *) (srcY+x)); // load 16 Y pixels
-					__m128i uv1 = _mm_loadu_si128((__m128i *) (srcUV+x)); // load 8 UV
-					__m128i uv2 = _mm_loadu_si128((__m128i *) (srcUV+x+srcWidth)); // load 8 UV
-					__m128i uv = _mm_avg_epu8(uv1, uv2);
-					_mm_storeu_si128((__m128i *) (dstY+x*2+ 0), _mm_unpacklo_epi8(uv, y)); // store 8 pixels
-					_mm_storeu_si128((__m128i *) (dstY+x*2+16), _mm_unpackhi_epi8(uv, y)); // store 8 pixels
-
-					x += 16;
-				}
-			}
-		}
-
-		while (x < srcWidth-1)
-		{
-			dstY[x*2+1] = srcY [x+0];
-			dstY[x*2+0] = (srcUV[x+0] + srcUV[x+0+srcWidth])/2;
-			dstY[x*2+3] = srcY [x+1];
-			dstY[x*2+2] = (srcUV[x+1] + srcUV[x+1+srcWidth])/2;
-
-			x += 2;
-		}
-
-		srcY += srcWidth;
-		srcUV += srcWidth;
-		dstY += strideY;
-	}
-
-	// last 2 lines
-	while (__y < height)
-	{
-		x = 0;
-
-		if (gSSE2)
-		{
-			if (((((uintptr_t) dstY) & 0xf) == 0) && ((((uintptr_t) srcY) & 0xf) == 0))
-			{
-				while (x < srcWidth-15)
-				{
-					__m128i y = _mm_load_si128((__m128i *) (srcY+x)); // load 16 Y pixels
-					__m128i uv = _mm_load_si128((__m128i *) (srcUV+x)); // load 8 UV
-					_mm_stream_si128((__m128i *) (dstY+x*2+ 0), _mm_unpacklo_epi8(uv, y)); // store 8 pixels
-					_mm_stream_si128((__m128i *) (dstY+x*2+16), _mm_unpackhi_epi8(uv, y)); // store 8 pixels
-
-					x += 16;
-				}
-			}
-			else
-			{
-				while (x < srcWidth-15)
-				{
-					__m128i y = _mm_loadu_si128((__m128i *) (srcY+x)); // load 16 Y pixels
-					__m128i uv = _mm_loadu_si128((__m128i *) (srcUV+x)); // load 8 UV
-					_mm_storeu_si128((__m128i *) (dstY+x*2+ 0), _mm_unpacklo_epi8(uv, y)); // store 8 pixels
-					_mm_storeu_si128((__m128i *) (dstY+x*2+16), _mm_unpackhi_epi8(uv, y)); // store 8 pixels
-
-					x += 16;
-				}
-			}
-		}
-
-		while (x < srcWidth-1)
-		{
-			dstY[x*2+1] = srcY [x+0];
-			dstY[x*2+0] = srcUV[x+0];
-			dstY[x*2+3] = srcY [x+1];
-			dstY[x*2+2] = srcUV[x+1];
-
-			x += 2;
-		}
-
-		srcY += srcWidth;
-		dstY += strideY;
-
-		__y++;
-	}
-
-	return BC_STS_SUCCESS;
-}
-
-static BC_STATUS DtsCopy420ToNV12(uint8_t *dstY, uint8_t *dstUV, const uint8_t *srcY, const uint8_t *srcUV, uint32_t srcWidth, uint32_t dstWidth, uint32_t height, uint32_t strideY, uint32_t strideUV)
-{ // tested
-	uint32_t __y;
-
-	strideY += dstWidth;
-	strideUV += dstWidth;
-
-	// first copy Y
-	for (__y = 0; __y < height; __y++)
-	{
-		fast_memcpy(dstY, srcY, srcWidth);
-		dstY += strideY;
-		srcY += srcWidth;
-	}
-
-	// now copy uvs
-	height /= 2;
-	for (__y = 0; __y < height; __y++)
-	{
-		fast_memcpy(dstUV, srcUV, srcWidth);
-		srcUV += srcWidth;
-		dstUV += strideUV;
-
-	}
-	return BC_STS_SUCCESS;
+	return VoutEx;
 }
 
-
 // copy 422/420 ( device format to format specified in Vout)
 BC_STATUS DtsCopyFormat(DTS_LIB_CONTEXT	*Ctx, BC_DTS_PROC_OUT *Vout, BC_DTS_PROC_OUT *Vin)
 {
 	uint32_t lDestStrideY=0, lDestStrideUV=0;
 	uint32_t dstHeightInPixels;
+	DTS_COPY_JOB job;
 
 	BC_STATUS	Sts = BC_STS_SUCCESS;
 
@@ -2059,61 +1486,117 @@ BC_STATUS DtsCopyFormat(DTS_LIB_CONTEXT	*Ctx, BC_DTS_PROC_OUT *Vout, BC_DTS_PROC
 	if (Ctx->HWOutPicWidth > Vin->PicInfo.width)
 		return BC_STS_IO_XFR_ERROR;
 
+	memset(&job, 0, sizeof(job));
+	job.copyFlags = DtsCopyFlags(Vout);
+	job.dstY = Vout->Ybuff;
+	job.srcY = Vin->Ybuff;
+	job.srcUV = Vin->UVbuff;
+	job.srcWidth = Ctx->HWOutPicWidth;
+	job.dstWidth = Vin->PicInfo.width;
+	job.height = dstHeightInPixels;
+	job.strideY = lDestStrideY;
+
+	if (Vout->PoutFlags & BC_POUT_FLAGS_SCALE) {
+		BC_DTS_PROC_OUT_EX *VoutEx = DtsGetProcOutEx(Vout, DTS_PROC_OUT_EX_END(ScaleHeight));
+
+		if (!VoutEx)
+			return BC_STS_INV_ARG;
+		// only the NV12 path is fused so far
+		if (Ctx->b422Mode || (Vout->b422Mode != OUTPUT_MODE420_NV12)) {
+			DebugLog_Trace(LDIL_DBG,"DtsCopyFormat: No scaling for mode %d to %d\n", Ctx->b422Mode, Vout->b422Mode);
+			return BC_STS_NOT_IMPL;
+		}
+		if ((VoutEx->ScaleWidth < 2) || (VoutEx->ScaleWidth & 1) || (VoutEx->ScaleWidth > job.srcWidth) ||
+		    (VoutEx->ScaleHeight < 2) || (VoutEx->ScaleHeight & 1) || (VoutEx->ScaleHeight > dstHeightInPixels) ||
+		    (job.srcWidth > DTS_SCALE_MAX_WIDTH))
+			return BC_STS_INV_ARG;
+
+		job.Rows = DtsScale420ToNV12;
+		job.dstU = Vout->UVbuff;
+		job.strideU = lDestStrideUV;
+		job.srcHeight = dstHeightInPixels;
+		job.dstWidth = VoutEx->ScaleWidth;
+		job.height = VoutEx->ScaleHeight;
+		Vout->YBuffDoneSz = job.dstWidth * job.height / 4;
+		Vout->UVBuffDoneSz = Vout->YBuffDoneSz / 2;
+		return DtsRunCopyJob(Ctx, &job);
+	}
+
+	if ((Vout->b422Mode == OUTPUT_MODE420_I420) || (Vout->b422Mode == OUTPUT_MODE420_YV12)) {
+		BC_DTS_PROC_OUT_EX *VoutEx = DtsGetProcOutEx(Vout, DTS_PROC_OUT_EX_END(StrideSzV));
+		uint8_t *dstU, *dstV;
+		uint32_t lDestStrideV;
+
+		if (!Vout->UVbuff)
+			return BC_STS_INV_ARG;
+		// chroma planes are half as wide, so is their default padding
+		if (!(Vout->PoutFlags & BC_POUT_FLAGS_STRIDE_UV))
+			lDestStrideUV = lDestStrideY/2;
+
+		if (VoutEx && VoutEx->Vbuff) {
+			// separate planes, UVbuff is U and Vbuff is V in either mode
+			dstU = Vout->UVbuff;
+			dstV = VoutEx->Vbuff;
+			lDestStrideV = VoutEx->StrideSzV;
+			VoutEx->VBuffDoneSz = Vin->UVBuffDoneSz / 2;
+		} else {
+			// contiguous chroma planes in UVbuff, ordered by mode
+			dstU = Vout->UVbuff;
+			dstV = Vout->UVbuff + (Vin->PicInfo.width/2 + lDestStrideUV) * (dstHeightInPixels/2);
+			lDestStrideV = lDestStrideUV;
+			if (Vout->b422Mode == OUTPUT_MODE420_YV12) {
+				uint8_t *tmp = dstU;
+				dstU = dstV;
+				dstV = tmp;
+			}
+		}
+
+		job.Rows = Ctx->b422Mode ? DtsCopy422ToI420 : DtsCopy420ToI420;
+		job.dstU = dstU;
+		job.dstV = dstV;
+		job.strideV = lDestStrideV;
+		job.strideU = lDestStrideUV;
+		return DtsRunCopyJob(Ctx, &job);
+	}
+
 	//DebugLog_Trace(LDIL_DBG,"Copying from %d to %d\n", Ctx->b422Mode, Vout->b422Mode);
 
+	job.dstU = Vout->UVbuff;
+	job.strideU = lDestStrideUV;
+
 	if (Ctx->b422Mode) {
 		// input is 422 (YUY2)
 		switch (Vout->b422Mode) {
 			case OUTPUT_MODE422_YUY2:
-				Sts = DtsCopy422ToYUY2(
-					Vout->Ybuff, Vout->UVbuff, Vin->Ybuff,
-					Ctx->HWOutPicWidth, Vin->PicInfo.width,  dstHeightInPixels, lDestStrideY, lDestStrideUV
-				);
+				job.Rows = DtsCopy422ToYUY2;
 				break;
 			case OUTPUT_MODE422_UYVY:
-				Sts = DtsCopy422ToUYVY(
-					Vout->Ybuff, Vout->UVbuff, Vin->Ybuff,
-					Ctx->HWOutPicWidth, Vin->PicInfo.width, dstHeightInPixels, lDestStrideY, lDestStrideUV
-				);
+				job.Rows = DtsCopy422ToUYVY;
 				break;
 			case OUTPUT_MODE420_NV12:
-				Sts = DtsCopy422ToNV12(
-					Vout->Ybuff, Vout->UVbuff, Vin->Ybuff,
-					Ctx->HWOutPicWidth, Vin->PicInfo.width, dstHeightInPixels, lDestStrideY, lDestStrideUV
-				);
+				job.Rows = DtsCopy422ToNV12;
 				break;
 			default:
-				Sts = BC_STS_INV_ARG;
-				break;
+				return BC_STS_INV_ARG;
 		}
 	}else{
 		// input is 420 (NV12)
 		switch (Vout->b422Mode) {
 			case OUTPUT_MODE422_YUY2:
-				Sts = DtsCopy420ToYUY2(
-					Vout->Ybuff, Vout->UVbuff, Vin->Ybuff, Vin->UVbuff,
-					Ctx->HWOutPicWidth, Vin->PicInfo.width, dstHeightInPixels, lDestStrideY, lDestStrideUV
-				);
+				job.Rows = DtsCopy420ToYUY2;
 				break;
 			case OUTPUT_MODE422_UYVY:
-				Sts = DtsCopy420ToUYVY(
-					Vout->Ybuff, Vout->UVbuff, Vin->Ybuff, Vin->UVbuff,
-					Ctx->HWOutPicWidth, Vin->PicInfo.width, dstHeightInPixels, lDestStrideY, lDestStrideUV
-				);
+				job.Rows = DtsCopy420ToUYVY;
 				break;
 			case OUTPUT_MODE420_NV12:
-				Sts = DtsCopy420ToNV12(
-					Vout->Ybuff, Vout->UVbuff, Vin->Ybuff, Vin->UVbuff,
-					Ctx->HWOutPicWidth, Vin->PicInfo.width, dstHeightInPixels, lDestStrideY, lDestStrideUV
-				);
+				job.Rows = DtsCopy420ToNV12;
 				break;
 			default:
-				Sts = BC_STS_INV_ARG;
-				break;
+				return BC_STS_INV_ARG;
 		}
 	}
 
-	return Sts;
+	return DtsRunCopyJob(Ctx, &job);
 }
 
 
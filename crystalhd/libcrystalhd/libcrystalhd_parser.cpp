@@ -27,6 +27,9 @@
  *******************************************************************/
 
 #include <stdlib.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "7411d.h"
 #include "libcrystalhd_if.h"
 #include "libcrystalhd_priv.h"
@@ -148,6 +151,11 @@ BC_STATUS DtsReleasePESConverter(HANDLE hDevice)
 		free(Ctx->PESConvParams.pStartcodePendBuff);
 	Ctx->PESConvParams.pStartcodePendBuff = NULL;
 
+	if (Ctx->PESConvParams.pSCRestore)
+		free(Ctx->PESConvParams.pSCRestore);
+	Ctx->PESConvParams.pSCRestore = NULL;
+	Ctx->PESConvParams.nSCRestoreMax = 0;
+
 	return BC_STS_SUCCESS;
 }
 
@@ -164,6 +172,11 @@ BC_STATUS DtsInitPESConverter(HANDLE hDevice)
 	Ctx->PESConvParams.pStartcodePendBuff = NULL;
 	Ctx->PESConvParams.lPendBufferSize = 0;
 
+	Ctx->PESConvParams.pSCRestoreBuf = NULL;
+	Ctx->PESConvParams.pSCRestore = NULL;
+	Ctx->PESConvParams.nSCRestore = 0;
+	Ctx->PESConvParams.nSCRestoreMax = 0;
+
 	Ctx->PESConvParams.m_SymbInt.m_nSize = 0;
 	Ctx->PESConvParams.m_SymbInt.m_nUsed = 0;
 	Ctx->PESConvParams.m_SymbInt.m_pCurrent = NULL;
@@ -418,12 +431,173 @@ BC_STATUS DtsSetPESConverter( HANDLE hDevice)
 	return BC_STS_SUCCESS;
 }
 
+// First SPS NAL unit (from the NAL header byte) in an H.264 sequence header.
+// Handles avcC, Annex B and 2 byte length prefixed layouts.
+static const uint8_t *DtsFindAVCSps(const uint8_t *pSrc, uint32_t iSize, uint32_t *pLen)
+{
+	uint32_t i = 0, iLen;
+
+	if (pSrc == NULL || iSize < 4)
+		return NULL;
+
+	// AVCDecoderConfigurationRecord
+	if (pSrc[0] == 0x01)
+	{
+		if (iSize < 8 || (pSrc[5] & 0x1F) == 0)
+			return NULL;
+		iLen = (pSrc[6] << 8) + pSrc[7];
+		if (iLen < 4 || 8 + iLen > iSize)
+			return NULL;
+		*pLen = iLen;
+		return pSrc + 8;
+	}
+
+	if (pSrc[0] == 0x00 && pSrc[1] == 0x00 && (pSrc[2] == 0x01 || (pSrc[2] == 0x00 && pSrc[3] == 0x01)))
+	{
+		while ((i = DtsScanStartCode(pSrc, iSize, i)) + 6 < iSize)
+		{
+			if ((pSrc[i+3] & 0x1F) == 0x7)
+			{
+				*pLen = DtsScanStartCode(pSrc, iSize, i + 3) - (i + 3);
+				return pSrc + i + 3;
+			}
+			i++;
+		}
+		return NULL;
+	}
+
+	while (i + 2 < iSize)
+	{
+		iLen = (pSrc[i] << 8) + pSrc[i+1];
+		if (iLen >= 4 && i + 2 + iLen <= iSize && (pSrc[i+2] & 0x1F) == 0x7)
+		{
+			*pLen = iLen;
+			return pSrc + i + 2;
+		}
+		i += 2 + iLen;
+	}
+	return NULL;
+}
+
+static uint32_t DtsSymbIntBits(HANDLE hDevice, int nBits)
+{
+	uint32_t ulCode = 0;
+
+	while (nBits-- > 0)
+		ulCode = (ulCode << 1) | DtsSymbIntNextBit(hDevice);
+	return ulCode;
+}
+
+// level_idc and num_ref_frames from an SPS NAL unit. Stops at num_ref_frames,
+// the rest of the SPS is not needed. Returns FALSE if the SPS is cut short.
+static BOOL DtsParseAVCSps(HANDLE hDevice, const uint8_t *pSps, uint32_t iLen, uint32_t *pLevel, uint32_t *pNumRefFrames)
+{
+	uint8_t rbsp[256];
+	uint32_t i, j, n = 0, nZeros = 0;
+	ULONG ulCode = 0, ulProfile, ulChroma = 1;
+	int nLast, nNext;
+
+	*pLevel = pSps[3];
+	ulProfile = pSps[1];
+
+	// Drop emulation prevention bytes
+	for (i = 1; i < iLen && n < sizeof(rbsp); i++)
+	{
+		if (nZeros >= 2 && pSps[i] == 0x03)
+		{
+			nZeros = 0;
+			continue;
+		}
+		nZeros = pSps[i] ? 0 : nZeros + 1;
+		rbsp[n++] = pSps[i];
+	}
+	if (n < 4)
+		return FALSE;
+
+	DtsSymbIntSiBuffer(hDevice, rbsp, n);
+	DtsSymbIntBits(hDevice, 24);				// profile, constraints, level
+	if (DtsSymbIntSiUe(hDevice, &ulCode) != BC_STS_SUCCESS)	// seq_parameter_set_id
+		return FALSE;
+
+	if (ulProfile == 100 || ulProfile == 110 || ulProfile == 122 || ulProfile == 244 ||
+	    ulProfile == 44 || ulProfile == 83 || ulProfile == 86 || ulProfile == 118 || ulProfile == 128)
+	{
+		if (DtsSymbIntSiUe(hDevice, &ulChroma) != BC_STS_SUCCESS)
+			return FALSE;
+		if (ulChroma == 3)
+			DtsSymbIntBits(hDevice, 1);		// separate_colour_plane_flag
+		if (DtsSymbIntSiUe(hDevice, &ulCode) != BC_STS_SUCCESS ||	// bit_depth_luma_minus8
+		    DtsSymbIntSiUe(hDevice, &ulCode) != BC_STS_SUCCESS)	// bit_depth_chroma_minus8
+			return FALSE;
+		DtsSymbIntBits(hDevice, 1);			// qpprime_y_zero_transform_bypass_flag
+		if (DtsSymbIntBits(hDevice, 1))		// seq_scaling_matrix_present_flag
+		{
+			for (i = 0; i < ((ulChroma != 3) ? 8U : 12U); i++)
+			{
+				if (!DtsSymbIntBits(hDevice, 1))
+					continue;
+				nLast = nNext = 8;
+				for (j = 0; j < ((i < 6) ? 16U : 64U) && nNext; j++)
+				{
+					if (DtsSymbIntSiUe(hDevice, &ulCode) != BC_STS_SUCCESS)
+						return FALSE;
+					nNext = (nLast + ((ulCode & 1) ? (int)((ulCode + 1) / 2) : -(int)(ulCode / 2)) + 256) % 256;
+					nLast = nNext ? nNext : nLast;
+				}
+			}
+		}
+	}
+
+	if (DtsSymbIntSiUe(hDevice, &ulCode) != BC_STS_SUCCESS)	// log2_max_frame_num_minus4
+		return FALSE;
+	if (DtsSymbIntSiUe(hDevice, &ulCode) != BC_STS_SUCCESS)	// pic_order_cnt_type
+		return FALSE;
+	if (ulCode == 0)
+	{
+		if (DtsSymbIntSiUe(hDevice, &ulCode) != BC_STS_SUCCESS)	// log2_max_pic_order_cnt_lsb_minus4
+			return FALSE;
+	}
+	else if (ulCode == 1)
+	{
+		DtsSymbIntBits(hDevice, 1);			// delta_pic_order_always_zero_flag
+		if (DtsSymbIntSiUe(hDevice, &ulCode) != BC_STS_SUCCESS ||	// offset_for_non_ref_pic
+		    DtsSymbIntSiUe(hDevice, &ulCode) != BC_STS_SUCCESS ||	// offset_for_top_to_bottom_field
+		    DtsSymbIntSiUe(hDevice, &ulCode) != BC_STS_SUCCESS)	// num_ref_frames_in_pic_order_cnt_cycle
+			return FALSE;
+		for (i = ulCode; i > 0; i--)
+		{
+			if (DtsSymbIntSiUe(hDevice, &ulCode) != BC_STS_SUCCESS)
+				return FALSE;
+		}
+	}
+
+	if (DtsSymbIntSiUe(hDevice, &ulCode) != BC_STS_SUCCESS)	// max_num_ref_frames
+		return FALSE;
+	*pNumRefFrames = ulCode;
+
+	return TRUE;
+}
+
 BC_STATUS DtsCheckProfile(HANDLE hDevice)
 {
-/*
 	DTS_LIB_CONTEXT *Ctx = NULL;
 	DTS_GET_CTX(hDevice,Ctx);
 
+	const uint8_t *pSps;
+	uint32_t iSpsLen = 0;
+
+	// The level sizes the TX ring and num_ref_frames the timestamp reorder
+	// window.
+	Ctx->VidParams.LevelIDC = 0;
+	Ctx->VidParams.NumOfRefFrames = 0;
+	if ((Ctx->VidParams.MediaSubType == BC_MSUBTYPE_AVC1) || (Ctx->VidParams.MediaSubType == BC_MSUBTYPE_H264))
+	{
+		pSps = DtsFindAVCSps(Ctx->VidParams.pMetaData, Ctx->VidParams.MetaDataSz, &iSpsLen);
+		if (pSps && !DtsParseAVCSps(hDevice, pSps, iSpsLen, &Ctx->VidParams.LevelIDC, &Ctx->VidParams.NumOfRefFrames))
+			Ctx->VidParams.NumOfRefFrames = 0;
+	}
+/*
+
 	uint8_t* pSequenceHeader = Ctx->VidParams.pMetaData;
 	LONG lSize = Ctx->VidParams.MetaDataSz;
 
@@ -527,6 +701,125 @@ BOOL DtsCheckSpsPps(HANDLE hDevice, uint8_t *pBuffer, uint32_t ulSize)
 
 }
 
+//------------------------------------------------------------------------
+// Name: DtsRestoreH264SCode
+// Description: Put back the NAL lengths DtsAddH264SCodeInPlace replaced
+//              with start codes. Called once the data has been queued.
+//------------------------------------------------------------------------
+void DtsRestoreH264SCode(HANDLE hDevice)
+{
+	DTS_LIB_CONTEXT *Ctx = DtsGetContext(hDevice);
+	uint8_t *p;
+	uint32_t i, len;
+
+	if (!Ctx)
+		return;
+
+	for (i = 0; i < Ctx->PESConvParams.nSCRestore; i++)
+	{
+		p = Ctx->PESConvParams.pSCRestoreBuf + Ctx->PESConvParams.pSCRestore[2*i];
+		len = Ctx->PESConvParams.pSCRestore[2*i + 1];
+		p[0] = (uint8_t)(len >> 24);
+		p[1] = (uint8_t)(len >> 16);
+		p[2] = (uint8_t)(len >> 8);
+		p[3] = (uint8_t)len;
+	}
+	Ctx->PESConvParams.nSCRestore = 0;
+}
+
+//------------------------------------------------------------------------
+// Name: DtsAddH264SCodeInPlace
+// Description: DtsAddH264SCode for 4 byte NAL lengths. A 4 byte length and
+//              the BRCM start code are the same size, so the lengths are
+//              overwritten in the caller's buffer instead of copying every
+//              NAL into the pending buffer. The overwritten lengths are
+//              recorded for DtsRestoreH264SCode. Returns BC_STS_NOT_IMPL if
+//              the restore list cannot grow, the caller then copies.
+//------------------------------------------------------------------------
+static BC_STATUS DtsAddH264SCodeInPlace(DTS_LIB_CONTEXT *Ctx, uint8_t **ppBuffer, uint32_t *pUlDataSize)
+{
+	PES_CONVERT_PARAMS *pConv = &Ctx->PESConvParams;
+	uint8_t *pStart = *ppBuffer;
+	uint32_t lDataRemained = *pUlDataSize;
+	uint32_t lEntryDataSize = pConv->m_lStartCodeDataSize;	// NAL split from the previous call
+	uint32_t *pList;
+	uint32_t nMax;
+
+	pConv->pSCRestoreBuf = *ppBuffer;
+	pConv->nSCRestore = 0;
+
+	while(1)
+	{
+		if(pConv->m_lStartCodeDataSize != 0)
+		{
+			//Remained, already in place
+			if(pConv->m_lStartCodeDataSize >= lDataRemained)
+			{
+				pConv->m_lStartCodeDataSize -= lDataRemained;
+				break;
+			}
+			pStart += pConv->m_lStartCodeDataSize;
+			lDataRemained -= pConv->m_lStartCodeDataSize;
+			pConv->m_lStartCodeDataSize = 0;
+		}
+
+		if(lDataRemained <= BRCM_START_CODE_SIZE)
+		{
+			DtsRestoreH264SCode((HANDLE)Ctx);
+			return BC_STS_IO_XFR_ERROR;
+		}
+
+		pConv->m_lStartCodeDataSize = ((uint32_t)pStart[0] << 24) | ((uint32_t)pStart[1] << 16) |
+					      ((uint32_t)pStart[2] << 8) | pStart[3];
+
+		if(pConv->m_lStartCodeDataSize == 1)
+		{
+			//Could be Alreay a Start Code
+			DtsRestoreH264SCode((HANDLE)Ctx);
+			pConv->m_lStartCodeDataSize = 0;
+			pConv->m_bIsAdd_SCode_CodeIn = false;
+			if (pConv->pStartcodePendBuff)
+				free(pConv->pStartcodePendBuff);
+			pConv->lPendBufferSize = 0;
+			pConv->pStartcodePendBuff = NULL;
+			return BC_STS_SUCCESS;
+		}
+		else if(pConv->m_lStartCodeDataSize < *pUlDataSize)
+		{
+			if(pConv->nSCRestore == pConv->nSCRestoreMax)
+			{
+				nMax = pConv->nSCRestoreMax ? pConv->nSCRestoreMax * 2 : 64;
+				pList = (uint32_t *)realloc(pConv->pSCRestore, nMax * 2 * sizeof(uint32_t));
+				if(!pList)
+				{
+					// The copy path starts over from the same state
+					DtsRestoreH264SCode((HANDLE)Ctx);
+					pConv->m_lStartCodeDataSize = lEntryDataSize;
+					return BC_STS_NOT_IMPL;
+				}
+				pConv->pSCRestore = pList;
+				pConv->nSCRestoreMax = nMax;
+			}
+			pConv->pSCRestore[2*pConv->nSCRestore] = (uint32_t)(pStart - pConv->pSCRestoreBuf);
+			pConv->pSCRestore[2*pConv->nSCRestore + 1] = pConv->m_lStartCodeDataSize;
+			pConv->nSCRestore++;
+
+			//BRCM Start Code
+			pStart[0] = 0;
+			pStart[1] = 0;
+			pStart[2] = 0;
+			pStart[3] = 1;
+
+			pStart += BRCM_START_CODE_SIZE;
+			lDataRemained -= BRCM_START_CODE_SIZE;
+		}
+		// Otherwise the length is passed on as data, as the copy path does
+	}
+
+	// Same buffer and size, now in Annex B
+	return BC_STS_SUCCESS;
+}
+
 BC_STATUS DtsAddH264SCode(HANDLE hDevice, uint8_t **ppBuffer, uint32_t *pUlDataSize, uint64_t *pTimeStamp)
 {
 	DTS_LIB_CONTEXT *Ctx = NULL;
@@ -544,6 +837,16 @@ BC_STATUS DtsAddH264SCode(HANDLE hDevice, uint8_t **ppBuffer, uint32_t *pUlDataS
 
 	int sts;
 
+	// Common case, no copy if the application allows its buffer to be
+	// rewritten. Only 1 and 2 byte lengths grow the data and always need
+	// the pending buffer.
+	if((Ctx->VidParams.StartCodeSz == BRCM_START_CODE_SIZE) && (Ctx->FixFlags & DTS_INPUT_IN_PLACE))
+	{
+		sts = DtsAddH264SCodeInPlace(Ctx, ppBuffer, pUlDataSize);
+		if(sts != BC_STS_NOT_IMPL)
+			return (BC_STATUS)sts;
+	}
+
 	if(Ctx->PESConvParams.lPendBufferSize < (*pUlDataSize*2))
 	{
 		if (Ctx->PESConvParams.pStartcodePendBuff)
@@ -974,6 +1277,48 @@ BC_STATUS DtsAddStartCode(HANDLE hDevice, uint8_t **ppBuffer, uint32_t *pUlDataS
 	return BC_STS_SUCCESS;
 }
 
+//------------------------------------------------------------------------
+// Name: DtsScanStartCode
+// Description: Offset of the first 00 00 01 prefix at or after ulFrom, or
+//              ulSize if there is none. With SSE2 16 positions are tested
+//              per step; the scalar path skips 3 bytes whenever the third
+//              byte cannot be part of a prefix.
+//------------------------------------------------------------------------
+uint32_t DtsScanStartCode(const uint8_t *pBuf, uint32_t ulSize, uint32_t ulFrom)
+{
+	uint32_t i = ulFrom;
+
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi8(1);
+	__m128i b0, b1, b2;
+	int mask;
+
+	// Each step reads pBuf[i] .. pBuf[i+17]
+	while (i + 18 <= ulSize)
+	{
+		b0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(pBuf + i)), zero);
+		b1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(pBuf + i + 1)), zero);
+		b2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(pBuf + i + 2)), one);
+		mask = _mm_movemask_epi8(_mm_and_si128(_mm_and_si128(b0, b1), b2));
+		if (mask)
+			return i + __builtin_ctz(mask);
+		i += 16;
+	}
+#endif
+
+	while (i + 3 <= ulSize)
+	{
+		if (pBuf[i+2] > 1)
+			i += 3;
+		else if (pBuf[i+2] == 1 && pBuf[i+1] == 0 && pBuf[i] == 0)
+			return i;
+		else
+			i++;
+	}
+	return ulSize;
+}
+
 int DtsFindBSStartCode (unsigned char *Buf, int ZerosInStartcode)
 {
 	BOOL bStartCode = TRUE;
@@ -993,6 +1338,7 @@ int DtsGetNaluType(HANDLE hDevice, uint8_t* pInputBuf, uint32_t ulSize, NALU_t*
 	DTS_LIB_CONTEXT *Ctx = NULL;
 	int b20sInSC, b30sInSC ;
 	int bStartCodeFound, Rewind;
+	uint32_t ulNext;
 	int nLeadingZero8BitsCount=0, TrailingZero8Bits=0;
 	//unused bool bSetIDR = true;
 	//unused static BOOL fOne = TRUE;
@@ -1046,19 +1392,20 @@ int DtsGetNaluType(HANDLE hDevice, uint8_t* pInputBuf, uint32_t ulSize, NALU_t*
 	b20sInSC = 0;
 	b30sInSC = 0;
 
-	while( (!bStartCodeFound) && (Pos < ulSize))
+	// Next start code. Pos is left just past it, as if it had been read
+	// byte by byte; a 00 00 00 01 code is one more zero in front of it.
+	ulNext = DtsScanStartCode(pInputBuf, ulSize, Pos);
+	if (ulNext < ulSize)
 	{
-		Pos++;
-		if(Pos > ulSize)
-		{
-//			DbgLog((LOG_TRACE, 1, TEXT("GetNaluType : Pos > size = %d\n"),ulSize));
-
-		}
-		b30sInSC = DtsFindBSStartCode( (pInputBuf + Pos- 4), 3);
-		if(b30sInSC != 1)
-			b20sInSC = DtsFindBSStartCode( (pInputBuf + Pos -3), 2);
-		bStartCodeFound = (b20sInSC  || b30sInSC);
+		Pos = ulNext + 3;
+		bStartCodeFound = 1;
+		if (pInputBuf[ulNext - 1] == 0)
+			b30sInSC = 1;
+		else
+			b20sInSC = 1;
 	}
+	else if (Pos < ulSize)
+		Pos = ulSize;
 
 	Rewind = 0;
 	if(!bStartCodeFound)
@@ -1219,18 +1566,12 @@ BC_STATUS DtsFindStartCode(HANDLE hDevice, uint8_t* pInputBuffer, uint32_t ulSiz
 		(Ctx->VidParams.MediaSubType == BC_MSUBTYPE_WMVA) || (Ctx->VidParams.MediaSubType ==BC_MSUBTYPE_WMV3) || (Ctx->VidParams.MediaSubType == BC_MSUBTYPE_VC1))
 
 	{
-		while(i < ulSizeInBytes)
+		while((i = DtsScanStartCode(pInputBuffer, ulSizeInBytes, i)) + 3 < ulSizeInBytes)
 		{
-			if( (*(pInputBuffer +i) == Suffix1) || (*(pInputBuffer +i) == Suffix2))
+			if( (*(pInputBuffer +i+3) == Suffix1) || (*(pInputBuffer +i+3) == Suffix2))
 			{
-				if(i >= 3)
-				{
-					if( (*(pInputBuffer+(i-3)) == 0x00) && (*(pInputBuffer+(i-2)) == 0x00) && (*(pInputBuffer+(i-1)) == 0x01))
-					{
-						*pOffset = i-3;
-						return BC_STS_SUCCESS;
-					}
-				}
+				*pOffset = i;
+				return BC_STS_SUCCESS;
 			}
 			i++;
 		}
@@ -113,6 +113,12 @@ typedef struct stPES_CONVERT_PARAMS
 	uint8_t  	*pStartcodePendBuff;
 	uint32_t 	lPendBufferSize;
 
+	//4 byte AVC1 lengths rewritten in place, as offset/length pairs
+	uint8_t		*pSCRestoreBuf;
+	uint32_t	*pSCRestore;
+	uint32_t	nSCRestore;
+	uint32_t	nSCRestoreMax;
+
 	//Get Sequence Header Info (Sequence Layer Bitestream for Simple and Main Profile)
 	bool		m_bRangered;
 	bool		m_bFinterpFlag;
@@ -147,7 +153,9 @@ BC_STATUS DtsSetVC1SH(HANDLE hDevice);
 BC_STATUS DtsAddH264SCode(HANDLE hDevice, uint8_t **ppBuffer, uint32_t *pUlDataSize, uint64_t *timeStamp);
 BC_STATUS DtsAddVC1SCode(HANDLE hDevice, uint8_t **ppBuffer, uint32_t *pUlDataSize, uint64_t *timeStamp);
 BC_STATUS DtsAddStartCode(HANDLE hDevice, uint8_t **ppBuffer, uint32_t *pUlDataSize, uint64_t *timeStamp);
+void DtsRestoreH264SCode(HANDLE hDevice);
 
+uint32_t DtsScanStartCode(const uint8_t *pBuf, uint32_t ulSize, uint32_t ulFrom);
 int32_t DtsFindBSStartCode (uint8_t *Buf, int ZerosInStartcode);
 int32_t DtsGetNaluType(HANDLE hDevice, uint8_t* pInputBuf, uint32_t ulSize, NALU_t* pNalu, bool bSkipSyncMarker);
 BC_STATUS DtsParseAVC(HANDLE hDevice, uint8_t* pInputBuf, uint32_t ulSize, uint32_t* Offset, bool bIDR, int32_t *pNalType);
@@ -35,11 +35,16 @@
 #include <sys/types.h>
 //#include <sys/ipc.h>
 #include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <stdio.h>
 #include "7411d.h"
 #include "libcrystalhd_if.h"
 #include "libcrystalhd_int_if.h"
 #include "libcrystalhd_priv.h"
 #include "libcrystalhd_parser.h"
+#include "libcrystalhd_copy.h"
 
 /*============== Global shared area usage ======================*/
 /* Global mode settings */
@@ -54,25 +59,26 @@
 bc_dil_glob_s *bc_dil_glob_ptr=NULL;
 bool glob_mode_valid=TRUE;
 
-BC_STATUS DtsCreateShMem(int *shmem_id)
+/* The shared area only keeps other processes out. Within this process any
+ * number of handles may be open, so the attachment, the hardware set up
+ * and the decoder ownership last until the last handle that needs them
+ * is gone. All under gProcLock.
+ */
+static pthread_mutex_t	gProcLock = PTHREAD_MUTEX_INITIALIZER;
+static int		gShmId = -1;
+static uint32_t	gShmUsers;		/* Holds on the attachment */
+static uint32_t	gModeUsers[DTS_HWINIT_MODE+1];	/* Open handles by mode */
+static uint32_t	gDecUsers;		/* Handles with a decoder open */
+
+static BC_STATUS DtsAttachShMem(int *shmem_id)
 {
 	int shmid=-1;
 	key_t shmkey=BC_DIL_SHMEM_KEY;
 	shmid_ds buf;
 	uint32_t mode=0;
 
-
-	if(shmem_id==NULL) {
-		DebugLog_Trace(LDIL_DBG,"Invalid argument ...\n");
-		return BC_STS_INSUFF_RES;
-	}
-
 	*shmem_id =shmid;
 	//First Try to create it.
-shmid =  shmget(123, 1024, 0644|IPC_CREAT|IPC_EXCL) ; 
-DebugLog_Trace(LDIL_DBG,"shmid=%d errno=%d \n",shmid,errno);
-shmid =  shmget(12345, 1024, 0644|IPC_CREAT|IPC_EXCL) ; 
-DebugLog_Trace(LDIL_DBG,"shmid=%d errno=%d \n",shmid,errno);
 	if((shmid= shmget(shmkey, 1024, 0644|IPC_CREAT|IPC_EXCL))== -1 ) {
 		if(errno==EEXIST) {
 			DebugLog_Trace(LDIL_DBG,"DtsCreateShMem:shmem already exists :%d\n",errno);
@@ -133,6 +139,26 @@ DebugLog_Trace(LDIL_DBG,"shmid=%d errno=%d \n",shmid,errno);
 	return BC_STS_SUCCESS;
 }
 
+BC_STATUS DtsCreateShMem(int *shmem_id)
+{
+	BC_STATUS sts = BC_STS_SUCCESS;
+
+	if(shmem_id==NULL) {
+		DebugLog_Trace(LDIL_DBG,"Invalid argument ...\n");
+		return BC_STS_INSUFF_RES;
+	}
+
+	pthread_mutex_lock(&gProcLock);
+	if(gShmUsers == 0)
+		sts = DtsAttachShMem(&gShmId);
+	if(sts == BC_STS_SUCCESS)
+		gShmUsers++;
+	*shmem_id = gShmId;
+	pthread_mutex_unlock(&gProcLock);
+
+	return sts;
+}
+
 BC_STATUS DtsGetDilShMem(uint32_t shmid)
 {
 	bc_dil_glob_ptr=(bc_dil_glob_s *)shmat(shmid,(void *)0,0);
@@ -145,7 +171,7 @@ BC_STATUS DtsGetDilShMem(uint32_t shmid)
 	return BC_STS_SUCCESS;
 }
 
-BC_STATUS DtsDelDilShMem()
+static BC_STATUS DtsDetachShMem()
 {
 	int shmid =0;
 	shmid_ds buf;
@@ -156,6 +182,8 @@ BC_STATUS DtsDelDilShMem()
 		DebugLog_Trace(LDIL_DBG,"Unable to detach from Dil shared memory ...\n");
 		//return BC_STS_ERROR;
 	}
+	bc_dil_glob_ptr = NULL;
+	gShmId = -1;
 
 	//delete the shared mem segment if there are no other attachments
 	if ((shmid =shmget((key_t)BC_DIL_SHMEM_KEY,0,0))==-1){
@@ -185,6 +213,57 @@ BC_STATUS DtsDelDilShMem()
 
 }
 
+BC_STATUS DtsDelDilShMem()
+{
+	BC_STATUS sts = BC_STS_SUCCESS;
+
+	pthread_mutex_lock(&gProcLock);
+	if(gShmUsers && (--gShmUsers == 0))
+		sts = DtsDetachShMem();
+	pthread_mutex_unlock(&gProcLock);
+
+	return sts;
+}
+
+//------------------------------------------------------------------------
+// Name: DtsAddProcHandle / DtsDelProcHandle
+// Description: Count the handles this process has open in each mode.
+//              DtsDelProcHandle returns TRUE for the last one.
+//------------------------------------------------------------------------
+void DtsAddProcHandle(uint32_t OpMode)
+{
+	pthread_mutex_lock(&gProcLock);
+	if(OpMode <= DTS_HWINIT_MODE)
+		gModeUsers[OpMode]++;
+	pthread_mutex_unlock(&gProcLock);
+}
+
+BOOL DtsDelProcHandle(uint32_t OpMode)
+{
+	uint32_t i, users = 0;
+
+	pthread_mutex_lock(&gProcLock);
+	if((OpMode <= DTS_HWINIT_MODE) && gModeUsers[OpMode])
+		gModeUsers[OpMode]--;
+	for(i = 0; i <= DTS_HWINIT_MODE; i++)
+		users += gModeUsers[i];
+	pthread_mutex_unlock(&gProcLock);
+
+	return (users == 0);
+}
+
+uint32_t DtsProcHandles(uint32_t OpMode)
+{
+	uint32_t users = 0;
+
+	pthread_mutex_lock(&gProcLock);
+	if(OpMode <= DTS_HWINIT_MODE)
+		users = gModeUsers[OpMode];
+	pthread_mutex_unlock(&gProcLock);
+
+	return users;
+}
+
 uint32_t DtsGetgDevID(void)
 {
 	if(bc_dil_glob_ptr == NULL)
@@ -218,16 +297,6 @@ void DtsSetHwInitSts( uint32_t value )
 	bc_dil_glob_ptr->gHwInitSts = value;
 }
 
-void DtsRstStats( void )
-{
-	memset(&bc_dil_glob_ptr->stats, 0, sizeof(bc_dil_glob_ptr->stats));
-}
-
-BC_DTS_STATS * DtsGetgStats ( void )
-{
-	return &bc_dil_glob_ptr->stats;
-}
-
 bool DtsIsDecOpened(pid_t nNewPID)
 {
 	if(bc_dil_glob_ptr == NULL)
@@ -250,14 +319,21 @@ bool DtsChkPID(pid_t nCurPID)
 	return (nCurPID == bc_dil_glob_ptr->g_nProcID);
 }
 
+// Other processes see the decoder taken from this process's first open
+// to its last close
 void DtsSetDecStat(bool bDecOpen, pid_t PID)
 {
-	if (bDecOpen == true)
-		bc_dil_glob_ptr->g_nProcID = PID;
-	else
+	pthread_mutex_lock(&gProcLock);
+	if (bDecOpen == true) {
+		if (gDecUsers++ == 0) {
+			bc_dil_glob_ptr->g_nProcID = PID;
+			bc_dil_glob_ptr->g_bDecOpened = true;
+		}
+	} else if (gDecUsers && (--gDecUsers == 0)) {
 		bc_dil_glob_ptr->g_nProcID = 0;
-
-	bc_dil_glob_ptr->g_bDecOpened = bDecOpen;
+		bc_dil_glob_ptr->g_bDecOpened = false;
+	}
+	pthread_mutex_unlock(&gProcLock);
 }
 /*============== Global shared area usage End.. ======================*/
 
@@ -279,23 +355,36 @@ static void DtsGetMaxSize(DTS_LIB_CONTEXT *Ctx, uint32_t *Sz)
 {
 	*Sz = (1920*1090)*2;
 }
-static void DtsInitLock(DTS_LIB_CONTEXT	*Ctx)
+static void DtsInitMutex(pthread_mutex_t *lock, BOOL recursive)
 {
-	//Create mutex
 	int ret;
-	pthread_mutexattr_t thLockattr;
-	ret = pthread_mutexattr_init(&thLockattr);
+	pthread_mutexattr_t attr;
+	ret = pthread_mutexattr_init(&attr);
 	if(ret)
 		DebugLog_Trace(LDIL_DBG, "Error initializing attributes\n");
-	ret = pthread_mutexattr_settype(&thLockattr, PTHREAD_MUTEX_RECURSIVE);
-	if(ret)
-		DebugLog_Trace(LDIL_DBG, "Error setting type of mutex\n");
-	ret = pthread_mutex_init(&Ctx->thLock, &thLockattr);
+	if(recursive) {
+		ret = pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+		if(ret)
+			DebugLog_Trace(LDIL_DBG, "Error setting type of mutex\n");
+	}
+	ret = pthread_mutex_init(lock, &attr);
 	if(ret)
 		DebugLog_Trace(LDIL_DBG, "Error initializing mutex\n");
+	pthread_mutexattr_destroy(&attr);
+}
+static void DtsInitLock(DTS_LIB_CONTEXT	*Ctx)
+{
+	//Create mutexes, see the lock order in DTS_LIB_CONTEXT
+	DtsInitMutex(&Ctx->thLock, TRUE);
+	DtsInitMutex(&Ctx->MdataLock, TRUE);
+	DtsInitMutex(&Ctx->CopyLock, FALSE);
+	DtsInitMutex(&Ctx->AsyncLock, FALSE);
 }
 static void DtsDelLock(DTS_LIB_CONTEXT	*Ctx)
 {
+	pthread_mutex_destroy(&Ctx->AsyncLock);
+	pthread_mutex_destroy(&Ctx->CopyLock);
+	pthread_mutex_destroy(&Ctx->MdataLock);
 	pthread_mutex_destroy(&Ctx->thLock);
 
 }
@@ -307,19 +396,38 @@ void DtsUnLock(DTS_LIB_CONTEXT	*Ctx)
 {
 	pthread_mutex_unlock(&Ctx->thLock);
 }
+void DtsCopyLock(DTS_LIB_CONTEXT *Ctx)
+{
+	pthread_mutex_lock(&Ctx->CopyLock);
+}
+void DtsCopyUnLock(DTS_LIB_CONTEXT *Ctx)
+{
+	pthread_mutex_unlock(&Ctx->CopyLock);
+}
+static void DtsMdataLock(DTS_LIB_CONTEXT *Ctx)
+{
+	pthread_mutex_lock(&Ctx->MdataLock);
+}
+static void DtsMdataUnLock(DTS_LIB_CONTEXT *Ctx)
+{
+	pthread_mutex_unlock(&Ctx->MdataLock);
+}
 
+// ProcOutPending is only a counter, keep it off the locks so that
+// ProcOutput never waits behind a decoder open/close.
 static void DtsIncPend(DTS_LIB_CONTEXT	*Ctx)
 {
-	DtsLock(Ctx);
-	Ctx->ProcOutPending++;
-	DtsUnLock(Ctx);
+	__sync_fetch_and_add(&Ctx->ProcOutPending, 1);
 }
 static void DtsDecPend(DTS_LIB_CONTEXT	*Ctx)
 {
-	DtsLock(Ctx);
-	if(Ctx->ProcOutPending)
-		Ctx->ProcOutPending--;
-	DtsUnLock(Ctx);
+	BOOL cur;
+
+	do {
+		cur = Ctx->ProcOutPending;
+		if(!cur)
+			return;
+	} while(!__sync_bool_compare_and_swap(&Ctx->ProcOutPending, cur, cur - 1));
 }
 
 void DtsGetFrameRate(DTS_LIB_CONTEXT *Ctx, BC_DTS_PROC_OUT *pOut)
@@ -492,14 +600,124 @@ static void DtsGetPibFrom422(uint8_t *pibBuff, uint8_t mode422)
 	}
 }
 
+//------------------------------------------------------------------------
+// Name: DtsSetPicInfo
+// Description: Field, encryption, frame rate and timestamp from a PIB
+//              already in pOut->PicInfo. PictureNumber is the first PIB
+//              word. Never touches the picture.
+//------------------------------------------------------------------------
+static BC_STATUS DtsSetPicInfo(DTS_LIB_CONTEXT *Ctx, BC_DTS_PROC_OUT *pOut, uint32_t PictureNumber)
+{
+	uint16_t			sNum = 0;
+	bool				bInterlaced = false;
+
+	pOut->PoutFlags |= BC_POUT_FLAGS_PIB_VALID;
+
+	if (Ctx->DevId == BC_PCI_DEVID_FLEA)
+	{
+		if (pOut->PicInfo.flags & VDEC_FLAG_BOTTOMFIELD)
+			bInterlaced = true;
+	}
+	else
+	{
+		if (pOut->PicInfo.flags & VDEC_FLAG_INTERLACED_SRC)
+			bInterlaced = true;
+	}
+
+	if(bInterlaced)
+	{
+		Ctx->VidParams.Progressive = FALSE;
+		pOut->PicInfo.flags |= VDEC_FLAG_INTERLACED_SRC;
+		if (PictureNumber & 0x40000000)
+		{
+			pOut->PoutFlags |= BC_POUT_FLAGS_FLD_BOT;
+			pOut->PicInfo.flags |= VDEC_FLAG_BOTTOMFIELD;
+		}
+		else
+		{
+			pOut->PicInfo.flags &= ~VDEC_FLAG_BOTTOMFIELD;
+			pOut->PicInfo.flags |= VDEC_FLAG_TOPFIELD;
+		}
+	}
+	else
+	{
+		Ctx->VidParams.Progressive = TRUE;
+		pOut->PicInfo.flags &= ~(VDEC_FLAG_BOTTOMFIELD | VDEC_FLAG_INTERLACED_SRC);
+	}
+
+	if(PictureNumber & 0x80000000)
+	{
+		pOut->PoutFlags |= BC_POUT_FLAGS_ENCRYPTED;
+	}
+
+	DtsGetFrameRate(Ctx, pOut);
+	//DILDbg_Trace(BC_DIL_DBG_DETAIL, TEXT("DtsGetPictureInfo: PicInfo (W,H):(%d,%d) FR:%ld Flags:0x%x\n"),pOut->PicInfo.width, pOut->PicInfo.height,pOut->PicInfo.frame_rate, pOut->PicInfo.flags);
+
+	if(Ctx->DevId == BC_PCI_DEVID_FLEA)
+	{
+		//Flea Mode
+		if(pOut->PicInfo.timeStamp == 0xFFFFFFFF)
+		{
+			//For Pre-Load
+			pOut->PicInfo.timeStamp = 0xFFFFFFFFFFFFFFFFLL;
+		}
+		else
+		{
+			//Normal PTS
+			//Change PTS becuase of Shift PTS Issue in FW and 32-bit (ms) and 64-bit (100 ns) Scaling
+			pOut->PicInfo.timeStamp = pOut->PicInfo.timeStamp * 2 * 10000;
+		}
+	}
+	else
+	{
+		/* Retrieve Timestamp */
+		if(pOut->PicInfo.flags & VDEC_FLAG_PICTURE_META_DATA_PRESENT)
+		{
+			sNum = (uint16_t) ( ( (pOut->PicInfo.picture_meta_payload & 0xFF) << 8) |
+                                ((pOut->PicInfo.picture_meta_payload& 0xFF00) >> 8) );
+			DtsFetchMdata(Ctx,sNum,pOut,&Ctx->OutCookie);
+		}
+	}
+	return BC_STS_SUCCESS;
+}
+
+static BC_STATUS DtsPicInfoEOS(DTS_LIB_CONTEXT *Ctx)
+{
+	Ctx->bEOS = true;
+	Ctx->pOutData->RetSts = BC_STS_NO_DATA;
+	DebugLog_Trace(LDIL_DBG, "Found EOS \n");
+	return BC_STS_NO_DATA;
+}
+
+// BC_PIB_SIDE uses room the ioctl union already has, growing the union
+// would change every ioctl number
+typedef char DtsPibSideFitsIoctl[(sizeof(BC_DEC_OUT_BUFF) <= sizeof(BC_FW_CMD)) ? 1 : -1];
+
+//------------------------------------------------------------------------
+// Name: DtsGetPictureInfoSide
+// Description: PIB the driver copied out of the frame, see BC_PIB_SIDE.
+//------------------------------------------------------------------------
+static BC_STATUS DtsGetPictureInfoSide(DTS_LIB_CONTEXT *Ctx, BC_DTS_PROC_OUT *pOut, BC_PIB_SIDE *pSide)
+{
+	memcpy(&pOut->PicInfo, &pSide->PicInfo, sizeof(BC_PIC_INFO_BLOCK));
+
+	if (pOut->PicInfo.flags & VDEC_FLAG_EOS)
+		return DtsPicInfoEOS(Ctx);
+
+	return DtsSetPicInfo(Ctx, pOut, pSide->PicNum);
+}
+
+//------------------------------------------------------------------------
+// Name: DtsGetPictureInfo
+// Description: Find the PIB the firmware wrote into the frame, after the
+//              last picture line, and put back the Y samples it used.
+//------------------------------------------------------------------------
 static BC_STATUS DtsGetPictureInfo(DTS_LIB_CONTEXT *Ctx, BC_DTS_PROC_OUT *pOut)
 {
 
-	uint16_t			sNum = 0;
 	uint8_t*			pPicInfoLine = NULL;
 	uint32_t			PictureNumber = 0;
 	uint32_t			PicInfoLineNum;
-	bool				bInterlaced = false;
 
 	if (Ctx->DevId == BC_PCI_DEVID_FLEA)
 	{
@@ -531,12 +749,7 @@ static BC_STATUS DtsGetPictureInfo(DTS_LIB_CONTEXT *Ctx, BC_DTS_PROC_OUT *pOut)
 	{
 		memcpy((uint32_t*)&pOut->PicInfo,(uint32_t*)(pOut->Ybuff + 4), sizeof(BC_PIC_INFO_BLOCK));
 		if (pOut->PicInfo.flags & VDEC_FLAG_EOS)
-		{
-			Ctx->bEOS = true;
-			Ctx->pOutData->RetSts = BC_STS_NO_DATA;
-			DebugLog_Trace(LDIL_DBG, "Found EOS \n");
-			return BC_STS_NO_DATA;
-		}
+			return DtsPicInfoEOS(Ctx);
 	}
 	/*
 	-- To take care of 16 byte alignment the firmware might put extra
@@ -573,8 +786,6 @@ static BC_STATUS DtsGetPictureInfo(DTS_LIB_CONTEXT *Ctx, BC_DTS_PROC_OUT *pOut)
 						| (((ULONG)(*(pPicInfoLine + 3)) << 24) & 0xff000000);
 	}
 
-	pOut->PoutFlags |= BC_POUT_FLAGS_PIB_VALID;
-
 	if (Ctx->DevId != BC_PCI_DEVID_FLEA)
 	{
 		dts_swap_buffer((uint32_t*)&pOut->PicInfo,(uint32_t*)(pPicInfoLine + 4), 32);
@@ -586,46 +797,6 @@ static BC_STATUS DtsGetPictureInfo(DTS_LIB_CONTEXT *Ctx, BC_DTS_PROC_OUT *pOut)
 		memcpy((uint32_t*)&pOut->PicInfo,(uint32_t*)(pPicInfoLine + 4), sizeof(BC_PIC_INFO_BLOCK));
 	}
 
-	if (Ctx->DevId == BC_PCI_DEVID_FLEA)
-	{
-		if (pOut->PicInfo.flags & VDEC_FLAG_BOTTOMFIELD)
-			bInterlaced = true;
-	}
-	else
-	{
-		if (pOut->PicInfo.flags & VDEC_FLAG_INTERLACED_SRC)
-			bInterlaced = true;
-	}
-
-	if(bInterlaced)
-	{
-		Ctx->VidParams.Progressive = FALSE;
-		pOut->PicInfo.flags |= VDEC_FLAG_INTERLACED_SRC;
-		if (PictureNumber & 0x40000000)
-		{
-			pOut->PoutFlags |= BC_POUT_FLAGS_FLD_BOT;
-			pOut->PicInfo.flags |= VDEC_FLAG_BOTTOMFIELD;
-		}
-		else
-		{
-			pOut->PicInfo.flags &= ~VDEC_FLAG_BOTTOMFIELD;
-			pOut->PicInfo.flags |= VDEC_FLAG_TOPFIELD;
-		}
-	}
-	else
-	{
-		Ctx->VidParams.Progressive = TRUE;
-		pOut->PicInfo.flags &= ~(VDEC_FLAG_BOTTOMFIELD | VDEC_FLAG_INTERLACED_SRC);
-	}
-
-	if(PictureNumber & 0x80000000)
-	{
-		pOut->PoutFlags |= BC_POUT_FLAGS_ENCRYPTED;
-	}
-
-	DtsGetFrameRate(Ctx, pOut);
-	//DILDbg_Trace(BC_DIL_DBG_DETAIL, TEXT("DtsGetPictureInfo: PicInfo (W,H):(%d,%d) FR:%ld Flags:0x%x\n"),pOut->PicInfo.width, pOut->PicInfo.height,pOut->PicInfo.frame_rate, pOut->PicInfo.flags);
-
 	/* Replace Y Component data*/
 	if(Ctx->DevId == BC_PCI_DEVID_FLEA)
 	{
@@ -658,32 +829,7 @@ static BC_STATUS DtsGetPictureInfo(DTS_LIB_CONTEXT *Ctx, BC_DTS_PROC_OUT *pOut)
 		}
 	}
 
-	if(Ctx->DevId == BC_PCI_DEVID_FLEA)
-	{
-		//Flea Mode
-		if(pOut->PicInfo.timeStamp == 0xFFFFFFFF)
-		{
-			//For Pre-Load
-			pOut->PicInfo.timeStamp = 0xFFFFFFFFFFFFFFFFLL;
-		}
-		else
-		{
-			//Normal PTS
-			//Change PTS becuase of Shift PTS Issue in FW and 32-bit (ms) and 64-bit (100 ns) Scaling
-			pOut->PicInfo.timeStamp = pOut->PicInfo.timeStamp * 2 * 10000;
-		}
-	}
-	else
-	{
-		/* Retrieve Timestamp */
-		if(pOut->PicInfo.flags & VDEC_FLAG_PICTURE_META_DATA_PRESENT)
-		{
-			sNum = (uint16_t) ( ( (pOut->PicInfo.picture_meta_payload & 0xFF) << 8) |
-                                ((pOut->PicInfo.picture_meta_payload& 0xFF00) >> 8) );
-			DtsFetchMdata(Ctx,sNum,pOut);
-		}
-	}
-	return BC_STS_SUCCESS;
+	return DtsSetPicInfo(Ctx, pOut, PictureNumber);
 }
 
 BC_STATUS DtsUpdateVidParams(DTS_LIB_CONTEXT *Ctx, BC_DTS_PROC_OUT *pOut)
@@ -878,7 +1024,11 @@ static void DtsSetupProcOutInfo(DTS_LIB_CONTEXT *Ctx, BC_DTS_PROC_OUT *pOut, BC_
 					pIo->u.DecOutData.OutPutBuffs.UVbuffOffset);
 
 		pOut->discCnt = pIo->u.DecOutData.BadFrCnt;
-		if(Ctx->FixFlags & DTS_LOAD_FILE_PLAY_FW){
+		if((pIo->u.DecOutData.Flags & COMP_FLAG_PIB_SIDE) &&
+		   (pIo->u.DecOutData.PibSide.Size == sizeof(BC_PIB_SIDE))){
+			/* Driver took the embedded PIB out, the frame is left alone */
+			DtsGetPictureInfoSide(Ctx, pOut, &pIo->u.DecOutData.PibSide);
+		}else if(Ctx->FixFlags & DTS_LOAD_FILE_PLAY_FW){
 			/* Decoder PIC_INFO_OFF mode, PIB is embedded in frame */
 			DtsGetPictureInfo(Ctx, pOut);
 		}
@@ -914,6 +1064,11 @@ static BC_STATUS	DtsCreateMdataPool(DTS_LIB_CONTEXT *Ctx)
 	Ctx->MDPendHead = DTS_MDATA_PEND_LINK(Ctx);
 	Ctx->MDPendTail = DTS_MDATA_PEND_LINK(Ctx);
 	Ctx->InMdataTag = 0;
+	memset(Ctx->MDTagIndex, 0, sizeof(Ctx->MDTagIndex));
+	Ctx->MDEvictCnt = 0;
+	Ctx->MDNewestFetchTag = 0;
+	Ctx->MDReorderWindow = DtsMdataReorderWindow(Ctx);
+	Ctx->MDBatchCnt = Ctx->MDBatchNext = 0;
 
 	return BC_STS_SUCCESS;
 }
@@ -921,7 +1076,7 @@ static BC_STATUS	DtsCreateMdataPool(DTS_LIB_CONTEXT *Ctx)
 static void DtsMdataSetIntTag(DTS_LIB_CONTEXT *Ctx, DTS_INPUT_MDATA	*temp)
 {
 	uint16_t stemp=0;
-	DtsLock(Ctx);
+	DtsMdataLock(Ctx);
 
 	if(Ctx->InMdataTag == 0xFFFF){
 		// Skip zero seqNum
@@ -931,16 +1086,46 @@ static void DtsMdataSetIntTag(DTS_LIB_CONTEXT *Ctx, DTS_INPUT_MDATA	*temp)
 	stemp = (uint16_t)( temp->IntTag & DTS_MDATA_MAX_TAG );
 	temp->Spes.SeqNum[0] = (uint8_t)(stemp & 0xFF);
 	temp->Spes.SeqNum[1] = (uint8_t)((stemp & 0xFF00) >> 8);
-	DtsUnLock(Ctx);
+	DtsMdataUnLock(Ctx);
+}
+
+// a - b for IntTags, which count 1..0xFFFF and then wrap
+static int32_t DtsMdataTagDiff(uint32_t a, uint32_t b)
+{
+	int32_t d = (int32_t)(a & DTS_MDATA_MAX_TAG) - (int32_t)(b & DTS_MDATA_MAX_TAG);
+
+	if(d > (DTS_MDATA_MAX_TAG / 2))
+		d -= DTS_MDATA_MAX_TAG;
+	else if(d < -(DTS_MDATA_MAX_TAG / 2))
+		d += DTS_MDATA_MAX_TAG;
+	return d;
+}
+
+//------------------------------------------------------------------------
+// Name: DtsMdataReorderWindow
+// Description: How many tags behind the newest output picture a picture can
+//              still come out. H.264 pictures wait in the DPB for at most
+//              num_ref_frames others (16 when the SPS is not known), the
+//              other formats reorder around a single anchor picture.
+//------------------------------------------------------------------------
+uint32_t DtsMdataReorderWindow(DTS_LIB_CONTEXT *Ctx)
+{
+	uint32_t depth = 2;
+
+	if((Ctx->VidParams.MediaSubType == BC_MSUBTYPE_H264) || (Ctx->VidParams.MediaSubType == BC_MSUBTYPE_AVC1) ||
+	   (Ctx->VidParams.MediaSubType == BC_MSUBTYPE_INVALID))
+		depth = Ctx->VidParams.NumOfRefFrames ? Ctx->VidParams.NumOfRefFrames : 16;
+
+	return depth + MAX_DISORDER_GAP;
 }
 
 static uint32_t DtsMdataGetIntTag(DTS_LIB_CONTEXT *Ctx, uint16_t snum)
 {
 	uint32_t retTag=0;
 
-	DtsLock(Ctx);
+	DtsMdataLock(Ctx);
 	retTag = ((Ctx->InMdataTag & DTS_MDATA_TAG_MASK) | snum) ;
-	DtsUnLock(Ctx);
+	DtsMdataUnLock(Ctx);
 
 	return retTag;
 }
@@ -953,7 +1138,7 @@ static BC_STATUS DtsDeleteMdataPool(DTS_LIB_CONTEXT *Ctx)
 	if(!Ctx || !Ctx->MdataPoolPtr){
 		return BC_STS_INV_ARG;
 	}
-	DtsLock(Ctx);
+	DtsMdataLock(Ctx);
 	/* Remove all Pending elements */
 	temp = Ctx->MDPendHead;
 
@@ -964,13 +1149,15 @@ static BC_STATUS DtsDeleteMdataPool(DTS_LIB_CONTEXT *Ctx)
 
 	/* Delete Free Pool */
 	Ctx->MDFreeHead = NULL;
+	memset(Ctx->MDTagIndex, 0, sizeof(Ctx->MDTagIndex));
+	Ctx->MDBatchCnt = Ctx->MDBatchNext = 0;
 
 	if(Ctx->MdataPoolPtr){
 		free(Ctx->MdataPoolPtr);
 		Ctx->MdataPoolPtr = NULL;
 	}
 
-	DtsUnLock(Ctx);
+	DtsMdataUnLock(Ctx);
 
 	return BC_STS_SUCCESS;
 }
@@ -1000,12 +1187,7 @@ DTS_LIB_CONTEXT	*	DtsGetContext(HANDLE userHnd)
 //-----------------------------------------------------------------------
 BOOL DtsIsPend(DTS_LIB_CONTEXT	*Ctx)
 {
-	BOOL res =FALSE;
-	DtsLock(Ctx);
-	res = (Ctx->ProcOutPending);
-	DtsUnLock(Ctx);
-
-	return res;
+	return (*(volatile BOOL *)&Ctx->ProcOutPending != 0);
 }
 
 //-----------------------------------------------------------------------
@@ -1119,85 +1301,120 @@ BC_STATUS DtsDrvCmd(DTS_LIB_CONTEXT	*Ctx,
 //------------------------------------------------------------------------
 // Name: DtsRelIoctlData
 // Description: Release IOCTL_DATA back to the pool.
+//
+// The pool is a lock-free stack over the pIoDataPool array. The top word
+// holds the index + 1 of the top entry in its low half and a generation
+// count in its high half, so a pop that raced with pop/push of the same
+// entry fails its compare and swap instead of corrupting the list.
 //------------------------------------------------------------------------
 void DtsRelIoctlData(DTS_LIB_CONTEXT *Ctx, BC_IOCTL_DATA *pIoData)
 {
-	DtsLock(Ctx);
-
-	pIoData->next = Ctx->pIoDataFreeHd;
-    Ctx->pIoDataFreeHd = pIoData;
+	uint64_t top, newTop;
+	uint32_t idx = (uint32_t)(pIoData - Ctx->pIoDataPool) + 1;
 
-	DtsUnLock(Ctx);
+	do {
+		top = __atomic_load_n(&Ctx->IoDataFreeTop, __ATOMIC_ACQUIRE);
+		pIoData->next = ((uint32_t)top) ? &Ctx->pIoDataPool[(uint32_t)top - 1] : NULL;
+		newTop = (top & 0xFFFFFFFF00000000ULL) + (1ULL << 32) + idx;
+	} while(!__sync_bool_compare_and_swap(&Ctx->IoDataFreeTop, top, newTop));
 }
 
 //------------------------------------------------------------------------
-// Name: DtsAllocIoctlData
-// Description: Acquire IOCTL_DATA From pool.
+// Name: DtsAllocIoctlDataSz
+// Description: Acquire IOCTL_DATA From pool. Only the header and the first
+//              uSz bytes of the union are cleared, callers pass the size
+//              of the member their command uses.
 //------------------------------------------------------------------------
-BC_IOCTL_DATA *DtsAllocIoctlData(DTS_LIB_CONTEXT *Ctx)
+BC_IOCTL_DATA *DtsAllocIoctlDataSz(DTS_LIB_CONTEXT *Ctx, uint32_t uSz)
 {
 	BC_IOCTL_DATA *temp=NULL;
-	DtsLock(Ctx);
-    if((temp=Ctx->pIoDataFreeHd) != NULL){
-        Ctx->pIoDataFreeHd = Ctx->pIoDataFreeHd->next;
-        memset(temp,0,sizeof(*temp));
-    }
-	DtsUnLock(Ctx);
-	if(!temp){
+	uint64_t top, newTop;
+	uint32_t idx;
+
+	do {
+		top = __atomic_load_n(&Ctx->IoDataFreeTop, __ATOMIC_ACQUIRE);
+		if(!(idx = (uint32_t)top))
+			break;
+		temp = &Ctx->pIoDataPool[idx - 1];
+		idx = temp->next ? (uint32_t)(temp->next - Ctx->pIoDataPool) + 1 : 0;
+		newTop = (top & 0xFFFFFFFF00000000ULL) + (1ULL << 32) + idx;
+	} while(!__sync_bool_compare_and_swap(&Ctx->IoDataFreeTop, top, newTop));
+
+	if(!(uint32_t)top){
 		DebugLog_Trace(LDIL_DBG,"DtsAllocIoctlData Error\n");
+		return NULL;
 	}
 
-    return temp;
+	if(uSz > sizeof(temp->u))
+		uSz = sizeof(temp->u);
+	temp->RetSts = BC_STS_SUCCESS;
+	temp->IoctlDataSz = 0;
+	temp->Timeout = 0;
+	memset(&temp->u, 0, uSz);
+	temp->next = NULL;
+
+	return temp;
 }
+
 //------------------------------------------------------------------------
-// Name: DtsAllocMemPools
-// Description: Allocate memory for application specific configs and RxBuffs
+// Name: DtsAllocIoctlData
+// Description: Acquire IOCTL_DATA From pool, fully cleared.
 //------------------------------------------------------------------------
-BC_STATUS DtsAllocMemPools(DTS_LIB_CONTEXT *Ctx)
+BC_IOCTL_DATA *DtsAllocIoctlData(DTS_LIB_CONTEXT *Ctx)
 {
-	uint32_t	i, Sz;
-	DTS_MPOOL_TYPE	*mp;
-	BC_IOCTL_DATA *pIoData;
-	BC_STATUS	sts = BC_STS_SUCCESS;
+	return DtsAllocIoctlDataSz(Ctx, sizeof(((BC_IOCTL_DATA *)0)->u));
+}
 
-	if(!Ctx){
-		return BC_STS_INV_ARG;
+static BC_STATUS DtsCreateIoctlPool(DTS_LIB_CONTEXT *Ctx)
+{
+	uint32_t i;
+
+	__atomic_store_n(&Ctx->IoDataFreeTop, 0, __ATOMIC_RELEASE);
+	Ctx->pIoDataPool = (BC_IOCTL_DATA *) malloc(BC_IOCTL_DATA_POOL_SIZE * sizeof(BC_IOCTL_DATA));
+	if(!Ctx->pIoDataPool){
+		DebugLog_Trace(LDIL_DBG,"DtsInitMemPools: ioctlData pool Alloc Failed\n");
+		return BC_STS_INSUFF_RES;
 	}
 
-	DtsInitLock(Ctx);
+	for(i=0; i< BC_IOCTL_DATA_POOL_SIZE; i++)
+		DtsRelIoctlData(Ctx, &Ctx->pIoDataPool[i]);
 
-	for(i=0; i< BC_IOCTL_DATA_POOL_SIZE; i++){
-		pIoData = (BC_IOCTL_DATA *) malloc(sizeof(BC_IOCTL_DATA));
-		if(!pIoData){
-			DebugLog_Trace(LDIL_DBG,"DtsInitMemPools: ioctlData pool Alloc Failed\n");
-			return BC_STS_INSUFF_RES;
-		}
-		DtsRelIoctlData(Ctx,pIoData);
-	}
+	return BC_STS_SUCCESS;
+}
 
-	Ctx->pOutData = (BC_IOCTL_DATA *) malloc(sizeof(BC_IOCTL_DATA));
-	if(!Ctx->pOutData){
-		DebugLog_Trace(LDIL_DBG,"DtsInitMemPools: pOutData \n");
-		return BC_STS_INSUFF_RES;
-	}
+static void DtsDeleteIoctlPool(DTS_LIB_CONTEXT *Ctx)
+{
+	uint32_t cnt=0;
 
-	if((Ctx->OpMode != DTS_PLAYBACK_MODE) && (Ctx->OpMode != DTS_DIAG_MODE))
-		return BC_STS_SUCCESS;
+	if(!Ctx->pIoDataPool)
+		return;
 
-	sts = DtsCreateMdataPool(Ctx);
-	if(sts != BC_STS_SUCCESS){
-		DebugLog_Trace(LDIL_DBG,"InMdata PoolCreation Failed:%x\n",sts);
-		return sts;
-	}
+	while(DtsAllocIoctlDataSz(Ctx, 0) != NULL)
+		cnt++;
 
-	if(!(Ctx->CfgFlags & BC_MPOOL_INCL_YUV_BUFFS)){
-		return BC_STS_SUCCESS;
+	if(cnt != BC_IOCTL_DATA_POOL_SIZE){
+		DebugLog_Trace(LDIL_DBG,"DtsReleaseMemPools: pIoData MemPool Leak: %d..\n",cnt);
 	}
+
+	free(Ctx->pIoDataPool);
+	Ctx->pIoDataPool = NULL;
+	__atomic_store_n(&Ctx->IoDataFreeTop, 0, __ATOMIC_RELEASE);
+}
+//------------------------------------------------------------------------
+// Name: DtsCreateYUVPool
+// Description: Allocate the library's own RxBuffs.
+//------------------------------------------------------------------------
+static BC_STATUS DtsCreateYUVPool(DTS_LIB_CONTEXT *Ctx)
+{
+	uint32_t	i, Sz;
+	DTS_MPOOL_TYPE	*mp;
+
 	Ctx->MpoolCnt	= BC_MAX_SW_VOUT_BUFFS;
 
 	Ctx->Mpools = (DTS_MPOOL_TYPE*)malloc(Ctx->MpoolCnt * sizeof(DTS_MPOOL_TYPE));
 	if(!Ctx->Mpools){
 		DebugLog_Trace(LDIL_DBG,"DtsInitMemPools: Mpool alloc failed\n");
+		Ctx->MpoolCnt = 0;
 		return BC_STS_INSUFF_RES;
 	}
 
@@ -1221,10 +1438,37 @@ BC_STATUS DtsAllocMemPools(DTS_LIB_CONTEXT *Ctx)
 
 	return BC_STS_SUCCESS;
 }
-BC_STATUS DtsAllocMemPools_dbg(DTS_LIB_CONTEXT *Ctx)
+//------------------------------------------------------------------------
+// Name: DtsDeleteYUVPool
+// Description: Free the RxBuffs list, and the buffers the library owns.
+//              The driver must not have any of them mapped.
+//------------------------------------------------------------------------
+static void DtsDeleteYUVPool(DTS_LIB_CONTEXT *Ctx)
 {
 	uint32_t	i;
-	BC_IOCTL_DATA *pIoData;
+	DTS_MPOOL_TYPE	*mp;
+
+	if (!Ctx->Mpools)
+		return;
+
+	for (i = 0; i < Ctx->MpoolCnt; i++){
+		mp = &Ctx->Mpools[i];
+		if (mp->buff && !(mp->type & BC_MEM_APP_OWNED)){
+			//DebugLog_Trace(LDIL_DBG,"DtsReleaseMemPools: Free Mpool %x Buff:%p\n",mp->type,mp->buff);
+			free(mp->buff);
+		}
+	}
+	free(Ctx->Mpools);
+	Ctx->Mpools = NULL;
+	Ctx->MpoolCnt = 0;
+}
+//------------------------------------------------------------------------
+// Name: DtsAllocMemPools
+// Description: Allocate memory for application specific configs and RxBuffs
+//------------------------------------------------------------------------
+BC_STATUS DtsAllocMemPools(DTS_LIB_CONTEXT *Ctx)
+{
+	BC_STATUS	sts = BC_STS_SUCCESS;
 
 	if(!Ctx){
 		return BC_STS_INV_ARG;
@@ -1232,15 +1476,42 @@ BC_STATUS DtsAllocMemPools_dbg(DTS_LIB_CONTEXT *Ctx)
 
 	DtsInitLock(Ctx);
 
-	for(i=0; i< BC_IOCTL_DATA_POOL_SIZE; i++){
-		pIoData = (BC_IOCTL_DATA *) malloc(sizeof(BC_IOCTL_DATA));
-		if(!pIoData){
-			DebugLog_Trace(LDIL_DBG,"DtsInitMemPools: ioctlData pool Alloc Failed\n");
-			return BC_STS_INSUFF_RES;
-		}
-		DtsRelIoctlData(Ctx,pIoData);
+	if(DtsCreateIoctlPool(Ctx) != BC_STS_SUCCESS)
+		return BC_STS_INSUFF_RES;
+
+	Ctx->pOutData = (BC_IOCTL_DATA *) malloc(sizeof(BC_IOCTL_DATA));
+	if(!Ctx->pOutData){
+		DebugLog_Trace(LDIL_DBG,"DtsInitMemPools: pOutData \n");
+		return BC_STS_INSUFF_RES;
+	}
+
+	if((Ctx->OpMode != DTS_PLAYBACK_MODE) && (Ctx->OpMode != DTS_DIAG_MODE))
+		return BC_STS_SUCCESS;
+
+	sts = DtsCreateMdataPool(Ctx);
+	if(sts != BC_STS_SUCCESS){
+		DebugLog_Trace(LDIL_DBG,"InMdata PoolCreation Failed:%x\n",sts);
+		return sts;
+	}
+
+	if(!(Ctx->CfgFlags & BC_MPOOL_INCL_YUV_BUFFS)){
+		return BC_STS_SUCCESS;
+	}
+
+	return DtsCreateYUVPool(Ctx);
+}
+BC_STATUS DtsAllocMemPools_dbg(DTS_LIB_CONTEXT *Ctx)
+{
+
+	if(!Ctx){
+		return BC_STS_INV_ARG;
 	}
 
+	DtsInitLock(Ctx);
+
+	if(DtsCreateIoctlPool(Ctx) != BC_STS_SUCCESS)
+		return BC_STS_INSUFF_RES;
+
 	Ctx->pOutData = (BC_IOCTL_DATA *) malloc(sizeof(BC_IOCTL_DATA));
 	if(!Ctx->pOutData){
 		DebugLog_Trace(LDIL_DBG,"DtsInitMemPools: pOutData \n");
@@ -1255,8 +1526,6 @@ BC_STATUS DtsAllocMemPools_dbg(DTS_LIB_CONTEXT *Ctx)
 //------------------------------------------------------------------------
 void DtsReleaseMemPools(DTS_LIB_CONTEXT *Ctx)
 {
-	uint32_t	i,cnt=0;
-	DTS_MPOOL_TYPE	*mp;
 	BC_IOCTL_DATA *pIoData = NULL;
 
 
@@ -1265,31 +1534,15 @@ void DtsReleaseMemPools(DTS_LIB_CONTEXT *Ctx)
 
 	/* need to release any user buffers mapped in driver
 	 * or free(mp->buff) can hang under Linux and Mac OS X */
-	pIoData = DtsAllocIoctlData(Ctx);
+	pIoData = DtsAllocIoctlDataFor(Ctx, FlushRxCap);
 	if (pIoData) {
 		pIoData->u.FlushRxCap.bDiscardOnly = TRUE;
 		DtsDrvCmd(Ctx, BCM_IOC_FLUSH_RX_CAP, 0, pIoData, TRUE);
 	}
-	if (Ctx->MpoolCnt) {
-		for (i = 0; i < Ctx->MpoolCnt; i++){
-			mp = &Ctx->Mpools[i];
-			if (mp->buff){
-				//DebugLog_Trace(LDIL_DBG,"DtsReleaseMemPools: Free Mpool %x Buff:%p\n",mp->type,mp->buff);
-				free(mp->buff);
-			}
-		}
-		free(Ctx->Mpools);
-	}
+	DtsDeleteYUVPool(Ctx);
 
 	/* Release IOCTL_DATA pool */
-    while((pIoData=DtsAllocIoctlData(Ctx))!=NULL){
-		free(pIoData);
-		cnt++;
-	}
-
-	if(cnt != BC_IOCTL_DATA_POOL_SIZE){
-		DebugLog_Trace(LDIL_DBG,"DtsReleaseMemPools: pIoData MemPool Leak: %d..\n",cnt);
-	}
+	DtsDeleteIoctlPool(Ctx);
 
 	if(Ctx->pOutData)
 		free(Ctx->pOutData);
@@ -1304,23 +1557,13 @@ void DtsReleaseMemPools(DTS_LIB_CONTEXT *Ctx)
 }
 void DtsReleaseMemPools_dbg(DTS_LIB_CONTEXT *Ctx)
 {
-	uint32_t	cnt=0;
-	BC_IOCTL_DATA *pIoData = NULL;
-
 
 	if(!Ctx || !Ctx->Mpools){
 		return;
 	}
 
 	/* Release IOCTL_DATA pool */
-    while((pIoData=DtsAllocIoctlData(Ctx))!=NULL){
-		free(pIoData);
-		cnt++;
-	}
-
-	if(cnt != BC_IOCTL_DATA_POOL_SIZE){
-		DebugLog_Trace(LDIL_DBG,"DtsReleaseMemPools: pIoData MemPool Leak: %d..\n",cnt);
-	}
+	DtsDeleteIoctlPool(Ctx);
 
 	if(Ctx->pOutData)
 		free(Ctx->pOutData);
@@ -1339,13 +1582,19 @@ BC_STATUS DtsAddOutBuff(DTS_LIB_CONTEXT *Ctx, uint8_t *buff, uint32_t BuffSz, ui
 	if(!Ctx || !buff)
 		return BC_STS_INV_ARG;
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx))) {
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, RxBuffs))) {
 		DebugLog_Trace(LDIL_DBG,"Cannot Allocate IOCTL data\n");
 		return BC_STS_INSUFF_RES;
 	}
 
 	DtsGetMaxYUVSize(Ctx, &YbSz, &UVbSz);
 
+	/* Registered buffers were sized for the mode at the time */
+	if(BuffSz < YbSz + UVbSz) {
+		DtsRelIoctlData(Ctx, pIocData);
+		return BC_STS_INV_ARG;
+	}
+
 	pIocData->u.RxBuffs.YuvBuff = buff;
 	pIocData->u.RxBuffs.YuvBuffSz = YbSz + UVbSz;
 
@@ -1396,15 +1645,44 @@ BC_STATUS DtsRelRxBuff(DTS_LIB_CONTEXT *Ctx, BC_DEC_YUV_BUFFS *buff, BOOL SkipAd
 	return sts;
 }
 
+// Monotonic time for the fetch latency histogram
+static uint64_t DtsGetTimeUs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// BC_DTS_DEC_STATS.FetchLatency index: 0 under 1ms, n under 2^n ms
+static uint32_t DtsLatencyBucket(uint64_t us)
+{
+	uint32_t b = 0;
+	uint64_t ms = us / 1000;
+
+	while(ms && (b < BC_DTS_LAT_BUCKETS - 1)) {
+		ms >>= 1;
+		b++;
+	}
+	return b;
+}
+
 //------------------------------------------------------------------------
 // Name: DtsFetchOutInterruptible
 // Description: Get uncompressed video data from hardware.
 //              This function is interruptable procOut for
 //              multi-threaded scenerios ONLY..
+//
+//              Drivers with DrvFetchWait sleep dwTimeout ms themselves.
+//              Older ones use their own fixed wait, for
+//              BC_POUT_WAIT_INFINITE the fetch is repeated until there is
+//              a picture, an interrupt or the decoder stops.
 //------------------------------------------------------------------------
 BC_STATUS DtsFetchOutInterruptible(DTS_LIB_CONTEXT *Ctx, BC_DTS_PROC_OUT *pOut, uint32_t dwTimeout)
 {
 	BC_STATUS sts = BC_STS_SUCCESS;
+	bool bRetry;
+	uint64_t start, trStart;
 
 	if(!Ctx ||  !pOut)
 		return BC_STS_INV_ARG;
@@ -1416,9 +1694,29 @@ BC_STATUS DtsFetchOutInterruptible(DTS_LIB_CONTEXT *Ctx, BC_DTS_PROC_OUT *pOut,
 
 	DtsIncPend(Ctx);
 
-	memset(Ctx->pOutData,0,sizeof(*Ctx->pOutData));
+	start = DtsGetTimeUs();
+	trStart = DTS_TRACE_BEGIN(Ctx);
+	do
+	{
+		if(!Ctx->DrvFetchWait && __sync_lock_test_and_set(&Ctx->FetchInterrupt, 0)){
+			DtsDecPend(Ctx);
+			return BC_STS_IO_USER_ABORT;
+		}
+
+		memset(Ctx->pOutData,0,sizeof(*Ctx->pOutData));
+		/* Ask for the in-frame PIB beside the picture, older drivers ignore this */
+		if(Ctx->FixFlags & DTS_LOAD_FILE_PLAY_FW)
+			Ctx->pOutData->u.DecOutData.Flags = COMP_FLAG_PIB_SIDE;
+		/* The driver takes 0 as its old fixed wait, a poll asks for 1 ms */
+		if(Ctx->DrvFetchWait)
+			Ctx->pOutData->Timeout = dwTimeout ? dwTimeout : 1;
 
-	sts=DtsDrvCmd(Ctx,BCM_IOC_FETCH_RXBUFF,0,Ctx->pOutData,FALSE);
+		sts=DtsDrvCmd(Ctx,BCM_IOC_FETCH_RXBUFF,0,Ctx->pOutData,FALSE);
+
+		bRetry = (sts == BC_STS_TIMEOUT) && (dwTimeout == BC_POUT_WAIT_INFINITE) &&
+				 !Ctx->DrvFetchWait && !Ctx->CancelWaiting &&
+				 ((Ctx->State == BC_DEC_STATE_START) || (Ctx->State == BC_DEC_STATE_PAUSE));
+	} while(bRetry);
 
 	if(sts == BC_STS_SUCCESS)
 	{
@@ -1428,6 +1726,14 @@ BC_STATUS DtsFetchOutInterruptible(DTS_LIB_CONTEXT *Ctx, BC_DTS_PROC_OUT *pOut,
 		{
 			DtsDecPend(Ctx);
 		}
+		else if(!(pOut->PoutFlags & BC_POUT_FLAGS_FMT_CHANGE))
+		{
+			DTS_STAT_ADD(Ctx->Counters.OutFrames, 1);
+			DTS_STAT_ADD(Ctx->Counters.FetchLatency[DtsLatencyBucket(DtsGetTimeUs() - start)], 1);
+			if(pOut->discCnt)
+				DTS_STAT_ADD(Ctx->Counters.Dropped, pOut->discCnt);
+			DTS_TRACE(Ctx, DTS_TR_FETCH, trStart, pOut->PicInfo.timeStamp, pOut->PicInfo.picture_number);
+		}
 
 	}else{
 		DebugLog_Trace(LDIL_DBG,"DtsFetchOutInterruptible: Failed:%x\n",sts);
@@ -1462,6 +1768,10 @@ BC_STATUS DtsCancelFetchOutInt(DTS_LIB_CONTEXT *Ctx)
 
 	Ctx->CancelWaiting = 1;
 
+	/* Drivers that can cancel end the wait now, others time out */
+	if(Ctx->DrvFetchWait)
+		DtsDrvCmd(Ctx,BCM_IOC_CANCEL_FETCH,0,NULL,FALSE);
+
 	/* Worst case scenerio the timeout should happen.. */
 	cnt = BC_PROC_OUTPUT_TIMEOUT / 100;
 
@@ -1499,7 +1809,8 @@ BC_STATUS DtsMapYUVBuffs(DTS_LIB_CONTEXT *Ctx)
 
 	for(i=0; i<Ctx->MpoolCnt; i++){
 		mp = &Ctx->Mpools[i];
-		if(mp->type & BC_MEM_DEC_YUVBUFF){
+		/* The application gives held buffers back with DtsGiveOutBuff */
+		if((mp->type & BC_MEM_DEC_YUVBUFF) && !(mp->type & BC_MEM_APP_HELD)){
 			sts = DtsAddOutBuff(Ctx, mp->buff,mp->sz, mp->type);
 			if(sts != BC_STS_SUCCESS) {
 				DebugLog_Trace(LDIL_DBG,"Map YUV buffs Failed [%x]\n",sts);
@@ -1511,6 +1822,163 @@ BC_STATUS DtsMapYUVBuffs(DTS_LIB_CONTEXT *Ctx)
 	Ctx->bMapOutBufDone = true;
 	return BC_STS_SUCCESS;
 }
+//------------------------------------------------------------------------
+// Name: DtsGetRxBuffReq
+// Description: Size and UV offset of one RxBuff in the current mode.
+//------------------------------------------------------------------------
+void DtsGetRxBuffReq(DTS_LIB_CONTEXT *Ctx, uint32_t *BuffSz, uint32_t *UVOffset)
+{
+	uint32_t YbSz, UVbSz;
+
+	DtsGetMaxYUVSize(Ctx, &YbSz, &UVbSz);
+
+	*BuffSz = YbSz + UVbSz;
+	*UVOffset = UVbSz ? YbSz : 0;
+}
+//------------------------------------------------------------------------
+// Name: DtsSetOutBuffPool
+// Description: Replace the RxBuffs with application buffers, or go back
+//              to the library's own with nBuffs of zero. Only allowed
+//              while the driver has none of them mapped.
+//------------------------------------------------------------------------
+BC_STATUS DtsSetOutBuffPool(DTS_LIB_CONTEXT *Ctx, BC_DTS_OUT_BUFF *pBuffs, uint32_t nBuffs)
+{
+	uint32_t	i, Sz, UVOff;
+	DTS_MPOOL_TYPE	*mp;
+
+	if(Ctx->bMapOutBufDone){
+		DebugLog_Trace(LDIL_DBG,"DtsSetOutBuffPool: RxBuffs are mapped\n");
+		return BC_STS_BUSY;
+	}
+
+	if(!(Ctx->CfgFlags & BC_MPOOL_INCL_YUV_BUFFS))
+		return BC_STS_ERR_USAGE;
+
+	if(!nBuffs){
+		if(!DtsHasAppOutBuffs(Ctx))
+			return BC_STS_SUCCESS;
+		DtsDeleteYUVPool(Ctx);
+		return DtsCreateYUVPool(Ctx);
+	}
+
+	if(!pBuffs || (nBuffs < BC_MIN_APP_VOUT_BUFFS) || (nBuffs > BC_MAX_SW_VOUT_BUFFS))
+		return BC_STS_INV_ARG;
+
+	DtsGetRxBuffReq(Ctx, &Sz, &UVOff);
+
+	for(i=0; i<nBuffs; i++){
+		if(!pBuffs[i].Buff || (((uintptr_t)pBuffs[i].Buff) & 0x03) || (pBuffs[i].BuffSz < Sz)){
+			DebugLog_Trace(LDIL_DBG,"DtsSetOutBuffPool: Bad buffer %u %p %x\n",i,pBuffs[i].Buff,pBuffs[i].BuffSz);
+			return BC_STS_INV_ARG;
+		}
+	}
+
+	mp = (DTS_MPOOL_TYPE*)malloc(nBuffs * sizeof(DTS_MPOOL_TYPE));
+	if(!mp)
+		return BC_STS_INSUFF_RES;
+
+	for(i=0; i<nBuffs; i++){
+		mp[i].type = BC_MEM_DEC_YUVBUFF | BC_MEM_APP_OWNED;
+		mp[i].sz = pBuffs[i].BuffSz;
+		mp[i].buff = pBuffs[i].Buff;
+	}
+
+	DtsDeleteYUVPool(Ctx);
+	Ctx->Mpools = mp;
+	Ctx->MpoolCnt = nBuffs;
+
+	return BC_STS_SUCCESS;
+}
+//------------------------------------------------------------------------
+// Name: DtsHasAppOutBuffs
+// Description: Are the RxBuffs the application's?
+//------------------------------------------------------------------------
+BOOL DtsHasAppOutBuffs(DTS_LIB_CONTEXT *Ctx)
+{
+	return (Ctx->Mpools && (Ctx->Mpools[0].type & BC_MEM_APP_OWNED));
+}
+//------------------------------------------------------------------------
+// Name: DtsTakeOutBuff
+// Description: Hand the RxBuff just fetched over to the application
+//              instead of releasing it back to the driver.
+//------------------------------------------------------------------------
+BC_STATUS DtsTakeOutBuff(DTS_LIB_CONTEXT *Ctx, uint32_t *pIdx)
+{
+	uint32_t	i;
+	DTS_MPOOL_TYPE	*mp;
+
+	for(i=0; i<Ctx->MpoolCnt; i++){
+		mp = &Ctx->Mpools[i];
+		if((mp->type & BC_MEM_APP_OWNED) && (mp->buff == Ctx->pOutData->u.DecOutData.OutPutBuffs.YuvBuff)){
+			__sync_fetch_and_or(&mp->type, BC_MEM_APP_HELD);
+			*pIdx = i;
+			/* Ends the fetch without re-adding the buffer */
+			return DtsRelRxBuff(Ctx, &Ctx->pOutData->u.RxBuffs, TRUE);
+		}
+	}
+
+	DebugLog_Trace(LDIL_DBG,"DtsTakeOutBuff: Unknown buffer %p\n",Ctx->pOutData->u.DecOutData.OutPutBuffs.YuvBuff);
+	DtsRelRxBuff(Ctx, &Ctx->pOutData->u.RxBuffs, FALSE);
+	return BC_STS_ERROR;
+}
+//------------------------------------------------------------------------
+// Name: DtsGiveOutBuff
+// Description: Return a buffer the application held back to the driver.
+//------------------------------------------------------------------------
+BC_STATUS DtsGiveOutBuff(DTS_LIB_CONTEXT *Ctx, uint32_t Idx)
+{
+	BC_STATUS	sts;
+	DTS_MPOOL_TYPE	*mp;
+
+	if(!DtsHasAppOutBuffs(Ctx) || (Idx >= Ctx->MpoolCnt))
+		return BC_STS_INV_ARG;
+
+	mp = &Ctx->Mpools[Idx];
+
+	if(!(__sync_fetch_and_and(&mp->type, ~BC_MEM_APP_HELD) & BC_MEM_APP_HELD)){
+		DebugLog_Trace(LDIL_DBG,"DtsGiveOutBuff: Buffer %u not held\n",Idx);
+		return BC_STS_INV_ARG;
+	}
+
+	/* Not mapped, the next DtsMapYUVBuffs adds it */
+	if(!Ctx->bMapOutBufDone)
+		return BC_STS_SUCCESS;
+
+	sts = DtsAddOutBuff(Ctx, mp->buff, mp->sz, mp->type);
+	if(sts != BC_STS_SUCCESS)
+		__sync_fetch_and_or(&mp->type, BC_MEM_APP_HELD);
+
+	return sts;
+}
+static void DtsStartTxThread(DTS_LIB_CONTEXT *Ctx)
+{
+	pthread_attr_t thread_attr;
+
+	Ctx->txThreadExit = false;
+	Ctx->txWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	pthread_attr_init(&thread_attr);
+	pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_JOINABLE);
+	pthread_create(&Ctx->htxThread, &thread_attr, txThreadProc, Ctx);
+	pthread_attr_destroy(&thread_attr);
+}
+
+static void DtsStopTxThread(DTS_LIB_CONTEXT *Ctx)
+{
+	// Exit TX thread
+	uint64_t one = 1;
+
+	Ctx->txThreadExit = true;
+	txBufWakeUp(&Ctx->circBuf);
+	if(Ctx->txWakeFd >= 0 && write(Ctx->txWakeFd, &one, sizeof(one)) != sizeof(one))
+		DebugLog_Trace(LDIL_DBG,"DtsStopTxThread: wake failed %d\n", errno);
+	// wait to make sure the thread exited
+	pthread_join(Ctx->htxThread, NULL);
+	Ctx->htxThread = 0;
+	if(Ctx->txWakeFd >= 0)
+		close(Ctx->txWakeFd);
+	Ctx->txWakeFd = -1;
+}
+
 //------------------------------------------------------------------------
 // Name: DtsInitInterface
 // Description: Do application specific allocation and other initialization.
@@ -1520,10 +1988,10 @@ BC_STATUS DtsInitInterface(int hDevice, HANDLE *RetCtx, uint32_t mode)
 
 	DTS_LIB_CONTEXT *Ctx = NULL;
 	BC_STATUS	sts = BC_STS_SUCCESS;
-	pthread_attr_t thread_attr;
-	int ret = 0;
 
-	Ctx = (DTS_LIB_CONTEXT*)malloc(sizeof(*Ctx));
+	// Aligned for the cache line split of the TX ring indices
+	if(posix_memalign((void**)&Ctx, TX_CACHE_LINE_SIZE, sizeof(*Ctx)))
+		Ctx = NULL;
 	if(!Ctx){
 		DebugLog_Trace(LDIL_DBG,"DtsInitInterface: Ctx alloc failed\n");
 		return BC_STS_INSUFF_RES;
@@ -1531,6 +1999,8 @@ BC_STATUS DtsInitInterface(int hDevice, HANDLE *RetCtx, uint32_t mode)
 
 	memset(Ctx,0,sizeof(*Ctx));
 
+	DtsAddProcHandle(mode);
+
 	/* Initialize Application specific params. */
 	Ctx->Sig		= LIB_CTX_SIG;
 	Ctx->DevHandle  = hDevice;
@@ -1568,18 +2038,12 @@ BC_STATUS DtsInitInterface(int hDevice, HANDLE *RetCtx, uint32_t mode)
 		}
 	}
 
-	// Allocate circular buffer
+	// Allocate circular buffer, it is sized for the stream on the first
+	// input after DtsOpenDecoder
 	if(BC_STS_SUCCESS != txBufInit(&Ctx->circBuf, CIRC_TX_BUF_SIZE))
 		sts = BC_STS_INSUFF_RES;
 
-	pthread_attr_init(&thread_attr);
-	pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_JOINABLE);
-	pthread_create(&Ctx->htxThread, &thread_attr, txThreadProc, Ctx);
-	pthread_attr_destroy(&thread_attr);
-
-	ret = posix_memalign((void**)&Ctx->alignBuf, 128, ALIGN_BUF_SIZE);
-	if(ret)
-		sts = BC_STS_INSUFF_RES;
+	DtsStartTxThread(Ctx);
 
 	*RetCtx = (HANDLE)Ctx;
 
@@ -1596,15 +2060,11 @@ BC_STATUS DtsReleaseInterface(DTS_LIB_CONTEXT *Ctx)
 	if(!Ctx)
 		return BC_STS_INV_ARG;
 
-	// Exit TX thread
-	Ctx->txThreadExit = true;
-	// wait to make sure the thread exited
-	pthread_join(Ctx->htxThread, NULL);
+	DtsStopTxThread(Ctx);
 	// de-Allocate circular buffer
 	txBufFree(&Ctx->circBuf);
-	Ctx->htxThread = 0;
-	if(Ctx->alignBuf)
-		free(Ctx->alignBuf);
+
+	DtsDeleteCopyPool(Ctx->CopyPool);
 
 	DtsReleaseMemPools(Ctx);
 
@@ -1616,10 +2076,14 @@ BC_STATUS DtsReleaseInterface(DTS_LIB_CONTEXT *Ctx)
 			DebugLog_Trace(LDIL_DBG,"DtsDeviceClose: Close Handle Failed with error %d\n",errno);
 	}
 
-	DtsSetHwInitSts(BC_DIL_HWINIT_NOT_YET);
+	/* Set up again on the next open once no handle here uses it */
+	if(DtsDelProcHandle(Ctx->OpMode))
+		DtsSetHwInitSts(BC_DIL_HWINIT_NOT_YET);
 
 	DtsDelDilShMem();
 
+	DtsTraceFree(Ctx);
+
 	free(Ctx);
 
 	return BC_STS_SUCCESS;
@@ -1627,21 +2091,125 @@ BC_STATUS DtsReleaseInterface(DTS_LIB_CONTEXT *Ctx)
 }
 
 //------------------------------------------------------------------------
-// Name: DtsReleaseUserHandle
-// Description: Notfiy the driver to release the user handle
-// Should be called right before close
+// Name: DtsTxBufSizeForStream
+// Description: TX ring size for the current stream. The application
+//              override wins, otherwise the ring holds the larger of a
+//              quarter second at the H.264 level's maximum bit rate and
+//              half a raw picture, the worst case for a single coded one.
+//              Always a power of two within TX_BUF_MIN_SIZE/TX_BUF_MAX_SIZE.
 //------------------------------------------------------------------------
-BC_STATUS DtsReleaseUserHandle(DTS_LIB_CONTEXT* Ctx)
-{
-	BC_IOCTL_DATA	pIo;
-	BC_STATUS		sts = BC_STS_SUCCESS;
-
-	memset(&pIo, 0, sizeof(BC_IOCTL_DATA));
+uint32_t DtsTxBufSizeForStream(DTS_LIB_CONTEXT *Ctx)
+{
+	/* MaxBR in kbit/s from Table A-1 of H.264, indexed by level_idc */
+	static const struct { uint32_t level; uint32_t maxBR; } levelBR[] = {
+		{ 9, 128 }, { 10, 64 }, { 11, 192 }, { 12, 384 }, { 13, 768 },
+		{ 20, 2000 }, { 21, 4000 }, { 22, 4000 }, { 30, 10000 }, { 31, 14000 },
+		{ 32, 20000 }, { 40, 20000 }, { 41, 50000 }, { 42, 50000 },
+		{ 50, 135000 }, { 51, 240000 }, { 52, 240000 },
+	};
+	uint32_t want = 0, size = TX_BUF_MIN_SIZE;
+	uint32_t width = Ctx->VidParams.WidthInPixels;
+	uint32_t height = Ctx->VidParams.HeightInPixels;
+	uint32_t i;
 
-	if( (sts=DtsDrvCmd(Ctx,BCM_IOC_RELEASE,0,&pIo,FALSE)) != BC_STS_SUCCESS){
-		DebugLog_Trace(LDIL_DBG,"DtsReleaseUserHandle: Ioctl failed: %d\n",sts);
-		return sts;
-	}
+	if(Ctx->txBufSizeReq) {
+		want = Ctx->txBufSizeReq;
+	} else {
+		if(!width || !height) {
+			width = 1920;
+			height = 1088;
+		}
+		want = (width * height * 3 / 2) / 2;
+
+		for(i = 0; i < sizeof(levelBR) / sizeof(levelBR[0]); i++) {
+			if(levelBR[i].level == Ctx->VidParams.LevelIDC) {
+				if(levelBR[i].maxBR * (1000 / 8) / 4 > want)
+					want = levelBR[i].maxBR * (1000 / 8) / 4;
+				break;
+			}
+		}
+	}
+
+	while(size < want && size < TX_BUF_MAX_SIZE)
+		size <<= 1;
+
+	return size;
+}
+
+//------------------------------------------------------------------------
+// Name: DtsResizeTxBuffer
+// Description: Reallocate the TX ring if DtsTxBufSizeForStream() asks for
+//              a different size. Only done while the ring is empty, since
+//              the TX thread is restarted around the reallocation; until
+//              then the resize stays pending and is retried on the next
+//              input. If the new ring can't be allocated the old one is
+//              kept. Must not be called with DtsLock held or from the TX
+//              thread.
+//------------------------------------------------------------------------
+BC_STATUS DtsResizeTxBuffer(DTS_LIB_CONTEXT *Ctx)
+{
+	uint32_t size, oldSize;
+	TXBUFFER newBuf;
+	uint8_t *buf;
+
+	if(!Ctx)
+		return BC_STS_INV_ARG;
+
+	size = DtsTxBufSizeForStream(Ctx);
+	oldSize = Ctx->circBuf.totalSize;
+	if(size == oldSize) {
+		Ctx->txBufResize = false;
+		return BC_STS_SUCCESS;
+	}
+
+	if(txBufBusySize(&Ctx->circBuf) != 0 || Ctx->circBuf.batchSize != 0)
+		return BC_STS_BUSY;
+
+	// The old ring stays in use unless the new one can be had
+	memset(&newBuf, 0, sizeof(newBuf));
+	if(txBufInit(&newBuf, size) != BC_STS_SUCCESS) {
+		DebugLog_Trace(LDIL_DBG,"DtsResizeTxBuffer: %d bytes failed, keeping %d\n", size, oldSize);
+		Ctx->txBufResize = false;
+		return BC_STS_SUCCESS;
+	}
+
+	// Only the memory changes hands, the ring is empty and its indices
+	// and wakeups stay where the two sides expect them
+	DtsStopTxThread(Ctx);
+	buf = Ctx->circBuf.buffer;
+	Ctx->circBuf.buffer = newBuf.buffer;
+	newBuf.buffer = buf;
+	buf = Ctx->circBuf.bounceBuf;
+	Ctx->circBuf.bounceBuf = newBuf.bounceBuf;
+	newBuf.bounceBuf = buf;
+	Ctx->circBuf.totalSize = newBuf.totalSize;
+	Ctx->circBuf.sizeMask = newBuf.sizeMask;
+	DtsStartTxThread(Ctx);
+
+	txBufFree(&newBuf);
+	DebugLog_Trace(LDIL_DBG,"DtsResizeTxBuffer: %d -> %d bytes\n", oldSize, Ctx->circBuf.totalSize);
+
+	Ctx->txBufResize = false;
+
+	return BC_STS_SUCCESS;
+}
+
+//------------------------------------------------------------------------
+// Name: DtsReleaseUserHandle
+// Description: Notfiy the driver to release the user handle
+// Should be called right before close
+//------------------------------------------------------------------------
+BC_STATUS DtsReleaseUserHandle(DTS_LIB_CONTEXT* Ctx)
+{
+	BC_IOCTL_DATA	pIo;
+	BC_STATUS		sts = BC_STS_SUCCESS;
+
+	memset(&pIo, 0, sizeof(BC_IOCTL_DATA));
+
+	if( (sts=DtsDrvCmd(Ctx,BCM_IOC_RELEASE,0,&pIo,FALSE)) != BC_STS_SUCCESS){
+		DebugLog_Trace(LDIL_DBG,"DtsReleaseUserHandle: Ioctl failed: %d\n",sts);
+		return sts;
+	}
 
 	return sts;
 }
@@ -1658,7 +2226,7 @@ BC_STATUS DtsNotifyOperatingMode(HANDLE hDevice,uint32_t Mode)
 
 	DTS_GET_CTX(hDevice,Ctx);
 
-	if(!(pIocData = DtsAllocIoctlData(Ctx)))
+	if(!(pIocData = DtsAllocIoctlDataFor(Ctx, NotifyMode)))
 		return BC_STS_INSUFF_RES;
 
 	pIocData->u.NotifyMode.Mode = Mode ; /* Setting the 31st bit to indicate that this is not the timeout value */
@@ -1808,7 +2376,7 @@ DTS_INPUT_MDATA	*DtsAllocMdata(DTS_LIB_CONTEXT *Ctx)
 	if(!Ctx)
 		return temp;
 
-	DtsLock(Ctx);
+	DtsMdataLock(Ctx);
 	if((temp=Ctx->MDFreeHead) != NULL)
 	{
 		Ctx->MDFreeHead = Ctx->MDFreeHead->flink;
@@ -1816,15 +2384,16 @@ DTS_INPUT_MDATA	*DtsAllocMdata(DTS_LIB_CONTEXT *Ctx)
 	}
 	else
 	{
-		//Use the Last Un-Fetched One
+		//Pool is all pending, the oldest one is the least likely to still
+		//have a picture coming. Reuse it.
 		DTS_INPUT_MDATA *last = NULL;
 		last = Ctx->MDPendHead;
 
-		//Check the Last Fetch Tag
-		if((last) && (Ctx->MDLastFetchTag > (last->IntTag + MAX_DISORDER_GAP)))
+		if((last) && (last != DTS_MDATA_PEND_LINK(Ctx)))
 		{
 			//Remove
 			DtsRemoveMdata(Ctx, last, FALSE);
+			DTS_STAT_ADD(Ctx->MDEvictCnt, 1);
 
 			if((temp = Ctx->MDFreeHead) != NULL)
 			{
@@ -1833,7 +2402,7 @@ DTS_INPUT_MDATA	*DtsAllocMdata(DTS_LIB_CONTEXT *Ctx)
 			}
 		}
 	}
-	DtsUnLock(Ctx);
+	DtsMdataUnLock(Ctx);
 
 	return temp;
 }
@@ -1847,11 +2416,11 @@ BC_STATUS DtsFreeMdata(DTS_LIB_CONTEXT *Ctx, DTS_INPUT_MDATA	*Mdata, BOOL sync)
 		return BC_STS_INV_ARG;
 	}
 	if(sync)
-		DtsLock(Ctx);
+		DtsMdataLock(Ctx);
 	Mdata->flink = Ctx->MDFreeHead;
 	Ctx->MDFreeHead = Mdata;
 	if(sync)
-		DtsUnLock(Ctx);
+		DtsMdataUnLock(Ctx);
 
 	return BC_STS_SUCCESS;
 }
@@ -1868,7 +2437,7 @@ BC_STATUS DtsClrPendMdataList(DTS_LIB_CONTEXT *Ctx)
 		return BC_STS_INV_ARG;
 	}
 
-	DtsLock(Ctx);
+	DtsMdataLock(Ctx);
 	/* Remove all Pending elements */
 	temp = Ctx->MDPendHead;
 
@@ -1882,42 +2451,7 @@ BC_STATUS DtsClrPendMdataList(DTS_LIB_CONTEXT *Ctx)
 	if (mdata_count)
 		DebugLog_Trace(LDIL_DBG,"Clearing %d PendMdata entries \n", mdata_count);
 
-	DtsUnLock(Ctx);
-
-	return BC_STS_SUCCESS;
-}
-//------------------------------------------------------------------------
-// Name: DtsPendMdataGarbageCollect
-// Description: Garbage Collect Meta Data. This funtion is only called
-//              internel when we run out of Mdata.
-//------------------------------------------------------------------------
-BC_STATUS DtsPendMdataGarbageCollect(DTS_LIB_CONTEXT *Ctx)
-{
-	DTS_INPUT_MDATA		*temp=NULL;
-	int mdata_count = 0;
-
-	if(!Ctx || !Ctx->MdataPoolPtr){
-		return BC_STS_INV_ARG;
-	}
-
-	DtsLock(Ctx);
-
-	/* Collect garbage it */
-	temp = Ctx->MDPendHead;
-	while(temp && temp != DTS_MDATA_PEND_LINK(Ctx)){
-		//DebugLog_Trace(LDIL_DBG,"Clearing PendMdata %p %x \n", temp->Spes.SeqNum, temp->IntTag);
-		if(mdata_count > (BC_INPUT_MDATA_POOL_SZ - BC_INPUT_MDATA_POOL_SZ_COLLECT)) {
-			break;
-		}
-		DtsRemoveMdata(Ctx,temp,FALSE);
-		temp = Ctx->MDPendHead;
-		mdata_count++;
-	}
-
-	if (mdata_count)
-		DebugLog_Trace(LDIL_DBG,"Clearing %d PendMdata entries \n", mdata_count);
-
-	DtsUnLock(Ctx);
+	DtsMdataUnLock(Ctx);
 
 	return BC_STS_SUCCESS;
 }
@@ -1930,12 +2464,14 @@ BC_STATUS DtsInsertMdata(DTS_LIB_CONTEXT *Ctx, DTS_INPUT_MDATA	*Mdata)
 	if(!Ctx || !Mdata){
 		return BC_STS_INV_ARG;
 	}
-	DtsLock(Ctx);
+	DtsMdataLock(Ctx);
 	Mdata->flink = DTS_MDATA_PEND_LINK(Ctx);
 	Mdata->blink = Ctx->MDPendTail;
 	Mdata->flink->blink = Mdata;
 	Mdata->blink->flink = Mdata;
-	DtsUnLock(Ctx);
+	Mdata->hlink = Ctx->MDTagIndex[DTS_MDATA_INDEX(Mdata->IntTag)];
+	Ctx->MDTagIndex[DTS_MDATA_INDEX(Mdata->IntTag)] = Mdata;
+	DtsMdataUnLock(Ctx);
 
 	return BC_STS_SUCCESS;
 
@@ -1951,31 +2487,50 @@ BC_STATUS DtsRemoveMdata(DTS_LIB_CONTEXT *Ctx, DTS_INPUT_MDATA	*Mdata, BOOL sync
 	}
 
 	if(sync)
-		DtsLock(Ctx);
+		DtsMdataLock(Ctx);
 	if(Ctx->MDPendHead != DTS_MDATA_PEND_LINK(Ctx))
 	{
 		Mdata->flink->blink = Mdata->blink;
 		Mdata->blink->flink = Mdata->flink;
+
+		DTS_INPUT_MDATA **pp = &Ctx->MDTagIndex[DTS_MDATA_INDEX(Mdata->IntTag)];
+		while(*pp && *pp != Mdata)
+			pp = &(*pp)->hlink;
+		if(*pp)
+			*pp = Mdata->hlink;
 	}
 	if(sync)
-		DtsUnLock(Ctx);
+		DtsMdataUnLock(Ctx);
 
 	return DtsFreeMdata(Ctx,Mdata,sync);
 }
 
+//------------------------------------------------------------------------
+// Name: DtsFindMdata
+// Description: Pending Meta Data with the given IntTag. Call with MdataLock held.
+//------------------------------------------------------------------------
+static DTS_INPUT_MDATA *DtsFindMdata(DTS_LIB_CONTEXT *Ctx, uint32_t InTag)
+{
+	DTS_INPUT_MDATA *temp = Ctx->MDTagIndex[DTS_MDATA_INDEX(InTag)];
+
+	while(temp && temp->IntTag != InTag)
+		temp = temp->hlink;
+
+	return temp;
+}
+
 //------------------------------------------------------------------------
 // Name: DtsFetchMdata
-// Description: Get Input Meta Data.
+// Description: Get Input Meta Data. pCookie, if not NULL, gets the
+//              DtsProcInputAsync cookie stored with it.
 //
 // FIX_ME:: Fill the pout part after FW upgrade with SeqNum feature..
 //------------------------------------------------------------------------
-BC_STATUS DtsFetchMdata(DTS_LIB_CONTEXT *Ctx, uint16_t snum, BC_DTS_PROC_OUT *pout)
+BC_STATUS DtsFetchMdata(DTS_LIB_CONTEXT *Ctx, uint16_t snum, BC_DTS_PROC_OUT *pout, uint64_t *pCookie)
 {
 	uint32_t		InTag;
 	DTS_INPUT_MDATA		*temp=NULL;
 	BC_STATUS	sts = BC_STS_NO_DATA;
-	int16_t tsnum = 0;
-	uint32_t i = 0;
 
 	if(!Ctx || !pout){
 		return BC_STS_INV_ARG;
@@ -1988,43 +2543,30 @@ BC_STATUS DtsFetchMdata(DTS_LIB_CONTEXT *Ctx, uint16_t snum, BC_DTS_PROC_OUT *po
 		return BC_STS_NO_DATA;
 	}
 
+	DtsMdataLock(Ctx);
 	InTag = DtsMdataGetIntTag(Ctx,snum);
-	temp = Ctx->MDPendHead;
-
-	DtsLock(Ctx);
-	while(temp && temp != DTS_MDATA_PEND_LINK(Ctx)){
-		if(temp->IntTag == InTag){
-			pout->PicInfo.timeStamp = temp->appTimeStamp;
-			sts = BC_STS_SUCCESS;
+	if((temp = DtsFindMdata(Ctx, InTag)) != NULL){
+		pout->PicInfo.timeStamp = temp->appTimeStamp;
+		if(pCookie)
+			*pCookie = temp->Cookie;
+		sts = BC_STS_SUCCESS;
+		DtsRemoveMdata(Ctx, temp, FALSE);
+
+		if(!Ctx->MDNewestFetchTag || DtsMdataTagDiff(InTag, Ctx->MDNewestFetchTag) > 0)
+			Ctx->MDNewestFetchTag = InTag;
+
+		// Pictures come out at most MDReorderWindow tags behind the newest
+		// one, anything older belongs to a lost picture. The pending list is
+		// in tag order so those are all at its head.
+		temp = Ctx->MDPendHead;
+		while(temp != DTS_MDATA_PEND_LINK(Ctx) &&
+		      DtsMdataTagDiff(Ctx->MDNewestFetchTag, temp->IntTag) > (int32_t)Ctx->MDReorderWindow){
 			DtsRemoveMdata(Ctx, temp, FALSE);
-
-			//Reserve the Last Fetch Tag
-			Ctx->MDLastFetchTag = InTag;
-			break;
-		}
-		temp = temp->flink;
-	}
-	DtsUnLock(Ctx);
-	// If we found a tag, clear out all the old entries - from (tag - 10) to (tag-110)
-	// This is to work around the issue of lost pictures for which tags will never get freed
-	if(sts == BC_STS_SUCCESS) {
-		for(i = 0; i < 100; i++) {
-			tsnum = snum - (10 + i);
-			if(tsnum < 0)
-				break;
-			InTag = DtsMdataGetIntTag(Ctx, tsnum);
+			DTS_STAT_ADD(Ctx->MDEvictCnt, 1);
 			temp = Ctx->MDPendHead;
-			DtsLock(Ctx);
-			while(temp && temp != DTS_MDATA_PEND_LINK(Ctx)){
-				if(temp->IntTag == InTag){
-					DtsRemoveMdata(Ctx, temp, FALSE);
-					break;
-				}
-				temp = temp->flink;
-			}
-			DtsUnLock(Ctx);
 		}
 	}
+	DtsMdataUnLock(Ctx);
 
 	return sts;
 }
@@ -2037,7 +2579,6 @@ BC_STATUS DtsFetchMdata(DTS_LIB_CONTEXT *Ctx, uint16_t snum, BC_DTS_PROC_OUT *po
 //------------------------------------------------------------------------
 BC_STATUS DtsFetchTimeStampMdata(DTS_LIB_CONTEXT *Ctx, uint16_t snum, uint64_t *TimeStamp)
 {
-	uint32_t InTag;
 	DTS_INPUT_MDATA *temp=NULL;
 	BC_STATUS	sts = BC_STS_NO_DATA;
 
@@ -2051,24 +2592,74 @@ BC_STATUS DtsFetchTimeStampMdata(DTS_LIB_CONTEXT *Ctx, uint16_t snum, uint64_t *
 		return BC_STS_NO_DATA;
 	}
 
-	InTag = DtsMdataGetIntTag(Ctx, snum);
-	temp = Ctx->MDPendHead;
+	DtsMdataLock(Ctx);
+	if((temp = DtsFindMdata(Ctx, DtsMdataGetIntTag(Ctx, snum))) != NULL) {
+		*TimeStamp = temp->appTimeStamp;
+		sts = BC_STS_SUCCESS;
+	}
+	DtsMdataUnLock(Ctx);
 
-	DtsLock(Ctx);
-	while(temp && temp != DTS_MDATA_PEND_LINK(Ctx)) {
-		if(temp->IntTag == InTag) {
+	return sts;
+}
 
-			*TimeStamp = temp->appTimeStamp;
-			/* DebugLog_Trace(LDIL_DBG, "Found entry for %x %x tstamp: %x\n", */
-			/*	snum, temp->IntTag, pout->PicInfo.timeStamp); */
-			sts = BC_STS_SUCCESS;
-			break;
-		}
-		temp = temp->flink;
+static void DtsFillMdataSpes(DTS_INPUT_MDATA *temp)
+{
+	/* Fill spes data.. */
+	temp->Spes.StartCode[0] = 0;
+	temp->Spes.StartCode[1] = 0;
+	temp->Spes.StartCode[2] = 01;
+	temp->Spes.StartCode[3] = 0xBD;
+	temp->Spes.PacketLen = 0x07;
+	temp->Spes.StartCodeEnd = 0x40;
+	temp->Spes.Command = 0x0A;
+}
+
+//------------------------------------------------------------------------
+// Name: DtsAllocMdataBatch
+// Description: Take up to count Mdata entries from the free pool in one
+//              locked pass for DtsProcInputV. DtsPrepareMdata hands them
+//              out in order; tags are still assigned at that point so
+//              that they follow the send order. Returns the number taken.
+//------------------------------------------------------------------------
+uint32_t DtsAllocMdataBatch(DTS_LIB_CONTEXT *Ctx, uint32_t count)
+{
+	DTS_INPUT_MDATA *temp;
+	uint32_t i;
+
+	if(!Ctx)
+		return 0;
+
+	DtsFreeMdataBatch(Ctx);
+	if(count > BC_INPUT_MDATA_BATCH_SZ)
+		count = BC_INPUT_MDATA_BATCH_SZ;
+
+	DtsMdataLock(Ctx);
+	for(i = 0; i < count && (temp = Ctx->MDFreeHead) != NULL; i++) {
+		Ctx->MDFreeHead = temp->flink;
+		memset(temp, 0, sizeof(*temp));
+		DtsFillMdataSpes(temp);
+		Ctx->MDBatch[i] = temp;
 	}
-	DtsUnLock(Ctx);
+	Ctx->MDBatchCnt = i;
+	DtsMdataUnLock(Ctx);
 
-	return sts;
+	return i;
+}
+
+//------------------------------------------------------------------------
+// Name: DtsFreeMdataBatch
+// Description: Return the unused part of a DtsAllocMdataBatch() to the pool.
+//------------------------------------------------------------------------
+void DtsFreeMdataBatch(DTS_LIB_CONTEXT *Ctx)
+{
+	if(!Ctx)
+		return;
+
+	DtsMdataLock(Ctx);
+	while(Ctx->MDBatchNext < Ctx->MDBatchCnt)
+		DtsFreeMdata(Ctx, Ctx->MDBatch[Ctx->MDBatchNext++], FALSE);
+	Ctx->MDBatchCnt = Ctx->MDBatchNext = 0;
+	DtsMdataUnLock(Ctx);
 }
 
 //------------------------------------------------------------------------
@@ -2078,36 +2669,36 @@ BC_STATUS DtsFetchTimeStampMdata(DTS_LIB_CONTEXT *Ctx, uint16_t snum, uint64_t *
 BC_STATUS DtsPrepareMdata(DTS_LIB_CONTEXT *Ctx, uint64_t timeStamp, DTS_INPUT_MDATA **mData, uint8_t** ppData, uint32_t *pSize)
 {
 	DTS_INPUT_MDATA		*temp = NULL;
-	BC_STATUS		ret;
 
 	if( !mData || !Ctx)
 		return BC_STS_INV_ARG;
 
+	/* Entries pre-allocated by DtsAllocMdataBatch() come first, already
+	 * cleared and carrying the SPES constants */
+	if(Ctx->MDBatchNext < Ctx->MDBatchCnt) {
+		temp = Ctx->MDBatch[Ctx->MDBatchNext++];
+		DtsMdataSetIntTag(Ctx,temp);
+		temp->appTimeStamp = timeStamp;
+		temp->Cookie = Ctx->InCookie;
+
+		*mData = temp;
+		*ppData = (uint8_t*)(&temp->Spes);
+		*pSize = sizeof(temp->Spes);
+		return BC_STS_SUCCESS;
+	}
+
 	/* Alloc clears all fields */
 	if( (temp = DtsAllocMdata(Ctx)) == NULL)
 	{
-		DebugLog_Trace(LDIL_DBG,"COULD not find free MDATA try again\n");
-		ret = DtsPendMdataGarbageCollect(Ctx);
-		if(ret != BC_STS_SUCCESS) {
-			return BC_STS_BUSY;
-		}
-		if( (temp = DtsAllocMdata(Ctx)) == NULL) {
-			DebugLog_Trace(LDIL_DBG,"COULD not find free MDATA finaly failed\n");
-			return BC_STS_BUSY;
-		}
+		DebugLog_Trace(LDIL_DBG,"COULD not find free MDATA\n");
+		return BC_STS_BUSY;
 	}
 	/* Store all app data */
 	DtsMdataSetIntTag(Ctx,temp);
 	temp->appTimeStamp = timeStamp;
+	temp->Cookie = Ctx->InCookie;
 
-	/* Fill spes data.. */
-	temp->Spes.StartCode[0] = 0;
-	temp->Spes.StartCode[1] = 0;
-	temp->Spes.StartCode[2] = 01;
-	temp->Spes.StartCode[3] = 0xBD;
-	temp->Spes.PacketLen = 0x07;
-	temp->Spes.StartCodeEnd = 0x40;
-	temp->Spes.Command = 0x0A;
+	DtsFillMdataSpes(temp);
 
 	*mData = temp;
 	*ppData = (uint8_t*)(&temp->Spes);
@@ -2148,13 +2739,11 @@ BC_STATUS DtsPrepareMdataASFHdr(DTS_LIB_CONTEXT *Ctx, DTS_INPUT_MDATA *mData, ui
 			return BC_STS_SUCCESS;
 }
 
+// TX thread only, DtsGetDrvStat reports them as ipSampleCnt and ipTotalSize
 void DtsUpdateInStats(DTS_LIB_CONTEXT	*Ctx, uint32_t	size)
 {
-	BC_DTS_STATS *pDtsStat = DtsGetgStats( );
-
-	pDtsStat->ipSampleCnt++;
-	pDtsStat->ipTotalSize += size;
-	pDtsStat->TxFifoBsyCnt = 0;
+	DTS_STAT_ADD(Ctx->Counters.TxChunks, 1);
+	DTS_STAT_ADD(Ctx->Counters.TxBytes, size);
 
 // 	Ctx->InSampleCount ++;
 // 	if (Ctx->InSampleCount > 65530)
@@ -2168,7 +2757,7 @@ void DtsUpdateOutStats(DTS_LIB_CONTEXT	*Ctx, BC_DTS_PROC_OUT *pOut)
 	uint32_t fr23_976 = 0;
 	BOOL	rptFrmCheck = TRUE;
 
-	BC_DTS_STATS *pDtsStat = DtsGetgStats( );
+	BC_DTS_STATS *pDtsStat = &Ctx->Stats;
 
 	if(pOut->PicInfo.flags & VDEC_FLAG_LAST_PICTURE)
 	{
@@ -2271,6 +2860,7 @@ void DtsUpdateOutStats(DTS_LIB_CONTEXT	*Ctx, BC_DTS_PROC_OUT *pOut)
 	if(!(pOut->PoutFlags & BC_POUT_FLAGS_PIB_VALID))
 	{
 		pDtsStat->pibMisses++;
+		DTS_STAT_ADD(Ctx->Counters.PibMisses, 1);
 		return;
 	}
 
@@ -2289,6 +2879,7 @@ void DtsUpdateOutStats(DTS_LIB_CONTEXT	*Ctx, BC_DTS_PROC_OUT *pOut)
 				if(Ctx->prevPicNum == pOut->PicInfo.picture_number)	{
 					DebugLog_Trace(LDIL_DBG,"Succesive Odd=%d\n", pOut->PicInfo.picture_number);
 					pDtsStat->reptdFrames++;
+					DTS_STAT_ADD(Ctx->Counters.Repeated, 1);
 					rptFrmCheck = FALSE;
 				}
 			}
@@ -2298,6 +2889,7 @@ void DtsUpdateOutStats(DTS_LIB_CONTEXT	*Ctx, BC_DTS_PROC_OUT *pOut)
 				if(Ctx->prevPicNum == pOut->PicInfo.picture_number)	{
 					DebugLog_Trace(LDIL_DBG,"Succesive Even=%d\n", pOut->PicInfo.picture_number);
 					pDtsStat->reptdFrames++;
+					DTS_STAT_ADD(Ctx->Counters.Repeated, 1);
 					rptFrmCheck = FALSE;
 				}
 
@@ -2314,6 +2906,7 @@ void DtsUpdateOutStats(DTS_LIB_CONTEXT	*Ctx, BC_DTS_PROC_OUT *pOut)
 		/* Picture Number repetetion..*/
 		DebugLog_Trace(LDIL_DBG,"Repetition=%d\n", pOut->PicInfo.picture_number);
 		pDtsStat->reptdFrames++;
+		DTS_STAT_ADD(Ctx->Counters.Repeated, 1);
 	}
 
 	if(((Ctx->prevPicNum +1) != pOut->PicInfo.picture_number)&& !(pOut->discCnt) ){
@@ -2329,183 +2922,390 @@ void DtsUpdateOutStats(DTS_LIB_CONTEXT	*Ctx, BC_DTS_PROC_OUT *pOut)
 /********************************************************************************/
 /* TX Circular Buffer routines */
 // Init the circular buffer to be on 128 byte boundary
+// The size is rounded up to a power of two so the indices can wrap freely
 BC_STATUS txBufInit(pTXBUFFER txBuf, uint32_t sizeInit)
 {
-	BC_STATUS sts = BC_STS_SUCCESS;
-	int ret = 0;
+	uint32_t size = 128;
+
 	if(txBuf->buffer != NULL)
 		return BC_STS_INV_ARG;
-	ret = posix_memalign((void**)&txBuf->buffer, 128, sizeInit);
-	if(ret)
+
+	while(size < sizeInit)
+		size <<= 1;
+
+	if(posix_memalign((void**)&txBuf->buffer, 128, size))
+		return BC_STS_INSUFF_RES;
+	if(posix_memalign((void**)&txBuf->bounceBuf, 128, TX_BOUNCE_BUF_SIZE)) {
+		free(txBuf->buffer);
+		txBuf->buffer = NULL;
 		return BC_STS_INSUFF_RES;
-	if(txBuf->buffer != NULL)
-	{
-		txBuf->basePointer = txBuf->buffer;
-		txBuf->endPointer = txBuf->basePointer + sizeInit - 1;
-		txBuf->readPointer = txBuf->writePointer = 0;
-		txBuf->freeSize = txBuf->totalSize = sizeInit;
-		txBuf->busySize = 0;
-		pthread_mutex_init(&txBuf->flushLock, NULL);
-		pthread_mutex_init(&txBuf->pushpopLock, NULL);
 	}
-	else
-		sts = BC_STS_INSUFF_RES;
-	return sts;
+
+	txBuf->totalSize = size;
+	txBuf->sizeMask = size - 1;
+	txBuf->writeIndex = txBuf->readIndex = 0;
+	txBuf->flushIndex = 0;
+	txBuf->flushGen = txBuf->flushSeen = 0;
+	txBuf->resvSize = 0;
+	txBuf->batchSize = 0;
+	txBuf->batching = 0;
+	txBuf->highWater = 0;
+	txBuf->fullWaits = 0;
+	txBuf->dataWaiters = txBuf->spaceWaiters = 0;
+	pthread_mutex_init(&txBuf->evLock, NULL);
+	pthread_cond_init(&txBuf->dataEvent, NULL);
+	pthread_cond_init(&txBuf->spaceEvent, NULL);
+
+	return BC_STS_SUCCESS;
 }
 
-// Push the number of bytes specified on to the circular buffer
-// This routine copies the data so that the orginial buffer can be released
+BC_STATUS txBufFree(pTXBUFFER txBuf)
+{
+	if(txBuf->buffer == NULL)
+		return BC_STS_INV_ARG;
+	free(txBuf->buffer);
+	free(txBuf->bounceBuf);
+	txBuf->buffer = NULL;
+	txBuf->bounceBuf = NULL;
+	txBuf->totalSize = 0;
+	txBuf->sizeMask = 0;
+	txBuf->writeIndex = txBuf->readIndex = 0;
+	txBuf->resvSize = 0;
+	pthread_cond_destroy(&txBuf->dataEvent);
+	pthread_cond_destroy(&txBuf->spaceEvent);
+	pthread_mutex_destroy(&txBuf->evLock);
+	return BC_STS_SUCCESS;
+}
 
-// Assume here that Flush of this buffer always happens from the same thread that does procinput
-// So don't lock pushing of new data against flush
+// Absolute deadline for pthread_cond_timedwait
+static void txBufDeadline(struct timespec *ts, uint32_t timeoutMs)
+{
+	struct timeval now;
 
-BC_STATUS txBufPush(pTXBUFFER txBuf, uint8_t* bufToPush, uint32_t sizeToPush)
+	gettimeofday(&now, NULL);
+	ts->tv_sec = now.tv_sec + timeoutMs / 1000;
+	ts->tv_nsec = (now.tv_usec + (timeoutMs % 1000) * 1000) * 1000;
+	if(ts->tv_nsec >= 1000000000) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+#define TXBUF_LOAD(_v)			__atomic_load_n(&(_v), __ATOMIC_ACQUIRE)
+#define TXBUF_STORE(_v, _x)		__atomic_store_n(&(_v), (_x), __ATOMIC_RELEASE)
+
+// Wake a sleeper on cond if there is one. The caller has already published
+// the index change, the full fence orders that store against reading the
+// waiter count, and pairs with the one in the waiters.
+static void txBufSignal(pTXBUFFER txBuf, pthread_cond_t *cond, uint32_t *waiters)
 {
-	uint32_t mcpySz = 0, sizeTop = 0;
-	uint8_t* bufRemain = bufToPush;
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if(__atomic_load_n(waiters, __ATOMIC_RELAXED)) {
+		pthread_mutex_lock(&txBuf->evLock);
+		pthread_cond_broadcast(cond);
+		pthread_mutex_unlock(&txBuf->evLock);
+	}
+}
 
-	if(txBuf == NULL || bufToPush == NULL)
+// Wake both sides, e.g. to have them re-check thread exit or decoder state
+void txBufWakeUp(pTXBUFFER txBuf)
+{
+	if(txBuf->buffer == NULL)
+		return;
+	pthread_mutex_lock(&txBuf->evLock);
+	pthread_cond_broadcast(&txBuf->dataEvent);
+	pthread_cond_broadcast(&txBuf->spaceEvent);
+	pthread_mutex_unlock(&txBuf->evLock);
+}
+
+// Flush can be requested from either thread. Only the consumer moves readIndex,
+// so the request is recorded here and acted upon by the next txBufSync().
+// Data committed after this call is not affected.
+BC_STATUS txBufFlush(pTXBUFFER txBuf)
+{
+	if(txBuf->buffer == NULL)
 		return BC_STS_INV_ARG;
+	__atomic_store_n(&txBuf->flushIndex, TXBUF_LOAD(txBuf->writeIndex), __ATOMIC_RELAXED);
+	// The new generation publishes flushIndex
+	__atomic_fetch_add(&txBuf->flushGen, 1, __ATOMIC_RELEASE);
+	txBufSignal(txBuf, &txBuf->dataEvent, &txBuf->dataWaiters);
+	return BC_STS_SUCCESS;
+}
 
-	if(txBuf->freeSize < sizeToPush)
-		return BC_STS_INSUFF_RES;
+// Free space as seen by the producer. Space released by a pending flush
+// shows up once the TX thread has acted on it.
+uint32_t txBufFreeSize(pTXBUFFER txBuf)
+{
+	return txBuf->totalSize - (TXBUF_LOAD(txBuf->writeIndex) - TXBUF_LOAD(txBuf->readIndex)) - txBuf->batchSize;
+}
 
-	// How much will fit before we need to wrap
-	sizeTop = (uint32_t)(txBuf->endPointer - (txBuf->basePointer + txBuf->writePointer) + 1);
-	if(sizeToPush <= sizeTop)
-		mcpySz = sizeToPush;
-	else
-		mcpySz = sizeTop;
+uint32_t txBufBusySize(pTXBUFFER txBuf)
+{
+	return TXBUF_LOAD(txBuf->writeIndex) - TXBUF_LOAD(txBuf->readIndex);
+}
+
+// Producer: sleep until sizeNeeded bytes are free, the timeout expires or
+// txBufWakeUp() is called. Callers loop, so an early return is harmless.
+BC_STATUS txBufWaitSpace(pTXBUFFER txBuf, uint32_t sizeNeeded, uint32_t timeoutMs)
+{
+	struct timespec ts;
 
-	memcpy(txBuf->basePointer + txBuf->writePointer, bufToPush, mcpySz);
+	pthread_mutex_lock(&txBuf->evLock);
+	__atomic_fetch_add(&txBuf->spaceWaiters, 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if(txBufFreeSize(txBuf) < sizeNeeded) {
+		txBuf->fullWaits++;
+		txBufDeadline(&ts, timeoutMs);
+		pthread_cond_timedwait(&txBuf->spaceEvent, &txBuf->evLock, &ts);
+	}
+	__atomic_fetch_sub(&txBuf->spaceWaiters, 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&txBuf->evLock);
 
-	txBuf->writePointer = (txBuf->writePointer + mcpySz) % txBuf->totalSize;
+	return (txBufFreeSize(txBuf) < sizeNeeded) ? BC_STS_TIMEOUT : BC_STS_SUCCESS;
+}
 
-	pthread_mutex_lock(&txBuf->pushpopLock);
-	txBuf->busySize += mcpySz;
-	txBuf->freeSize -= mcpySz;
-	pthread_mutex_unlock(&txBuf->pushpopLock);
+// Consumer: act on a pending flush request
+void txBufSync(pTXBUFFER txBuf)
+{
+	uint32_t gen = TXBUF_LOAD(txBuf->flushGen);
+	uint32_t flushIndex;
 
-	if((sizeToPush - mcpySz) != 0)
-	{
-		// Can only get here if we wrap at the top
-		// writePointer should be 0
-		bufRemain += mcpySz;
-		mcpySz = sizeToPush - mcpySz;
-		sizeTop = txBuf->readPointer;
-		memcpy(txBuf->basePointer, bufRemain, mcpySz);
-		txBuf->writePointer = mcpySz;
-		pthread_mutex_lock(&txBuf->pushpopLock);
-		txBuf->busySize += mcpySz;
-		txBuf->freeSize -= mcpySz;
-		pthread_mutex_unlock(&txBuf->pushpopLock);
+	if(gen == txBuf->flushSeen)
+		return;
+
+	// Never move backwards over data already sent after the flush point
+	flushIndex = __atomic_load_n(&txBuf->flushIndex, __ATOMIC_RELAXED);
+	if((int32_t)(flushIndex - txBuf->readIndex) > 0)
+		TXBUF_STORE(txBuf->readIndex, flushIndex);
+	txBuf->flushSeen = gen;
+	txBufSignal(txBuf, &txBuf->spaceEvent, &txBuf->spaceWaiters);
+}
+
+// Consumer: sleep until there is data or a flush to act on, the timeout
+// expires or txBufWakeUp() is called
+BC_STATUS txBufWaitData(pTXBUFFER txBuf, uint32_t timeoutMs)
+{
+	struct timespec ts;
+
+	pthread_mutex_lock(&txBuf->evLock);
+	__atomic_fetch_add(&txBuf->dataWaiters, 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if(txBufBusySize(txBuf) == 0 && TXBUF_LOAD(txBuf->flushGen) == txBuf->flushSeen) {
+		txBufDeadline(&ts, timeoutMs);
+		pthread_cond_timedwait(&txBuf->dataEvent, &txBuf->evLock, &ts);
 	}
+	__atomic_fetch_sub(&txBuf->dataWaiters, 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&txBuf->evLock);
 
-	return BC_STS_SUCCESS;
+	return txBufBusySize(txBuf) ? BC_STS_SUCCESS : BC_STS_TIMEOUT;
 }
 
-// Pops data from the circular buffer
-// Returns the number of bytes popped
-// We have to do a copy since we require the HW buffer to be 128 byte aligned for Flea
-BC_STATUS txBufPop(pTXBUFFER txBuf, uint8_t* bufToPop, uint32_t sizeToPop)
+// Make the held back part of a batch visible to the TX thread. Batch mode
+// stays on, so txBufReserve() can use this when the ring fills up mid batch.
+static void txBufPublishBatch(pTXBUFFER txBuf)
 {
-	uint32_t popSz = 0, sizeTop = 0;
-	uint8_t* bufRemain = bufToPop;
+	uint32_t size = txBuf->batchSize;
 
-	if(txBuf == NULL)
+	if(size == 0)
+		return;
+	txBuf->batchSize = 0;
+	TXBUF_STORE(txBuf->writeIndex, txBuf->writeIndex + size);
+	txBufSignal(txBuf, &txBuf->dataEvent, &txBuf->dataWaiters);
+}
+
+// Reserve space for the producer to fill in with txBufWrite() and publish
+// with txBufCommit(). Nothing is visible to the consumer until committed.
+BC_STATUS txBufReserve(pTXBUFFER txBuf, uint32_t sizeToReserve)
+{
+	if(txBuf == NULL || txBuf->buffer == NULL)
 		return BC_STS_INV_ARG;
 
-	pthread_mutex_lock(&txBuf->flushLock);
+	if(txBufFreeSize(txBuf) < sizeToReserve) {
+		// The TX thread can only free space for what it can see, so
+		// publish a held back batch before asking the caller to wait
+		txBufPublishBatch(txBuf);
+		if(txBufFreeSize(txBuf) < sizeToReserve)
+			return BC_STS_INSUFF_RES;
+	}
 
-	if(sizeToPop > txBuf->busySize)
-		return BC_STS_INV_ARG;
+	txBuf->resvSize = sizeToReserve;
+	return BC_STS_SUCCESS;
+}
 
-	sizeTop = (uint32_t)(txBuf->endPointer - (txBuf->basePointer + txBuf->readPointer) + 1);
-	if(sizeToPop <= sizeTop)
-		popSz = sizeToPop;
-	else
-		popSz = sizeTop;
+// Copy into the reserved region at resvOffset, wrapping at the top of the ring
+void txBufWrite(pTXBUFFER txBuf, uint32_t resvOffset, const uint8_t* bufToWrite, uint32_t sizeToWrite)
+{
+	uint32_t offset = (txBuf->writeIndex + txBuf->batchSize + resvOffset) & txBuf->sizeMask;
+	uint32_t sizeTop = txBuf->totalSize - offset;
 
-	memcpy(bufToPop, txBuf->basePointer + txBuf->readPointer, popSz);
+	if(sizeToWrite <= sizeTop) {
+		memcpy(txBuf->buffer + offset, bufToWrite, sizeToWrite);
+	} else {
+		memcpy(txBuf->buffer + offset, bufToWrite, sizeTop);
+		memcpy(txBuf->buffer, bufToWrite + sizeTop, sizeToWrite - sizeTop);
+	}
+}
 
-	txBuf->readPointer = (txBuf->readPointer + popSz) % txBuf->totalSize;
+// Make sizeToCommit bytes of the reservation visible to the TX thread,
+// or add them to the current batch
+void txBufCommit(pTXBUFFER txBuf, uint32_t sizeToCommit)
+{
+	if(sizeToCommit > txBuf->resvSize)
+		sizeToCommit = txBuf->resvSize;
+	txBuf->resvSize = 0;
+	if(txBuf->writeIndex + txBuf->batchSize + sizeToCommit - txBuf->readIndex > txBuf->highWater)
+		txBuf->highWater = txBuf->writeIndex + txBuf->batchSize + sizeToCommit - txBuf->readIndex;
+	if(txBuf->batching) {
+		txBuf->batchSize += sizeToCommit;
+		return;
+	}
+	// The release store keeps the data ahead of the new index
+	TXBUF_STORE(txBuf->writeIndex, txBuf->writeIndex + sizeToCommit);
+	txBufSignal(txBuf, &txBuf->dataEvent, &txBuf->dataWaiters);
+}
 
-	pthread_mutex_lock(&txBuf->pushpopLock);
-	txBuf->busySize -= popSz;
-	txBuf->freeSize += popSz;
-	pthread_mutex_unlock(&txBuf->pushpopLock);
+// Hold back commits until txBufEndBatch() so a batch of submissions is
+// published to the TX thread at once
+void txBufBeginBatch(pTXBUFFER txBuf)
+{
+	txBuf->batching = 1;
+}
 
-	if((sizeToPop - popSz) != 0)
-	{
-		// Can only get here if we wrap at the top
-		// readPointer should be 0
-		bufRemain += popSz;
-		popSz = sizeToPop - popSz;
-		sizeTop = txBuf->writePointer;
-		memcpy(bufRemain, txBuf->basePointer, popSz);
-		txBuf->readPointer = popSz;
-		pthread_mutex_lock(&txBuf->pushpopLock);
-		txBuf->busySize -= popSz;
-		txBuf->freeSize += popSz;
-		pthread_mutex_unlock(&txBuf->pushpopLock);
-	}
-
-	pthread_mutex_unlock(&txBuf->flushLock);
-	return BC_STS_SUCCESS;
+// Publish everything committed since txBufBeginBatch() and leave batch mode
+void txBufEndBatch(pTXBUFFER txBuf)
+{
+	txBufPublishBatch(txBuf);
+	txBuf->batching = 0;
 }
 
-// Assume here that Flush of this buffer always happens from the same thread that does procinput
-// So don't lock pushing of new data against flush
-BC_STATUS txBufFlush(pTXBUFFER txBuf)
+// Push the number of bytes specified on to the circular buffer
+// This routine copies the data so that the orginial buffer can be released
+BC_STATUS txBufPush(pTXBUFFER txBuf, uint8_t* bufToPush, uint32_t sizeToPush)
 {
-	if(txBuf->buffer == NULL)
+	BC_STATUS sts;
+
+	if(bufToPush == NULL)
 		return BC_STS_INV_ARG;
-	pthread_mutex_lock(&txBuf->flushLock);
-	txBuf->readPointer = txBuf->writePointer = 0;
-	txBuf->freeSize = txBuf->totalSize;
-	txBuf->busySize = 0;
-	pthread_mutex_unlock(&txBuf->flushLock);
+
+	if((sts = txBufReserve(txBuf, sizeToPush)) != BC_STS_SUCCESS)
+		return sts;
+
+	txBufWrite(txBuf, 0, bufToPush, sizeToPush);
+	txBufCommit(txBuf, sizeToPush);
+
 	return BC_STS_SUCCESS;
 }
 
-BC_STATUS txBufFree(pTXBUFFER txBuf)
+// Returns up to maxSize bytes that can be DMA'd to HW as one transfer, without
+// consuming them. The data is handed out in place whenever the read offset is
+// DWORD aligned (required by the driver), otherwise it is staged through the
+// bounce buffer. Transfers that do not drain the ring end on a DWORD boundary
+// so that the next one can go straight from the ring again.
+uint32_t txBufPeek(pTXBUFFER txBuf, uint32_t maxSize, uint8_t** ppData)
 {
-	if(txBuf->buffer == NULL)
-		return BC_STS_INV_ARG;
-	txBuf->basePointer = NULL;
-	txBuf->endPointer = NULL;
-	txBuf->readPointer = txBuf->writePointer = 0;
-	txBuf->freeSize = 0;
-	txBuf->busySize = 0;
-	free(txBuf->buffer);
-	pthread_mutex_destroy(&txBuf->flushLock);
-	pthread_mutex_destroy(&txBuf->pushpopLock);
-	return BC_STS_SUCCESS;
+	uint32_t busy, offset, size, trimmed;
+
+	if(txBuf == NULL || txBuf->buffer == NULL)
+		return 0;
+
+	txBufSync(txBuf);
+
+	// Acquire pairs with txBufCommit(); don't read data ahead of the index
+	busy = TXBUF_LOAD(txBuf->writeIndex) - txBuf->readIndex;
+	if(!busy || !maxSize)
+		return 0;
+
+	offset = txBuf->readIndex & txBuf->sizeMask;
+	size = txBuf->totalSize - offset;
+	if(size > busy)
+		size = busy;
+	if(size > maxSize)
+		size = maxSize;
+	if((offset & 0x3) && size > TX_BOUNCE_BUF_SIZE)
+		size = TX_BOUNCE_BUF_SIZE;
+
+	if(size < busy) {
+		trimmed = size - ((offset + size) & 0x3);
+		if(trimmed)
+			size = trimmed;
+	}
+
+	if(offset & 0x3) {
+		memcpy(txBuf->bounceBuf, txBuf->buffer + offset, size);
+		*ppData = txBuf->bounceBuf;
+	} else {
+		*ppData = txBuf->buffer + offset;
+	}
+
+	return size;
+}
+
+// Release data handed out by txBufPeek() once HW is done with it
+void txBufConsume(pTXBUFFER txBuf, uint32_t sizeConsumed)
+{
+	// Release: finish with the data before the producer may overwrite it
+	TXBUF_STORE(txBuf->readIndex, txBuf->readIndex + sizeConsumed);
+	txBufSignal(txBuf, &txBuf->spaceEvent, &txBuf->spaceWaiters);
+}
+
+// TX thread: sleep until the CPB may have room again, or DtsStopTxThread
+static void DtsWaitCpbSpace(DTS_LIB_CONTEXT *Ctx)
+{
+	struct pollfd fds[2];
+
+	if(!Ctx->DrvFetchWait || Ctx->txWakeFd < 0) {
+		bc_sleep_ms(TX_CPB_FULL_POLL_MS);
+		return;
+	}
+
+	fds[0].fd = Ctx->DevHandle;
+	fds[0].events = POLLOUT;
+	fds[0].revents = 0;
+	fds[1].fd = Ctx->txWakeFd;
+	fds[1].events = POLLIN;
+	fds[1].revents = 0;
+
+	// The timeout only bounds a flush request or a missed wakeup
+	if(poll(fds, 2, TX_CPB_FULL_WAIT_MS) < 0 && errno != EINTR)
+		bc_sleep_ms(TX_CPB_FULL_POLL_MS);
+}
+
+static uint32_t txGetTimeMs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
 }
 
 // TX Thread
 // This thread has dual purpose. First is to send TX data. Second is to detect if we have restarted from any suspend/hibernate action
 // and to restore the HW state
+// It sleeps on the TX ring until data is committed, and otherwise only wakes up
+// to poll for the EOS picture count or every TX_IDLE_WAIT_MS. Those two stay
+// timed: the HW signals neither EOS nor a power state change. While the CPB is
+// full it sleeps in poll() for POLLOUT on drivers with DrvFetchWait, older
+// ones have no CPB space event and are polled every TX_CPB_FULL_POLL_MS.
 void * txThreadProc(void *ctx)
 {
 	DTS_LIB_CONTEXT* Ctx = (DTS_LIB_CONTEXT*)ctx;
-	uint8_t* localBuffer;
+	uint8_t* pDmaData = NULL;
 	uint32_t szDataToSend;
 	BC_STATUS sts;
-	uint32_t dramOff;
+	uint32_t dramOff = 0;
 	uint8_t encrypted = 0;
 	HANDLE hDevice = (HANDLE)Ctx;
 	BC_DTS_STATUS pStat;
-	int ret = 0;
-	uint32_t waitForPictCount = 0;
+	uint32_t lastPicTime = txGetTimeMs();
 	uint32_t numPicCaptured = 0;
-
-	ret = posix_memalign((void**)&localBuffer, 128, CIRC_TX_BUF_SIZE);
-	if(ret)
-		return FALSE;
+	uint32_t lastReady = 0;
+	uint64_t trStart;
 
 	while(!Ctx->txThreadExit)
 	{
+		txBufSync(&Ctx->circBuf);
+
+
 		// First check the status of the HW
 		// Get the real HW free size and also mark as we want TX information only
 		pStat.cpbEmptySize = (0x3 << 31);
@@ -2519,7 +3319,13 @@ void * txThreadProc(void *ctx)
 			continue;
 		}
 
-		//DebugLog_Trace(LDIL_ERR,"txThreadProc: Got hw size %u and data size %u\n", pStat.cpbEmptySize, Ctx->circBuf.busySize);
+		//DebugLog_Trace(LDIL_ERR,"txThreadProc: Got hw size %u and data size %u\n", pStat.cpbEmptySize, txBufBusySize(&Ctx->circBuf));
+
+		if(pStat.ReadyListCount != lastReady)
+		{
+			lastReady = pStat.ReadyListCount;
+			DTS_TRACE(Ctx, DTS_TR_READY, 0, txBufBusySize(&Ctx->circBuf), lastReady);
+		}
 
 		if(pStat.PowerStateChange == BC_HW_SUSPEND)
 		{
@@ -2529,26 +3335,14 @@ void * txThreadProc(void *ctx)
 		}
 
 		// hack for indicating EOS when the HW does not signal one
-		// We will check if the HW does not produce a picture for 1s and does not signal EOS either
-		// This way exit maximum in 1s
-		if(Ctx->bEOSCheck)
-		{
-			if(numPicCaptured == pStat.FramesCaptured)
-				waitForPictCount++;
-
-			if(waitForPictCount >= BC_EOS_PIC_COUNT)
-				Ctx->bEOS = true;
-
-			usleep(30 * 1000);
-		}
-		else
-			waitForPictCount = 0;
-
-		if(numPicCaptured != pStat.FramesCaptured)
+		// We will check if the HW does not produce a picture for TX_EOS_TIMEOUT_MS and does not signal EOS either
+		if(!Ctx->bEOSCheck || numPicCaptured != pStat.FramesCaptured)
 		{
-			waitForPictCount = 0;
 			numPicCaptured = pStat.FramesCaptured;
+			lastPicTime = txGetTimeMs();
 		}
+		else if((txGetTimeMs() - lastPicTime) >= TX_EOS_TIMEOUT_MS)
+			Ctx->bEOS = true;
 
 		if(pStat.PowerStateChange == BC_HW_RESUME)
 		{
@@ -2608,25 +3402,24 @@ void * txThreadProc(void *ctx)
 		}
 
 		// Check if we have data to send.
-		if(Ctx->circBuf.busySize != 0)
+		if(txBufBusySize(&Ctx->circBuf) != 0)
 		{
 			if(pStat.cpbEmptySize == 0)
 			{
-				usleep(3000);
+				DtsWaitCpbSpace(Ctx);
 				continue;
 			}
 
-			if(Ctx->circBuf.busySize < pStat.cpbEmptySize)
-				szDataToSend = Ctx->circBuf.busySize;
-			else
-				szDataToSend = pStat.cpbEmptySize;
-			if(BC_STS_SUCCESS != txBufPop(&Ctx->circBuf, localBuffer, szDataToSend)) {
-				usleep(5 * 1000);
+			// DMA straight out of the ring, no intermediate copy
+			szDataToSend = txBufPeek(&Ctx->circBuf, pStat.cpbEmptySize, &pDmaData);
+			if(szDataToSend == 0)
 				continue;
-			}
 			if(Ctx->VidParams.VideoAlgo == BC_VID_ALGO_VC1MP)
 				encrypted |= 0x2;
-			sts = DtsTxDmaText(hDevice, localBuffer, szDataToSend, &dramOff, encrypted);
+			trStart = DTS_TRACE_BEGIN(Ctx);
+			sts = DtsTxDmaText(hDevice, pDmaData, szDataToSend, &dramOff, encrypted);
+			DTS_TRACE(Ctx, DTS_TR_DMA, trStart, dramOff, szDataToSend);
+			txBufConsume(&Ctx->circBuf, szDataToSend);
 			if(sts == BC_STS_SUCCESS)
 				DtsUpdateInStats(Ctx, szDataToSend);
 			else
@@ -2635,14 +3428,513 @@ void * txThreadProc(void *ctx)
 				DebugLog_Trace(LDIL_ERR,"txThreadProc: Got status %d from TxDmaText\n", sts);
 			}
 		} else
-			usleep(5 * 1000);
+			txBufWaitData(&Ctx->circBuf, Ctx->bEOSCheck ? TX_EOS_POLL_MS : TX_IDLE_WAIT_MS);
 	}
 
-	free(localBuffer);
-	localBuffer = NULL;
 	return FALSE;
 }
 
+/*====================== Async output ========================================*/
+// Completions are queued by the output thread and taken by the application,
+// Head and Tail are free running counts of entries taken and queued.
+// DtsGetCompletions callers find it through Ctx->AsyncOut under AsyncLock
+// and count themselves in Users, DtsStopAsyncOut frees it once they left.
+typedef struct _DTS_ASYNC_OUT {
+	DTS_LIB_CONTEXT	*Ctx;
+	pthread_t		hThread;
+	pthread_mutex_t	Lock;
+	pthread_cond_t	ReadyEvent;	// Completion queued or stopping
+	pthread_cond_t	SpaceEvent;	// Completion taken or stopping
+	pthread_cond_t	IdleEvent;	// Last user left after stopping
+	int				WakeFd;		// Ends the thread's wait for a picture, -1 for none
+	uint32_t		Users;		// DtsGetCompletions callers inside
+	volatile bool	Exit;
+	dts_completion_callback	CallBack;	// Instead of the queue, NULL for none
+	void			*CbContext;
+	uint32_t		Depth;
+	uint32_t		Head;
+	uint32_t		Tail;
+	BC_DTS_COMPLETION	Queue[1];	// Depth entries
+} DTS_ASYNC_OUT;
+
+// Hand a completion to the application, waits while the queue is full
+static void DtsAsyncPost(DTS_LIB_CONTEXT *Ctx, DTS_ASYNC_OUT *ao, BC_DTS_COMPLETION *pComp)
+{
+	if(ao->CallBack) {
+		ao->CallBack(ao->CbContext, pComp);
+		return;
+	}
+
+	pthread_mutex_lock(&ao->Lock);
+	while(!ao->Exit && (ao->Tail - ao->Head) >= ao->Depth)
+		pthread_cond_wait(&ao->SpaceEvent, &ao->Lock);
+
+	if(ao->Exit) {
+		pthread_mutex_unlock(&ao->Lock);
+		if(pComp->BuffIdx != BC_DTS_NO_BUFF)
+			DtsGiveOutBuff(Ctx, pComp->BuffIdx);
+		return;
+	}
+
+	ao->Queue[ao->Tail++ % ao->Depth] = *pComp;
+	pthread_cond_signal(&ao->ReadyEvent);
+	pthread_mutex_unlock(&ao->Lock);
+}
+
+// Wait for the driver to have a picture after a failed fetch, or for
+// DtsStopAsyncOut. Drivers without DrvFetchWait have no output event and are
+// polled. So is a device that was readable and still failed the fetch, an
+// EOS already posted or another thread fetching, rather than spin on it.
+// Returns whether the device was readable.
+static bool DtsAsyncOutWait(DTS_LIB_CONTEXT *Ctx, DTS_ASYNC_OUT *ao, bool bWasReadable)
+{
+	struct pollfd fds[2];
+
+	if(!Ctx->DrvFetchWait || (ao->WakeFd < 0) || bWasReadable) {
+		bc_sleep_ms(ASYNC_OUT_POLL_MS);
+		return false;
+	}
+
+	fds[0].fd = Ctx->DevHandle;
+	fds[0].events = POLLIN;
+	fds[0].revents = 0;
+	fds[1].fd = ao->WakeFd;
+	fds[1].events = POLLIN;
+	fds[1].revents = 0;
+
+	if(poll(fds, 2, ASYNC_OUT_WAIT_MS) < 0) {
+		if(errno != EINTR)
+			bc_sleep_ms(ASYNC_OUT_POLL_MS);
+		return false;
+	}
+
+	return (fds[0].revents & POLLIN) != 0;
+}
+
+static void * DtsAsyncOutProc(void *ctx)
+{
+	DTS_ASYNC_OUT *ao = (DTS_ASYNC_OUT *)ctx;
+	DTS_LIB_CONTEXT* Ctx = ao->Ctx;
+	HANDLE hDevice = (HANDLE)Ctx;
+	BC_DTS_PROC_OUT Out;
+	BC_DTS_COMPLETION Comp;
+	BC_STATUS sts;
+	bool bEOSPosted = false, bReadable = false;
+
+	while(!ao->Exit)
+	{
+		memset(&Out, 0, sizeof(Out));
+		memset(&Comp, 0, sizeof(Comp));
+		Comp.BuffIdx = BC_DTS_NO_BUFF;
+
+		// Blocks in the driver while the decoder runs
+		Ctx->OutCookie = 0;
+		sts = DtsProcOutputZeroCopy(hDevice, BC_POUT_WAIT_INFINITE, &Out, &Comp.BuffIdx);
+
+		if(sts == BC_STS_IO_USER_ABORT)
+			continue;
+
+		// Flea's end of stream picture has no data, post it once. Anything
+		// else is not started, flushing or another thread fetching.
+		if((sts != BC_STS_SUCCESS) && (sts != BC_STS_FMT_CHANGE) &&
+		   !((sts == BC_STS_NO_DATA) && (Out.PicInfo.flags & VDEC_FLAG_EOS) && !bEOSPosted)) {
+			bReadable = DtsAsyncOutWait(Ctx, ao, bReadable);
+			continue;
+		}
+		bReadable = false;
+
+		bEOSPosted = (Out.PicInfo.flags & VDEC_FLAG_EOS) != 0;
+
+		Comp.Status = sts;
+		Comp.Ybuff = Out.Ybuff;
+		Comp.UVbuff = Out.UVbuff;
+		Comp.StrideSz = Out.StrideSz;
+		Comp.PoutFlags = Out.PoutFlags;
+		Comp.PicInfo = Out.PicInfo;
+		if((sts == BC_STS_SUCCESS) && (Out.PoutFlags & BC_POUT_FLAGS_PIB_VALID))
+			Comp.Cookie = Ctx->OutCookie;
+
+		DtsAsyncPost(Ctx, ao, &Comp);
+	}
+
+	return NULL;
+}
+
+//------------------------------------------------------------------------
+// Name: DtsStartAsyncOut
+// Description: Start the thread that fetches pictures into the registered
+//              buffers and queues them as completions.
+//------------------------------------------------------------------------
+BC_STATUS DtsStartAsyncOut(DTS_LIB_CONTEXT *Ctx, uint32_t Depth, dts_completion_callback CallBack, void *CbContext)
+{
+	DTS_ASYNC_OUT *ao;
+	pthread_attr_t thread_attr;
+	int ret;
+
+	if(!Depth)
+		Depth = BC_ASYNC_DEF_DEPTH;
+	if(Depth > BC_ASYNC_MAX_DEPTH)
+		return BC_STS_INV_ARG;
+
+	pthread_mutex_lock(&Ctx->AsyncLock);
+	if(Ctx->AsyncOut) {
+		pthread_mutex_unlock(&Ctx->AsyncLock);
+		return BC_STS_BUSY;
+	}
+
+	ao = (DTS_ASYNC_OUT *)malloc(sizeof(*ao) + (Depth - 1) * sizeof(BC_DTS_COMPLETION));
+	if(!ao) {
+		pthread_mutex_unlock(&Ctx->AsyncLock);
+		return BC_STS_INSUFF_RES;
+	}
+
+	memset(ao, 0, sizeof(*ao));
+	DtsInitMutex(&ao->Lock, FALSE);
+	pthread_cond_init(&ao->ReadyEvent, NULL);
+	pthread_cond_init(&ao->SpaceEvent, NULL);
+	pthread_cond_init(&ao->IdleEvent, NULL);
+	ao->Ctx = Ctx;
+	ao->WakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	ao->CallBack = CallBack;
+	ao->CbContext = CbContext;
+	ao->Depth = Depth;
+
+	pthread_attr_init(&thread_attr);
+	pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_JOINABLE);
+	ret = pthread_create(&ao->hThread, &thread_attr, DtsAsyncOutProc, ao);
+	pthread_attr_destroy(&thread_attr);
+
+	if(ret) {
+		DebugLog_Trace(LDIL_ERR,"DtsStartAsyncOut: thread create failed %d\n", ret);
+		pthread_mutex_unlock(&Ctx->AsyncLock);
+		if(ao->WakeFd >= 0)
+			close(ao->WakeFd);
+		pthread_cond_destroy(&ao->IdleEvent);
+		pthread_cond_destroy(&ao->ReadyEvent);
+		pthread_cond_destroy(&ao->SpaceEvent);
+		pthread_mutex_destroy(&ao->Lock);
+		free(ao);
+		return BC_STS_INSUFF_RES;
+	}
+
+	Ctx->AsyncOut = ao;
+	pthread_mutex_unlock(&Ctx->AsyncLock);
+
+	return BC_STS_SUCCESS;
+}
+
+//------------------------------------------------------------------------
+// Name: DtsStopAsyncOut
+// Description: Stop the async output thread. Buffers of completions
+//              nobody took go back to the driver.
+//------------------------------------------------------------------------
+void DtsStopAsyncOut(DTS_LIB_CONTEXT *Ctx)
+{
+	DTS_ASYNC_OUT *ao;
+	uint64_t one = 1;
+
+	// No new DtsGetCompletions callers past this
+	pthread_mutex_lock(&Ctx->AsyncLock);
+	ao = Ctx->AsyncOut;
+	Ctx->AsyncOut = NULL;
+	pthread_mutex_unlock(&Ctx->AsyncLock);
+
+	if(!ao)
+		return;
+
+	pthread_mutex_lock(&ao->Lock);
+	ao->Exit = true;
+	pthread_cond_broadcast(&ao->ReadyEvent);
+	pthread_cond_broadcast(&ao->SpaceEvent);
+	pthread_mutex_unlock(&ao->Lock);
+
+	if(ao->WakeFd >= 0 && write(ao->WakeFd, &one, sizeof(one)) != sizeof(one))
+		DebugLog_Trace(LDIL_DBG,"DtsStopAsyncOut: wake failed %d\n", errno);
+	DtsInterruptProcOutput((HANDLE)Ctx);
+	pthread_join(ao->hThread, NULL);
+
+	// In case the thread was not inside the fetch to see it
+	__sync_lock_test_and_set(&Ctx->FetchInterrupt, 0);
+
+	// Callers woken above still hold ao, let them leave
+	pthread_mutex_lock(&ao->Lock);
+	while(ao->Users)
+		pthread_cond_wait(&ao->IdleEvent, &ao->Lock);
+	pthread_mutex_unlock(&ao->Lock);
+
+	while(ao->Head != ao->Tail) {
+		BC_DTS_COMPLETION *pComp = &ao->Queue[ao->Head++ % ao->Depth];
+		if(pComp->BuffIdx != BC_DTS_NO_BUFF)
+			DtsGiveOutBuff(Ctx, pComp->BuffIdx);
+	}
+
+	if(ao->WakeFd >= 0)
+		close(ao->WakeFd);
+	pthread_cond_destroy(&ao->IdleEvent);
+	pthread_cond_destroy(&ao->ReadyEvent);
+	pthread_cond_destroy(&ao->SpaceEvent);
+	pthread_mutex_destroy(&ao->Lock);
+	free(ao);
+}
+
+//------------------------------------------------------------------------
+// Name: DtsGetCompletionsInt
+// Description: Take up to MaxCount queued completions, waiting up to
+//              milliSecWait for the first one.
+//------------------------------------------------------------------------
+BC_STATUS DtsGetCompletionsInt(DTS_LIB_CONTEXT *Ctx, BC_DTS_COMPLETION *pComp, uint32_t MaxCount, uint32_t milliSecWait, uint32_t *pCount)
+{
+	DTS_ASYNC_OUT *ao;
+	struct timespec ts;
+	uint32_t n = 0;
+
+	*pCount = 0;
+
+	// Hold ao as a user so that DtsStopAsyncOut waits for us to leave
+	pthread_mutex_lock(&Ctx->AsyncLock);
+	ao = Ctx->AsyncOut;
+	if(!ao || ao->CallBack) {
+		pthread_mutex_unlock(&Ctx->AsyncLock);
+		return BC_STS_ERR_USAGE;
+	}
+	pthread_mutex_lock(&ao->Lock);
+	ao->Users++;
+	pthread_mutex_unlock(&Ctx->AsyncLock);
+
+	if((ao->Head == ao->Tail) && milliSecWait) {
+		if(milliSecWait != BC_POUT_WAIT_INFINITE)
+			txBufDeadline(&ts, milliSecWait);
+		while((ao->Head == ao->Tail) && !ao->Exit) {
+			if(milliSecWait == BC_POUT_WAIT_INFINITE)
+				pthread_cond_wait(&ao->ReadyEvent, &ao->Lock);
+			else if(pthread_cond_timedwait(&ao->ReadyEvent, &ao->Lock, &ts))
+				break;
+		}
+	}
+
+	while((n < MaxCount) && (ao->Head != ao->Tail))
+		pComp[n++] = ao->Queue[ao->Head++ % ao->Depth];
+
+	if(n)
+		pthread_cond_signal(&ao->SpaceEvent);
+
+	if(!--ao->Users && ao->Exit)
+		pthread_cond_signal(&ao->IdleEvent);
+	pthread_mutex_unlock(&ao->Lock);
+
+	*pCount = n;
+	if(n)
+		return BC_STS_SUCCESS;
+
+	return milliSecWait ? BC_STS_TIMEOUT : BC_STS_NO_DATA;
+}
+
+/*====================== Tracing =============================================*/
+// Trace points are written by the input, TX and output threads at once.
+// A writer claims a slot by bumping the free running Next count and
+// publishes it by storing its sequence number last, the dump skips slots
+// whose sequence changed while they were read. The oldest events are
+// overwritten when the ring is full.
+typedef struct _DTS_TRACE_REC {
+	uint32_t		Seq;		// Event number + 1, zero while being written
+	uint16_t		Point;
+	uint16_t		Reserved;
+	uint32_t		Tid;
+	uint32_t		Val;
+	uint64_t		Ts;			// CLOCK_MONOTONIC ns
+	uint64_t		Dur;		// Zero for an instant event
+	uint64_t		Arg;
+} DTS_TRACE_REC;
+
+typedef struct _DTS_TRACE {
+	uint32_t		Mask;		// Depth - 1, Depth is a power of two
+	uint32_t		Start;		// Next at the last DtsTraceStart
+	uint32_t		Next;
+	uint32_t		Reserved;
+	DTS_TRACE_REC	Rec[1];		// Depth entries
+} DTS_TRACE;
+
+// Chrome trace names of the points and of their two values, NULL to leave
+// a value out
+static const struct { const char *Name; const char *ArgName; const char *ValName; } gTracePoints[DTS_TR_POINTS] = {
+	{ "input",	"pts",	"bytes" },	// DTS_TR_INPUT
+	{ "push",	"pts",	"ring" },	// DTS_TR_PUSH
+	{ "dma",	"dram",	"bytes" },	// DTS_TR_DMA
+	{ "driver",	"ring",	"ready" },	// DTS_TR_READY, a counter
+	{ "fetch",	"pts",	"pic" },	// DTS_TR_FETCH
+	{ "copy",	"pts",	"pic" },	// DTS_TR_COPY
+};
+
+static __thread uint32_t gTraceTid;
+
+uint64_t DtsTraceTime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//------------------------------------------------------------------------
+// Name: DtsTraceAdd
+// Description: Record a trace point. Start is the DTS_TRACE_BEGIN time of
+//              a span, zero for an instant event. Use DTS_TRACE().
+//------------------------------------------------------------------------
+void DtsTraceAdd(DTS_LIB_CONTEXT *Ctx, uint32_t Point, uint64_t Start, uint64_t Arg, uint32_t Val)
+{
+	DTS_TRACE *tr = __atomic_load_n(&Ctx->Trace, __ATOMIC_ACQUIRE);
+	DTS_TRACE_REC *rec;
+	uint64_t now;
+	uint32_t idx;
+
+	if(!tr)
+		return;
+
+	if(!gTraceTid)
+		gTraceTid = (uint32_t)syscall(SYS_gettid);
+
+	now = DtsTraceTime();
+	idx = __atomic_fetch_add(&tr->Next, 1, __ATOMIC_RELAXED);
+	rec = &tr->Rec[idx & tr->Mask];
+
+	__atomic_store_n(&rec->Seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	rec->Point = (uint16_t)Point;
+	rec->Tid = gTraceTid;
+	rec->Val = Val;
+	rec->Ts = Start ? Start : now;
+	rec->Dur = Start ? now - Start : 0;
+	rec->Arg = Arg;
+	__atomic_store_n(&rec->Seq, idx + 1, __ATOMIC_RELEASE);
+}
+
+//------------------------------------------------------------------------
+// Name: DtsTraceStart
+// Description: Start recording trace points. The ring is allocated with
+//              Depth events on the first call and kept until the handle
+//              is closed, since the trace points never take a lock;
+//              later calls keep its size and drop what it held.
+//------------------------------------------------------------------------
+BC_STATUS DtsTraceStart(DTS_LIB_CONTEXT *Ctx, uint32_t Depth)
+{
+	DTS_TRACE *tr = __atomic_load_n(&Ctx->Trace, __ATOMIC_ACQUIRE);
+	uint32_t size = BC_TRACE_MIN_DEPTH;
+
+	if(!tr) {
+		while(size < Depth && size < BC_TRACE_MAX_DEPTH)
+			size <<= 1;
+
+		tr = (DTS_TRACE *)malloc(sizeof(*tr) + (size - 1) * sizeof(tr->Rec[0]));
+		if(!tr)
+			return BC_STS_INSUFF_RES;
+		memset(tr, 0, sizeof(*tr) + (size - 1) * sizeof(tr->Rec[0]));
+		tr->Mask = size - 1;
+
+		if(!__sync_bool_compare_and_swap(&Ctx->Trace, NULL, tr)) {
+			// Lost a race with another caller, use its ring
+			free(tr);
+			tr = Ctx->Trace;
+		}
+	}
+
+	__atomic_store_n(&tr->Start, __atomic_load_n(&tr->Next, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+	__atomic_store_n(&Ctx->TraceOn, 1, __ATOMIC_RELEASE);
+
+	DebugLog_Trace(LDIL_DBG,"DtsTraceStart: %u events\n", tr->Mask + 1);
+
+	return BC_STS_SUCCESS;
+}
+
+void DtsTraceStop(DTS_LIB_CONTEXT *Ctx)
+{
+	__atomic_store_n(&Ctx->TraceOn, 0, __ATOMIC_RELAXED);
+}
+
+//------------------------------------------------------------------------
+// Name: DtsTraceDump
+// Description: Write the events recorded since the last DtsTraceStart to
+//              FileName in the Chrome trace event format. Recording may
+//              go on meanwhile, events overwritten during the dump are
+//              left out.
+//------------------------------------------------------------------------
+BC_STATUS DtsTraceDump(DTS_LIB_CONTEXT *Ctx, const char *FileName)
+{
+	DTS_TRACE *tr = __atomic_load_n(&Ctx->Trace, __ATOMIC_ACQUIRE);
+	DTS_TRACE_REC rec;
+	uint32_t idx, first, next, seq;
+	uint32_t cnt = 0;
+	int pid = getpid();
+	FILE *fp;
+
+	if(!tr)
+		return BC_STS_ERR_USAGE;
+
+	fp = fopen(FileName, "w");
+	if(!fp) {
+		DebugLog_Trace(LDIL_DBG,"DtsTraceDump: Cannot create %s error %d\n", FileName, errno);
+		return BC_STS_IO_ERROR;
+	}
+
+	next = __atomic_load_n(&tr->Next, __ATOMIC_ACQUIRE);
+	first = __atomic_load_n(&tr->Start, __ATOMIC_RELAXED);
+	if(next - first > tr->Mask + 1)
+		first = next - (tr->Mask + 1);
+
+	fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"crystalhd %p\"}}",
+			pid, (void *)Ctx);
+
+	for(idx = first; idx != next; idx++) {
+		DTS_TRACE_REC *src = &tr->Rec[idx & tr->Mask];
+
+		seq = __atomic_load_n(&src->Seq, __ATOMIC_ACQUIRE);
+		if(seq != idx + 1)
+			continue;
+		rec = *src;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if(__atomic_load_n(&src->Seq, __ATOMIC_RELAXED) != seq || rec.Point >= DTS_TR_POINTS)
+			continue;
+
+		fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"dil\",\"pid\":%d,\"tid\":%u,\"ts\":%llu.%03u",
+				gTracePoints[rec.Point].Name, pid, rec.Tid,
+				(unsigned long long)(rec.Ts / 1000), (uint32_t)(rec.Ts % 1000));
+		if(rec.Point == DTS_TR_READY)
+			fprintf(fp, ",\"ph\":\"C\"");
+		else if(rec.Dur)
+			fprintf(fp, ",\"ph\":\"X\",\"dur\":%llu.%03u",
+					(unsigned long long)(rec.Dur / 1000), (uint32_t)(rec.Dur % 1000));
+		else
+			fprintf(fp, ",\"ph\":\"i\",\"s\":\"t\"");
+
+		fprintf(fp, ",\"args\":{\"%s\":%u", gTracePoints[rec.Point].ValName, rec.Val);
+		if(gTracePoints[rec.Point].ArgName)
+			fprintf(fp, ",\"%s\":%llu", gTracePoints[rec.Point].ArgName, (unsigned long long)rec.Arg);
+		fprintf(fp, "}}");
+		cnt++;
+	}
+
+	fprintf(fp, "\n]}\n");
+
+	if(fclose(fp) != 0) {
+		DebugLog_Trace(LDIL_DBG,"DtsTraceDump: Write to %s failed error %d\n", FileName, errno);
+		return BC_STS_IO_ERROR;
+	}
+
+	DebugLog_Trace(LDIL_DBG,"DtsTraceDump: %u of %u events to %s\n", cnt, next - first, FileName);
+
+	return BC_STS_SUCCESS;
+}
+
+// Only once no thread can reach a trace point any more
+void DtsTraceFree(DTS_LIB_CONTEXT *Ctx)
+{
+	Ctx->TraceOn = 0;
+	if(Ctx->Trace) {
+		free(Ctx->Trace);
+		Ctx->Trace = NULL;
+	}
+}
+
 DRVIFLIB_INT_API BC_STATUS DtsGetHWFeatures(uint32_t *pciids)
 {
 	int drvHandle = -1;
@@ -2725,7 +4017,7 @@ void DtsTestMdata(DTS_LIB_CONTEXT	*gCtx)
 	DebugLog_Trace(LDIL_DBG,"Fetch Begin\n");
 	//for(i=0x12; i < 0x22; i++){
 	for(i=1; i < 64; i++){
-		sts = DtsFetchMdata(gCtx,i,&gpout);
+		sts = DtsFetchMdata(gCtx,i,&gpout,NULL);
 		if(sts != BC_STS_SUCCESS){
 			DebugLog_Trace(LDIL_DBG,"DtsFetchMdata Failed:%x SNum:%x \n",sts,i);
 			//return;
@@ -64,8 +64,14 @@ enum _bc_ldil_log_level{
 enum _crystalhd_ldil_globals {
 	BC_EOS_PIC_COUNT	= 16,			/* EOS check counter..*/
 	BC_INPUT_MDATA_POOL_SZ  = 1024,			/* Input Meta Data Pool size */
-	BC_INPUT_MDATA_POOL_SZ_COLLECT  = 256,		/* Input Meta Data Pool size for collector */
+	BC_INPUT_MDATA_BATCH_SZ	= 32,			/* Meta Data pre-allocated per DtsProcInputV chunk */
+	BC_INPUT_MDATA_INDEX_SZ	= 1024,			/* Pending Meta Data tag index buckets, power of 2 */
 	BC_MAX_SW_VOUT_BUFFS    = BC_RX_LIST_CNT,	/* MAX - pre allocated buffers..*/
+	BC_MIN_APP_VOUT_BUFFS	= 4,			/* MIN - application registered buffers */
+	BC_ASYNC_DEF_DEPTH	= 16,			/* Completion queue depth when the app passes 0 */
+	BC_ASYNC_MAX_DEPTH	= 256,			/* Largest completion queue */
+	BC_TRACE_MIN_DEPTH	= 1024,			/* Smallest trace ring, in events */
+	BC_TRACE_MAX_DEPTH	= 1 << 20,		/* Largest trace ring */
 	RX_START_DELIVERY_THRESHOLD = 0,
 	PAUSE_DECODER_THRESHOLD = 12,
 	RESUME_DECODER_THRESHOLD = 5,
@@ -86,6 +92,8 @@ enum _DtsRunState {
 /* Bit fields */
 enum _BCMemTypeFlags {
         BC_MEM_DEC_YUVBUFF  = 0x1,
+	BC_MEM_APP_OWNED	= 0x2,		/* Registered by the application, never freed here */
+	BC_MEM_APP_HELD		= 0x4,		/* Handed to the application, not with the driver */
 	BC_MEM_USER_MODE_ALLOC	= 0x80000000,
 };
 
@@ -124,11 +132,24 @@ enum _DtsAppSpecificCfgFlags {
 #define BC_DTS_DEF_OPTIONS_LINK	0xB0000005
 
 #define BC_FW_CMD_TIMEOUT		2
-//Use the Last Un-Fetched One
+//Pictures a timestamp may come out past the reorder depth before it is dropped
 #define MAX_DISORDER_GAP	5
 
-#define ALIGN_BUF_SIZE	(512*1024)
-#define CIRC_TX_BUF_SIZE (1024*1024)
+#define CIRC_TX_BUF_SIZE (1024*1024)	// Until the stream is known, see DtsTxBufSizeForStream()
+#define TX_BUF_MIN_SIZE (128*1024)
+#define TX_BUF_MAX_SIZE (8*1024*1024)
+#define TX_BUF_ALIGN (4*1024)	// DtsSetTxBufferSize() sizes are whole pages
+#define TX_BOUNCE_BUF_SIZE (64*1024)	// Staging for DMA from a non DWORD aligned ring offset
+#define TX_CACHE_LINE_SIZE 64
+
+#define TX_IDLE_WAIT_MS		1000	// TX thread wakeup interval with nothing to send, no driver reports a power state change
+#define TX_EOS_POLL_MS		30	// HW picture count poll interval while hunting for EOS
+#define TX_CPB_FULL_POLL_MS	3	// Drivers without DrvFetchWait have no CPB space event, poll while it is full
+#define TX_CPB_FULL_WAIT_MS	100	// Longest poll() for CPB space on drivers that report it
+#define TX_EOS_TIMEOUT_MS	(BC_EOS_PIC_COUNT * TX_EOS_POLL_MS)
+
+#define ASYNC_OUT_POLL_MS	10	// Async output retry interval on drivers without DrvFetchWait
+#define ASYNC_OUT_WAIT_MS	100	// Longest poll() for a picture after a failed fetch, decoder start has no event
 
 #define	 BC_EOS_DETECTED		0xffffffff
 
@@ -182,7 +203,9 @@ typedef struct _DTS_INPUT_MDATA{
 	uint32_t			IntTag;
 	uint32_t			Reserved;
 	uint64_t			appTimeStamp;
+	uint64_t			Cookie;	/* From DtsProcInputAsync, zero otherwise */
 	BC_SEQ_HDR_FORMAT	Spes;
+	struct _DTS_INPUT_MDATA	*hlink;	/* Next in the same tag index bucket */
 }DTS_INPUT_MDATA;
 
 
@@ -190,25 +213,106 @@ typedef struct _DTS_INPUT_MDATA{
 
 #define DTS_MDATA_TAG_MASK		(0x00010000)
 #define DTS_MDATA_MAX_TAG		(0x0000FFFF)
+#define DTS_MDATA_INDEX(_tag)	((_tag) & (BC_INPUT_MDATA_INDEX_SZ - 1))
+
+/* Counters behind DtsGetDecodeStats() and DtsGetDrvStat(). Each has a single
+ * writer thread, so DTS_STAT_ADD is a relaxed atomic load and store rather
+ * than a locked read-modify-write, and a snapshot through DTS_STAT_GET needs
+ * no lock or ioctl. On x86-64 that is a plain add. On i386 the 64 bit load
+ * and store are SSE or x87 moves, atomic only on 8 byte aligned data, hence
+ * the alignment of the struct. */
+typedef struct __attribute__((aligned(8))) _DTS_DEC_COUNTERS {
+	uint64_t	InUnits;		/* ProcInput thread */
+	uint64_t	InBytes;
+	uint64_t	TxBytes;		/* TX thread */
+	uint64_t	TxChunks;		/* DMA transfers, DtsGetDrvStat's ipSampleCnt */
+	uint64_t	OutFrames;		/* ProcOutput thread */
+	uint64_t	Dropped;
+	uint64_t	Repeated;
+	uint64_t	PibMisses;
+	uint64_t	FetchLatency[BC_DTS_LAT_BUCKETS];
+} DTS_DEC_COUNTERS;
+
+#define DTS_STAT_ADD(_c, _v)	__atomic_store_n(&(_c), __atomic_load_n(&(_c), __ATOMIC_RELAXED) + (_v), __ATOMIC_RELAXED)
+#define DTS_STAT_GET(_c)		__atomic_load_n(&(_c), __ATOMIC_RELAXED)
+
+/* Trace points, see DtsSetTrace(). The two values each one records are
+ * named in the comment. */
+enum _DTS_TRACE_POINT {
+	DTS_TR_INPUT = 0,	/* Span of a ProcInput unit: app timestamp, bytes */
+	DTS_TR_PUSH,		/* Unit fully in the TX ring: app timestamp, ring busy bytes */
+	DTS_TR_DMA,			/* Span of DtsTxDmaText: DRAM offset, bytes */
+	DTS_TR_READY,		/* Driver ready list changed, sampled by the TX thread: ring busy bytes, pictures */
+	DTS_TR_FETCH,		/* Span of a successful picture fetch: timestamp, picture number */
+	DTS_TR_COPY,		/* Span of the copy to the app buffer: timestamp, picture number */
+	DTS_TR_POINTS
+};
 
+/* Tracing is off unless DtsSetTrace() turned it on, which costs a relaxed
+ * load per trace point. DTS_TRACE_BEGIN gives the start of a span, zero
+ * when off, and DTS_TRACE records the span or, with a zero start, an
+ * instant event. */
+#define DTS_TRACE_ON(_c)		__atomic_load_n(&(_c)->TraceOn, __ATOMIC_RELAXED)
+#define DTS_TRACE_BEGIN(_c)		(DTS_TRACE_ON(_c) ? DtsTraceTime() : 0)
+#define DTS_TRACE(_c, _pt, _start, _arg, _val)	\
+	do { if ((_start) || DTS_TRACE_ON(_c)) DtsTraceAdd((_c), (_pt), (_start), (_arg), (_val)); } while (0)
+
+// Single producer (ProcInput thread) / single consumer (TX thread) ring.
+// writeIndex and readIndex are free running byte counters and each one is only
+// ever stored to by its owner, so push and pop need no locks. totalSize is a
+// power of two, so (index & sizeMask) is the offset into the buffer and
+// (writeIndex - readIndex) is the busy size even across 32 bit wrap.
+// The indices are published with release stores and read with acquire
+// loads. Each side's fields start their own cache line, which takes the
+// owning DTS_LIB_CONTEXT to be allocated TX_CACHE_LINE_SIZE aligned.
 typedef struct _TXBUFFER{
-	uint32_t	readPointer; // Index into the buffer for next read
-	uint32_t	writePointer; // Index into the buffer for next write
-	uint32_t	freeSize;
-	uint32_t	totalSize;
-	uint32_t	busySize;
-	uint8_t		*basePointer; // First byte that can be written
-	uint8_t		*endPointer; // Last byte that can be written
 	uint8_t		*buffer;
-	pthread_mutex_t flushLock; // LOCK used only for flushing
-	pthread_mutex_t pushpopLock; // LOCK for push and pop operations
+	uint8_t		*bounceBuf;	// Used only when the read offset is not DWORD aligned
+	uint32_t	totalSize;
+	uint32_t	sizeMask;
+
+	// Producer owned
+	uint32_t	writeIndex __attribute__((aligned(TX_CACHE_LINE_SIZE))); // Next byte to be committed
+	uint32_t	resvSize; // Bytes reserved past the batch and not yet committed
+	uint32_t	batchSize; // Committed bytes held back until txBufEndBatch()
+	uint32_t	batching;
+	uint32_t	flushIndex; // writeIndex at the time of the last flush request
+	uint32_t	flushGen; // Bumped on every flush request
+	uint32_t	highWater; // Largest committed busy size seen by the producer
+	uint32_t	fullWaits; // Times the producer had to sleep for space
+
+	// Consumer owned
+	uint32_t	readIndex __attribute__((aligned(TX_CACHE_LINE_SIZE))); // Next byte to be sent to HW
+	uint32_t	flushSeen; // Last flushGen acted upon
+
+	// Wakeups between the two sides. The lock is only taken when
+	// one of them is about to sleep or there is a sleeper to wake.
+	pthread_mutex_t	evLock __attribute__((aligned(TX_CACHE_LINE_SIZE)));
+	pthread_cond_t	dataEvent; // Commit, flush or txBufWakeUp()
+	pthread_cond_t	spaceEvent; // Consume, flush or txBufWakeUp()
+	uint32_t	dataWaiters;
+	uint32_t	spaceWaiters;
 }TXBUFFER, *pTXBUFFER;
 
-BC_STATUS txBufPush(pTXBUFFER txBuf, uint8_t* bufToPush, uint32_t sizeToPush);
-BC_STATUS txBufPop(pTXBUFFER txBuf, uint8_t* bufToPop, uint32_t sizeToPop);
-BC_STATUS txBufFlush(pTXBUFFER txBuf);
 BC_STATUS txBufInit(pTXBUFFER txBuf, uint32_t sizeInit);
 BC_STATUS txBufFree(pTXBUFFER txBuf);
+BC_STATUS txBufFlush(pTXBUFFER txBuf);
+void txBufWakeUp(pTXBUFFER txBuf);
+// Producer side
+BC_STATUS txBufReserve(pTXBUFFER txBuf, uint32_t sizeToReserve);
+void txBufWrite(pTXBUFFER txBuf, uint32_t resvOffset, const uint8_t* bufToWrite, uint32_t sizeToWrite);
+void txBufCommit(pTXBUFFER txBuf, uint32_t sizeToCommit);
+void txBufBeginBatch(pTXBUFFER txBuf);
+void txBufEndBatch(pTXBUFFER txBuf);
+BC_STATUS txBufPush(pTXBUFFER txBuf, uint8_t* bufToPush, uint32_t sizeToPush);
+uint32_t txBufFreeSize(pTXBUFFER txBuf);
+BC_STATUS txBufWaitSpace(pTXBUFFER txBuf, uint32_t sizeNeeded, uint32_t timeoutMs);
+// Consumer side
+uint32_t txBufBusySize(pTXBUFFER txBuf);
+void txBufSync(pTXBUFFER txBuf);
+BC_STATUS txBufWaitData(pTXBUFFER txBuf, uint32_t timeoutMs);
+uint32_t txBufPeek(pTXBUFFER txBuf, uint32_t maxSize, uint8_t** ppData);
+void txBufConsume(pTXBUFFER txBuf, uint32_t sizeConsumed);
 
 // TX Thread function
 void * txThreadProc(void *ctx);
@@ -217,7 +321,8 @@ typedef struct _DTS_LIB_CONTEXT{
 	uint32_t				Sig;			/* Mazic number */
 	uint32_t				State;			/* DIL's Run State */
 	int				DevHandle;		/* Driver handle */
-	BC_IOCTL_DATA	*pIoDataFreeHd;	/* IOCTL data pool head */
+	BC_IOCTL_DATA	*pIoDataPool;	/* IOCTL data pool */
+	uint64_t		IoDataFreeTop __attribute__((aligned(8)));	/* Pool free stack top, see DtsRelIoctlData. cmpxchg8b on i386 needs the alignment */
 	DTS_MPOOL_TYPE	*Mpools;		/* List of memory pools created */
 	uint32_t				MpoolCnt;		/* Number of entries */
 	uint32_t				CfgFlags;		/* Application specifi flags */
@@ -228,7 +333,19 @@ typedef struct _DTS_LIB_CONTEXT{
 	uint32_t				fwcmdseq;		/* FW Cmd Sequence number */
 	uint32_t				FixFlags;		/* Flags for conditionally enabling fixes */
 
+	/* Locks, always taken in this order and never held across a ring wait:
+	 *   thLock     - decoder state (open/close/start/stop, State).
+	 *   MdataLock  - input meta data pool, pending list, tag index, tag
+	 *                generation and async input cookies.
+	 *   CopyLock   - CopyPool, held over each output picture copy.
+	 *   AsyncLock  - the AsyncOut pointer, taken before the DTS_ASYNC_OUT lock.
+	 * The IOCTL data pool is lock-free and ProcOutPending is updated
+	 * atomically, neither needs a lock.
+	 */
 	pthread_mutex_t  thLock;
+	pthread_mutex_t  MdataLock;
+	pthread_mutex_t  CopyLock;
+	pthread_mutex_t  AsyncLock;
 
 	DTS_VIDEO_PARAMS VidParams;		/* App specific Video Params */
 
@@ -238,6 +355,8 @@ typedef struct _DTS_LIB_CONTEXT{
 	/* Proc Output Related */
 	BOOL			ProcOutPending;	/* To avoid muliple ProcOuts */
 	BOOL			CancelWaiting;	/* Notify FetchOut to signal */
+	BOOL			DrvFetchWait;	/* Driver takes the fetch timeout, CANCEL_FETCH and poll */
+	uint32_t		FetchInterrupt;	/* DtsInterruptProcOutput() not yet seen, old drivers */
 
 	/* pOutData is dedicated for ProcOut() use only. Every other
 	 * Interface should use the memory from IocData pool. This
@@ -264,8 +383,24 @@ typedef struct _DTS_LIB_CONTEXT{
 	struct _DTS_INPUT_MDATA	*MDPendHead;	/* MetaData Pending List Head */
 	struct _DTS_INPUT_MDATA	*MDPendTail;	/* MetaData Pending List Tail */
 
-	//Reserve the Last Fetch Tag
-	uint32_t		MDLastFetchTag;
+	//Newest tag fetched so far and how far behind it a pending tag may still
+	//come out, see DtsMdataReorderWindow()
+	uint32_t		MDNewestFetchTag;
+	uint32_t		MDReorderWindow;
+
+	/* Pending Meta Data by IntTag, chained through hlink. Tags are handed out
+	 * in sequence so the buckets rarely hold more than one entry. */
+	struct _DTS_INPUT_MDATA	*MDTagIndex[BC_INPUT_MDATA_INDEX_SZ];
+	uint32_t		MDEvictCnt;	/* Pending entries dropped without a matching picture */
+
+	/* Meta Data pre-allocated for a DtsProcInputV chunk, used in order by DtsPrepareMdata */
+	struct _DTS_INPUT_MDATA	*MDBatch[BC_INPUT_MDATA_BATCH_SZ];
+	uint32_t		MDBatchCnt;
+	uint32_t		MDBatchNext;
+
+	uint64_t		InCookie;	/* DtsProcInputAsync cookie for the Meta Data being prepared */
+	uint64_t		OutCookie;	/* Cookie of the last fetched Meta Data, output thread only */
+	struct _DTS_ASYNC_OUT	*AsyncOut;	/* Async output thread, NULL when not running */
 
 	/* End Of Stream detection */
 	BOOL			bEOSCheck;				/* Flag to start EOS detection */
@@ -277,6 +412,12 @@ typedef struct _DTS_LIB_CONTEXT{
 	BOOL			bEOS;
 
 	/* Statistics Related */
+	BC_DTS_STATS	Stats;					/* DIL counters of DtsGetDriverStatus */
+	DTS_DEC_COUNTERS	Counters;			/* DtsGetDecodeStats counters */
+	BC_DTS_DEC_STATS	StatsBase;			/* Counters at the last reset, reader only */
+	uint64_t		DrvStatInBase[2];		/* TxChunks/TxBytes at DtsRstDrvStat */
+	struct _DTS_TRACE	*Trace;				/* Trace ring, kept from the first DtsSetTrace until close */
+	uint32_t		TraceOn;				/* Trace points are recorded */
 	uint32_t		prevPicNum;				/* Previous received frame */
 	uint32_t		CapState;				/* 0 = Not started, 1 = Interlaced, 2 = progressive */
 	uint32_t		PibIntToggle;			/* Toggle flag to detect PIB miss in Interlaced mode.*/
@@ -299,13 +440,16 @@ typedef struct _DTS_LIB_CONTEXT{
 	BC_HW_CAPS		capInfo;
 //	uint16_t		InSampleCount;
 	uint8_t			bMapOutBufDone;
+	struct _DTS_COPY_POOL	*CopyPool;	/* Stripe workers for output copies, NULL for none */
 
 	BC_PIC_INFO_BLOCK	FormatInfo;
 
 	TXBUFFER		circBuf;
 	bool			txThreadExit; // Handle to event to indicate to the tx thread to exit
 	pthread_t		htxThread; // Handle to TX thread
-	uint8_t			*alignBuf;
+	int				txWakeFd; // eventfd that ends the TX thread's wait for CPB space
+	uint32_t		txBufSizeReq; // Application ring size, zero to size from the stream
+	bool			txBufResize; // Ring size to be re-evaluated before the next input
 
 	uint32_t		EnableScaling;
 	uint8_t			bEnable720pDropHalf;
@@ -340,6 +484,8 @@ BOOL DtsDrvIoctl
 BC_STATUS DtsDrvCmd(DTS_LIB_CONTEXT	*Ctx, DWORD Code, BOOL Async, BC_IOCTL_DATA *pIoData, BOOL Rel);
 void DtsRelIoctlData(DTS_LIB_CONTEXT *Ctx, BC_IOCTL_DATA *pIoData);
 BC_IOCTL_DATA *DtsAllocIoctlData(DTS_LIB_CONTEXT *Ctx);
+BC_IOCTL_DATA *DtsAllocIoctlDataSz(DTS_LIB_CONTEXT *Ctx, uint32_t uSz);
+#define DtsAllocIoctlDataFor(Ctx, member) DtsAllocIoctlDataSz(Ctx, sizeof(((BC_IOCTL_DATA *)0)->u.member))
 BC_STATUS DtsAllocMemPools(DTS_LIB_CONTEXT *Ctx);
 void DtsReleaseMemPools(DTS_LIB_CONTEXT *Ctx);
 BC_STATUS DtsAddOutBuff(DTS_LIB_CONTEXT *Ctx, PVOID buff, uint32_t BuffSz, uint32_t flags);
@@ -347,18 +493,37 @@ BC_STATUS DtsRelRxBuff(DTS_LIB_CONTEXT *Ctx, BC_DEC_YUV_BUFFS *buff,BOOL SkipAdd
 BC_STATUS DtsFetchOutInterruptible(DTS_LIB_CONTEXT *Ctx, BC_DTS_PROC_OUT *DecOut, uint32_t dwTimeout);
 BC_STATUS DtsCancelFetchOutInt(DTS_LIB_CONTEXT *Ctx);
 BC_STATUS DtsMapYUVBuffs(DTS_LIB_CONTEXT *Ctx);
+void DtsGetRxBuffReq(DTS_LIB_CONTEXT *Ctx, uint32_t *BuffSz, uint32_t *UVOffset);
+BC_STATUS DtsSetOutBuffPool(DTS_LIB_CONTEXT *Ctx, BC_DTS_OUT_BUFF *pBuffs, uint32_t nBuffs);
+BOOL DtsHasAppOutBuffs(DTS_LIB_CONTEXT *Ctx);
+BC_STATUS DtsTakeOutBuff(DTS_LIB_CONTEXT *Ctx, uint32_t *pIdx);
+BC_STATUS DtsGiveOutBuff(DTS_LIB_CONTEXT *Ctx, uint32_t Idx);
 BC_STATUS DtsInitInterface(int hDevice,HANDLE *RetCtx, uint32_t mode);
 BC_STATUS DtsSetupConfig(DTS_LIB_CONTEXT *Ctx, uint32_t did, uint32_t rid, uint32_t FixFlags);
 BC_STATUS DtsReleaseInterface(DTS_LIB_CONTEXT *Ctx);
+uint32_t DtsTxBufSizeForStream(DTS_LIB_CONTEXT *Ctx);
+BC_STATUS DtsResizeTxBuffer(DTS_LIB_CONTEXT *Ctx);
 BC_STATUS DtsGetBCRegConfig(DTS_LIB_CONTEXT	*Ctx);
 BC_STATUS DtsGetFirmwareFiles(DTS_LIB_CONTEXT	*Ctx);
 DTS_INPUT_MDATA	*DtsAllocMdata(DTS_LIB_CONTEXT *Ctx);
 BC_STATUS DtsFreeMdata(DTS_LIB_CONTEXT *Ctx, DTS_INPUT_MDATA	*Mdata, BOOL sync);
+uint32_t DtsAllocMdataBatch(DTS_LIB_CONTEXT *Ctx, uint32_t count);
+uint32_t DtsMdataReorderWindow(DTS_LIB_CONTEXT *Ctx);
+void DtsFreeMdataBatch(DTS_LIB_CONTEXT *Ctx);
 BC_STATUS DtsClrPendMdataList(DTS_LIB_CONTEXT *Ctx);
 BC_STATUS DtsInsertMdata(DTS_LIB_CONTEXT *Ctx, DTS_INPUT_MDATA	*Mdata);
 BC_STATUS DtsRemoveMdata(DTS_LIB_CONTEXT *Ctx, DTS_INPUT_MDATA	*Mdata, BOOL sync);
-BC_STATUS DtsFetchMdata(DTS_LIB_CONTEXT *Ctx, uint16_t snum, BC_DTS_PROC_OUT *pout);
+BC_STATUS DtsFetchMdata(DTS_LIB_CONTEXT *Ctx, uint16_t snum, BC_DTS_PROC_OUT *pout, uint64_t *pCookie);
 BC_STATUS DtsFetchTimeStampMdata(DTS_LIB_CONTEXT *Ctx, uint16_t snum, uint64_t *TimeStamp);
+BC_STATUS DtsStartAsyncOut(DTS_LIB_CONTEXT *Ctx, uint32_t Depth, dts_completion_callback CallBack, void *CbContext);
+void DtsStopAsyncOut(DTS_LIB_CONTEXT *Ctx);
+BC_STATUS DtsGetCompletionsInt(DTS_LIB_CONTEXT *Ctx, BC_DTS_COMPLETION *pComp, uint32_t MaxCount, uint32_t milliSecWait, uint32_t *pCount);
+uint64_t DtsTraceTime(void);
+void DtsTraceAdd(DTS_LIB_CONTEXT *Ctx, uint32_t Point, uint64_t Start, uint64_t Arg, uint32_t Val);
+BC_STATUS DtsTraceStart(DTS_LIB_CONTEXT *Ctx, uint32_t Depth);
+void DtsTraceStop(DTS_LIB_CONTEXT *Ctx);
+BC_STATUS DtsTraceDump(DTS_LIB_CONTEXT *Ctx, const char *FileName);
+void DtsTraceFree(DTS_LIB_CONTEXT *Ctx);
 BC_STATUS DtsPrepareMdataASFHdr(DTS_LIB_CONTEXT *Ctx, DTS_INPUT_MDATA *mData, uint8_t* buf);
 BC_STATUS DtsPrepareMdata(DTS_LIB_CONTEXT *Ctx, uint64_t timeStamp, DTS_INPUT_MDATA **mData, uint8_t** pDataBuf, uint32_t *pSize);
 BC_STATUS DtsNotifyOperatingMode(HANDLE hDevice, uint32_t Mode);
@@ -380,10 +545,11 @@ void DtsUpdateOutStats(DTS_LIB_CONTEXT	*Ctx, BC_DTS_PROC_OUT *pOut);
 
 #define BC_DIL_SHMEM_KEY 0xBABEFACE
 
+/* Seen by every process using the library, keep the layout */
 typedef struct _bc_dil_glob_s{
 	uint32_t 		gDilOpMode;
 	uint32_t 		gHwInitSts;
-	BC_DTS_STATS 	stats;
+	BC_DTS_STATS 	stats;			/* Unused, counters are per handle */
 	pid_t			g_nProcID;
 	bool			g_bDecOpened;
 	uint32_t 		DevID;
@@ -399,8 +565,6 @@ uint32_t 		DtsGetOPMode(void);
 void 			DtsSetOPMode(uint32_t value);
 uint32_t 		DtsGetHwInitSts(void);
 void 			DtsSetHwInitSts(uint32_t value);
-void 			DtsRstStats(void);
-BC_DTS_STATS * 	DtsGetgStats (void);
 uint32_t		DtsGetgDevID(void);
 void DtsSetgDevID(uint32_t DevID);
 
@@ -411,8 +575,15 @@ bool DtsIsDecOpened(pid_t nNewPID);
 void DtsSetDecStat(bool bDecOpen, pid_t PID);
 bool DtsChkPID(pid_t nCurPID);
 
+/* Handles and decoders open in this process */
+void DtsAddProcHandle(uint32_t OpMode);
+BOOL DtsDelProcHandle(uint32_t OpMode);
+uint32_t DtsProcHandles(uint32_t OpMode);
+
 void DtsLock(DTS_LIB_CONTEXT	*Ctx);
 void DtsUnLock(DTS_LIB_CONTEXT	*Ctx);
+void DtsCopyLock(DTS_LIB_CONTEXT *Ctx);
+void DtsCopyUnLock(DTS_LIB_CONTEXT *Ctx);
 
 /*====================== Debug Routines ========================================*/
 void DtsTestMdata(DTS_LIB_CONTEXT	*gCtx);
@@ -133,7 +133,8 @@ enum _DtsDeviceFixMode {
 	DTS_DIAG_TEST_MODE = BC_BIT(23),
 	DTS_SINGLE_THREADED_MODE = BC_BIT(24),
 	DTS_FILTER_MODE = BC_BIT(25),
-	DTS_MFT_MODE = BC_BIT(26)
+	DTS_MFT_MODE = BC_BIT(26),
+	DTS_INPUT_IN_PLACE = BC_BIT(27)	/* AVC1 input may be rewritten during DtsProcInput */
 };
 
 #define DTS_DFLT_RESOLUTION(x)	(x<<11)
@@ -411,6 +412,9 @@ enum _POUT_OPTIONAL_IN_FLAGS_{
 	BC_POUT_FLAGS_INTERLEAVED = 0x10,	/* interleaved frame */
 	BC_POUT_FLAGS_STRIDE_UV	  = 0x20,	/* Stride size is valid (for UV buffers). */
 	BC_POUT_FLAGS_MODE	  = 0x40,	/* Take output mode from Application, overrides YV12 flag if on */
+	BC_POUT_FLAGS_EXT	  = 0x80,	/* pOut is the head of a BC_DTS_PROC_OUT_EX */
+	BC_POUT_FLAGS_SCALE	  = 0x100,	/* Downscale to ScaleWidth x ScaleHeight of the EX struct */
+	BC_POUT_FLAGS_CACHED	  = 0x200,	/* Leave the copied picture in the CPU cache */
 
 	/* Flags from Device to APP */
 	BC_POUT_FLAGS_FMT_CHANGE  = 0x10000,	/* Data is not VALID when this flag is set */
@@ -419,6 +423,10 @@ enum _POUT_OPTIONAL_IN_FLAGS_{
 	BC_POUT_FLAGS_FLD_BOT	  = 0x80000,	/* Bottom Field data */
 };
 
+/* milliSecWait for the ProcOutput calls: wait until a picture comes or
+   DtsInterruptProcOutput() is called */
+#define BC_POUT_WAIT_INFINITE	0xFFFFFFFF
+
 /*Decoder Capability */
 enum DECODER_CAP_FLAGS
 {
@@ -469,6 +477,88 @@ typedef struct _BC_DTS_PROC_OUT {
 
 } BC_DTS_PROC_OUT;
 
+/*
+ * Extended ProcOut, for output that needs more than two planes. Pass a
+ * pointer to Out with BC_POUT_FLAGS_EXT set in Out.PoutFlags and ExSize
+ * set to sizeof(BC_DTS_PROC_OUT_EX). Fields are only ever appended, the
+ * library uses those that fit in the ExSize the caller was built with.
+ */
+typedef struct _BC_DTS_PROC_OUT_EX {
+	BC_DTS_PROC_OUT	Out;
+
+	uint32_t	ExSize;			/* sizeof(BC_DTS_PROC_OUT_EX) */
+
+	uint8_t		*Vbuff;			/* Caller Supplied buffer for V data, planar modes */
+	uint32_t	VbuffSz;		/* Caller Supplied V buffer size */
+	uint32_t	VBuffDoneSz;		/* Transferred V data size */
+	uint32_t	StrideSzV;		/* Caller supplied Stride Size (for V buffer) */
+
+	uint32_t	ScaleWidth;		/* Output size for BC_POUT_FLAGS_SCALE, even and */
+	uint32_t	ScaleHeight;		/* no larger than the decoded picture */
+} BC_DTS_PROC_OUT_EX;
+
+/* Application output buffer for DtsRegisterOutBuffs() */
+typedef struct _BC_DTS_OUT_BUFF {
+	uint8_t		*Buff;			/* 4 byte aligned, hardware picture layout */
+	uint32_t	BuffSz;			/* At least the size from DtsGetOutBuffReq() */
+} BC_DTS_OUT_BUFF;
+
+/* One access unit for DtsProcInputV() */
+typedef struct _BC_DTS_INPUT_UNIT {
+	uint8_t		*pData;			/* Coded data */
+	uint32_t	dataSz;			/* Size of coded data in bytes */
+	uint32_t	Flags;			/* Reserved, must be zero */
+	uint64_t	timeStamp;		/* Same meaning as DtsProcInput() timeStamp */
+} BC_DTS_INPUT_UNIT;
+
+/* BC_DTS_COMPLETION.BuffIdx when no registered buffer came with it */
+#define BC_DTS_NO_BUFF		0xFFFFFFFF
+
+/* One picture or event from the async output, DtsGetCompletions() */
+typedef struct _BC_DTS_COMPLETION {
+	BC_STATUS	Status;			/* SUCCESS picture, FMT_CHANGE, NO_DATA end of stream */
+	uint32_t	BuffIdx;		/* For DtsReleaseOutBuff(), BC_DTS_NO_BUFF for none */
+	uint64_t	Cookie;			/* From DtsProcInputAsync(), zero if none matched */
+	uint8_t		*Ybuff;			/* Y plane in the registered buffer */
+	uint8_t		*UVbuff;		/* UV plane in the registered buffer */
+	uint32_t	StrideSz;		/* Row padding in bytes */
+	uint32_t	PoutFlags;		/* BC_POUT_FLAGS_xxx */
+	BC_PIC_INFO_BLOCK PicInfo;		/* Picture information, timeStamp is the PTS */
+} BC_DTS_COMPLETION;
+
+/* Called on the library's output thread instead of queueing the completion */
+typedef void (*dts_completion_callback)(void *Context, BC_DTS_COMPLETION *pComp);
+
+/* DtsGetTxBufferStats() */
+typedef struct _BC_DTS_TXBUF_STATS {
+	uint32_t	RingSize;		/* Current tx circular buffer size */
+	uint32_t	StreamSize;		/* Size it will have for the current stream/override */
+	uint32_t	BusySize;		/* Bytes waiting to be sent to the HW */
+	uint32_t	HighWater;		/* Largest BusySize since the last reset */
+	uint32_t	FullWaits;		/* Times input waited for buffer space */
+} BC_DTS_TXBUF_STATS;
+
+#define BC_DTS_LAT_BUCKETS	12
+
+/* DtsGetDecodeStats() */
+typedef struct _BC_DTS_DEC_STATS {
+	uint64_t	InUnits;		/* Access units queued by the ProcInput calls */
+	uint64_t	InBytes;		/* Coded bytes queued, start codes included */
+	uint64_t	TxBytes;		/* Coded bytes sent to the HW */
+	uint64_t	OutFrames;		/* Pictures fetched from the driver */
+	uint64_t	Dropped;		/* Pictures skipped by DropFrames or lost in discontinuities */
+	uint64_t	Repeated;		/* Pictures/fields delivered twice */
+	uint64_t	PibMisses;		/* Pictures without picture information */
+	uint64_t	MdataEvicted;		/* Input timestamps dropped without a picture */
+	uint32_t	RingSize;		/* Tx circular buffer size */
+	uint32_t	RingBusy;		/* Bytes in it waiting for the HW */
+	uint32_t	RingHighWater;		/* Largest RingBusy, see DtsGetTxBufferStats() */
+	uint32_t	Reserved;
+	/* Fetches by how long they waited for the picture: [0] under 1 ms,
+	 * [n] under 2^n ms, the last one everything longer */
+	uint64_t	FetchLatency[BC_DTS_LAT_BUCKETS];
+} BC_DTS_DEC_STATS;
+
 typedef struct _BC_DTS_STATUS {
 	uint8_t		ReadyListCount;	/* Number of frames in ready list (reported by driver) */
 	uint8_t		FreeListCount;	/* Number of frame buffers free.  (reported by driver) */
@@ -500,7 +590,9 @@ typedef struct _BC_DTS_STATUS {
 
 	uint32_t	picNumFlags; /* Picture number and flags of the next picture to be delivered from the driver */
 
-	uint8_t		reserved___[8];
+	uint32_t	MdataEvicted;	/* Input timestamps dropped because their picture never came out.
+					 * (reported by DIL) */
+	uint8_t		reserved___[4];
 
 } BC_DTS_STATUS;
 
@@ -527,6 +619,8 @@ typedef enum _BC_OUTPUT_FORMAT {
 	OUTPUT_MODE422_YUY2	= 0x1,
 	OUTPUT_MODE422_UYVY	= 0x2,
 	OUTPUT_MODE420_NV12	= 0x0,
+	OUTPUT_MODE420_I420	= 0x3,	/* Planar Y, U, V, destination only */
+	OUTPUT_MODE420_YV12	= 0x4,	/* Planar Y, V, U, destination only */
 	OUTPUT_MODE_INVALID	= 0xFF,
 } BC_OUTPUT_FORMAT;
 
@@ -81,6 +81,21 @@ enum _BC_DTS_GLOBALS {
 	BC_INFIFO_THRESHOLD	= 0x10000,
 };
 
+/* Driver version as DtsGetVersion() reports it, revision left out */
+#define BC_DRV_VERSION(_maj, _min)	(((uint32_t)(_maj) << 24) | ((uint32_t)(_min) << 16))
+
+/*
+ * Drivers from this version on wait up to BC_IOCTL_DATA.Timeout ms
+ * in FETCH_RXBUFF, BC_POUT_WAIT_INFINITE for no limit and 0 for the old
+ * BC_PROC_OUTPUT_TIMEOUT, in one sleep that ends when a picture is
+ * queued. CANCEL_FETCH ends that wait with BC_STS_IO_USER_ABORT, or the
+ * next one if none is waiting; a flush drops a cancel nothing picked up.
+ * poll() on the device handle reports POLLIN while a picture is queued
+ * for it, and POLLOUT while the CPB has room for a TX DMA.
+ */
+#define BC_DRV_MAJOR_FETCH_WAIT	3
+#define BC_DRV_MINOR_FETCH_WAIT	16
+
 /* definitions for HW Pause */
 /* NAREN FIXME temporarily disable HW PAUSE */
 #define HW_PAUSE_THRESHOLD (BC_RX_LIST_CNT)
@@ -216,8 +231,25 @@ enum _DECOUT_COMPLETION_FLAGS{
 	COMP_FLAG_DATA_VALID	= 0x04,
 	COMP_FLAG_DATA_ENC	= 0x08,
 	COMP_FLAG_DATA_BOT	= 0x10,
+	COMP_FLAG_PIB_SIDE	= 0x20,	/* PibSide holds the in-frame PIB */
 };
 
+/*
+ * In-frame PIB delivered next to the picture. The library sets
+ * COMP_FLAG_PIB_SIDE in Flags when it fetches to say it takes this. A
+ * driver that does keeps the flag, sets Size and copies the PIB out of
+ * the frame: PicInfo in host byte order with the extension, PicNum the
+ * first PIB word (bit 31 encrypted, bit 30 bottom field). It also puts
+ * back the Y samples the firmware overwrote with the PIB line number,
+ * so the picture can be handed on untouched. For EOS PicInfo.flags has
+ * VDEC_FLAG_EOS. Has to fit the BC_IOCTL_DATA union as it is.
+ */
+typedef struct _BC_PIB_SIDE {
+	uint32_t		Size;		/* sizeof(BC_PIB_SIDE), 0 if not filled in */
+	uint32_t		PicNum;
+	BC_PIC_INFO_BLOCK	PicInfo;
+} BC_PIB_SIDE;
+
 typedef struct _BC_DEC_OUT_BUFF{
 	BC_DEC_YUV_BUFFS	OutPutBuffs;
 #if !defined(__KERNEL__)
@@ -227,6 +259,7 @@ typedef struct _BC_DEC_OUT_BUFF{
 #endif
 	uint32_t		Flags;
 	uint32_t		BadFrCnt;
+	BC_PIB_SIDE		PibSide;
 } BC_DEC_OUT_BUFF;
 
 typedef struct _BC_NOTIFY_MODE {
@@ -278,6 +311,7 @@ typedef enum _BC_DRV_CMD{
 	DRV_CMD_RST_DRV_STAT,	/* Reset Driver Internal Statistics */
 	DRV_CMD_NOTIFY_MODE,	/* Notify the Mode to driver in which the application is Operating*/
 	DRV_CMD_RELEASE,		/* Notify the driver to release user handle and application resources */
+	DRV_CMD_CANCEL_FETCH,	/* Wake a FETCH_RXBUFF waiting on this handle */
 
 	/* MUST be the last one.. */
 	DRV_CMD_END,			/* End of the List.. */
@@ -309,6 +343,7 @@ typedef enum _BC_DRV_CMD{
 #define BCM_IOC_NOTIFY_MODE		BC_IOC_IOWR(DRV_CMD_NOTIFY_MODE, BC_IOCTL_MB)
 #define	BCM_IOC_FW_DOWNLOAD		BC_IOC_IOWR(DRV_CMD_FW_DOWNLOAD, BC_IOCTL_MB)
 #define BCM_IOC_RELEASE			BC_IOC_IOWR(DRV_CMD_RELEASE, BC_IOCTL_MB)
+#define BCM_IOC_CANCEL_FETCH	BC_IOC_IOWR(DRV_CMD_CANCEL_FETCH, BC_IOCTL_MB)
 #define	BCM_IOC_END				BC_IOC_VOID
 
 /* Wrapper for main IOCTL data */
@@ -323,7 +358,7 @@ typedef struct _crystalhd_ioctl_data {
 
 enum _crystalhd_kmod_ver{
 	crystalhd_kmod_major	= 3,
-	crystalhd_kmod_minor	= 10,
+	crystalhd_kmod_minor	= 16,
 	crystalhd_kmod_rev		= 0,
 };
 
@@ -630,6 +630,8 @@ static BC_STATUS bc_cproc_fetch_frame(struct crystalhd_cmd *ctx,
 	struct crystalhd_dio_req *dio = NULL;
 	BC_STATUS sts = BC_STS_SUCCESS;
 	BC_DEC_OUT_BUFF *frame;
+	uint32_t to_ms;
+	bool pib_side;
 
 	if (!ctx || !idata) {
 		dev_err(dev, "%s: Invalid Arg\n", __func__);
@@ -645,8 +647,13 @@ static BC_STATUS bc_cproc_fetch_frame(struct crystalhd_cmd *ctx,
 	}
 
 	frame = &idata->udata.u.DecOutData;
+	pib_side = (frame->Flags & COMP_FLAG_PIB_SIDE) != 0;
+	frame->PibSide.Size = 0;
 
-	sts = crystalhd_hw_get_cap_buffer(ctx->hw_ctx, &frame->PibInfo, &dio);
+	/* Older libraries leave Timeout at 0 and get the fixed wait */
+	to_ms = idata->udata.Timeout ? idata->udata.Timeout : BC_PROC_OUTPUT_TIMEOUT;
+
+	sts = crystalhd_hw_get_cap_buffer(ctx->hw_ctx, &frame->PibInfo, to_ms, &dio);
 	if (sts != BC_STS_SUCCESS)
 		return (ctx->state & BC_LINK_SUSPEND) ? BC_STS_PWR_MGMT : sts;
 
@@ -665,11 +672,30 @@ static BC_STATUS bc_cproc_fetch_frame(struct crystalhd_cmd *ctx,
 	frame->OutPutBuffs.YBuffDoneSz = dio->uinfo.y_done_sz;
 	frame->OutPutBuffs.UVBuffDoneSz = dio->uinfo.uv_done_sz;
 
+	/* Library asked for the in-frame PIB beside the picture */
+	if (pib_side && (frame->Flags & COMP_FLAG_DATA_VALID) &&
+	    ctx->hw_ctx->pfnGetPibSide &&
+	    (ctx->hw_ctx->pfnGetPibSide(ctx->hw_ctx, dio, &frame->PibSide) == BC_STS_SUCCESS))
+		frame->Flags |= COMP_FLAG_PIB_SIDE;
+
 	crystalhd_unmap_dio(ctx->adp, dio);
 
 	return BC_STS_SUCCESS;
 }
 
+static BC_STATUS bc_cproc_cancel_fetch(struct crystalhd_cmd *ctx,
+				       crystalhd_ioctl_data *idata)
+{
+	if (!ctx || !idata) {
+		dev_err(chddev(), "%s: Invalid Arg\n", __func__);
+		return BC_STS_INV_ARG;
+	}
+
+	crystalhd_hw_cancel_fetch(ctx->hw_ctx, true);
+
+	return BC_STS_SUCCESS;
+}
+
 static BC_STATUS bc_cproc_start_capture(struct crystalhd_cmd *ctx,
 					crystalhd_ioctl_data *idata)
 {
@@ -732,6 +758,9 @@ static BC_STATUS bc_cproc_flush_cap_buffs(struct crystalhd_cmd *ctx,
 		crystalhd_hw_stop_capture(ctx->hw_ctx, true);
 	}
 
+	/* A cancel meant for the flushed stream must not end the next fetch */
+	crystalhd_hw_cancel_fetch(ctx->hw_ctx, false);
+
 	return BC_STS_SUCCESS;
 }
 
@@ -918,6 +947,7 @@ static const struct crystalhd_cmd_tbl	g_crystalhd_cproc_tbl[] = {
 	{ BCM_IOC_RST_DRV_STAT,		bc_cproc_reset_stats,	0},
 	{ BCM_IOC_NOTIFY_MODE,		bc_cproc_notify_mode,	0},
 	{ BCM_IOC_RELEASE,			bc_cproc_release_user,  0},
+	{ BCM_IOC_CANCEL_FETCH,		bc_cproc_cancel_fetch,	1},
 	{ BCM_IOC_END,				NULL},
 };
 
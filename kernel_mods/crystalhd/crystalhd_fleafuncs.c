@@ -2938,6 +2938,67 @@ uint32_t flea_GetRptDropParam(struct crystalhd_hw *hw, void* pRxDMAReq)
 	return result;
 }
 
+/*
+ * flea_GetPictureInfo left the PIB line number in the first Y word and
+ * the sample it replaced in the PIB. Hand the PIB out in the fetch's
+ * BC_PIB_SIDE and put the sample back. Process context only.
+ */
+BC_STATUS crystalhd_flea_get_pib_side(struct crystalhd_hw *hw,
+				      struct crystalhd_dio_req *dio,
+				      BC_PIB_SIDE *side)
+{
+	uint32_t PicInfoLineNum, offset;
+
+	if (!hw || !dio || !side || !dio->uinfo.xfr_buff)
+		return BC_STS_INV_ARG;
+
+	side->Size = 0;
+
+	if (copy_from_user(&PicInfoLineNum, dio->uinfo.xfr_buff, 4))
+		return BC_STS_IO_XFR_ERROR;
+
+	if (PicInfoLineNum == 0xFFFFFFFF) {
+		/* EOS, the PIB follows the marker */
+		if (copy_from_user(&side->PicInfo, dio->uinfo.xfr_buff + 4,
+				   sizeof(BC_PIC_INFO_BLOCK)))
+			return BC_STS_IO_XFR_ERROR;
+		if (!(side->PicInfo.flags & VDEC_FLAG_EOS))
+			return BC_STS_IO_XFR_ERROR;
+		side->PicNum = 0;
+		side->Size = sizeof(BC_PIB_SIDE);
+		return BC_STS_SUCCESS;
+	}
+
+	/* The firmware may pad a line to start the PIB 16 byte aligned */
+	if (!hw->PICHeight || !hw->PICWidth ||
+	    ((PicInfoLineNum != hw->PICHeight) &&
+	     (PicInfoLineNum != hw->PICHeight + 1) &&
+	     (PicInfoLineNum != hw->PICHeight / 2) &&
+	     (PicInfoLineNum != (hw->PICHeight + 1) / 2)))
+		return BC_STS_IO_XFR_ERROR;
+
+	if (dio->uinfo.b422mode)
+		offset = PicInfoLineNum * hw->PICWidth * 2;
+	else
+		offset = PicInfoLineNum * hw->PICWidth;
+
+	if ((offset + 4 + sizeof(BC_PIC_INFO_BLOCK)) > dio->uinfo.y_done_sz * 4)
+		return BC_STS_IO_XFR_ERROR;
+
+	/* Linear and host byte order on Flea */
+	if (copy_from_user(&side->PicNum, dio->uinfo.xfr_buff + offset, 4) ||
+	    copy_from_user(&side->PicInfo, dio->uinfo.xfr_buff + offset + 4,
+			   sizeof(BC_PIC_INFO_BLOCK)))
+		return BC_STS_IO_XFR_ERROR;
+
+	if (copy_to_user(dio->uinfo.xfr_buff, &side->PicInfo.ycom, 4))
+		return BC_STS_IO_XFR_ERROR;
+
+	side->Size = sizeof(BC_PIB_SIDE);
+
+	return BC_STS_SUCCESS;
+}
+
 bool crystalhd_flea_notify_event(struct crystalhd_hw *hw, enum BRCM_EVENT EventCode)
 {
 	switch(EventCode)
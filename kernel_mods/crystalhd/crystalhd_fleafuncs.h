@@ -56,6 +56,7 @@ bool crystalhd_flea_rx_list1_handler(struct crystalhd_hw *hw,union FLEA_INTR_BIT
 void crystalhd_flea_rx_isr(struct crystalhd_hw *hw, union FLEA_INTR_BITS_COMMON intr_sts);
 void crystalhd_flea_notify_fll_change(struct crystalhd_hw *hw, bool bCleanupContext);
 bool crystalhd_flea_notify_event(struct crystalhd_hw *hw, enum BRCM_EVENT EventCode);
+BC_STATUS crystalhd_flea_get_pib_side(struct crystalhd_hw *hw, struct crystalhd_dio_req *dio, BC_PIB_SIDE *side);
 
 bool flea_GetPictureInfo(struct crystalhd_hw *hw, struct crystalhd_rx_dma_pkt * rx_pkt,
 						 uint32_t *PicNumber, uint64_t *PicMetaData);
@@ -75,6 +75,7 @@ BC_STATUS crystalhd_hw_open(struct crystalhd_hw *hw, struct crystalhd_adp *adp)
 		hw->pfnStopRXDMAEngines = crystalhd_flea_stop_rx_dma_engine;
 		hw->pfnNotifyFLLChange = crystalhd_flea_notify_fll_change;
 		hw->pfnNotifyHardware = crystalhd_flea_notify_event;
+		hw->pfnGetPibSide = crystalhd_flea_get_pib_side;
 	} else {
 		dev_dbg(dev, "crystalhd_hw_open: setting up functions, device = Link\n");
 		hw->pfnStartDevice = crystalhd_link_start_device;
@@ -98,6 +99,7 @@ BC_STATUS crystalhd_hw_open(struct crystalhd_hw *hw, struct crystalhd_adp *adp)
 		hw->pfnStopRXDMAEngines = crystalhd_link_stop_rx_dma_engine;
 		hw->pfnNotifyFLLChange = crystalhd_link_notify_fll_change;
 		hw->pfnNotifyHardware = crystalhd_link_notify_event;
+		hw->pfnGetPibSide = crystalhd_link_get_pib_side;
 	}
 
 	hw->adp = adp;
@@ -411,10 +413,10 @@ BC_STATUS crystalhd_hw_tx_req_complete(struct crystalhd_hw *hw,
 		tx_req->list_tag);
 	}
 
-	/* Now put back the tx_list back in FreeQ */
+	/* Now put back the tx_list back in FreeQ, waking CPB space pollers */
 	tx_req->list_tag = 0;
 
-	return crystalhd_dioq_add(hw->tx_freeq, tx_req, false, 0);
+	return crystalhd_dioq_add(hw->tx_freeq, tx_req, true, 0);
 }
 
 BC_STATUS crystalhd_hw_fill_desc(struct crystalhd_dio_req *ioreq,
@@ -887,10 +889,10 @@ BC_STATUS crystalhd_hw_add_cap_buffer(struct crystalhd_hw *hw,
 
 BC_STATUS crystalhd_hw_get_cap_buffer(struct crystalhd_hw *hw,
 										struct C011_PIB *pib,
+										uint32_t to_ms,
 										struct crystalhd_dio_req **ioreq)
 {
 	struct crystalhd_rx_dma_pkt *rpkt;
-	uint32_t timeout = BC_PROC_OUTPUT_TIMEOUT / 1000;
 	uint32_t sig_pending = 0;
 
 	if (!hw || !ioreq || !pib) {
@@ -898,7 +900,7 @@ BC_STATUS crystalhd_hw_get_cap_buffer(struct crystalhd_hw *hw,
 		return BC_STS_INV_ARG;
 	}
 
-	rpkt = crystalhd_dioq_fetch_wait(hw, timeout, &sig_pending);
+	rpkt = crystalhd_dioq_fetch_wait(hw, to_ms, &sig_pending);
 
 	if( hw->adp->pdev->device == BC_PCI_DEVID_FLEA)
 	{
@@ -956,6 +958,25 @@ BC_STATUS crystalhd_hw_get_cap_buffer(struct crystalhd_hw *hw,
 	return BC_STS_SUCCESS;
 }
 
+/*
+ * Ends a fetch waiting in crystalhd_dioq_fetch_wait, or the next one
+ * when none is waiting. cancel false drops a cancel nobody picked up.
+ */
+void crystalhd_hw_cancel_fetch(struct crystalhd_hw *hw, bool cancel)
+{
+	unsigned long flags = 0;
+
+	if (!hw || !hw->rx_rdyq)
+		return;
+
+	spin_lock_irqsave(&hw->rx_rdyq->lock, flags);
+	hw->fetch_cancel = cancel;
+	spin_unlock_irqrestore(&hw->rx_rdyq->lock, flags);
+
+	if (cancel)
+		crystalhd_set_event(&hw->rx_rdyq->event);
+}
+
 BC_STATUS crystalhd_hw_start_capture(struct crystalhd_hw *hw)
 {
 	struct crystalhd_rx_dma_pkt *rx_pkt;
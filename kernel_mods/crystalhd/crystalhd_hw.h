@@ -328,6 +328,7 @@ typedef BOOLEAN		(*FIRE_TX_CMD_TO_HW)	(PCONTEXT_FOR_POST_TX);
 */
 typedef void		(*NOTIFY_FLL_CHANGE)(struct crystalhd_hw*,bool);
 typedef bool		(*HW_EVENT_NOTIFICATION)(struct crystalhd_hw*, enum BRCM_EVENT);
+typedef BC_STATUS	(*HW_GET_PIB_SIDE)(struct crystalhd_hw*, struct crystalhd_dio_req*, BC_PIB_SIDE*);
 
 struct crystalhd_hw {
 	struct tx_dma_pkt		tx_pkt_pool[DMA_ENGINE_CNT];
@@ -378,6 +379,7 @@ struct crystalhd_hw {
 	uint32_t	LastSessNum;	/* For Session Change Detection */
 
 	struct semaphore fetch_sem; /* semaphore between fetch and probe of the next picture information, since both will be in process context */
+	bool		fetch_cancel;	/* CANCEL_FETCH not yet seen by a fetch, under rx_rdyq->lock */
 
 	uint32_t	RxCaptureState; /* 0 if capture is not enabled, 1 if capture is enabled, 2 if stop rxdma is pending */
 
@@ -485,6 +487,7 @@ struct crystalhd_hw {
 /*	FIRE_TX_CMD_TO_HW			pfnFireTx; */
 	NOTIFY_FLL_CHANGE			pfnNotifyFLLChange;
 	HW_EVENT_NOTIFICATION		pfnNotifyHardware;
+	HW_GET_PIB_SIDE			pfnGetPibSide;
 };
 
 struct crystalhd_rx_dma_pkt *crystalhd_hw_alloc_rx_pkt(struct crystalhd_hw *hw);
@@ -517,7 +520,8 @@ BC_STATUS crystalhd_hw_post_tx(struct crystalhd_hw *hw, struct crystalhd_dio_req
 				uint8_t data_flags);
 BC_STATUS crystalhd_hw_cancel_tx(struct crystalhd_hw *hw, uint32_t list_id);
 BC_STATUS crystalhd_hw_add_cap_buffer(struct crystalhd_hw *hw,struct crystalhd_dio_req *ioreq, bool en_post);
-BC_STATUS crystalhd_hw_get_cap_buffer(struct crystalhd_hw *hw,struct C011_PIB *pib,struct crystalhd_dio_req **ioreq);
+BC_STATUS crystalhd_hw_get_cap_buffer(struct crystalhd_hw *hw,struct C011_PIB *pib,uint32_t to_ms,struct crystalhd_dio_req **ioreq);
+void crystalhd_hw_cancel_fetch(struct crystalhd_hw *hw, bool cancel);
 BC_STATUS crystalhd_hw_start_capture(struct crystalhd_hw *hw);
 BC_STATUS crystalhd_hw_stop_capture(struct crystalhd_hw *hw, bool unmap);
 BC_STATUS crystalhd_hw_suspend(struct crystalhd_hw *hw);
@@ -784,6 +784,111 @@ uint32_t link_GetRptDropParam(struct crystalhd_hw *hw, uint32_t picHeight, uint3
 	return result;
 }
 
+/*
+ * Copy the PIB the firmware wrote after the last picture line into the
+ * BC_PIB_SIDE of the fetch and put back the Y samples that carried its
+ * line number. Process context only, the picture is still in user memory.
+ */
+BC_STATUS crystalhd_link_get_pib_side(struct crystalhd_hw *hw,
+				      struct crystalhd_dio_req *dio,
+				      BC_PIB_SIDE *side)
+{
+	uint8_t *buff = NULL;
+	uint8_t *ycom;
+	uint32_t PicInfoLineNum, offset, size, i;
+	uint32_t *src, *dst;
+	BC_STATUS sts = BC_STS_IO_XFR_ERROR;
+
+	if (!hw || !dio || !side || !dio->uinfo.xfr_buff)
+		return BC_STS_INV_ARG;
+
+	side->Size = 0;
+
+	/* Room for both 422 stripes, PIB and extension, 256 bytes each */
+	buff = kmalloc(512, GFP_KERNEL);
+	if (!buff)
+		return BC_STS_INSUFF_RES;
+
+	if (copy_from_user(buff, dio->uinfo.xfr_buff, 8))
+		goto pib_side_out;
+
+	PicInfoLineNum = link_GetPicInfoLineNum(dio, buff);
+
+	if (PicInfoLineNum == 0xFFFFFFFF) {
+		/* EOS, the PIB follows the marker */
+		if (copy_from_user(&side->PicInfo, dio->uinfo.xfr_buff + 4,
+				   sizeof(BC_PIC_INFO_BLOCK)))
+			goto pib_side_out;
+		if (side->PicInfo.flags & VDEC_FLAG_EOS) {
+			side->PicNum = 0;
+			side->Size = sizeof(BC_PIB_SIDE);
+			sts = BC_STS_SUCCESS;
+		}
+		goto pib_side_out;
+	}
+
+	if (!hw->PICHeight || !hw->PICWidth ||
+	    ((PicInfoLineNum != hw->PICHeight) &&
+	     (PicInfoLineNum != hw->PICHeight / 2)))
+		goto pib_side_out;
+
+	if (dio->uinfo.b422mode) {
+		offset = PicInfoLineNum * hw->PICWidth * 2;
+		size = 512;
+	} else {
+		offset = PicInfoLineNum * hw->PICWidth;
+		size = 256;
+	}
+
+	if ((offset + size) > dio->uinfo.y_done_sz * 4)
+		goto pib_side_out;
+
+	if (copy_from_user(buff, dio->uinfo.xfr_buff + offset, size))
+		goto pib_side_out;
+
+	/* PIB bytes are every other byte in 422 */
+	if (dio->uinfo.b422mode == MODE422_YUY2) {
+		for (i = 0; i < 256; i++)
+			buff[i] = buff[i * 2];
+	} else if (dio->uinfo.b422mode == MODE422_UYVY) {
+		for (i = 0; i < 256; i++)
+			buff[i] = buff[(i * 2) + 1];
+	}
+
+	/* Big endian on Link: common part after the picture number, extension at 128 */
+	side->PicNum = BC_SWAP32(*(uint32_t *)buff);
+	src = (uint32_t *)(buff + 4);
+	dst = (uint32_t *)&side->PicInfo;
+	for (i = 0; i < OFFSETOF(BC_PIC_INFO_BLOCK, other) / 4; i++)
+		dst[i] = BC_SWAP32(src[i]);
+	src = (uint32_t *)(buff + 128);
+	dst = (uint32_t *)&side->PicInfo.other;
+	for (i = 0; i < sizeof(side->PicInfo.other) / 4; i++)
+		dst[i] = BC_SWAP32(src[i]);
+
+	/* Put back the Y samples the line number was written over */
+	if (copy_from_user(buff, dio->uinfo.xfr_buff, 8))
+		goto pib_side_out;
+	ycom = (uint8_t *)&side->PicInfo.ycom;
+	if (dio->uinfo.b422mode == MODE422_YUY2) {
+		for (i = 0; i < 4; i++)
+			buff[i * 2] = ycom[i];
+	} else if (dio->uinfo.b422mode == MODE422_UYVY) {
+		for (i = 0; i < 4; i++)
+			buff[(i * 2) + 1] = ycom[i];
+	} else
+		*(uint32_t *)buff = side->PicInfo.ycom;
+	if (copy_to_user(dio->uinfo.xfr_buff, buff, 8))
+		goto pib_side_out;
+
+	side->Size = sizeof(BC_PIB_SIDE);
+	sts = BC_STS_SUCCESS;
+
+pib_side_out:
+	kfree(buff);
+	return sts;
+}
+
 /*
 * This function gets the next picture metadata payload
 * from the decoded picture in ReadyQ (if there was any)
@@ -194,6 +194,7 @@ uint32_t link_GetHeightFromPib(struct crystalhd_dio_req *dio, PBC_PIC_INFO_BLOCK
 bool link_GetPictureInfo(struct crystalhd_hw *hw, uint32_t picHeight, uint32_t picWidth, struct crystalhd_dio_req *dio,
 								uint32_t *PicNumber, uint64_t *PicMetaData);
 uint32_t link_GetRptDropParam(struct crystalhd_hw *hw, uint32_t picHeight, uint32_t picWidth, void *pRxDMAReq);
+BC_STATUS crystalhd_link_get_pib_side(struct crystalhd_hw *hw, struct crystalhd_dio_req *dio, BC_PIB_SIDE *side);
 bool crystalhd_link_peek_next_decoded_frame(struct crystalhd_hw *hw, uint64_t *meta_payload, uint32_t *picNumFlags, uint32_t PicWidth);
 bool crystalhd_link_check_input_full(struct crystalhd_hw *hw, uint32_t needed_sz, uint32_t *empty_sz,
 									 bool b_188_byte_pkts, uint8_t *flags);
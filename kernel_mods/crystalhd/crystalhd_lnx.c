@@ -404,9 +404,56 @@ static int chd_dec_close(struct inode *in, struct file *fd)
 	return 0;
 }
 
+/*
+ * POLLIN while a picture waits in the ready queue, POLLOUT while the
+ * CPB has room. The CPB drains without an interrupt of its own, so a
+ * CPB poller is woken by TX completions and by decoded pictures.
+ */
+static unsigned int chd_dec_poll(struct file *fd, poll_table *wait)
+{
+	struct crystalhd_adp *adp = chd_get_adp();
+	struct crystalhd_cmd *ctx;
+	struct crystalhd_hw *hw;
+	unsigned int mask = 0;
+	unsigned long irqflags;
+	uint32_t empty_sz = 0;
+	uint8_t flags = 0x04;	/* Only checking, as for BCM_IOC_GET_DRV_STAT */
+	bool full;
+
+	if (!adp || !fd || !fd->private_data) {
+		dev_err(chddev(), "Invalid adp\n");
+		return POLLERR;
+	}
+
+	ctx = &adp->cmds;
+	hw = ctx->hw_ctx;
+
+	/* Nothing to wait on before the rings exist or while suspended */
+	if (!hw || !hw->rx_rdyq || !hw->tx_freeq ||
+	    (ctx->state & BC_LINK_SUSPEND))
+		return mask;
+
+	poll_wait(fd, &hw->rx_rdyq->event, wait);
+	poll_wait(fd, &hw->tx_freeq->event, wait);
+
+	if (crystalhd_dioq_count(hw->rx_rdyq))
+		mask |= POLLIN | POLLRDNORM;
+
+	if (hw->pfnCheckInputFIFO) {
+		spin_lock_irqsave(&hw->lock, irqflags);
+		full = hw->pfnCheckInputFIFO(hw, 0, &empty_sz, false, &flags);
+		spin_unlock_irqrestore(&hw->lock, irqflags);
+		if (!full)
+			mask |= POLLOUT | POLLWRNORM;
+	}
+
+	return mask;
+}
+
 static const struct file_operations chd_dec_fops = {
 	.owner		= THIS_MODULE,
 	.unlocked_ioctl	= chd_dec_ioctl,
+	.poll		= chd_dec_poll,
 	.open		= chd_dec_open,
 	.release	= chd_dec_close,
 	.llseek		= noop_llseek,
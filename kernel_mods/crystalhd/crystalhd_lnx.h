@@ -41,6 +41,7 @@
 #include <linux/interrupt.h>
 #include <linux/pagemap.h>
 #include <linux/vmalloc.h>
+#include <linux/poll.h>
 
 #include <linux/io.h>
 #include <asm/irq.h>
@@ -462,91 +462,117 @@ void *crystalhd_dioq_find_and_fetch(struct crystalhd_dioq *ioq, uint32_t tag)
 
 /**
  * crystalhd_dioq_fetch_wait - Fetch element from Head.
- * @ioq: DIO queue instance
- * @to_secs: Wait timeout in seconds..
+ * @hw: HW context, the ready queue is waited on
+ * @to_ms: Wait timeout in milliseconds, BC_POUT_WAIT_INFINITE for none
+ * @sig_pend: Set when a signal or crystalhd_hw_cancel_fetch ended the wait
  *
  * Return:
  *	element from the head..
  *
- * Return element from head if Q is not empty. Wait for new element
- * if Q is empty for Timeout seconds.
+ * Return element from head if Q is not empty. Otherwise sleep until
+ * an element is added, the fetch is cancelled or the timeout passes.
+ * Repeated pictures are dropped and the wait goes on for the next one.
  */
-void *crystalhd_dioq_fetch_wait(struct crystalhd_hw *hw, uint32_t to_secs, uint32_t *sig_pend)
+void *crystalhd_dioq_fetch_wait(struct crystalhd_hw *hw, uint32_t to_ms, uint32_t *sig_pend)
 {
 	struct device *dev = chddev();
 	unsigned long flags = 0;
-	int rc = 0;
+	long rc = 0;
 
 	struct crystalhd_rx_dma_pkt *r_pkt = NULL;
 	struct crystalhd_dioq *ioq = hw->rx_rdyq;
 	uint32_t picYcomp = 0;
+	uint32_t count;
+	bool cancel;
 
-	unsigned long fetchTimeout = jiffies + msecs_to_jiffies(to_secs * 1000);
+	unsigned long fetchTimeout = jiffies + msecs_to_jiffies(to_ms);
 
-	if (!ioq || (ioq->sig != BC_LINK_DIOQ_SIG) || !to_secs || !sig_pend) {
+	if (!ioq || (ioq->sig != BC_LINK_DIOQ_SIG) || !to_ms || !sig_pend) {
 		dev_err(dev, "%s: Invalid arg\n", __func__);
 		return r_pkt;
 	}
 
-	spin_lock_irqsave(&ioq->lock, flags);
-	while (!time_after_eq(jiffies, fetchTimeout)) {
-		if(ioq->count == 0) {
-			spin_unlock_irqrestore(&ioq->lock, flags);
-			crystalhd_wait_on_event(&ioq->event, (ioq->count > 0),
-					250, rc, false);
+	for (;;) {
+		spin_lock_irqsave(&ioq->lock, flags);
+		cancel = hw->fetch_cancel;
+		hw->fetch_cancel = false;
+		count = ioq->count;
+		spin_unlock_irqrestore(&ioq->lock, flags);
+
+		if (cancel) {
+			dev_dbg(dev, "Fetch cancelled\n");
+			*sig_pend = 1;
+			return NULL;
 		}
-		else
-			spin_unlock_irqrestore(&ioq->lock, flags);
-		if (rc == 0) {
-			/* Found a packet. Check if it is a repeated picture or not */
-			/* Drop the picture if it is a repeated picture */
-			/* Lock against checks from get status calls */
-			if(down_interruptible(&hw->fetch_sem))
-				goto sem_error;
-			r_pkt = crystalhd_dioq_fetch(ioq);
-			/* If format change packet, then return with out checking anything */
-			if (r_pkt->flags & (COMP_FLAG_PIB_VALID | COMP_FLAG_FMT_CHANGE))
-				goto sem_rel_return;
-			if (hw->adp->pdev->device == BC_PCI_DEVID_LINK) {
-				picYcomp = link_GetRptDropParam(hw, hw->PICHeight, hw->PICWidth, (void *)r_pkt);
+
+		if (count == 0) {
+			/* One sleep, woken by the ready queue add or a cancel */
+			if (to_ms == BC_POUT_WAIT_INFINITE) {
+				rc = wait_event_interruptible(ioq->event,
+						(ioq->count > 0) || hw->fetch_cancel);
+			} else {
+				if (time_after_eq(jiffies, fetchTimeout))
+					break;
+				rc = wait_event_interruptible_timeout(ioq->event,
+						(ioq->count > 0) || hw->fetch_cancel,
+						fetchTimeout - jiffies);
+				if (rc == 0)
+					break;
 			}
-			else {
-				/* For Flea, we don't have the width and height handy since they */
-				/* come in the PIB in the picture, so this function will also */
-				/* populate the width and height */
-				picYcomp = flea_GetRptDropParam(hw, (void *)r_pkt);
-				/* For flea it is the above function that indicated format change */
-				if(r_pkt->flags & (COMP_FLAG_PIB_VALID | COMP_FLAG_FMT_CHANGE))
-					goto sem_rel_return;
+			if (rc == -ERESTARTSYS) {
+				*sig_pend = 1;
+				return NULL;
 			}
-			if(!picYcomp || (picYcomp == hw->LastPicNo) ||
-				(picYcomp == hw->LastTwoPicNo)) {
-				/*Discard picture */
-				if(picYcomp != 0) {
-					hw->LastTwoPicNo = hw->LastPicNo;
-					hw->LastPicNo = picYcomp;
-				}
-				crystalhd_dioq_add(hw->rx_freeq, r_pkt, false, r_pkt->pkt_tag);
-				r_pkt = NULL;
-				up(&hw->fetch_sem);
-			} else {
-				if(hw->adp->pdev->device == BC_PCI_DEVID_LINK) {
-					if((picYcomp - hw->LastPicNo) > 1) {
-						dev_info(dev, "MISSING %u PICTURES\n", (picYcomp - hw->LastPicNo));
-					}
-				}
+			continue;
+		}
+
+		/* Found a packet. Check if it is a repeated picture or not */
+		/* Drop the picture if it is a repeated picture */
+		/* Lock against checks from get status calls */
+		if(down_interruptible(&hw->fetch_sem))
+			goto sem_error;
+		r_pkt = crystalhd_dioq_fetch(ioq);
+		if (!r_pkt) {
+			up(&hw->fetch_sem);
+			continue;
+		}
+		/* If format change packet, then return with out checking anything */
+		if (r_pkt->flags & (COMP_FLAG_PIB_VALID | COMP_FLAG_FMT_CHANGE))
+			goto sem_rel_return;
+		if (hw->adp->pdev->device == BC_PCI_DEVID_LINK) {
+			picYcomp = link_GetRptDropParam(hw, hw->PICHeight, hw->PICWidth, (void *)r_pkt);
+		}
+		else {
+			/* For Flea, we don't have the width and height handy since they */
+			/* come in the PIB in the picture, so this function will also */
+			/* populate the width and height */
+			picYcomp = flea_GetRptDropParam(hw, (void *)r_pkt);
+			/* For flea it is the above function that indicated format change */
+			if(r_pkt->flags & (COMP_FLAG_PIB_VALID | COMP_FLAG_FMT_CHANGE))
+				goto sem_rel_return;
+		}
+		if(!picYcomp || (picYcomp == hw->LastPicNo) ||
+			(picYcomp == hw->LastTwoPicNo)) {
+			/*Discard picture */
+			if(picYcomp != 0) {
 				hw->LastTwoPicNo = hw->LastPicNo;
 				hw->LastPicNo = picYcomp;
-				goto sem_rel_return;
 			}
-		} else if (rc == -EINTR) {
-			*sig_pend = 1;
-			return r_pkt;
+			crystalhd_dioq_add(hw->rx_freeq, r_pkt, false, r_pkt->pkt_tag);
+			r_pkt = NULL;
+			up(&hw->fetch_sem);
+		} else {
+			if(hw->adp->pdev->device == BC_PCI_DEVID_LINK) {
+				if((picYcomp - hw->LastPicNo) > 1) {
+					dev_info(dev, "MISSING %u PICTURES\n", (picYcomp - hw->LastPicNo));
+				}
+			}
+			hw->LastTwoPicNo = hw->LastPicNo;
+			hw->LastPicNo = picYcomp;
+			goto sem_rel_return;
 		}
-		spin_lock_irqsave(&ioq->lock, flags);
 	}
 	dev_info(dev, "FETCH TIMEOUT\n");
-	spin_unlock_irqrestore(&ioq->lock, flags);
 	return r_pkt;
 sem_error:
 	return NULL;